@@ -0,0 +1,97 @@
+// Adaptive rendering (display.adaptive) on a scene with large flat areas: a
+// plain floor, the background and a few big spheres. Prints the time and
+// camera rays of every tolerance against tracing every pixel, the PSNR of the
+// whole image and the RMS error on edges (pixels that differ from a neighbour
+// by more than 0.1 in the full render).
+//
+// Usage: bench_adaptive [width] [height]
+
+#include <include/render.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void bench_scene(rt_context* ctx) {
+    rt_context_add_body(
+        ctx, body_floor_new(-2.0, texture_new_single_color(
+                                      color_new(0.45, 0.5, 0.4), 0.3, 0.0)));
+    for (int i = 0; i < 5; i++) {
+        color col = color_new(0.9 - 0.15 * i, 0.3 + 0.1 * i, 0.4);
+        rt_context_add_body(
+            ctx, body_sphere_new(vec3(-6.0 + 3.0 * i, -0.8 + 0.3 * i,
+                                      12.0 + 2.0 * (i % 2)),
+                                 1.2, texture_new_single_color(col, 0.5, 0.0)));
+    }
+}
+
+/// Squared error of pixel \b i over its channels
+static double bench_se(const display* a, const display* b, size_t i) {
+    double dr = a->color_buffer[i].r - b->color_buffer[i].r;
+    double dg = a->color_buffer[i].g - b->color_buffer[i].g;
+    double db = a->color_buffer[i].b - b->color_buffer[i].b;
+    return dr * dr + dg * dg + db * db;
+}
+
+/// Whether pixel (x, y) of \b d differs from its right or lower neighbour
+static bool bench_edge(const display* d, unsigned int x, unsigned int y) {
+    size_t i = (size_t)y * d->d_w + x;
+    size_t n[2] = {x + 1 < d->d_w ? i + 1 : i, y + 1 < d->d_h ? i + d->d_w : i};
+    for (int k = 0; k < 2; k++) {
+        color a = d->color_buffer[i], b = d->color_buffer[n[k]];
+        if (fabs(a.r - b.r) > 0.1 || fabs(a.g - b.g) > 0.1 ||
+            fabs(a.b - b.b) > 0.1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv) {
+    static const double tols[] = {0.0, 0.005, 0.02, 0.05};
+    rt_config cfg = rt_config_default();
+    cfg.width = argc > 1 ? atoi(argv[1]) : 640;
+    cfg.height = argc > 2 ? atoi(argv[2]) : 360;
+    cfg.max_refl = 6;
+    cfg.seed = 3;
+
+    rt_context* full = rt_context_new(&cfg);
+    rt_context* ctx = rt_context_new(&cfg);
+    bench_scene(full);
+    bench_scene(ctx);
+    rt_context_render(full);
+    size_t n = (size_t)cfg.width * cfg.height;
+
+    for (size_t t = 0; t < sizeof(tols) / sizeof(tols[0]); t++) {
+        cfg.adaptive = tols[t];
+        rt_context_configure(ctx, &cfg);
+        rt_context_render(ctx);
+        rt_stats st = rt_context_stats(ctx);
+
+        double se = 0.0, edge_se = 0.0;
+        size_t edges = 0;
+        for (unsigned int y = 0; y < cfg.height; y++) {
+            for (unsigned int x = 0; x < cfg.width; x++) {
+                size_t i = (size_t)y * cfg.width + x;
+                double e = bench_se(&full->disp, &ctx->disp, i);
+                se += e;
+                if (bench_edge(&full->disp, x, y)) {
+                    edge_se += e;
+                    edges++;
+                }
+            }
+        }
+        double mse = se / (n * 3);
+        printf("tolerance %.3f %.3fs camera rays %8llu (%5.1f%%) "
+               "psnr %6.2f dB edge rmse %.4f\n",
+               tols[t], st.trace_seconds,
+               (unsigned long long)st.primary_rays,
+               100.0 * st.primary_rays / n,
+               mse > 0.0 ? 10.0 * log10(1.0 / mse) : INFINITY,
+               edges > 0 ? sqrt(edge_se / (edges * 3)) : 0.0);
+    }
+
+    rt_context_free(full);
+    rt_context_free(ctx);
+    return 0;
+}
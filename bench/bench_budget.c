@@ -0,0 +1,73 @@
+// Time-budgeted renders of a glossy scene at a range of deadlines: wall time
+// against the budget, the settings the final pass ended up with and the
+// RMSE against the unbudgeted render.
+//
+// Usage: bench_budget [width] [height] [spp] [max_refl]
+
+#include <include/render.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void bench_scene(rt_context* ctx) {
+    for (int x = -2; x <= 2; x++) {
+        color col = color_new(0.5 + 0.1 * x, 0.4, 0.7 - 0.1 * x);
+        rt_context_add_body(
+            ctx, body_sphere_new(vec3(x * 4.5, 0.0, 20.0), 2.0,
+                                 texture_new_single_color(col, 0.3, 0.6)));
+    }
+    rt_context_add_body(
+        ctx, body_floor_new(-2.0, texture_new_single_color(
+                                      color_new(0.3, 0.3, 0.35), 0.2, 0.6)));
+}
+
+static double bench_rmse(const color* a, const color* b, size_t n) {
+    double se = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double dr = a[i].r - b[i].r;
+        double dg = a[i].g - b[i].g;
+        double db = a[i].b - b[i].b;
+        se += dr * dr + dg * dg + db * db;
+    }
+    return sqrt(se / (n * 3));
+}
+
+int main(int argc, char** argv) {
+    static const double budgets[] = {0.005, 0.02, 0.05, 0.1, 0.25, 1.0};
+    rt_config cfg = rt_config_default();
+    cfg.width = argc > 1 ? atoi(argv[1]) : 640;
+    cfg.height = argc > 2 ? atoi(argv[2]) : 360;
+    cfg.spp = argc > 3 ? atoi(argv[3]) : 16;
+    cfg.max_refl = argc > 4 ? atoi(argv[4]) : 8;
+    cfg.sampler = SAMPLER_SOBOL;
+    cfg.seed = 3;
+    rt_context* ctx = rt_context_new(&cfg);
+    bench_scene(ctx);
+
+    size_t pixels = (size_t)cfg.width * cfg.height;
+    rt_context_render(ctx);
+    printf("unbudgeted %.3fs, %ux%u spp %u refl %d\n",
+           rt_context_stats(ctx).trace_seconds, cfg.width, cfg.height,
+           cfg.spp, cfg.max_refl);
+    color* ref = rt_malloc(MEM_OUTPUT, sizeof(color) * pixels);
+    memcpy(ref, ctx->disp.color_buffer, sizeof(color) * pixels);
+
+    printf("budget    took      probe   predicted  final            "
+           "rmse    dropped\n");
+    for (size_t i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++) {
+        budget_report rep;
+        rt_context_render_budget(ctx, budgets[i], &rep);
+        char drops[64];
+        budget_drop_names(rep.drops, drops, sizeof(drops));
+        printf("%6.3fs  %6.3fs  %6.3fs  %6.3fs   %4ux%-4u %2u %2d  %.4f  %s\n",
+               budgets[i], rep.seconds, rep.probe_seconds, rep.predicted,
+               rep.width, rep.height, rep.spp, rep.max_refl,
+               bench_rmse(ref, ctx->disp.color_buffer, pixels), drops);
+    }
+
+    rt_free(ref);
+    rt_context_free(ctx);
+    return 0;
+}
@@ -0,0 +1,124 @@
+// Progressive render stopped after its first pass, checkpointed and resumed
+// in a new context, against an uninterrupted one and rt_context_render().
+// All three images must be bit identical.
+//
+// Usage: bench_checkpoint [width] [height] [spp] [pass spp]
+
+#include <include/render.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_CHECKPOINT "/tmp/bench_checkpoint.rtck"
+
+static rt_context* bench_context(unsigned int w, unsigned int h,
+                                 sampler_kind kind, unsigned int spp) {
+    rt_config cfg = rt_config_default();
+    cfg.width = w;
+    cfg.height = h;
+    cfg.max_refl = 4;
+    cfg.sampler = kind;
+    cfg.spp = spp;
+    cfg.seed = 7;
+    rt_context* ctx = rt_context_new(&cfg);
+    for (int x = -2; x <= 2; x++) {
+        color col = color_new(0.5 + 0.1 * x, 0.4, 0.7 - 0.1 * x);
+        rt_context_add_body(
+            ctx, body_sphere_new(vec3(x * 4.5, 0.0, 20.0), 2.0,
+                                 texture_new_single_color(col, 0.6, 0.4)));
+    }
+    rt_context_add_body(
+        ctx, body_floor_new(-2.0, texture_new_single_color(
+                                      color_new(0.3, 0.3, 0.35), 0.5, 0.3)));
+    return ctx;
+}
+
+/// Stops the render once any tile finished a pass
+static void* bench_stopper(void* arg) {
+    progressive_render* pr = (progressive_render*)arg;
+    for (bool passed = false; !passed; usleep(1000)) {
+        pthread_mutex_lock(&pr->lock);
+        for (size_t t = 0; t < (size_t)pr->tiles_x * pr->tiles_y; t++) {
+            passed |= pr->tile_pass[t] > 0;
+        }
+        pthread_mutex_unlock(&pr->lock);
+    }
+    progressive_stop(pr);
+    return NULL;
+}
+
+static size_t bench_diff(const rt_context* a, const rt_context* b) {
+    size_t diff = 0;
+    for (size_t i = 0; i < (size_t)a->disp.d_w * a->disp.d_h; i++) {
+        diff += memcmp(&a->disp.color_buffer[i], &b->disp.color_buffer[i],
+                       sizeof(color)) != 0;
+    }
+    return diff;
+}
+
+/// Returns the pixels that differ from the reference in either image
+static size_t bench_kind(const char* name, unsigned int w, unsigned int h,
+                         sampler_kind kind, unsigned int spp,
+                         unsigned int pass_spp) {
+    rt_context* ref = bench_context(w, h, kind, spp);
+    rt_context_render(ref);
+    double ref_secs = rt_context_stats(ref).trace_seconds;
+
+    rt_context* whole = bench_context(w, h, kind, spp);
+    progressive_render pr;
+    progressive_init(&pr, whole, pass_spp);
+    progressive_run(&pr);
+    double whole_secs = rt_context_stats(whole).trace_seconds;
+    progressive_free(&pr);
+
+    // Stopped, then continued by a context that knows nothing of the first
+    rt_context* first = bench_context(w, h, kind, spp);
+    progressive_init(&pr, first, pass_spp);
+    progressive_checkpoint(&pr, BENCH_CHECKPOINT, 0.01);
+    pthread_t stopper;
+    pthread_create(&stopper, NULL, &bench_stopper, &pr);
+    bool done = progressive_run(&pr);
+    pthread_join(stopper, NULL);
+    unsigned int saved = pr.saved;
+    progressive_free(&pr);
+
+    rt_context* resumed = bench_context(w, h, kind, spp);
+    progressive_init(&pr, resumed, pass_spp);
+    RT_RES res = progressive_resume(&pr, BENCH_CHECKPOINT);
+    PRINT_ERR(res);
+    size_t left = 0;
+    for (size_t t = 0; t < (size_t)pr.tiles_x * pr.tiles_y; t++) {
+        left += pr.passes - pr.tile_pass[t];
+    }
+    progressive_run(&pr);
+    progressive_free(&pr);
+
+    size_t diff_whole = bench_diff(ref, whole);
+    size_t diff_resumed = bench_diff(ref, resumed);
+    printf("%-10s render %.3fs, progressive %.3fs, %s after %u checkpoints "
+           "with %zu tile passes left, %zu / %zu pixels differ\n",
+           name, ref_secs, whole_secs, done ? "not stopped" : "stopped",
+           saved, left, diff_whole, diff_resumed);
+
+    rt_context_free(ref);
+    rt_context_free(whole);
+    rt_context_free(first);
+    rt_context_free(resumed);
+    remove(BENCH_CHECKPOINT);
+    return diff_whole + diff_resumed;
+}
+
+int main(int argc, char** argv) {
+    unsigned int w = argc > 1 ? atoi(argv[1]) : 320;
+    unsigned int h = argc > 2 ? atoi(argv[2]) : 180;
+    unsigned int spp = argc > 3 ? atoi(argv[3]) : 64;
+    unsigned int pass_spp = argc > 4 ? atoi(argv[4]) : 8;
+
+    size_t diff = bench_kind("none", w, h, SAMPLER_NONE, 1, 1);
+    diff += bench_kind("random", w, h, SAMPLER_RANDOM, spp, pass_spp);
+    diff += bench_kind("sobol", w, h, SAMPLER_SOBOL, spp, pass_spp);
+    diff += bench_kind("blue", w, h, SAMPLER_BLUE, spp, pass_spp);
+    return diff != 0;
+}
@@ -0,0 +1,83 @@
+// Ray cones on a scene where they matter: a checker floor reaching the
+// horizon (aliases without a mip level) and a field of small distant mirror
+// spheres (whose reflections are smaller than a pixel). Prints the time,
+// rays and culled reflections with and without cones, and the error of a
+// single sample against a supersampled reference without cones.
+//
+// Usage: bench_cones [width] [height] [reference spp]
+
+#include <include/render.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void bench_scene(rt_context* ctx) {
+    rt_context_add_body(
+        ctx, body_floor_new(-2.0, texture_new_checker(
+                                      color_new(0.9, 0.9, 0.9),
+                                      color_new(0.1, 0.1, 0.15), 8, 8.0,
+                                      0.4, 0.0)));
+    for (int z = 0; z < 24; z++) {
+        for (int x = -12; x <= 12; x++) {
+            color col = color_new(0.5 + 0.02 * x, 0.5, 0.5 - 0.02 * x);
+            rt_context_add_body(
+                ctx, body_sphere_new(vec3(x * 3.0, -1.7, 20.0 + z * 8.0), 0.3,
+                                     texture_new_single_color(col, 0.8, 0.0)));
+        }
+    }
+}
+
+static rt_context* bench_render(unsigned int w, unsigned int h,
+                                sampler_kind kind, unsigned int spp,
+                                bool cones, double* secs) {
+    rt_config cfg = rt_config_default();
+    cfg.width = w;
+    cfg.height = h;
+    cfg.max_refl = 6;
+    cfg.sampler = kind;
+    cfg.spp = spp;
+    cfg.seed = 7;
+    cfg.cones = cones;
+    rt_context* ctx = rt_context_new(&cfg);
+    bench_scene(ctx);
+    double start = util_seconds();
+    rt_context_render(ctx);
+    *secs = util_seconds() - start;
+    return ctx;
+}
+
+/// Root mean square error over all channels
+static double bench_rmse(const display* a, const display* b) {
+    double se = 0.0;
+    size_t n = (size_t)a->d_w * a->d_h;
+    for (size_t i = 0; i < n; i++) {
+        double dr = a->color_buffer[i].r - b->color_buffer[i].r;
+        double dg = a->color_buffer[i].g - b->color_buffer[i].g;
+        double db = a->color_buffer[i].b - b->color_buffer[i].b;
+        se += dr * dr + dg * dg + db * db;
+    }
+    return sqrt(se / (n * 3));
+}
+
+int main(int argc, char** argv) {
+    unsigned int w = argc > 1 ? atoi(argv[1]) : 320;
+    unsigned int h = argc > 2 ? atoi(argv[2]) : 180;
+    unsigned int ref_spp = argc > 3 ? atoi(argv[3]) : 64;
+    double secs;
+
+    rt_context* ref = bench_render(w, h, SAMPLER_SOBOL, ref_spp, false, &secs);
+    printf("reference %ux%u sobol %u spp %.3fs\n", w, h, ref_spp, secs);
+
+    for (int cones = 0; cones <= 1; cones++) {
+        rt_context* ctx = bench_render(w, h, SAMPLER_NONE, 1, cones, &secs);
+        rt_stats st = rt_context_stats(ctx);
+        printf("cones %-3s %.3fs rays %10llu culled %9llu rmse %.5f\n",
+               cones ? "on" : "off", secs, (unsigned long long)st.rays,
+               (unsigned long long)st.culled,
+               bench_rmse(rt_context_display(ctx), rt_context_display(ref)));
+        rt_context_free(ctx);
+    }
+    rt_context_free(ref);
+    return 0;
+}
@@ -0,0 +1,138 @@
+// Encoders of src/output/encode.h against the P6 stream: time and file size
+// of writing one rendered frame, with the strips compressed on the calling
+// thread and on the render pool. The QOI file is decoded again and must match
+// the 8 bit pixels of the framebuffer.
+//
+// Usage: bench_encode [width] [height] [dir]
+
+#include <include/output.h>
+#include <include/render.h>
+#include <include/util.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void bench_scene(rt_context* ctx) {
+    rt_context_add_body(
+        ctx, body_floor_new(-2.0, texture_new_checker(
+                                      color_new(0.8, 0.8, 0.8),
+                                      color_new(0.2, 0.2, 0.25), 8, 4.0,
+                                      0.3, 0.0)));
+    for (int i = 0; i < 6; i++) {
+        color col = color_new(0.9 - 0.12 * i, 0.3 + 0.1 * i, 0.5);
+        rt_context_add_body(
+            ctx, body_sphere_new(vec3(-6.0 + 2.4 * i, -0.8 + 0.3 * (i % 3),
+                                      12.0 + 2.0 * (i % 2)),
+                                 1.1, texture_new_single_color(col, 0.4, 0.1)));
+    }
+}
+
+static long bench_size(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+/// Decodes the QOI file at \b path and counts the pixels that differ from the
+/// framebuffer, or returns -1 if the file is broken
+static long bench_qoi_check(const char* path, const display* disp) {
+    long size = bench_size(path);
+    FILE* f = fopen(path, "rb");
+    if (f == NULL || size < 22) {
+        return -1;
+    }
+    unsigned char* in = malloc(size);
+    size_t got = fread(in, 1, size, f);
+    fclose(f);
+    size_t n = (size_t)disp->d_w * disp->d_h, pos = 14, px = 0;
+    if (got != (size_t)size || memcmp(in, "qoif", 4) != 0) {
+        free(in);
+        return -1;
+    }
+    unsigned char seen[64][3] = {{0}}, c[3] = {0, 0, 0};
+    long bad = 0;
+    int run = 0;
+    while (px < n && (run > 0 || pos < (size_t)size - 8)) {
+        if (run > 0) {
+            run--;
+        } else {
+            unsigned char b = in[pos++];
+            if (b == 0xfe) {
+                memcpy(c, in + pos, 3);
+                pos += 3;
+            } else if ((b & 0xc0) == 0x00) {
+                memcpy(c, seen[b], 3);
+            } else if ((b & 0xc0) == 0x40) {
+                c[0] += ((b >> 4) & 3) - 2;
+                c[1] += ((b >> 2) & 3) - 2;
+                c[2] += (b & 3) - 2;
+            } else if ((b & 0xc0) == 0x80) {
+                int vg = (b & 0x3f) - 32, b2 = in[pos++];
+                c[0] += vg - 8 + ((b2 >> 4) & 0xf);
+                c[1] += vg;
+                c[2] += vg - 8 + (b2 & 0xf);
+            } else {
+                run = b & 0x3f;
+            }
+            memcpy(seen[(c[0] * 3 + c[1] * 5 + c[2] * 7 + 255 * 11) % 64], c,
+                   3);
+        }
+        color col = disp->color_buffer[px++];
+        bad += c[0] != (unsigned char)(col.r * 255.999) ||
+               c[1] != (unsigned char)(col.g * 255.999) ||
+               c[2] != (unsigned char)(col.b * 255.999);
+    }
+    free(in);
+    return px == n ? bad : -1;
+}
+
+int main(int argc, char** argv) {
+    rt_config cfg = rt_config_default();
+    cfg.width = argc > 1 ? atoi(argv[1]) : 1920;
+    cfg.height = argc > 2 ? atoi(argv[2]) : 1080;
+    const char* dir = argc > 3 ? argv[3] : "/tmp";
+    cfg.max_refl = 4;
+
+    rt_context* ctx = rt_context_new(&cfg);
+    bench_scene(ctx);
+    rt_context_render(ctx);
+    const display* disp = rt_context_display(ctx);
+    char p6[256], qoi[256], png[256];
+    snprintf(p6, sizeof(p6), "%s/bench_encode.ppm", dir);
+    snprintf(qoi, sizeof(qoi), "%s/bench_encode.qoi", dir);
+    snprintf(png, sizeof(png), "%s/bench_encode.png", dir);
+
+    double t = util_seconds();
+    disp_file file = {p6};
+    display_write_stream(disp, stream_p6(&file));
+    double p6_time = util_seconds() - t;
+    long p6_size = bench_size(p6);
+    printf("p6            %.3fs %9ld bytes\n", p6_time, p6_size);
+
+    for (int parallel = 0; parallel < 2; parallel++) {
+        disp_encoder enc = {qoi, parallel ? ctx->pool : NULL};
+        t = util_seconds();
+        display_write_stream(disp, stream_qoi(&enc));
+        double qoi_time = util_seconds() - t;
+        enc.path = png;
+        t = util_seconds();
+        display_write_stream(disp, stream_png(&enc));
+        double png_time = util_seconds() - t;
+        const char* name = parallel ? "pool" : "serial";
+        printf("qoi %-6s    %.3fs %9ld bytes (%.1f%%)\n", name, qoi_time,
+               bench_size(qoi), 100.0 * bench_size(qoi) / p6_size);
+        printf("png %-6s    %.3fs %9ld bytes (%.1f%%)\n", name, png_time,
+               bench_size(png), 100.0 * bench_size(png) / p6_size);
+    }
+
+    long bad = bench_qoi_check(qoi, disp);
+    printf("qoi decode    %s\n", bad == 0 ? "ok" : "MISMATCH");
+    rt_context_free(ctx);
+    return bad != 0;
+}
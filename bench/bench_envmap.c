@@ -0,0 +1,139 @@
+// Environment map lighting (src/texture/envmap.h): matte spheres under a
+// synthetic sky with a small bright sun, written to a PFM file and loaded
+// back. Renders with and without sampling the map at every rough hit and
+// prints the error of 4, 16 and 64 spp against a high spp reference of the
+// same mode, then the difference of the two references. Paths are clamped
+// only once at the end, so both modes converge to the same image even with
+// the sun far brighter than white.
+//
+// Usage: bench_envmap [width] [height] [reference spp]
+
+#include <include/render.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SKY_W 256
+#define SKY_H 128
+
+/// Writes one float little endian
+static void bench_put_float(FILE* f, float v) {
+    unsigned char b[4];
+    unsigned int bits;
+    memcpy(&bits, &v, sizeof(bits));
+    for (int i = 0; i < 4; i++) {
+        b[i] = (bits >> (8 * i)) & 0xff;
+    }
+    fwrite(b, 1, 4, f);
+}
+
+/// Dim sky over a darker ground with a sun 0.05 rad wide and 100 times as
+/// bright as white, as a PFM file
+static bool bench_write_sky(const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    vector3 sun = vec_norm(vec3(0.5, 0.8, -0.3));
+    fprintf(f, "PF\n%d %d\n-1.0\n", SKY_W, SKY_H);
+    // Bottom row first
+    for (int y = SKY_H - 1; y >= 0; y--) {
+        for (int x = 0; x < SKY_W; x++) {
+            double theta = M_PI * (y + 0.5) / SKY_H;
+            double phi = 2.0 * M_PI * (x + 0.5) / SKY_W;
+            vector3 d = vec3(sin(theta) * sin(phi), cos(theta),
+                             sin(theta) * cos(phi));
+            float c[3] = {0.02f, 0.02f, 0.015f};
+            if (d.j > 0.0) {
+                c[0] = 0.03f + 0.02f * (1.0f - d.j);
+                c[1] = 0.04f + 0.02f * (1.0f - d.j);
+                c[2] = 0.08f;
+            }
+            if (vec_dot(d, sun) > cos(0.05)) {
+                c[0] = c[1] = 100.0f;
+                c[2] = 90.0f;
+            }
+            for (int k = 0; k < 3; k++) {
+                bench_put_float(f, c[k]);
+            }
+        }
+    }
+    return fclose(f) == 0;
+}
+
+static void bench_scene(rt_context* ctx) {
+    for (int i = 0; i < 5; i++) {
+        color col = color_new(0.8 - 0.1 * i, 0.5 + 0.1 * (i % 3), 0.4);
+        rt_context_add_body(
+            ctx, body_sphere_new(vec3(-4.0 + 2.0 * i, -0.6, 9.0 + (i % 2)),
+                                 0.9, texture_new_single_color(col, 0.7,
+                                                               1.0)));
+    }
+    rt_context_add_body(
+        ctx, body_floor_new(-1.5, texture_new_single_color(
+                                      color_new(0.6, 0.6, 0.6), 0.6, 1.0)));
+}
+
+static double bench_rmse(const display* a, const display* b) {
+    double se = 0.0;
+    size_t n = (size_t)a->d_w * a->d_h;
+    for (size_t i = 0; i < n; i++) {
+        double dr = a->color_buffer[i].r - b->color_buffer[i].r;
+        double dg = a->color_buffer[i].g - b->color_buffer[i].g;
+        double db = a->color_buffer[i].b - b->color_buffer[i].b;
+        se += dr * dr + dg * dg + db * db;
+    }
+    return sqrt(se / (n * 3));
+}
+
+int main(int argc, char** argv) {
+    const char* path = "/tmp/bench_envmap.pfm";
+    env_map env;
+    if (!bench_write_sky(path) || env_map_load(&env, path).type != ALL_GOOD) {
+        fprintf(stderr, "bench_envmap: can't write or read %s\n", path);
+        return 1;
+    }
+
+    rt_config cfg = rt_config_default();
+    cfg.width = argc > 1 ? atoi(argv[1]) : 80;
+    cfg.height = argc > 2 ? atoi(argv[2]) : 45;
+    unsigned int ref_spp = argc > 3 ? atoi(argv[3]) : 2048;
+    cfg.sampler = SAMPLER_SOBOL;
+    cfg.max_refl = 4;
+    cfg.seed = 5;
+    cfg.env = &env;
+    static const unsigned int spps[] = {4, 16, 64};
+
+    rt_context* refs[2];
+    for (int direct = 0; direct < 2; direct++) {
+        cfg.env_direct = direct;
+        cfg.spp = ref_spp;
+        refs[direct] = rt_context_new(&cfg);
+        bench_scene(refs[direct]);
+        rt_context_render(refs[direct]);
+
+        for (size_t s = 0; s < sizeof(spps) / sizeof(spps[0]); s++) {
+            cfg.spp = spps[s];
+            cfg.seed = 100 + s;
+            rt_context* ctx = rt_context_new(&cfg);
+            bench_scene(ctx);
+            rt_context_render(ctx);
+            rt_stats st = rt_context_stats(ctx);
+            printf("%-6s %3u spp %.3fs %.2f Mrays/s, rmse %.4f\n",
+                   direct ? "direct" : "bounce", spps[s], st.trace_seconds,
+                   st.rays / st.trace_seconds / 1e6,
+                   bench_rmse(&ctx->disp, &refs[direct]->disp));
+            rt_context_free(ctx);
+        }
+        cfg.seed = 5;
+    }
+    // Both estimate the same image, only the noise differs
+    printf("references rmse %.4f\n",
+           bench_rmse(&refs[0]->disp, &refs[1]->disp));
+    rt_context_free(refs[0]);
+    rt_context_free(refs[1]);
+    env_map_free(&env);
+    return 0;
+}
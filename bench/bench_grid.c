@@ -0,0 +1,86 @@
+// Build + render timings of the uniform grid against brute force traversal
+// on a field of equal sized spheres.
+//
+// Usage: bench_grid [sphere count] [width] [height] [brute force limit]
+// Brute force is skipped for scenes with more spheres than the limit.
+
+#include <include/accel.h>
+#include <include/render.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/// Fills the context with n spheres in a box in front of the camera
+static void bench_scene(rt_context* ctx, size_t n) {
+    rt_rng rng;
+    rng_seed(&rng, 1234, 0);
+    // Keep the density the same regardless of count
+    RT_FLOAT side = 4.0 * cbrt((double)n);
+    RT_FLOAT radius = 0.8;
+
+    for (size_t i = 0; i < n; i++) {
+        vector3 c = vec3((rng_next_float(&rng) - 0.5) * side,
+                         (rng_next_float(&rng) - 0.5) * side,
+                         side * 0.6 + rng_next_float(&rng) * side);
+        color col = color_new(rng_next_float(&rng), rng_next_float(&rng),
+                              rng_next_float(&rng));
+        rt_context_add_body(ctx, body_sphere_new(c, radius,
+                                                 texture_new_single_color(
+                                                     col, 0.4, 0.05)));
+    }
+    rt_context_add_body(
+        ctx, body_floor_new(-side, texture_new_single_color(
+                                       color_new(0.2, 0.2, 0.3), 0.3, 0.0)));
+}
+
+/// Renders with the given structure, returns the context for comparing
+static rt_context* bench_run(size_t n, unsigned int w, unsigned int h,
+                             accel_kind kind) {
+    rt_config cfg = rt_config_default();
+    cfg.width = w;
+    cfg.height = h;
+    cfg.accel = kind;
+    rt_context* ctx = rt_context_new(&cfg);
+
+    double start = util_seconds();
+    bench_scene(ctx, n);
+    double scene = util_seconds() - start;
+
+    rt_context_render(ctx);
+    rt_stats s = rt_context_stats(ctx);
+    printf("%-6s n=%zu scene %.3fs build %.4fs render %.3fs total %.3fs "
+           "(%.2f Mrays/s)\n",
+           kind == ACCEL_GRID ? "grid" : "brute", n, scene, s.accel_seconds,
+           s.trace_seconds - s.accel_seconds, s.trace_seconds,
+           s.rays / (s.trace_seconds - s.accel_seconds) * 1e-6);
+    return ctx;
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    unsigned int w = argc > 2 ? atoi(argv[2]) : 480;
+    unsigned int h = argc > 3 ? atoi(argv[3]) : 270;
+    size_t brute_limit = argc > 4 ? strtoul(argv[4], NULL, 10) : 5000;
+
+    rt_context* grid = bench_run(n, w, h, ACCEL_GRID);
+    if (n <= brute_limit) {
+        rt_context* brute = bench_run(n, w, h, ACCEL_NONE);
+        const display* a = rt_context_display(grid);
+        const display* b = rt_context_display(brute);
+        size_t diff = 0;
+        for (size_t i = 0; i < (size_t)w * h; i++) {
+            if (a->color_buffer[i].r != b->color_buffer[i].r ||
+                a->color_buffer[i].g != b->color_buffer[i].g ||
+                a->color_buffer[i].b != b->color_buffer[i].b) {
+                diff++;
+            }
+        }
+        printf("pixels differing from brute force: %zu\n", diff);
+        rt_context_free(brute);
+    } else {
+        printf("brute force skipped (n > %zu)\n", brute_limit);
+    }
+    rt_context_free(grid);
+    return 0;
+}
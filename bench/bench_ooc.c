@@ -0,0 +1,118 @@
+// Out-of-core rendering of a sphere field with a residency budget, compared
+// against the in-core grid render of the same scene.
+//
+// Usage: bench_ooc [sphere count] [budget in KiB] [width] [height]
+//                  [in-core limit] [scene file]
+// The in-core render is skipped for scenes with more spheres than the limit.
+
+#include <include/ooc.h>
+#include <include/render.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/// n spheres in a box in front of the camera, mirror-like so that the
+/// reflections don't depend on the random jitter
+static ooc_sphere* bench_spheres(size_t n) {
+    ooc_sphere* ret = malloc(sizeof(ooc_sphere) * n);
+    rt_rng rng;
+    rng_seed(&rng, 1234, 0);
+    RT_FLOAT side = 4.0 * cbrt((double)n);
+
+    for (size_t i = 0; i < n; i++) {
+        ret[i].sph.center = vec3((rng_next_float(&rng) - 0.5) * side,
+                                 (rng_next_float(&rng) - 0.5) * side,
+                                 side * 0.6 + rng_next_float(&rng) * side);
+        ret[i].sph.R = 0.8;
+        ret[i].col = color_new(rng_next_float(&rng), rng_next_float(&rng),
+                               rng_next_float(&rng));
+        ret[i].reflectivity = 0.4;
+        ret[i].diffusivity = 0.0;
+    }
+    return ret;
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+    size_t budget = (argc > 2 ? strtoul(argv[2], NULL, 10) : 1024) * 1024;
+    unsigned int w = argc > 3 ? atoi(argv[3]) : 480;
+    unsigned int h = argc > 4 ? atoi(argv[4]) : 270;
+    size_t incore_limit = argc > 5 ? strtoul(argv[5], NULL, 10) : 20000;
+    const char* path = argc > 6 ? argv[6] : "bench_ooc.rtooc";
+
+    RT_FLOAT side = 4.0 * cbrt((double)n);
+    body_rep floor = body_floor_new(
+        -side, texture_new_single_color(color_new(0.2, 0.2, 0.3), 0.3, 0.0));
+
+    double start = util_seconds();
+    ooc_sphere* spheres = bench_spheres(n);
+    RT_RES res = ooc_write(path, spheres, n, OOC_CLUSTER_SIZE);
+    PRINT_ERR(res);
+    if (res.type != ALL_GOOD) {
+        return 1;
+    }
+    printf("write  n=%zu %.3fs\n", n, util_seconds() - start);
+
+    ooc_scene* scene = ooc_scene_open(path, budget);
+    if (scene == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+        return 1;
+    }
+    ooc_scene_add_body(scene, &floor);
+    display disp =
+        display_init(w, h, 60.0, vec_zero(), NULL, NULL, &no_free_func);
+    rt_pool* pool = pool_new(0);
+
+    ooc_render(scene, &disp, pool, 0);
+    ooc_stats s = ooc_scene_stats(scene);
+    printf("ooc    budget %zuKiB render %.3fs (%.2f Mrays/s), stalled %.3fs\n"
+           "       %llu passes, %llu waits, %llu loads, %llu evictions, "
+           "peak %zuKiB\n",
+           budget / 1024, s.trace_seconds, s.rays / s.trace_seconds * 1e-6,
+           s.stall_seconds, (unsigned long long)s.passes,
+           (unsigned long long)s.waits, (unsigned long long)s.loads,
+           (unsigned long long)s.evictions, s.resident_peak / 1024);
+
+    if (n <= incore_limit) {
+        rt_config cfg = rt_config_default();
+        cfg.width = w;
+        cfg.height = h;
+        cfg.pool = pool;
+        rt_context* ctx = rt_context_new(&cfg);
+        for (size_t i = 0; i < n; i++) {
+            rt_context_add_body(
+                ctx, body_sphere_new(spheres[i].sph.center, spheres[i].sph.R,
+                                     texture_new_single_color(
+                                         spheres[i].col,
+                                         spheres[i].reflectivity,
+                                         spheres[i].diffusivity)));
+        }
+        rt_context_add_body(
+            ctx, body_floor_new(-side, texture_new_single_color(
+                                           color_new(0.2, 0.2, 0.3), 0.3,
+                                           0.0)));
+        rt_context_render(ctx);
+        printf("incore render %.3fs\n", rt_context_stats(ctx).trace_seconds);
+
+        const display* b = rt_context_display(ctx);
+        size_t diff = 0;
+        for (size_t i = 0; i < (size_t)w * h; i++) {
+            if (fabs(disp.color_buffer[i].r - b->color_buffer[i].r) > 1e-4 ||
+                fabs(disp.color_buffer[i].g - b->color_buffer[i].g) > 1e-4 ||
+                fabs(disp.color_buffer[i].b - b->color_buffer[i].b) > 1e-4) {
+                diff++;
+            }
+        }
+        printf("pixels differing from in-core: %zu\n", diff);
+        rt_context_free(ctx);
+    }
+
+    display_free(&disp);
+    pool_free(pool);
+    ooc_scene_close(scene);
+    body_free(&floor);
+    free(spheres);
+    remove(path);
+    return 0;
+}
@@ -0,0 +1,66 @@
+// Cost of timeline recording (src/prof): the same renders with recording
+// off and on, then the timeline of the last ones written for Perfetto. Build
+// with `make PROF=0` to compare against spans compiled out.
+//
+// Usage: bench_prof [trace.json] [width] [height] [renders]
+
+#include <include/prof.h>
+#include <include/render.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static void bench_scene(rt_context* ctx) {
+    for (int i = 0; i < 200; i++) {
+        color col = color_new(0.3 + (i % 7) * 0.1, 0.5, 0.9 - (i % 5) * 0.1);
+        rt_context_add_body(
+            ctx, body_sphere_new(vec3(-20.0 + (i % 20) * 2.0,
+                                      -4.0 + (i / 20) * 1.0, 30.0 + i % 3),
+                                 0.8, texture_new_single_color(col, 0.5, 0.2)));
+    }
+    rt_context_add_body(
+        ctx, body_floor_new(-6.0, texture_new_single_color(
+                                      color_new(0.3, 0.3, 0.35), 0.5, 0.1)));
+}
+
+/// Best trace time of \b renders renders
+static double bench_best(rt_context* ctx, int renders) {
+    double best = 1e9;
+    for (int i = 0; i < renders; i++) {
+        rt_context_render(ctx);
+        double t = rt_context_stats(ctx).trace_seconds;
+        best = t < best ? t : best;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "/tmp/bench_prof.json";
+    rt_config cfg = rt_config_default();
+    cfg.width = argc > 2 ? atoi(argv[2]) : 640;
+    cfg.height = argc > 3 ? atoi(argv[3]) : 360;
+    int renders = argc > 4 ? atoi(argv[4]) : 10;
+    cfg.max_refl = 6;
+    cfg.tile_size = 16;
+    rt_context* ctx = rt_context_new(&cfg);
+    bench_scene(ctx);
+    prof_thread_name("main");
+
+    // Warm up and build the grid once
+    rt_context_render(ctx);
+    double off = bench_best(ctx, renders);
+    prof_start(0);
+    double on = bench_best(ctx, renders);
+    disp_file file = {"/tmp/bench_prof.ppm"};
+    rt_context_render_stream(ctx, stream_p6(&file));
+    prof_stop();
+
+    RT_RES res = prof_write(path);
+    PRINT_ERR(res);
+    printf("off %.4fs, on %.4fs (%+.1f%%), %llu tiles per render, "
+           "timeline in %s\n",
+           off, on, (on / off - 1.0) * 100.0,
+           (unsigned long long)rt_context_stats(ctx).tiles, path);
+    rt_context_free(ctx);
+    return res.type != ALL_GOOD;
+}
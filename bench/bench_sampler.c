@@ -0,0 +1,86 @@
+// Noise of every sampler against a high sample count reference, on a scene
+// of rough spheres where both the pixel edges and the reflection jitter
+// matter.
+//
+// Usage: bench_sampler [width] [height] [reference spp] [max spp]
+
+#include <include/render.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void bench_scene(rt_context* ctx) {
+    for (int x = -2; x <= 2; x++) {
+        color col = color_new(0.5 + 0.1 * x, 0.4, 0.7 - 0.1 * x);
+        rt_context_add_body(
+            ctx, body_sphere_new(vec3(x * 4.5, 0.0, 20.0), 2.0,
+                                 texture_new_single_color(col, 0.6, 0.4)));
+    }
+    rt_context_add_body(
+        ctx, body_floor_new(-2.0, texture_new_single_color(
+                                      color_new(0.3, 0.3, 0.35), 0.5, 0.3)));
+}
+
+static rt_context* bench_render(unsigned int w, unsigned int h,
+                                sampler_kind kind, unsigned int spp,
+                                uint64_t seed) {
+    rt_config cfg = rt_config_default();
+    cfg.width = w;
+    cfg.height = h;
+    cfg.max_refl = 4;
+    cfg.sampler = kind;
+    cfg.spp = spp;
+    cfg.seed = seed;
+    rt_context* ctx = rt_context_new(&cfg);
+    bench_scene(ctx);
+    rt_context_render(ctx);
+    return ctx;
+}
+
+/// Root mean square error over all channels
+static double bench_rmse(const display* a, const display* b) {
+    double se = 0.0;
+    size_t n = (size_t)a->d_w * a->d_h;
+    for (size_t i = 0; i < n; i++) {
+        double dr = a->color_buffer[i].r - b->color_buffer[i].r;
+        double dg = a->color_buffer[i].g - b->color_buffer[i].g;
+        double db = a->color_buffer[i].b - b->color_buffer[i].b;
+        se += dr * dr + dg * dg + db * db;
+    }
+    return sqrt(se / (n * 3));
+}
+
+int main(int argc, char** argv) {
+    unsigned int w = argc > 1 ? atoi(argv[1]) : 160;
+    unsigned int h = argc > 2 ? atoi(argv[2]) : 90;
+    unsigned int ref_spp = argc > 3 ? atoi(argv[3]) : 256;
+    unsigned int max_spp = argc > 4 ? atoi(argv[4]) : 16;
+    static const sampler_kind kinds[] = {SAMPLER_RANDOM, SAMPLER_STRATIFIED,
+                                         SAMPLER_SOBOL, SAMPLER_BLUE};
+
+    double start = util_seconds();
+    rt_context* ref = bench_render(w, h, SAMPLER_SOBOL, ref_spp, 99);
+    printf("reference %ux%u sobol %u spp %.3fs\n", w, h, ref_spp,
+           util_seconds() - start);
+
+    printf("%-12s", "spp");
+    for (unsigned int spp = 1; spp <= max_spp; spp *= 2) {
+        printf(" %9u", spp);
+    }
+    printf("\n");
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        printf("%-12s", sampler_name(kinds[k]));
+        for (unsigned int spp = 1; spp <= max_spp; spp *= 2) {
+            rt_context* ctx = bench_render(w, h, kinds[k], spp, 7);
+            printf(" %9.5f", bench_rmse(rt_context_display(ctx),
+                                        rt_context_display(ref)));
+            fflush(stdout);
+            rt_context_free(ctx);
+        }
+        printf("\n");
+    }
+    rt_context_free(ref);
+    return 0;
+}
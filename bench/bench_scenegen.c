@@ -0,0 +1,143 @@
+// Compiled scene (tools/rt_scenegen) against the generic body loop of
+// display_iterate_single_ray() on the same rays. The scene is the demo scene
+// plus a row of extra spheres; it is compiled with $CC (cc by default) into
+// /tmp, so run from the repository root.
+//
+// Usage: bench_scenegen [extra spheres] [width] [height]
+
+#include <include/render.h>
+#include <include/scene.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_C "/tmp/bench_scenegen.c"
+#define BENCH_SO "/tmp/bench_scenegen.so"
+
+/// Appends the scene text to \b buf, returns its length
+static size_t bench_scene(char* buf, size_t size, int extra) {
+    size_t len = 0;
+    FILE* f = fopen("res/demo.scene", "r");
+    if (f != NULL) {
+        len = fread(buf, 1, size - 1, f);
+        fclose(f);
+    }
+    for (int i = 0; i < extra && len < size; i++) {
+        len += snprintf(buf + len, size - len,
+                        "sphere %d %d %d 1.5 0.6 0.5 0.4 0.5 0.2\n",
+                        -20 + (i % 10) * 4, -3 + (i / 10) % 4 * 3,
+                        40 + i / 40 * 5);
+    }
+    return len < size ? len : size - 1;
+}
+
+/// Traces every pixel center with \b accel (NULL for the generic loop)
+static double bench_trace(const display* disp, const body_rep** bodies,
+                          size_t count, const rt_accel* accel, color* out) {
+    RT_FLOAT disp_x, disp_y;
+    display_view_extent(disp, &disp_x, &disp_y);
+    double start = util_seconds();
+    for (unsigned int y = 0; y < disp->d_h; y++) {
+        rng_seed(rng_thread(), 1, y);
+        for (unsigned int x = 0; x < disp->d_w; x++) {
+            ray r = display_camera_ray(disp, disp_x, disp_y, x, y);
+            out[y * disp->d_w + x] =
+                accel == NULL
+                    ? display_iterate_single_ray(bodies, count, r, NULL,
+                                                 disp->max_refl)
+                    : display_trace_ray_accel(accel, bodies, count, r, NULL,
+                                              disp->max_refl, NULL);
+        }
+    }
+    return util_seconds() - start;
+}
+
+int main(int argc, char** argv) {
+    int extra = argc > 1 ? atoi(argv[1]) : 40;
+    unsigned int w = argc > 2 ? atoi(argv[2]) : 640;
+    unsigned int h = argc > 3 ? atoi(argv[3]) : 360;
+    static char text[1 << 20];
+    size_t len = bench_scene(text, sizeof(text), extra);
+
+    rt_config cfg = rt_config_default();
+    cfg.width = w;
+    cfg.height = h;
+    cfg.max_refl = 8;
+    cfg.threads = 1;
+    rt_context* ctx = rt_context_new(&cfg);
+    size_t line;
+    RT_RES res = scene_parse(ctx, text, len, &line);
+    PRINT_ERR(res);
+
+    FILE* f = fopen(BENCH_C, "w");
+    if (f == NULL) {
+        perror(BENCH_C);
+        return 1;
+    }
+    res = scene_compile(ctx, scene_hash(text, len), f);
+    fclose(f);
+    PRINT_ERR(res);
+
+    char cmd[512];
+    const char* cc = getenv("CC") != NULL ? getenv("CC") : "cc";
+    snprintf(cmd, sizeof(cmd), "%s -O3 -fPIC -shared -Isrc -o %s %s", cc,
+             BENCH_SO, BENCH_C);
+    double start = util_seconds();
+    if (system(cmd) != 0) {
+        fprintf(stderr, "failed: %s\n", cmd);
+        return 1;
+    }
+    printf("%zu bodies, compiled in %.2fs\n", ctx->bodies.count,
+           util_seconds() - start);
+
+    scene_compiled sc;
+    res = scene_compiled_open(&sc, BENCH_SO, scene_hash(text, len));
+    PRINT_ERR(res);
+    if (res.type != ALL_GOOD) {
+        return 1;
+    }
+
+    // The pointer list is filled by the first render
+    rt_context_render(ctx);
+    const body_rep** bodies = ctx->body_ptrs.data;
+    size_t count = ctx->body_ptrs.count;
+    size_t pixels = (size_t)w * h;
+    color* generic = rt_malloc(MEM_OUTPUT, sizeof(color) * pixels);
+    color* compiled = rt_malloc(MEM_OUTPUT, sizeof(color) * pixels);
+    double best_generic = 1e9, best_compiled = 1e9;
+    for (int rep = 0; rep < 3; rep++) {
+        double t = bench_trace(&ctx->disp, bodies, count, NULL, generic);
+        best_generic = t < best_generic ? t : best_generic;
+        t = bench_trace(&ctx->disp, bodies, count, &sc.accel, compiled);
+        best_compiled = t < best_compiled ? t : best_compiled;
+    }
+
+    size_t diff = 0;
+    for (size_t i = 0; i < pixels; i++) {
+        diff += generic[i].r != compiled[i].r ||
+                generic[i].g != compiled[i].g ||
+                generic[i].b != compiled[i].b;
+    }
+    printf("generic  %.3fs\ncompiled %.3fs (%.2fx), %zu pixels differ\n",
+           best_generic, best_compiled, best_generic / best_compiled, diff);
+
+    // Whole render through rt_context_set_accel() against the first one
+    memcpy(generic, ctx->disp.color_buffer, sizeof(color) * pixels);
+    double first = rt_context_stats(ctx).trace_seconds;
+    rt_context_set_accel(ctx, &sc.accel, sc.body_count);
+    rt_context_render(ctx);
+    diff = 0;
+    for (size_t i = 0; i < pixels; i++) {
+        diff += memcmp(&generic[i], &ctx->disp.color_buffer[i],
+                       sizeof(color)) != 0;
+    }
+    printf("render    %.3fs\nrender    %.3fs compiled, %zu pixels differ\n",
+           first, rt_context_stats(ctx).trace_seconds, diff);
+
+    rt_free(generic);
+    rt_free(compiled);
+    scene_compiled_close(&sc);
+    rt_context_free(ctx);
+    return 0;
+}
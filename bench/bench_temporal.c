@@ -0,0 +1,100 @@
+// Temporal accumulation on a camera moving through a scene of rough spheres,
+// compared to tracing every frame from scratch. Errors are against a high
+// sample count render of each frame.
+//
+// Usage: bench_temporal [frames] [width] [height] [spp] [reference spp]
+
+#include <include/render.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_BODIES 6
+
+static void bench_scene(body_rep* bodies) {
+    for (int x = -2; x <= 2; x++) {
+        color col = color_new(0.5 + 0.1 * x, 0.4, 0.7 - 0.1 * x);
+        bodies[x + 2] = body_sphere_new(
+            vec3(x * 4.5, 0.0, 20.0), 2.0,
+            texture_new_single_color(col, 0.6, 0.4));
+    }
+    bodies[5] = body_floor_new(-2.0, texture_new_single_color(
+                                         color_new(0.3, 0.3, 0.35), 0.5, 0.3));
+}
+
+/// Root mean square error over all channels
+static double bench_rmse(const display* a, const display* b) {
+    double se = 0.0;
+    size_t n = (size_t)a->d_w * a->d_h;
+    for (size_t i = 0; i < n; i++) {
+        double dr = a->color_buffer[i].r - b->color_buffer[i].r;
+        double dg = a->color_buffer[i].g - b->color_buffer[i].g;
+        double db = a->color_buffer[i].b - b->color_buffer[i].b;
+        se += dr * dr + dg * dg + db * db;
+    }
+    return sqrt(se / (n * 3));
+}
+
+int main(int argc, char** argv) {
+    unsigned int frames = argc > 1 ? atoi(argv[1]) : 12;
+    unsigned int w = argc > 2 ? atoi(argv[2]) : 160;
+    unsigned int h = argc > 3 ? atoi(argv[3]) : 90;
+    unsigned int spp = argc > 4 ? atoi(argv[4]) : 1;
+    unsigned int ref_spp = argc > 5 ? atoi(argv[5]) : 64;
+
+    body_rep bodies[BENCH_BODIES];
+    const body_rep* ptrs[BENCH_BODIES];
+    bench_scene(bodies);
+    for (int i = 0; i < BENCH_BODIES; i++) {
+        ptrs[i] = &bodies[i];
+    }
+
+    display disp =
+        display_init(w, h, 60.0, vec_zero(), NULL, NULL, &no_free_func);
+    display plain =
+        display_init(w, h, 60.0, vec_zero(), NULL, NULL, &no_free_func);
+    display ref =
+        display_init(w, h, 60.0, vec_zero(), NULL, NULL, &no_free_func);
+    disp.max_refl = plain.max_refl = ref.max_refl = 4;
+    disp.sampler = plain.sampler = ref.sampler = SAMPLER_SOBOL;
+    disp.spp = plain.spp = spp;
+    ref.spp = ref_spp;
+    ref.seed = 99;
+
+    temporal_render tr;
+    if (!temporal_init(&tr, &disp)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    rt_pool* pool = pool_new(0);
+
+    printf("%5s %9s %9s %9s %9s\n", "frame", "reused", "temporal", "plain",
+           "seconds");
+    for (unsigned int f = 0; f < frames; f++) {
+        // Slow dolly forward and to the side
+        vector3 pos = vec3(0.08 * f, 0.02 * f, 0.15 * f);
+        disp.pos = plain.pos = ref.pos = pos;
+
+        double start = util_seconds();
+        size_t reused = temporal_run(&tr, ptrs, BENCH_BODIES, pool);
+        double seconds = util_seconds() - start;
+        plain.seed = f + 1;
+        display_run_rays(&plain, ptrs, BENCH_BODIES);
+        display_run_rays(&ref, ptrs, BENCH_BODIES);
+
+        printf("%5u %8.1f%% %9.5f %9.5f %9.3f\n", f,
+               100.0 * reused / ((double)w * h), bench_rmse(&disp, &ref),
+               bench_rmse(&plain, &ref), seconds);
+    }
+
+    temporal_free(&tr);
+    pool_free(pool);
+    display_free(&disp);
+    display_free(&plain);
+    display_free(&ref);
+    for (int i = 0; i < BENCH_BODIES; i++) {
+        body_free(&bodies[i]);
+    }
+    return 0;
+}
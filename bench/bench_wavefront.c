@@ -0,0 +1,96 @@
+// Wavefront rendering (src/render/wavefront.h) against rt_context_render()
+// on two scenes with a material per body: a few spheres tested without an
+// acceleration structure, and a field of spheres in a grid. Both sample with
+// Sobol points, so the images must match up to rounding (PSNR).
+//
+// Usage: bench_wavefront [width] [height] [spp]
+
+#include <include/render.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/// \b count spheres on rings, every one with its own texture
+static void bench_scene(rt_context* ctx, int count, RT_FLOAT radius) {
+    for (int i = 0; i < count; i++) {
+        double a = i * 2.4, r = 4.0 + 0.05 * i;
+        color col = color_new(0.3 + (i % 7) * 0.1, 0.2 + (i % 3) * 0.3,
+                              0.9 - (i % 5) * 0.15);
+        ray_texture tex =
+            i % 4 == 0
+                ? texture_new_checker(col, color_new(0.1, 0.1, 0.1), 4, 0.5,
+                                      0.3, 0.05 * (i % 3))
+                : texture_new_single_color(col, 0.2 + 0.1 * (i % 6),
+                                           0.1 * (i % 4));
+        rt_context_add_body(
+            ctx, body_sphere_new(vec3(r * cos(a), -1.0 + (i % 5) * 0.6,
+                                      14.0 + r * sin(a)),
+                                 radius, tex));
+    }
+    rt_context_add_body(
+        ctx, body_floor_new(-2.0, texture_new_checker(
+                                      color_new(0.8, 0.8, 0.8),
+                                      color_new(0.2, 0.2, 0.25), 8, 4.0,
+                                      0.3, 0.2)));
+}
+
+static double bench_psnr(const display* a, const display* b) {
+    double se = 0.0;
+    size_t n = (size_t)a->d_w * a->d_h;
+    for (size_t i = 0; i < n; i++) {
+        double dr = a->color_buffer[i].r - b->color_buffer[i].r;
+        double dg = a->color_buffer[i].g - b->color_buffer[i].g;
+        double db = a->color_buffer[i].b - b->color_buffer[i].b;
+        se += dr * dr + dg * dg + db * db;
+    }
+    return se > 0.0 ? 10.0 * log10(1.0 / (se / (n * 3))) : INFINITY;
+}
+
+int main(int argc, char** argv) {
+    rt_config cfg = rt_config_default();
+    cfg.width = argc > 1 ? atoi(argv[1]) : 480;
+    cfg.height = argc > 2 ? atoi(argv[2]) : 270;
+    cfg.spp = argc > 3 ? atoi(argv[3]) : 4;
+    cfg.sampler = SAMPLER_SOBOL;
+    cfg.max_refl = 8;
+    cfg.seed = 11;
+    static const struct {
+        const char* name;
+        int count;
+        RT_FLOAT radius;
+    } scenes[] = {{"brute", 24, 0.9}, {"grid", 2000, 0.25}};
+    int bad = 0;
+
+    for (int sc = 0; sc < 2; sc++) {
+        rt_context* ref = rt_context_new(&cfg);
+        rt_context* ctx = rt_context_new(&cfg);
+        bench_scene(ref, scenes[sc].count, scenes[sc].radius);
+        bench_scene(ctx, scenes[sc].count, scenes[sc].radius);
+        // Build the structures outside of the timings
+        rt_context_render(ref);
+        wavefront_render(ctx, NULL);
+
+        rt_context_render(ref);
+        rt_stats rs = rt_context_stats(ref);
+        wavefront_stats ws;
+        wavefront_render(ctx, &ws);
+        rt_stats st = rt_context_stats(ctx);
+        double psnr = bench_psnr(&ref->disp, &ctx->disp);
+        bad += psnr < 50.0;
+
+        printf("%-6s %-4s paths %.3fs %.2f Mrays/s, wavefront %.3fs "
+               "%.2f Mrays/s (%.2fx), %llu materials, %llu stages, "
+               "psnr %.1f dB\n",
+               scenes[sc].name, st.accel == ACCEL_GRID ? "grid" : "none",
+               rs.trace_seconds,
+               rs.rays / rs.trace_seconds / 1e6, st.trace_seconds,
+               st.rays / st.trace_seconds / 1e6,
+               rs.trace_seconds / st.trace_seconds,
+               (unsigned long long)ws.materials,
+               (unsigned long long)ws.stages, psnr);
+        rt_context_free(ref);
+        rt_context_free(ctx);
+    }
+    return bad != 0;
+}
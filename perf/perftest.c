@@ -0,0 +1,312 @@
+// End-to-end render regression test, run by `make perftest`.
+//
+// Renders a fixed set of scenes with fixed seeds, compares every image
+// against perf/golden/<scene>.ppm by PSNR and the throughput against the
+// baseline in perf/baseline.txt.
+//
+// Usage: perftest [-d dir] [-t max drop %] [-p min PSNR] [-r runs] [-g] [-b]
+//   -g  write the golden images instead of comparing
+//   -b  write the baseline instead of comparing
+// Without a baseline file the run records one and passes.
+
+#include <include/render.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PERF_WIDTH 240
+#define PERF_HEIGHT 135
+#define PERF_SEED 42
+/// Scenes are rendered at least this long in total, the best run counts
+#define PERF_MIN_SECONDS 0.5
+
+typedef struct {
+    const char* name;
+    void (*build)(rt_context* ctx);
+    int max_refl;
+} perf_scene;
+
+typedef struct {
+    double seconds;      ///< Best wall time of the runs
+    double rays_per_sec; ///< Rays of a run over the best wall time
+} perf_result;
+
+static body_rep perf_sphere(vector3 c, RT_FLOAT r, color col, RT_FLOAT refl,
+                            RT_FLOAT diff) {
+    return body_sphere_new(c, r, texture_new_single_color(col, refl, diff));
+}
+
+/// The src/main.c demo
+static void perf_demo(rt_context* ctx) {
+    rt_context_add_body(ctx, perf_sphere(vec3(-15.0, 2.0, 30.0), 4.0,
+                                         color_new(0.1, 0.8, 0.4), 0.7, 0.1));
+    rt_context_add_body(ctx, perf_sphere(vec3(-5.0, -8.0, 10.0), 4.0,
+                                         color_white(), 0.8, 0.1));
+    rt_context_add_body(ctx, perf_sphere(vec3(-15.0, 2.0, 20.0), 4.0,
+                                         color_new(0.5, 0.5, 0.9), 0.9, 0.15));
+    rt_context_add_body(ctx, perf_sphere(vec3(5.0, -4.0, 10.0), 4.0,
+                                         color_new(0.9, 0.3, 0.9), 0.7, 0.2));
+    rt_context_add_body(ctx, perf_sphere(vec3(1.0, 8.0, 15.0), 4.0,
+                                         color_new(0.5, 0.2, 0.9), 0.5, 0.05));
+    rt_context_add_body(
+        ctx, body_floor_new(-5.0, texture_new_single_color(
+                                      color_new(0.0, 0.09, 0.5), 0.5, 0.0)));
+}
+
+/// 10k random spheres over a floor
+static void perf_spheres(rt_context* ctx) {
+    rt_rng rng;
+    rng_seed(&rng, 1234, 0);
+    RT_FLOAT side = 4.0 * cbrt(10000.0);
+    for (int i = 0; i < 10000; i++) {
+        vector3 c = vec3((rng_next_float(&rng) - 0.5) * side,
+                         (rng_next_float(&rng) - 0.5) * side,
+                         side * 0.6 + rng_next_float(&rng) * side);
+        color col = color_new(rng_next_float(&rng), rng_next_float(&rng),
+                              rng_next_float(&rng));
+        rt_context_add_body(ctx, perf_sphere(c, 0.8, col, 0.4, 0.05));
+    }
+    rt_context_add_body(
+        ctx, body_floor_new(-side, texture_new_single_color(
+                                       color_new(0.2, 0.2, 0.3), 0.3, 0.0)));
+}
+
+/// Tightly packed near-mirrors, most rays bounce many times
+static void perf_mirrors(rt_context* ctx) {
+    for (int y = -2; y <= 2; y++) {
+        for (int x = -3; x <= 3; x++) {
+            color col = color_new(0.5 + 0.07 * x, 0.5 + 0.1 * y, 0.6);
+            rt_context_add_body(ctx, perf_sphere(vec3(x * 4.2, y * 4.2, 25.0),
+                                                 2.0, col, 0.95, 0.02));
+        }
+    }
+    rt_context_add_body(
+        ctx, body_floor_new(-12.0, texture_new_single_color(
+                                       color_new(0.3, 0.3, 0.3), 0.9, 0.0)));
+}
+
+/// Camera between a floor and a ceiling that are both mirrors, with a high
+/// reflection limit
+static void perf_deep(rt_context* ctx) {
+    rt_context_add_body(
+        ctx, body_floor_new(-3.0, texture_new_single_color(
+                                      color_new(0.2, 0.3, 0.8), 0.98, 0.0)));
+    rt_context_add_body(
+        ctx, body_floor_new(3.0, texture_new_single_color(
+                                     color_new(0.8, 0.3, 0.2), 0.98, 0.0)));
+    rt_context_add_body(ctx, perf_sphere(vec3(0.0, 0.0, 20.0), 2.5,
+                                         color_new(0.9, 0.9, 0.2), 0.5, 0.0));
+}
+
+static const perf_scene perf_scenes[] = {
+    {"demo", &perf_demo, MAX_REFL},
+    {"spheres10k", &perf_spheres, MAX_REFL},
+    {"mirrors", &perf_mirrors, MAX_REFL},
+    {"deep", &perf_deep, 200},
+};
+
+#define PERF_SCENE_COUNT (sizeof(perf_scenes) / sizeof(perf_scenes[0]))
+
+/// 8 bit value of a channel, the same as the P6 writer
+static unsigned char perf_byte(COLOR_TYPE v) {
+    return (unsigned char)(v * 255.999);
+}
+
+/// Reads a binary P6 image of the given size, NULL on any mismatch
+static unsigned char* perf_read_p6(const char* path, unsigned int w,
+                                   unsigned int h) {
+    unsigned int fw, fh, max;
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    if (fscanf(f, "P6 %u %u %u", &fw, &fh, &max) != 3 || fw != w ||
+        fh != h || max != 255 || fgetc(f) == EOF) {
+        fclose(f);
+        return NULL;
+    }
+    size_t size = (size_t)w * h * 3;
+    unsigned char* data = malloc(size);
+    if (fread(data, 1, size, f) != size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+/// PSNR in dB of the framebuffer against 8 bit reference data, INFINITY if
+/// they're the same
+static double perf_psnr(const display* disp, const unsigned char* ref) {
+    double se = 0.0;
+    size_t n = (size_t)disp->d_w * disp->d_h;
+    for (size_t i = 0; i < n; i++) {
+        color c = disp->color_buffer[i];
+        double dr = perf_byte(c.r) - (double)ref[i * 3];
+        double dg = perf_byte(c.g) - (double)ref[i * 3 + 1];
+        double db = perf_byte(c.b) - (double)ref[i * 3 + 2];
+        se += dr * dr + dg * dg + db * db;
+    }
+    if (se == 0.0) {
+        return INFINITY;
+    }
+    return 10.0 * log10(255.0 * 255.0 / (se / (n * 3)));
+}
+
+/// Rays per second of a scene in the baseline file, 0 if it isn't there
+static double perf_baseline(const char* path, const char* name) {
+    char line[256], scene[128];
+    double rate;
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return 0.0;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "%127s %lf", scene, &rate) == 2 &&
+            strcmp(scene, name) == 0) {
+            fclose(f);
+            return rate;
+        }
+    }
+    fclose(f);
+    return 0.0;
+}
+
+int main(int argc, char** argv) {
+    const char* dir = "perf";
+    double max_drop = 10.0;
+    double min_psnr = 40.0;
+    int runs = 3;
+    bool write_golden = false;
+    bool write_baseline = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:t:p:r:gb")) != -1) {
+        switch (opt) {
+        case 'd':
+            dir = optarg;
+            break;
+        case 't':
+            max_drop = atof(optarg);
+            break;
+        case 'p':
+            min_psnr = atof(optarg);
+            break;
+        case 'r':
+            runs = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+        case 'g':
+            write_golden = true;
+            break;
+        case 'b':
+            write_baseline = true;
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-d dir] [-t max drop %%] [-p min PSNR] "
+                    "[-r runs] [-g] [-b]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    char baseline_path[1024], golden_path[1024];
+    snprintf(baseline_path, sizeof(baseline_path), "%s/baseline.txt", dir);
+    FILE* check = fopen(baseline_path, "r");
+    if (check == NULL) {
+        write_baseline = true;
+        printf("no baseline yet, recording %s\n", baseline_path);
+    } else {
+        fclose(check);
+    }
+
+    perf_result results[PERF_SCENE_COUNT];
+    int failures = 0;
+    printf("%-12s %10s %12s %10s %10s\n", "scene", "seconds", "Mrays/s",
+           "change", "PSNR");
+
+    for (size_t s = 0; s < PERF_SCENE_COUNT; s++) {
+        const perf_scene* scene = &perf_scenes[s];
+        rt_config cfg = rt_config_default();
+        cfg.width = PERF_WIDTH;
+        cfg.height = PERF_HEIGHT;
+        cfg.max_refl = scene->max_refl;
+        cfg.seed = PERF_SEED;
+        rt_context* ctx = rt_context_new(&cfg);
+        scene->build(ctx);
+
+        double best = INFINITY, total = 0.0;
+        uint64_t rays = 0;
+        for (int r = 0; r < runs || total < PERF_MIN_SECONDS; r++) {
+            rt_context_render(ctx);
+            rt_stats st = rt_context_stats(ctx);
+            if (st.trace_seconds < best) {
+                best = st.trace_seconds;
+            }
+            total += st.trace_seconds;
+            rays = st.rays;
+        }
+        results[s].seconds = best;
+        results[s].rays_per_sec = rays / best;
+
+        snprintf(golden_path, sizeof(golden_path), "%s/golden/%s.ppm", dir,
+                 scene->name);
+        disp_file golden = {golden_path};
+        double psnr = INFINITY;
+        bool bad_image = false;
+        if (write_golden) {
+            rt_context_write(ctx, stream_p6(&golden));
+        } else {
+            unsigned char* ref =
+                perf_read_p6(golden_path, PERF_WIDTH, PERF_HEIGHT);
+            if (ref == NULL) {
+                fprintf(stderr, "%s: missing or bad golden image %s\n",
+                        scene->name, golden_path);
+                bad_image = true;
+            } else {
+                psnr = perf_psnr(rt_context_display(ctx), ref);
+                bad_image = psnr < min_psnr;
+                free(ref);
+            }
+        }
+
+        double base = perf_baseline(baseline_path, scene->name);
+        double change = base > 0.0
+                            ? (results[s].rays_per_sec / base - 1.0) * 100.0
+                            : 0.0;
+        bool slow = !write_baseline && !write_golden && base > 0.0 &&
+                    change < -max_drop;
+
+        printf("%-12s %10.3f %12.3f %9.1f%% %10.2f%s%s\n", scene->name, best,
+               results[s].rays_per_sec * 1e-6, change, psnr,
+               bad_image ? "  IMAGE MISMATCH" : "", slow ? "  SLOWER" : "");
+        failures += bad_image || slow;
+        rt_context_free(ctx);
+    }
+
+    if (write_baseline) {
+        FILE* f = fopen(baseline_path, "w");
+        if (f == NULL) {
+            fprintf(stderr, "can't write %s\n", baseline_path);
+            return 1;
+        }
+        fprintf(f, "# scene rays/s, written by perftest -b\n");
+        for (size_t s = 0; s < PERF_SCENE_COUNT; s++) {
+            fprintf(f, "%s %.0f\n", perf_scenes[s].name,
+                    results[s].rays_per_sec);
+        }
+        fclose(f);
+    }
+
+    if (failures > 0) {
+        printf("perftest: %d of %zu scenes failed (max drop %.1f%%, min "
+               "PSNR %.1f dB)\n",
+               failures, PERF_SCENE_COUNT, max_drop, min_psnr);
+        return 1;
+    }
+    printf("perftest: all %zu scenes passed\n", PERF_SCENE_COUNT);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#include "accel.h"
+
+#include <math.h>
+
+accel_kind accel_choose(const body_rep** const bodies, size_t body_count) {
+    vector3 center;
+    RT_FLOAT radius;
+    double sum = 0.0, sum_sq = 0.0;
+    size_t n = 0;
+
+    for (size_t i = 0; i < body_count; i++) {
+        if (body_bounds(bodies[i], &center, &radius)) {
+            sum += radius;
+            sum_sq += (double)radius * radius;
+            n++;
+        }
+    }
+    if (n < ACCEL_MIN_BODIES) {
+        return ACCEL_NONE;
+    }
+
+    double mean = sum / n;
+    double var = sum_sq / n - mean * mean;
+    double cv = mean > 0.0 ? sqrt(fmax(var, 0.0)) / mean : 0.0;
+    return cv <= ACCEL_GRID_MAX_CV ? ACCEL_GRID : ACCEL_NONE;
+}
@@ -0,0 +1,34 @@
+#ifndef RAY_TRACE_ACCEL_H
+#define RAY_TRACE_ACCEL_H
+
+#include <include/body.h>
+
+#include <stddef.h>
+
+/// Bodies below this count are always traced brute force
+#define ACCEL_MIN_BODIES 32
+/// Largest coefficient of variation of body sizes that a uniform grid
+/// handles well
+#define ACCEL_GRID_MAX_CV 1.0
+
+/// Acceleration structure choice
+typedef enum {
+    ACCEL_AUTO, ///< Pick one with accel_choose()
+    ACCEL_NONE, ///< Test every body for every ray
+    ACCEL_GRID, ///< Uniform grid, see accel_grid
+    /// Given by the caller, e.g. a compiled scene, see rt_context_set_accel()
+    ACCEL_CUSTOM,
+} accel_kind;
+
+/** Picks an acceleration structure for the scene.
+ *
+ * A uniform grid is chosen when there are enough bounded bodies and they are
+ * of roughly equal size (e.g. particle fields), since then it builds in O(n)
+ * and each ray only visits a few cells. Otherwise bodies are tested brute
+ * force.
+ *
+ * @return ACCEL_NONE or ACCEL_GRID
+ */
+accel_kind accel_choose(const body_rep** const bodies, size_t body_count);
+
+#endif
@@ -0,0 +1,326 @@
+#include "grid.h"
+#include <include/math.h>
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Recently tested bodies remembered per ray so that bodies spanning
+/// several cells aren't tested again in every one of them
+#define GRID_MAILBOX 8
+
+static inline RT_FLOAT vec_axis(const vector3 v, int axis) {
+    return axis == 0 ? v.i : (axis == 1 ? v.j : v.k);
+}
+
+/// Cell coordinate of a point along one axis, clamped to the grid
+static inline int grid_cell(const accel_grid* grid, RT_FLOAT p, int axis) {
+    int c = (int)((p - vec_axis(grid->min, axis)) *
+                  vec_axis(grid->inv_cell, axis));
+    if (c < 0)
+        return 0;
+    if (c >= (int)grid->res[axis])
+        return grid->res[axis] - 1;
+    return c;
+}
+
+/// Cell range covered by a bounding sphere
+static void grid_cell_range(const accel_grid* grid, vector3 center,
+                            RT_FLOAT radius, int lo[3], int hi[3]) {
+    for (int a = 0; a < 3; a++) {
+        lo[a] = grid_cell(grid, vec_axis(center, a) - radius, a);
+        hi[a] = grid_cell(grid, vec_axis(center, a) + radius, a);
+    }
+}
+
+/// Frees the scratch buffers and whatever of the grid was built, for
+/// grid_build() running out of memory
+static bool grid_build_fail(accel_grid* grid, vector3* centers,
+                            RT_FLOAT* radii, bool* bounded, uint32_t* cursor) {
+    rt_aligned_free(cursor);
+    rt_aligned_free(centers);
+    rt_aligned_free(radii);
+    rt_aligned_free(bounded);
+    grid_free(grid);
+    memset(grid, 0, sizeof(*grid));
+    return false;
+}
+
+bool grid_build(accel_grid* grid, const body_rep** const bodies,
+                size_t body_count, RT_FLOAT density) {
+    vector3 center;
+    RT_FLOAT radius;
+    vector3* centers =
+        rt_aligned_alloc(MEM_ACCEL, sizeof(vector3) * body_count);
+    RT_FLOAT* radii =
+        rt_aligned_alloc(MEM_ACCEL, sizeof(RT_FLOAT) * body_count);
+    bool* bounded = rt_aligned_alloc(MEM_ACCEL, sizeof(bool) * body_count);
+    int lo[3], hi[3];
+
+    memset(grid, 0, sizeof(*grid));
+    grid->others = rtvec_u32_new(MEM_ACCEL);
+    if (body_count > 0 &&
+        (centers == NULL || radii == NULL || bounded == NULL)) {
+        return grid_build_fail(grid, centers, radii, bounded, NULL);
+    }
+    grid->min = vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    grid->max = vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+    // Bounds of the whole grid
+    for (size_t i = 0; i < body_count; i++) {
+        bounded[i] = body_bounds(bodies[i], &center, &radius);
+        if (!bounded[i]) {
+            if (rtvec_u32_push(&grid->others, i) == NULL) {
+                return grid_build_fail(grid, centers, radii, bounded, NULL);
+            }
+            continue;
+        }
+        centers[i] = center;
+        radii[i] = radius;
+        grid->min.i = fmin(grid->min.i, center.i - radius);
+        grid->min.j = fmin(grid->min.j, center.j - radius);
+        grid->min.k = fmin(grid->min.k, center.k - radius);
+        grid->max.i = fmax(grid->max.i, center.i + radius);
+        grid->max.j = fmax(grid->max.j, center.j + radius);
+        grid->max.k = fmax(grid->max.k, center.k + radius);
+        grid->bounded_count++;
+    }
+
+    if (grid->bounded_count == 0) {
+        grid->res[0] = grid->res[1] = grid->res[2] = 0;
+        grid->cell_start = rt_aligned_alloc(MEM_ACCEL, sizeof(uint32_t));
+        grid->cell_items = NULL;
+        if (grid->cell_start == NULL) {
+            return grid_build_fail(grid, centers, radii, bounded, NULL);
+        }
+        grid->cell_start[0] = 0;
+        rt_aligned_free(centers);
+        rt_aligned_free(radii);
+        rt_aligned_free(bounded);
+        return true;
+    }
+
+    // Pad a little so that nothing sits exactly on the border, by more far
+    // from the origin
+    RT_FLOAT eps = RTFCOMPVAL;
+    for (int a = 0; a < 3; a++) {
+        eps = fmax(eps, RT_EPS(fmax(fabs(vec_axis(grid->min, a)),
+                                    fabs(vec_axis(grid->max, a)))));
+    }
+    vector3 pad = vec3(eps, eps, eps);
+    grid->min = vec_sub(grid->min, pad);
+    grid->max = vec_sum(grid->max, pad);
+    vector3 ext = vec_sub(grid->max, grid->min);
+
+    // Cells of about equal size in every direction, `density` per body
+    double volume = (double)ext.i * ext.j * ext.k;
+    double k = cbrt(density * grid->bounded_count / volume);
+    for (int a = 0; a < 3; a++) {
+        double r = ceil(vec_axis(ext, a) * k);
+        grid->res[a] = r < 1.0 ? 1 : (r > GRID_MAX_RES ? GRID_MAX_RES : r);
+    }
+    grid->cell = vec3(ext.i / grid->res[0], ext.j / grid->res[1],
+                      ext.k / grid->res[2]);
+    grid->inv_cell =
+        vec3(1.0 / grid->cell.i, 1.0 / grid->cell.j, 1.0 / grid->cell.k);
+
+    size_t cells = (size_t)grid->res[0] * grid->res[1] * grid->res[2];
+    grid->cell_start =
+        rt_aligned_alloc(MEM_ACCEL, (cells + 1) * sizeof(uint32_t));
+    if (grid->cell_start == NULL) {
+        return grid_build_fail(grid, centers, radii, bounded, NULL);
+    }
+    memset(grid->cell_start, 0, (cells + 1) * sizeof(uint32_t));
+
+    // Count pass, cell_start[c + 1] holds the size of cell c
+    for (size_t i = 0; i < body_count; i++) {
+        if (!bounded[i])
+            continue;
+        grid_cell_range(grid, centers[i], radii[i], lo, hi);
+        for (int z = lo[2]; z <= hi[2]; z++)
+            for (int y = lo[1]; y <= hi[1]; y++)
+                for (int x = lo[0]; x <= hi[0]; x++)
+                    grid->cell_start[((size_t)z * grid->res[1] + y) *
+                                         grid->res[0] +
+                                     x + 1]++;
+    }
+
+    // Prefix sum turns the sizes into offsets
+    for (size_t c = 0; c < cells; c++) {
+        grid->cell_start[c + 1] += grid->cell_start[c];
+    }
+    grid->cell_items =
+        rt_aligned_alloc(MEM_ACCEL, sizeof(uint32_t) * grid->cell_start[cells]);
+
+    // Fill pass, with a write cursor per cell
+    uint32_t* cursor = rt_aligned_alloc(MEM_ACCEL, sizeof(uint32_t) * cells);
+    if (grid->cell_items == NULL || cursor == NULL) {
+        return grid_build_fail(grid, centers, radii, bounded, cursor);
+    }
+    memcpy(cursor, grid->cell_start, sizeof(uint32_t) * cells);
+    for (size_t i = 0; i < body_count; i++) {
+        if (!bounded[i])
+            continue;
+        grid_cell_range(grid, centers[i], radii[i], lo, hi);
+        for (int z = lo[2]; z <= hi[2]; z++)
+            for (int y = lo[1]; y <= hi[1]; y++)
+                for (int x = lo[0]; x <= hi[0]; x++)
+                    grid->cell_items[cursor[((size_t)z * grid->res[1] + y) *
+                                                grid->res[0] +
+                                            x]++] = i;
+    }
+
+    rt_aligned_free(cursor);
+    rt_aligned_free(centers);
+    rt_aligned_free(radii);
+    rt_aligned_free(bounded);
+    return true;
+}
+
+void grid_free(accel_grid* grid) {
+    rt_aligned_free(grid->cell_start);
+    rt_aligned_free(grid->cell_items);
+    rtvec_u32_free(&grid->others);
+}
+
+/// Intersects the ray with the grid box, returns false on a miss
+static bool grid_clip(const accel_grid* grid, ray r, RT_FLOAT* t0,
+                      RT_FLOAT* t1) {
+    RT_FLOAT tmin = 0.0, tmax = FLT_MAX;
+    for (int a = 0; a < 3; a++) {
+        RT_FLOAT o = vec_axis(r.pos, a);
+        RT_FLOAT d = vec_axis(r.path, a);
+        RT_FLOAT lo = vec_axis(grid->min, a);
+        RT_FLOAT hi = vec_axis(grid->max, a);
+        if (d == 0.0) {
+            if (o < lo || o > hi)
+                return false;
+            continue;
+        }
+        RT_FLOAT ta = (lo - o) / d;
+        RT_FLOAT tb = (hi - o) / d;
+        if (ta > tb) {
+            RT_FLOAT tmp = ta;
+            ta = tb;
+            tb = tmp;
+        }
+        tmin = ta > tmin ? ta : tmin;
+        tmax = tb < tmax ? tb : tmax;
+        if (tmin > tmax)
+            return false;
+    }
+    *t0 = tmin;
+    *t1 = tmax;
+    return true;
+}
+
+bool grid_closest_hit(const void* impl, const body_rep** const bodies,
+                      size_t body_count, ray r, const body_rep* ignore,
+                      size_t* hit, RT_FLOAT* dist, vector3* norm) {
+    const accel_grid* grid = (const accel_grid*)impl;
+    const body_rep* ref;
+    bool found = false;
+    RT_FLOAT z, t0, t1;
+    vector3 n;
+
+    // Unbounded bodies first, their hit limits the grid walk
+    for (size_t o = 0; o < grid->others.count; o++) {
+        ref = bodies[grid->others.data[o]];
+        if (ref != ignore && ref->_col_impl(ref, r, &z, &n) &&
+            (!found || z < *dist)) {
+            found = true;
+            *hit = grid->others.data[o];
+            *dist = z;
+            *norm = n;
+        }
+    }
+
+    if (grid->bounded_count == 0 || !grid_clip(grid, r, &t0, &t1)) {
+        return found;
+    }
+    if (found && *dist < t0) {
+        return true;
+    }
+
+    // 3D-DDA setup (Amanatides & Woo)
+    vector3 p = ray_dist(r, t0);
+    int cell[3], step[3], res[3];
+    RT_FLOAT t_next[3], t_delta[3];
+    for (int a = 0; a < 3; a++) {
+        RT_FLOAT d = vec_axis(r.path, a);
+        RT_FLOAT size = vec_axis(grid->cell, a);
+        RT_FLOAT lo = vec_axis(grid->min, a);
+        res[a] = grid->res[a];
+        cell[a] = grid_cell(grid, vec_axis(p, a), a);
+        if (d > 0.0) {
+            step[a] = 1;
+            t_delta[a] = size / d;
+            t_next[a] = t0 + (lo + (cell[a] + 1) * size - vec_axis(p, a)) / d;
+        } else if (d < 0.0) {
+            step[a] = -1;
+            t_delta[a] = -size / d;
+            t_next[a] = t0 + (lo + cell[a] * size - vec_axis(p, a)) / d;
+        } else {
+            step[a] = 0;
+            t_delta[a] = FLT_MAX;
+            t_next[a] = FLT_MAX;
+        }
+    }
+
+    uint32_t mailbox[GRID_MAILBOX];
+    unsigned int mail_n = 0;
+
+    for (;;) {
+        size_t c = ((size_t)cell[2] * res[1] + cell[1]) * res[0] + cell[0];
+        for (uint32_t it = grid->cell_start[c]; it < grid->cell_start[c + 1];
+             it++) {
+            uint32_t b = grid->cell_items[it];
+            bool seen = false;
+            for (unsigned int m = 0; m < GRID_MAILBOX && m < mail_n; m++) {
+                if (mailbox[m] == b) {
+                    seen = true;
+                    break;
+                }
+            }
+            if (seen)
+                continue;
+            mailbox[mail_n++ % GRID_MAILBOX] = b;
+
+            ref = bodies[b];
+            if (ref != ignore && ref->_col_impl(ref, r, &z, &n) &&
+                (!found || z < *dist)) {
+                found = true;
+                *hit = b;
+                *dist = z;
+                *norm = n;
+            }
+        }
+
+        // Next cell is the one whose border is crossed first
+        int a = 0;
+        if (t_next[1] < t_next[a])
+            a = 1;
+        if (t_next[2] < t_next[a])
+            a = 2;
+
+        // A hit inside the cells walked so far can't be beaten
+        if (found && *dist <= t_next[a]) {
+            break;
+        }
+        if (t_next[a] > t1 || step[a] == 0) {
+            break;
+        }
+        cell[a] += step[a];
+        if (cell[a] < 0 || cell[a] >= res[a]) {
+            break;
+        }
+        t_next[a] += t_delta[a];
+    }
+    return found;
+}
+
+rt_accel grid_accel(const accel_grid* grid) {
+    rt_accel ret = {grid, &grid_closest_hit};
+    return ret;
+}
@@ -0,0 +1,58 @@
+#ifndef RAY_TRACE_GRID_H
+#define RAY_TRACE_GRID_H
+
+#include <include/body.h>
+#include <include/output.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Default target amount of cells per bounded body
+#define GRID_DENSITY 2.0
+/// Max cell count along one axis
+#define GRID_MAX_RES 512
+
+/** Uniform grid over the bounded bodies of a scene.
+ *
+ * Meant for many bodies of about the same size spread fairly evenly, e.g.
+ * particle fields. Building is O(n): a counting pass, a prefix sum and a fill
+ * pass. The cell lists are stored CSR style, all body indices in one array
+ * with the list of cell c at cell_items[cell_start[c] .. cell_start[c + 1]).
+ *
+ * Unbounded bodies (floors) are kept in a separate list and tested for every
+ * ray.
+ */
+typedef struct {
+    vector3 min;           ///< Lower corner of the grid
+    vector3 max;           ///< Upper corner of the grid
+    unsigned int res[3];   ///< Cell count per axis
+    vector3 cell;          ///< Cell size
+    vector3 inv_cell;      ///< 1 / cell size
+    uint32_t* cell_start;  ///< Cell list offsets, cell count + 1 entries
+    uint32_t* cell_items;  ///< Body indices of all cell lists
+    rtvec_u32 others;      ///< Indices of unbounded bodies
+    size_t bounded_count;  ///< Bodies in the grid
+} accel_grid;
+
+/** Builds the grid for the given body list. Queries must use the same list.
+ *
+ * @param density Target amount of cells per body, e.g. GRID_DENSITY
+ * @return false if out of memory, nothing needs to be freed then
+ */
+bool grid_build(accel_grid* grid, const body_rep** const bodies,
+                size_t body_count, RT_FLOAT density);
+
+/// Frees the grid
+void grid_free(accel_grid* grid);
+
+/// Closest hit query, same semantics as display_closest_hit(). \b impl is an
+/// accel_grid. Cells are walked with a 3D-DDA.
+bool grid_closest_hit(const void* impl, const body_rep** const bodies,
+                      size_t body_count, ray r, const body_rep* ignore,
+                      size_t* hit, RT_FLOAT* dist, vector3* norm);
+
+/// Acceleration structure handle for display.accel
+rt_accel grid_accel(const accel_grid* grid);
+
+#endif
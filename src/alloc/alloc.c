@@ -6,7 +6,7 @@
 #include <string.h>
 
 rtvec rtvec_alloc_n(size_t n, size_t size) {
-    void* data = malloc(n * size);
+    void* data = rt_malloc(MEM_ALLOC, n * size);
     rtvec ret = {0, n, data, size};
     return ret;
 }
@@ -15,17 +15,17 @@ rtvec rtvec_alloc(size_t size) {
     return rtvec_alloc_n(RTVEC_DEF_COUNT, size);
 }
 
-void rtvec_realloc(rtvec* vec, int n) {
+void rtvec_realloc(rtvec* vec, size_t n) {
     vec->max_data_count = n;
-    void* ptr = realloc(vec->data, n * vec->data_size);
+    void* ptr = rt_realloc(MEM_ALLOC, vec->data, n * vec->data_size);
     vec->data = ptr;
 }
 
 void rtvec_push(rtvec* vec, void* data) {
-    if (vec->max_data_count >= vec->data_count) {
+    if (vec->data_count >= vec->max_data_count) {
         // If vector is max size, expand the vector
-        int n = vec->max_data_count * RTVEC_DEF_EXP;
-        rtvec_realloc(vec, n);
+        size_t n = vec->max_data_count * RTVEC_DEF_EXP;
+        rtvec_realloc(vec, n > 0 ? n : RTVEC_DEF_COUNT);
     }
     size_t byte_count = vec->data_size * vec->data_count;
     void* end = vec->data + byte_count;
@@ -47,14 +47,14 @@ void* rtvec_end(const rtvec* const vec) {
 }
 
 void rtvec_free(rtvec* vec) {
-    free(vec->data);
+    rt_free(vec->data);
 }
 
-RT_RES rtvec_get(const rtvec* const vec, size_t n, void* ret) {
+RT_RES rtvec_get(const rtvec* const vec, size_t n, void** ret) {
     if (n >= vec->data_count) {
         RETURN_ERR(OUT_OF_BOUNDS);
     }
-    ret = vec->data + vec->data_count * vec->data_size;
+    *ret = vec->data + n * vec->data_size;
     RETURN_NOERROR;
 }
 
@@ -64,13 +64,17 @@ RT_RES rtdll_del(rtdll* ll, size_t n) {
         _n++;
         // Then we are at the node that must go
         if (_n == n) {
-            if (w->prev != NULL) {
-                w->prev->next = w->next;
+            // The head isn't from the slab
+            if (w == ll) {
+                break;
             }
+            w->prev->next = w->next;
             if (w->next != NULL) {
                 w->next->prev = w->prev;
+            } else {
+                ll->tail = w->prev != ll ? w->prev : NULL;
             }
-            free(w);
+            rtslab_release(ll->nodes, w);
             RETURN_NOERROR;
         }
     }
@@ -80,9 +84,11 @@ RT_RES rtdll_del(rtdll* ll, size_t n) {
 rtdll rtdll_new(void* data, size_t data_size) {
     rtdll ret;
     ret.next = NULL;
-    ret.next = NULL;
+    ret.prev = NULL;
     ret.data = data;
     ret.data_size = data_size;
+    ret.tail = NULL;
+    ret.nodes = NULL;
     return ret;
 }
 
@@ -94,20 +100,150 @@ rtdll rtdll_new_list(void* data, size_t data_size, size_t n) {
     return ret;
 }
 
-void rtdll_push(rtdll* ll, void* data, size_t data_size) {
-    rtdll* new = malloc(sizeof(*ll));
+bool rtdll_push(rtdll* ll, void* data, size_t data_size) {
+    if (ll->nodes == NULL) {
+        ll->nodes = rt_malloc(MEM_ALLOC, sizeof(rtslab));
+        if (ll->nodes == NULL) {
+            return false;
+        }
+        rtslab_init(ll->nodes, sizeof(rtdll), RTSLAB_DEF_COUNT);
+    }
+    rtdll* new = rtslab_alloc(ll->nodes);
+    if (new == NULL) {
+        return false;
+    }
     new->data_size = data_size;
     new->data = data;
+    new->next = NULL;
+    new->tail = NULL;
+    new->nodes = NULL;
 
-    // For iterating
-    rtdll* n;
-    DLL_ITER_EX(n, ll) {}
-    new->prev = n;
-    n->next = new;
+    rtdll* last = ll->tail != NULL ? ll->tail : ll;
+    new->prev = last;
+    last->next = new;
+    ll->tail = new;
+    return true;
 }
 
-void rtdll_push_list(rtdll* ll, void* data, size_t data_size, size_t n) {
+bool rtdll_push_list(rtdll* ll, void* data, size_t data_size, size_t n) {
     for (size_t i = 0; i < n; i++) {
-        rtdll_push(ll, data + i * data_size, data_size);
+        if (!rtdll_push(ll, data + i * data_size, data_size)) {
+            return false;
+        }
     }
+    return true;
+}
+
+void rtdll_free(rtdll* ll) {
+    if (ll->nodes != NULL) {
+        rtslab_free(ll->nodes);
+        rt_free(ll->nodes);
+    }
+    ll->next = NULL;
+    ll->tail = NULL;
+    ll->nodes = NULL;
+}
+
+void rtslab_init(rtslab* slab, size_t obj_size, size_t per_slab) {
+    // Released objects store the free list link in their first bytes
+    size_t align = RTSLAB_ALIGN;
+    if (obj_size < sizeof(void*))
+        obj_size = sizeof(void*);
+    slab->obj_size = (obj_size + align - 1) / align * align;
+    slab->per_slab = per_slab ? per_slab : RTSLAB_DEF_COUNT;
+    slab->slabs = NULL;
+    slab->free_list = NULL;
+    slab->bump = NULL;
+    slab->bump_end = NULL;
+}
+
+void* rtslab_alloc(rtslab* slab) {
+    void* ret;
+    if (slab->free_list != NULL) {
+        ret = slab->free_list;
+        slab->free_list = *(void**)ret;
+        return ret;
+    }
+    if (slab->bump == slab->bump_end) {
+        // New slab, with the link to the previous one in front of the
+        // objects. RT_ALIGN keeps the objects aligned after it.
+        size_t head = RT_ALIGN;
+        char* mem = rt_aligned_alloc(MEM_ALLOC,
+                                     head + slab->obj_size * slab->per_slab);
+        if (mem == NULL) {
+            return NULL;
+        }
+        *(void**)mem = slab->slabs;
+        slab->slabs = mem;
+        slab->bump = mem + head;
+        slab->bump_end = slab->bump + slab->obj_size * slab->per_slab;
+    }
+    ret = slab->bump;
+    slab->bump += slab->obj_size;
+    return ret;
+}
+
+void rtslab_release(rtslab* slab, void* obj) {
+    *(void**)obj = slab->free_list;
+    slab->free_list = obj;
+}
+
+void rtslab_free(rtslab* slab) {
+    void* s = slab->slabs;
+    while (s != NULL) {
+        void* next = *(void**)s;
+        rt_aligned_free(s);
+        s = next;
+    }
+    slab->slabs = NULL;
+    slab->free_list = NULL;
+    slab->bump = NULL;
+    slab->bump_end = NULL;
+}
+
+void rtlist_init(rtlist* list) {
+    list->head = NULL;
+    list->tail = NULL;
+    list->count = 0;
+    rtslab_init(&list->nodes, sizeof(rtlist_node), RTSLAB_DEF_COUNT);
+}
+
+rtlist_node* rtlist_push(rtlist* list, void* data) {
+    rtlist_node* node = rtslab_alloc(&list->nodes);
+    if (node == NULL) {
+        return NULL;
+    }
+    node->data = data;
+    node->next = NULL;
+    node->prev = list->tail;
+    if (list->tail != NULL) {
+        list->tail->next = node;
+    } else {
+        list->head = node;
+    }
+    list->tail = node;
+    list->count++;
+    return node;
+}
+
+void rtlist_remove(rtlist* list, rtlist_node* node) {
+    if (node->prev != NULL) {
+        node->prev->next = node->next;
+    } else {
+        list->head = node->next;
+    }
+    if (node->next != NULL) {
+        node->next->prev = node->prev;
+    } else {
+        list->tail = node->prev;
+    }
+    list->count--;
+    rtslab_release(&list->nodes, node);
+}
+
+void rtlist_free(rtlist* list) {
+    rtslab_free(&list->nodes);
+    list->head = NULL;
+    list->tail = NULL;
+    list->count = 0;
 }
@@ -1,11 +1,32 @@
 #ifndef RAY_TRACE_ALLOC_H
 #define RAY_TRACE_ALLOC_H
 
+#include "mem.h"
 #include <include/errors.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
-#define RTVEC_DEF_COUNT 10
-#define RTVEC_DEF_EXP 1.25
+#define RTVEC_DEF_COUNT 16
+/// Growth factor of all vectors, a full vector doubles its capacity
+#define RTVEC_DEF_EXP 2
+
+/// Alignment of the storage of typed vectors, one cache line (and wide enough
+/// for any SIMD load)
+#define RT_ALIGN 64
+
+/// Allocates \b size bytes aligned to RT_ALIGN, accounted to \b tag. Free
+/// with rt_aligned_free() or rt_free().
+void* rt_aligned_alloc(rt_mem_tag tag, size_t size);
+
+/// Moves an RT_ALIGN aligned block to a new block of \b new_size bytes,
+/// keeping the first \b old_size bytes. Returns NULL and keeps \b ptr if
+/// the new block can't be allocated.
+void* rt_aligned_realloc(rt_mem_tag tag, void* ptr, size_t old_size,
+                         size_t new_size);
+
+/// Frees memory from rt_aligned_alloc()
+void rt_aligned_free(void* ptr);
 
 /// Resizeable vector type
 typedef struct {
@@ -20,7 +41,7 @@ rtvec rtvec_alloc_n(size_t n, size_t size);
 /// Initialize new rtvec type.
 rtvec rtvec_alloc(size_t size);
 /// Reallocate vector and resize.
-void rtvec_realloc(rtvec* vec, int n);
+void rtvec_realloc(rtvec* vec, size_t n);
 /// Push data (data is copied)
 void rtvec_push(rtvec* vec, void* data);
 
@@ -40,17 +61,178 @@ void* rtvec_end(const rtvec* const vec);
 void rtvec_free(rtvec* vec);
 
 /// Set result parameter to pointer to the nth index
-RT_RES rtvec_get(const rtvec* const vec, size_t n, void* ret);
+RT_RES rtvec_get(const rtvec* const vec, size_t n, void** ret);
+
+/** Defines a vector type \b name holding \b type values, with inline
+ * functions prefixed by \b name.
+ *
+ * Unlike rtvec, the element type is known at compile time so pushes are plain
+ * stores, and the storage is aligned to RT_ALIGN so it can back SIMD SoA
+ * buffers. Capacity grows geometrically (RTVEC_DEF_EXP). The storage is
+ * accounted to the tag given to name##_new(). Growing can fail: reserve and
+ * resize return false and push returns NULL, leaving the vector as it was.
+ *
+ * Example:
+ * @code
+ * RTVEC_DEFINE(rtvec_f, float)
+ * rtvec_f v = rtvec_f_new(MEM_ALLOC);
+ * if (rtvec_f_reserve(&v, 1000))
+ *     rtvec_f_push(&v, 1.0f);
+ * rtvec_f_free(&v);
+ * @endcode
+ */
+#define RTVEC_DEFINE(name, type)                                               \
+    typedef struct {                                                           \
+        type* data;   /**< Elements, RT_ALIGN aligned */                       \
+        size_t count; /**< Element count */                                    \
+        size_t cap;   /**< Allocated element count */                          \
+        rt_mem_tag tag; /**< Tag the storage is accounted to */                \
+    } name;                                                                    \
+                                                                               \
+    static inline name name##_new(rt_mem_tag tag) {                            \
+        name ret = {NULL, 0, 0, tag};                                          \
+        return ret;                                                            \
+    }                                                                          \
+                                                                               \
+    /* Makes room for at least n elements, false (and the old storage kept)    \
+     * if out of memory */                                                     \
+    static inline bool name##_reserve(name* vec, size_t n) {                   \
+        if (n <= vec->cap)                                                     \
+            return true;                                                       \
+        type* data = (type*)rt_aligned_realloc(vec->tag, vec->data,            \
+                                               vec->count * sizeof(type),      \
+                                               n * sizeof(type));              \
+        if (data == NULL)                                                      \
+            return false;                                                      \
+        vec->data = data;                                                      \
+        vec->cap = n;                                                          \
+        return true;                                                           \
+    }                                                                          \
+                                                                               \
+    /* Grows geometrically so pushes are amortized O(1) */                     \
+    static inline bool name##_grow(name* vec, size_t n) {                      \
+        if (n <= vec->cap)                                                     \
+            return true;                                                       \
+        size_t cap = vec->cap ? vec->cap * RTVEC_DEF_EXP : RTVEC_DEF_COUNT;    \
+        return name##_reserve(vec, cap > n ? cap : n);                         \
+    }                                                                          \
+                                                                               \
+    /* Pointer to the new element, NULL if out of memory */                    \
+    static inline type* name##_push(name* vec, type val) {                     \
+        if (!name##_grow(vec, vec->count + 1))                                 \
+            return NULL;                                                       \
+        vec->data[vec->count] = val;                                           \
+        return &vec->data[vec->count++];                                       \
+    }                                                                          \
+                                                                               \
+    /* Sets the count, new elements are uninitialized. False if out of         \
+     * memory, the count is unchanged then */                                  \
+    static inline bool name##_resize(name* vec, size_t n) {                    \
+        if (!name##_grow(vec, n))                                              \
+            return false;                                                      \
+        vec->count = n;                                                        \
+        return true;                                                           \
+    }                                                                          \
+                                                                               \
+    static inline void name##_pop(name* vec) {                                 \
+        vec->count--;                                                          \
+    }                                                                          \
+                                                                               \
+    static inline void name##_clear(name* vec) {                               \
+        vec->count = 0;                                                        \
+    }                                                                          \
+                                                                               \
+    static inline void name##_free(name* vec) {                                \
+        rt_aligned_free(vec->data);                                            \
+        vec->data = NULL;                                                      \
+        vec->count = 0;                                                        \
+        vec->cap = 0;                                                          \
+    }
+
+RTVEC_DEFINE(rtvec_u32, uint32_t)
+RTVEC_DEFINE(rtvec_f, float)
+
+/// Default object count per slab
+#define RTSLAB_DEF_COUNT 256
+
+/// Alignment of slab objects, enough for any scalar and for vector3
+#define RTSLAB_ALIGN                                                           \
+    (_Alignof(max_align_t) > 16 ? _Alignof(max_align_t) : 16)
+
+/** Fixed size object allocator.
+ *
+ * Objects are carved out of big slabs instead of being malloc()ed one by one,
+ * and released objects are kept on a free list for reuse. Every object is
+ * RTSLAB_ALIGN aligned. Everything is freed at once with rtslab_free().
+ */
+typedef struct rtslab {
+    size_t obj_size; ///< Size of one object, a multiple of RTSLAB_ALIGN
+    size_t per_slab; ///< Objects per slab
+    void* slabs;     ///< Slab list, linked through the first pointer
+    void* free_list; ///< Released objects, linked through their first bytes
+    char* bump;      ///< Next unused object of the newest slab
+    char* bump_end;  ///< End of the newest slab
+} rtslab;
+
+/// Initializes the allocator for objects of \b obj_size bytes
+void rtslab_init(rtslab* slab, size_t obj_size, size_t per_slab);
+
+/// Returns an uninitialized object, NULL if out of memory
+void* rtslab_alloc(rtslab* slab);
 
-/// Doubly linked list
+/// Gives an object back for reuse
+void rtslab_release(rtslab* slab, void* obj);
+
+/// Frees every slab, and so every object
+void rtslab_free(rtslab* slab);
+
+/// Node of rtlist
+typedef struct rtlist_node {
+    struct rtlist_node* next; ///< Next node, NULL at the tail
+    struct rtlist_node* prev; ///< Previous node, NULL at the head
+    void* data;               ///< Ptr to data (not owned)
+} rtlist_node;
+
+/// Doubly linked list with O(1) append whose nodes come from a slab
+typedef struct {
+    rtlist_node* head; ///< First node
+    rtlist_node* tail; ///< Last node
+    size_t count;      ///< Node count
+    rtslab nodes;      ///< Node allocator
+} rtlist;
+
+/// Creates an empty list
+void rtlist_init(rtlist* list);
+
+/// Appends data to the end of the list in O(1), NULL if out of memory
+rtlist_node* rtlist_push(rtlist* list, void* data);
+
+/// Removes the node in O(1), the node goes back to the slab
+void rtlist_remove(rtlist* list, rtlist_node* node);
+
+/// Frees every node
+void rtlist_free(rtlist* list);
+
+/// Iterator macro for rtlist
+#define RTLIST_ITER(n, list)                                                   \
+    for (rtlist_node* n = (list)->head; n != NULL; n = n->next)
+
+/** Doubly linked list whose first node is a value kept by the caller.
+ *
+ * The head also keeps the tail, so pushes are O(1), and a slab the pushed
+ * nodes come from. Free them with rtdll_free(). See rtlist for a list that
+ * doesn't treat its first item differently.
+ */
 typedef struct rtdll {
-    struct rtdll* next; ///< Next item
-    struct rtdll* prev; ///< Previous item
-    void* data;         ///<  Ptr to data
-    size_t data_size;   ///< sizeof(data)
+    struct rtdll* next;   ///< Next item
+    struct rtdll* prev;   ///< Previous item
+    void* data;           ///<  Ptr to data
+    size_t data_size;     ///< sizeof(data)
+    struct rtdll* tail;   ///< Last item, NULL for the head. Head only.
+    struct rtslab* nodes; ///< Allocator of the pushed items. Head only.
 } rtdll;
 
-/// Delete nth element
+/// Delete nth element. The head itself (n = 1) can't be deleted.
 RT_RES rtdll_del(rtdll* ll, size_t n);
 
 /// Generate a new rtdll from just data
@@ -59,11 +241,14 @@ rtdll rtdll_new(void* data, size_t data_size);
 /// Generate a new rtdll from a list of data.
 rtdll rtdll_new_list(void* data, size_t data_size, size_t n);
 
-/// Push one data
-void rtdll_push(rtdll* ll, void* data, size_t data_size);
+/// Push one data in O(1). False if out of memory.
+bool rtdll_push(rtdll* ll, void* data, size_t data_size);
+
+/// Push a list of items. False if out of memory, the items before stay.
+bool rtdll_push_list(rtdll* ll, void* data, size_t data_size, size_t n);
 
-/// Push a list of items. Generates a new doubly linked list object per data.
-void rtdll_push_list(rtdll* ll, void* data, size_t data_size, size_t n);
+/// Frees every pushed item, the head is left alone
+void rtdll_free(rtdll* ll);
 
 /// Iterator macro for doubly linked list
 #define DLL_ITER(n, head) for (rtdll* n = head; n->next != NULL; n = n->next)
@@ -0,0 +1,212 @@
+#include "mem.h"
+#include "alloc.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Header in front of every accounted block
+typedef struct {
+    size_t size;     ///< Requested size
+    uint32_t tag;    ///< rt_mem_tag
+    uint32_t offset; ///< Distance from the malloc()ed base to the user pointer
+} rt_mem_head;
+
+/// Plain blocks keep malloc()'s 16 byte alignment
+#define RT_MEM_HEAD 16
+
+typedef struct {
+    atomic_size_t current;
+    atomic_size_t peak;
+    atomic_size_t allocs;
+    atomic_size_t frees;
+} rt_mem_counter;
+
+static rt_mem_counter rt_mem_counters[MEM_TAG_COUNT];
+static rt_mem_counter rt_mem_all;
+
+static const char* rt_mem_names[MEM_TAG_COUNT] = {
+    "alloc", "body", "texture", "output", "math", "accel", "render", "sched",
+    "ooc", "prof",
+};
+
+#ifdef RT_NO_MEMSTATS
+
+void* rt_malloc(rt_mem_tag tag, size_t size) {
+    return malloc(size);
+}
+
+void* rt_calloc(rt_mem_tag tag, size_t n, size_t size) {
+    return calloc(n, size);
+}
+
+void* rt_realloc(rt_mem_tag tag, void* ptr, size_t size) {
+    return realloc(ptr, size);
+}
+
+void rt_free(void* ptr) {
+    free(ptr);
+}
+
+void* rt_aligned_alloc(rt_mem_tag tag, size_t size) {
+    void* ptr = NULL;
+    // posix_memalign doesn't like 0
+    if (posix_memalign(&ptr, RT_ALIGN, size ? size : RT_ALIGN) != 0) {
+        return NULL;
+    }
+    return ptr;
+}
+
+#else
+
+/// Raises the peak to at least \b val
+static void rt_mem_peak(atomic_size_t* peak, size_t val) {
+    size_t old = atomic_load_explicit(peak, memory_order_relaxed);
+    while (old < val && !atomic_compare_exchange_weak_explicit(
+                            peak, &old, val, memory_order_relaxed,
+                            memory_order_relaxed)) {
+    }
+}
+
+static void rt_mem_add(rt_mem_counter* c, size_t size) {
+    size_t now =
+        atomic_fetch_add_explicit(&c->current, size, memory_order_relaxed) +
+        size;
+    atomic_fetch_add_explicit(&c->allocs, 1, memory_order_relaxed);
+    rt_mem_peak(&c->peak, now);
+}
+
+static void rt_mem_sub(rt_mem_counter* c, size_t size) {
+    atomic_fetch_sub_explicit(&c->current, size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->frees, 1, memory_order_relaxed);
+}
+
+static void rt_mem_track(rt_mem_tag tag, size_t size) {
+    rt_mem_add(&rt_mem_counters[tag], size);
+    rt_mem_add(&rt_mem_all, size);
+}
+
+static void rt_mem_untrack(rt_mem_tag tag, size_t size) {
+    rt_mem_sub(&rt_mem_counters[tag], size);
+    rt_mem_sub(&rt_mem_all, size);
+}
+
+/// Fills in the header of a fresh block and returns the user pointer
+static void* rt_mem_init(void* base, rt_mem_tag tag, size_t size,
+                         uint32_t offset) {
+    char* ptr = (char*)base + offset;
+    rt_mem_head* head = (rt_mem_head*)(ptr - sizeof(rt_mem_head));
+    head->size = size;
+    head->tag = tag;
+    head->offset = offset;
+    rt_mem_track(tag, size);
+    return ptr;
+}
+
+static rt_mem_head* rt_mem_head_of(void* ptr) {
+    return (rt_mem_head*)((char*)ptr - sizeof(rt_mem_head));
+}
+
+void* rt_malloc(rt_mem_tag tag, size_t size) {
+    void* base = malloc(size + RT_MEM_HEAD);
+    if (base == NULL) {
+        return NULL;
+    }
+    return rt_mem_init(base, tag, size, RT_MEM_HEAD);
+}
+
+void* rt_calloc(rt_mem_tag tag, size_t n, size_t size) {
+    void* base = calloc(n * size + RT_MEM_HEAD, 1);
+    if (base == NULL) {
+        return NULL;
+    }
+    return rt_mem_init(base, tag, n * size, RT_MEM_HEAD);
+}
+
+void* rt_realloc(rt_mem_tag tag, void* ptr, size_t size) {
+    if (ptr == NULL) {
+        return rt_malloc(tag, size);
+    }
+    rt_mem_head* head = rt_mem_head_of(ptr);
+    rt_mem_tag old_tag = head->tag;
+    size_t old_size = head->size;
+    void* base = realloc((char*)ptr - RT_MEM_HEAD, size + RT_MEM_HEAD);
+    if (base == NULL) {
+        return NULL;
+    }
+    rt_mem_untrack(old_tag, old_size);
+    return rt_mem_init(base, tag, size, RT_MEM_HEAD);
+}
+
+void rt_free(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    rt_mem_head* head = rt_mem_head_of(ptr);
+    rt_mem_untrack(head->tag, head->size);
+    free((char*)ptr - head->offset);
+}
+
+void* rt_aligned_alloc(rt_mem_tag tag, size_t size) {
+    void* base = NULL;
+    // The header takes a whole RT_ALIGN block in front of the data
+    if (posix_memalign(&base, RT_ALIGN, size + RT_ALIGN) != 0) {
+        return NULL;
+    }
+    return rt_mem_init(base, tag, size, RT_ALIGN);
+}
+
+#endif
+
+void* rt_aligned_realloc(rt_mem_tag tag, void* ptr, size_t old_size,
+                         size_t new_size) {
+    void* ret = rt_aligned_alloc(tag, new_size);
+    // Like realloc(), a failure leaves the old block alone
+    if (ret == NULL) {
+        return NULL;
+    }
+    if (ptr != NULL) {
+        memcpy(ret, ptr, old_size < new_size ? old_size : new_size);
+        rt_free(ptr);
+    }
+    return ret;
+}
+
+void rt_aligned_free(void* ptr) {
+    rt_free(ptr);
+}
+
+static rt_mem_stat rt_mem_load(rt_mem_counter* c) {
+    rt_mem_stat ret = {atomic_load(&c->current), atomic_load(&c->peak),
+                       atomic_load(&c->allocs), atomic_load(&c->frees)};
+    return ret;
+}
+
+rt_mem_stat rt_mem_get(rt_mem_tag tag) {
+    return rt_mem_load(&rt_mem_counters[tag]);
+}
+
+rt_mem_stat rt_mem_total(void) {
+    return rt_mem_load(&rt_mem_all);
+}
+
+const char* rt_mem_tag_name(rt_mem_tag tag) {
+    return rt_mem_names[tag];
+}
+
+void rt_mem_report(FILE* fd) {
+    rt_mem_stat s;
+    fprintf(fd, "%-8s %14s %14s %10s %10s\n", "memory", "current", "peak",
+            "allocs", "frees");
+    for (int t = 0; t < MEM_TAG_COUNT; t++) {
+        s = rt_mem_get(t);
+        if (s.allocs == 0) {
+            continue;
+        }
+        fprintf(fd, "%-8s %14zu %14zu %10zu %10zu\n", rt_mem_names[t],
+                s.current, s.peak, s.allocs, s.frees);
+    }
+    s = rt_mem_total();
+    fprintf(fd, "%-8s %14zu %14zu %10zu %10zu\n", "total", s.current, s.peak,
+            s.allocs, s.frees);
+}
@@ -0,0 +1,61 @@
+#ifndef RAY_TRACE_MEM_H
+#define RAY_TRACE_MEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/// Subsystem an allocation is accounted to
+typedef enum {
+    MEM_ALLOC,   ///< Generic containers (src/alloc)
+    MEM_BODY,    ///< Body data
+    MEM_TEXTURE, ///< Texture data
+    MEM_OUTPUT,  ///< Framebuffers and writers
+    MEM_MATH,    ///< Matrices
+    MEM_ACCEL,   ///< Acceleration structures
+    MEM_RENDER,  ///< Render contexts
+    MEM_SCHED,   ///< Thread pools
+    MEM_OOC,     ///< Out-of-core scene data
+    MEM_PROF,    ///< Timeline ring buffers
+    MEM_TAG_COUNT,
+} rt_mem_tag;
+
+/// Counters of one tag
+typedef struct {
+    size_t current; ///< Bytes currently allocated
+    size_t peak;    ///< Highest value \b current has had
+    size_t allocs;  ///< Allocation count
+    size_t frees;   ///< Free count
+} rt_mem_stat;
+
+/** Accounted allocation functions.
+ *
+ * Every block carries a small header with its size and tag, so that freeing
+ * doesn't need either. Counters are updated with relaxed atomics, which is
+ * nothing next to the malloc() call itself. Building with RT_NO_MEMSTATS
+ * turns these into the plain libc functions and the stats stay zero.
+ *
+ * Memory from these must be freed with rt_free(), never with free().
+ */
+void* rt_malloc(rt_mem_tag tag, size_t size);
+/// calloc() counterpart of rt_malloc()
+void* rt_calloc(rt_mem_tag tag, size_t n, size_t size);
+/// realloc() counterpart of rt_malloc(). \b ptr may be NULL but must not come
+/// from rt_aligned_alloc().
+void* rt_realloc(rt_mem_tag tag, void* ptr, size_t size);
+/// Frees memory from any of the rt_*alloc() functions, NULL is fine
+void rt_free(void* ptr);
+
+/// Counters of one tag
+rt_mem_stat rt_mem_get(rt_mem_tag tag);
+
+/// Counters over all tags. The peak is the highest total, not a sum of peaks.
+rt_mem_stat rt_mem_total(void);
+
+/// Name of the tag, e.g. "body"
+const char* rt_mem_tag_name(rt_mem_tag tag);
+
+/// Writes a table of every tag's counters
+void rt_mem_report(FILE* fd);
+
+#endif
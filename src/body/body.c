@@ -9,13 +9,17 @@
 
 bool sphere_col(const body_rep* const body, const ray r, RT_FLOAT* dist,
                 vector3* norm) {
+    return sphere_hit((const body_sphere*)body->body, r, dist, norm);
+}
+
+bool sphere_hit(const body_sphere* const sph, const ray r, RT_FLOAT* dist,
+                vector3* norm) {
     // First collision distance to ray origin
     RT_FLOAT d_col1, d_col2;
     // Second collision distance to ray origin
     // Point of the first collision
     vector3 p_col;
 
-    body_sphere* sph = (body_sphere*)body->body;
     const vector3 D = r.path;
     const vector3 Q = r.pos;
     const vector3 C = sph->center;
@@ -28,36 +32,46 @@ bool sphere_col(const body_rep* const body, const ray r, RT_FLOAT* dist,
     RT_FLOAT c = vec_dot(oc, oc) - R * R;
     RT_FLOAT disc = b * b - 4 * a * c;
     if (disc >= 0) {
-        d_col1 = (-b - sqrt(disc)) / (2 * a);
-        d_col2 = (-b + sqrt(disc)) / (2 * a);
+        RT_FLOAT root = rt_sqrt_fast(disc);
+        d_col1 = (-b - root) / (2 * a);
+        d_col2 = (-b + root) / (2 * a);
         if (d_col1 < 0.0) {
             if (d_col2 < 0.0) {
                 return false;
             } else {
                 p_col = ray_dist(r, d_col2);
                 *dist = d_col2;
-                *norm = vec_norm(vec_sub(p_col, C));
+                *norm = vec_norm_fast(vec_sub(p_col, C));
                 return true;
             }
         }
         p_col = ray_dist(r, d_col1);
         *dist = d_col1;
-        *norm = vec_norm(vec_sub(p_col, C));
+        *norm = vec_norm_fast(vec_sub(p_col, C));
 
         return true;
     }
     return false;
 }
 
+bool sphere_bounds(const body_rep* const body, vector3* center,
+                   RT_FLOAT* radius) {
+    body_sphere* sph = (body_sphere*)body->body;
+    *center = sph->center;
+    *radius = sph->R;
+    return true;
+}
+
 body_rep body_sphere_new(vector3 center, RT_FLOAT radius, ray_texture tex) {
     size_t sph_s = sizeof(body_sphere);
     body_sphere* sph;
 
-    sph = (body_sphere*)malloc(sph_s);
+    sph = (body_sphere*)rt_malloc(MEM_BODY, sph_s);
     sph->center = center;
     sph->R = radius;
 
-    body_rep ret = {(void*)sph, sph_s, tex, &sphere_col, &free_generic_impl};
+    body_rep ret = {(void*)sph, sph_s, tex, &sphere_col, &free_rt_impl,
+                    &sphere_bounds};
 
     return ret;
 }
@@ -66,9 +80,10 @@ body_rep body_floor_new(RT_FLOAT y, ray_texture tex) {
     size_t flr_s = sizeof(body_floor);
     body_floor* flr;
 
-    flr = (body_floor*)malloc(flr_s);
+    flr = (body_floor*)rt_malloc(MEM_BODY, flr_s);
     flr->height = y;
-    body_rep ret = {(void*)flr, flr_s, tex, &floor_col, &free_generic_impl};
+    body_rep ret = {(void*)flr, flr_s, tex, &floor_col, &free_rt_impl,
+                    &floor_bounds};
 
     return ret;
 }
@@ -104,8 +119,18 @@ bool floor_col(const body_rep* const body, const ray r, RT_FLOAT* dist,
     return false;
 }
 
+bool floor_bounds(const body_rep* const body, vector3* center,
+                  RT_FLOAT* radius) {
+    return false;
+}
+
+bool body_bounds(const body_rep* const body, vector3* center,
+                 RT_FLOAT* radius) {
+    return body->_bounds_impl(body, center, radius);
+}
+
 void body_free(body_rep* body) {
-    free(body->body);
+    body->impl_free(body->body);
     texture_free(&body->tex);
 }
 
@@ -120,7 +145,8 @@ bool body_ray_col(const body_rep* const body, const ray ray_in,
 
         // Calculate reflected ray
         point = ray_dist(ray_in, *dist);
-        reflect = vec_refl_diff(ray_in.path, *norm, body->tex.diffusivity);
+        reflect =
+            brdf_sample_dir(ray_in.path, *norm, body->tex.diffusivity).dir;
 
         // Form new reflected ray
         *refl_ray = ray_new(point, reflect);
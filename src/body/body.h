@@ -5,6 +5,7 @@
 #include <stddef.h>
 
 // 3D rectangular prism body
+#include <include/alloc.h>
 #include <include/math.h>
 #include <include/texture.h>
 #include <include/util.h>
@@ -48,7 +49,18 @@ typedef struct body_rep {
     bool (*_col_impl)(
         const struct body_rep* const body, const ray r, RT_FLOAT* dist,
         vector3* norm); ///< Collision function implementation. DONT call.
-    void (*impl_free)(void* impl); ///< Body free function
+    /// Body free function, free_generic_impl() for a malloc() body
+    void (*impl_free)(void* impl);
+    /** Bounding sphere function
+     *
+     * @param body Pointer to body for the function to use
+     * @param center Set to the center of the bounding sphere
+     * @param radius Set to the radius of the bounding sphere
+     * @return false if the body is unbounded (e.g. a floor)
+     */
+    bool (*_bounds_impl)(const struct body_rep* const body, vector3* center,
+                         RT_FLOAT* radius); ///< Bounds implementation. DONT
+                                            ///< call, see body_bounds().
 } body_rep;
 
 /// Spherical body geometric data
@@ -68,6 +80,14 @@ body_rep body_sphere_new(vector3 center, RT_FLOAT radius, ray_texture tex);
 bool sphere_col(const body_rep* const body, const ray r, RT_FLOAT* dist,
                 vector3* norm);
 
+/// sphere_col() on bare sphere data, for code that stores spheres without a
+/// body_rep
+bool sphere_hit(const body_sphere* const sph, const ray r, RT_FLOAT* dist,
+                vector3* norm);
+
+bool sphere_bounds(const body_rep* const body, vector3* center,
+                   RT_FLOAT* radius);
+
 typedef struct {
     RT_FLOAT height;
 } body_floor;
@@ -77,7 +97,24 @@ body_rep body_floor_new(RT_FLOAT y, ray_texture tex);
 bool floor_col(const body_rep* const body, const ray r, RT_FLOAT* dist,
                vector3* norm);
 
-/**  Frees the body pointer
+/// Floors are infinite, so this always returns false
+bool floor_bounds(const body_rep* const body, vector3* center,
+                  RT_FLOAT* radius);
+
+/** Gets a sphere that encloses the whole body.
+ *
+ * @return false if the body has no finite bounds, in which case \b center and
+ * \b radius are left untouched.
+ */
+bool body_bounds(const body_rep* const body, vector3* center,
+                 RT_FLOAT* radius);
+
+/// Vector of bodies, for building scenes
+RTVEC_DEFINE(rtvec_body, body_rep)
+/// Vector of body pointers, the list form the tracer takes
+RTVEC_DEFINE(rtvec_body_ptr, const body_rep*)
+
+/**  Frees the body pointer with its \b impl_free and its texture
  *
  * @param body Body to be freed
  */
@@ -25,6 +25,9 @@ typedef enum {
     OUT_OF_BOUNDS,
     INCOMPATIBLE_MATRIX,
     INCOMPATIBLE_VECTOR,
+    FILE_ERROR,
+    PARSE_ERROR,
+    OUT_OF_MEMORY,
 } RT_RES_TYPE;
 
 /// Result type struct that also holds information about where it is declared.
@@ -68,6 +71,24 @@ typedef struct {
         fprintf(stderr, "---- ERROR ----\n\n");                                \
     }
 
+/// Checks that are only worth paying for while debugging (e.g. per element
+/// bounds checks) are enabled with RT_CHECKS. Debug builds always have them.
+#if defined(RT_DEBUG) && !defined(RT_CHECKS)
+#define RT_CHECKS 1
+#endif
+
+/** Returns the given error if \b cond is false, but only if RT_CHECKS is
+ * defined. Otherwise it compiles to nothing, so it is fine to use on hot
+ * paths.
+ */
+#ifdef RT_CHECKS
+#define RT_CHECK(cond, type)                                                   \
+    if (!(cond))                                                               \
+        RETURN_ERR(type)
+#else
+#define RT_CHECK(cond, type)
+#endif
+
 /// fprintf wrapper if RT_DEBUG=1, else it is just nothing
 #ifdef RT_DEBUG
 #define DEBUG_PRINT(fd, msg) fprintf(fd, "%s\n", msg);
@@ -0,0 +1,7 @@
+#ifndef RAY_TRACE_INCL_ACCEL_H
+#define RAY_TRACE_INCL_ACCEL_H
+
+#include <accel/accel.h>
+#include <accel/grid.h>
+
+#endif
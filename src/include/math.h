@@ -1,6 +1,7 @@
 #ifndef RAY_TRACE_INCL_MATH_H
 #define RAY_TRACE_INCL_MATH_H
 
+#include <math/brdf.h>
 #include <math/matrix.h>
 #include <math/ray.h>
 #include <math/vec_mat.h>
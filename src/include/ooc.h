@@ -0,0 +1,6 @@
+#ifndef RAY_TRACE_INCL_OOC_H
+#define RAY_TRACE_INCL_OOC_H
+
+#include <ooc/ooc.h>
+
+#endif
@@ -2,5 +2,9 @@
 #define RAY_TRACE_INCL_OUTPUT_H
 
 #include <output/output.h>
+#include <output/encode.h>
+#include <output/incremental.h>
+#include <output/pipeline.h>
+#include <output/temporal.h>
 
 #endif
@@ -0,0 +1,6 @@
+#ifndef RAY_TRACE_INCL_PROF_H
+#define RAY_TRACE_INCL_PROF_H
+
+#include <prof/prof.h>
+
+#endif
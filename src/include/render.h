@@ -0,0 +1,10 @@
+#ifndef RAY_TRACE_INCL_RENDER_H
+#define RAY_TRACE_INCL_RENDER_H
+
+#include <render/budget.h>
+#include <render/context.h>
+#include <render/multiview.h>
+#include <render/progressive.h>
+#include <render/wavefront.h>
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef RAY_TRACE_INCL_SAMPLE_H
+#define RAY_TRACE_INCL_SAMPLE_H
+
+#include <sample/sampler.h>
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef RAY_TRACE_INCL_SCENE_H
+#define RAY_TRACE_INCL_SCENE_H
+
+#include <scene/compiled.h>
+#include <scene/scene.h>
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef RAY_TRACE_INCL_SCHED_H
+#define RAY_TRACE_INCL_SCHED_H
+
+#include <sched/pool.h>
+
+#endif
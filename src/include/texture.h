@@ -2,5 +2,6 @@
 #define RAY_TRACE_INCL_TEXTURE_H
 
 #include <texture/texture.h>
+#include <texture/envmap.h>
 
 #endif
@@ -1,6 +1,7 @@
 #ifndef RAY_TRACE_INCL_UTIL_H
 #define RAY_TRACE_INCL_UTIL_H
 
+#include <util/rng.h>
 #include <util/type.h>
 #include <util/util.h>
 
@@ -1,11 +1,11 @@
 #include "body/body.h"
 #include "output/output.h"
+#include <include/alloc.h>
 #include <include/body.h>
 #include <include/math.h>
 #include <include/output.h>
 #include <include/texture.h>
 #include <include/util.h>
-#include <string.h>
 
 int main() {
     body_rep sph1 = body_sphere_new(
@@ -28,12 +28,12 @@ int main() {
 
     const body_rep* bodies[] = {&sph1, &sph2, &sph3, &sph4, &sph5, &flr1};
 
-    char* out = "./test.ppm";
-    disp_ppm writer = {out, strlen(out)};
-    display dp = display_init(1920, 1080, 60.0, vec_zero(), &writer, &ppm_out,
+    // Rows are written as P6 by a background thread while tracing goes on
+    disp_file writer = {"./test.ppm"};
+    display dp = display_init(1920, 1080, 60.0, vec_zero(), &writer, &p6_out,
                               &no_free_func);
-    display_run_rays(&dp, bodies, 6);
-    display_write(&dp);
+    display_run_rays_pipelined(&dp, bodies, 6, stream_p6(&writer));
+    rt_mem_report(stdout);
 
     // NOTE: ADD FREE CODE!!!!! QWEKQEQEKWQELMWA
     display_free(&dp);
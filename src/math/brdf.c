@@ -0,0 +1,99 @@
+#include "brdf.h"
+
+#include <math.h>
+
+/// Orthonormal basis around n (Duff et al., "Building an Orthonormal Basis,
+/// Revisited", 2017)
+static void brdf_basis(vector3 n, vector3* t, vector3* b) {
+    RT_FLOAT sign = rt_copysign(1.0f, n.k);
+    RT_FLOAT a = -1.0f / (sign + n.k);
+    RT_FLOAT c = n.i * n.j * a;
+    *t = vec3(1.0f + sign * n.i * n.i * a, sign * c, -sign * n.i);
+    *b = vec3(c, sign + n.j * n.j * a, -n.j);
+}
+
+/// Local (x, y, z) around the normal to world space
+static inline vector3 brdf_world(vector3 t, vector3 b, vector3 n, RT_FLOAT x,
+                                 RT_FLOAT y, RT_FLOAT z) {
+    return vec3(t.i * x + b.i * y + n.i * z, t.j * x + b.j * y + n.j * z,
+                t.k * x + b.k * y + n.k * z);
+}
+
+/// GGX normal distribution
+static inline RT_FLOAT brdf_ggx_d(RT_FLOAT a2, RT_FLOAT cos_h) {
+    RT_FLOAT d = cos_h * cos_h * (a2 - 1.0f) + 1.0f;
+    return a2 / ((RT_FLOAT)M_PI * d * d);
+}
+
+/// Smith masking of one direction for GGX
+static inline RT_FLOAT brdf_ggx_g1(RT_FLOAT a2, RT_FLOAT cos_w) {
+    return 2.0f * cos_w /
+           (cos_w + rt_sqrt(a2 + (1.0f - a2) * cos_w * cos_w));
+}
+
+RT_FLOAT brdf_eval(vector3 in, vector3 norm, RT_FLOAT diffusivity,
+                   vector3 out, RT_FLOAT* pdf) {
+    *pdf = 0.0f;
+    if (vec_dot(in, norm) > 0.0f) {
+        norm = vec_mul(-1.0f, norm);
+    }
+    RT_FLOAT cos_i = -vec_dot(in, norm);
+    RT_FLOAT cos_o = vec_dot(out, norm);
+    if (diffusivity < BRDF_MIRROR || cos_o <= 0.0f || cos_i <= 0.0f) {
+        return 0.0f;
+    }
+
+    RT_FLOAT alpha = diffusivity > 1.0f ? 1.0f : diffusivity;
+    RT_FLOAT a2 = alpha * alpha;
+    RT_FLOAT lambert = a2; // Share of the Lambert lobe
+    vector3 h = vec_norm_fast(vec_sub(out, in));
+    RT_FLOAT cos_h = vec_dot(h, norm);
+    RT_FLOAT o_h = vec_dot(out, h);
+    RT_FLOAT d = brdf_ggx_d(a2, cos_h);
+
+    RT_FLOAT f_ggx = d * brdf_ggx_g1(a2, cos_i) * brdf_ggx_g1(a2, cos_o) /
+                     (4.0f * cos_i * cos_o);
+    RT_FLOAT pdf_ggx = o_h > 0.0f ? d * cos_h / (4.0f * o_h) : 0.0f;
+    *pdf = lambert * cos_o / (RT_FLOAT)M_PI + (1.0f - lambert) * pdf_ggx;
+    return (lambert / (RT_FLOAT)M_PI + (1.0f - lambert) * f_ggx) * cos_o;
+}
+
+brdf_sample brdf_sample_dir(vector3 in, vector3 norm, RT_FLOAT diffusivity) {
+    brdf_sample ret;
+    if (diffusivity < BRDF_MIRROR) {
+        ret.dir = vec_norm_fast(vec_refl(in, norm));
+        ret.weight = 1.0f;
+        ret.pdf = 0.0f;
+        return ret;
+    }
+
+    in = vec_norm(in);
+    vector3 n = vec_dot(in, norm) > 0.0f ? vec_mul(-1.0f, norm) : norm;
+    vector3 t, b;
+    brdf_basis(n, &t, &b);
+
+    RT_FLOAT alpha = diffusivity > 1.0f ? 1.0f : diffusivity;
+    RT_FLOAT a2 = alpha * alpha;
+    vector3 xi = vec_rand(0.0, 1.0);
+    RT_FLOAT phi = 2.0f * (RT_FLOAT)M_PI * xi.j;
+
+    if (xi.k < a2) {
+        // Cosine weighted hemisphere
+        RT_FLOAT r = rt_sqrt(xi.i);
+        ret.dir = brdf_world(t, b, n, r * rt_cos(phi), r * rt_sin(phi),
+                             rt_sqrt(1.0f - xi.i));
+    } else {
+        // GGX half vector, then mirror the ray around it
+        RT_FLOAT cos2 = (1.0f - xi.i) / (1.0f + (a2 - 1.0f) * xi.i);
+        RT_FLOAT sin_h = rt_sqrt(1.0f - cos2);
+        vector3 h = brdf_world(t, b, n, sin_h * rt_cos(phi),
+                               sin_h * rt_sin(phi), rt_sqrt(cos2));
+        ret.dir = vec_refl(in, h);
+    }
+
+    RT_FLOAT pdf;
+    RT_FLOAT f = brdf_eval(in, n, diffusivity, ret.dir, &pdf);
+    ret.weight = pdf > 0.0f ? f / pdf : 0.0f;
+    ret.pdf = pdf;
+    return ret;
+}
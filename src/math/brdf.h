@@ -0,0 +1,45 @@
+#ifndef RAY_TRACE_BRDF_H
+#define RAY_TRACE_BRDF_H
+
+#include <include/util.h>
+
+#include "vector.h"
+
+/** Reflection lobe of a surface with the given diffusivity.
+ *
+ * A mixture of a Lambert lobe and a GGX microfacet lobe (without Fresnel,
+ * the texture reflectivity already scales the reflection). The diffusivity is
+ * the GGX roughness alpha and the Lambert share is its square, so 0 is a
+ * perfect mirror, small values are glossy and 1 is fully matte.
+ */
+
+/// Direction picked by brdf_sample_dir()
+typedef struct {
+    vector3 dir;     ///< Normalized reflection direction
+    RT_FLOAT weight; ///< BRDF * cosine / pdf, 0 if it points into the surface
+    RT_FLOAT pdf;    ///< Density of \b dir per solid angle, 0 for mirrors
+} brdf_sample;
+
+/// Diffusivity below which a surface is treated as a perfect mirror
+#define BRDF_MIRROR 1e-3
+
+/** Importance samples the lobe.
+ *
+ * The three random numbers come from vec_rand(), so the thread sampler drives
+ * them when one is set up. Mirrors take no random numbers.
+ *
+ * @param in Direction of the incoming ray
+ * @param norm Surface normal, either side
+ */
+brdf_sample brdf_sample_dir(vector3 in, vector3 norm, RT_FLOAT diffusivity);
+
+/** BRDF times cosine of the lobe for a given outgoing direction.
+ *
+ * @param in, out Normalized incoming ray and reflection directions
+ * @param pdf Set to the density brdf_sample_dir() picks \b out with
+ * @return 0 for mirrors and directions into the surface
+ */
+RT_FLOAT brdf_eval(vector3 in, vector3 norm, RT_FLOAT diffusivity,
+                   vector3 out, RT_FLOAT* pdf);
+
+#endif
@@ -4,12 +4,13 @@
 #include <time.h>
 
 #include <include/errors.h>
+#include <include/alloc.h>
 #include "matrix.h"
 #include <include/util.h>
 
 r_matrix r_mat_alloc(I_MAT row, I_MAT col) {
     I_MAT n = row * col;
-    RT_FLOAT* mat = (RT_FLOAT*)calloc(n, sizeof(RT_FLOAT));
+    RT_FLOAT* mat = (RT_FLOAT*)rt_calloc(MEM_MATH, n, sizeof(RT_FLOAT));
     r_matrix ret = {row, col, mat};
     return ret;
 }
@@ -17,8 +18,8 @@ r_matrix r_mat_alloc(I_MAT row, I_MAT col) {
 r_matrix r_mat_id(I_MAT rowcol) {
     r_matrix ret = r_mat_alloc(rowcol, rowcol);
     // Create the identity matrix
-    for (int i = 0; i < rowcol; i++) {
-        r_mat_assign(&ret, i, i, 1.0);
+    for (I_MAT i = 0; i < rowcol; i++) {
+        r_mat_put(&ret, i, i, 1.0);
     }
     return ret;
 }
@@ -46,116 +47,132 @@ RT_RES r_mat_memcpy(r_matrix* mat, const r_matrix other) {
 }
 
 r_matrix r_mat_clone(const r_matrix val) {
-    r_matrix ret = {val.r, val.c, NULL};
-    memcpy(&ret.mat, val.mat, sizeof(RT_FLOAT) * val.r * val.c);
+    r_matrix ret = r_mat_alloc(val.r, val.c);
+    memcpy(ret.mat, val.mat, sizeof(RT_FLOAT) * val.r * val.c);
     return ret;
 }
 
 void r_mat_free(r_matrix* mat) {
-    free(mat->mat);
+    rt_free(mat->mat);
 }
 
-RT_RES r_matmul(const r_matrix left, const r_matrix right, r_matrix* res) {
-    // Return matrix MUST NOT be one of the inputs
-    if (res->mat == left.mat || res->mat == right.mat) {
-        RETURN_ERR(INCOMPATIBLE_MATRIX);
+/// res[i0..i1, j0..j1] += left[i0..i1, k0..k1] * right[k0..k1, j0..j1]
+static inline void r_matmul_block(const RT_FLOAT* restrict left,
+                                  const RT_FLOAT* restrict right,
+                                  RT_FLOAT* restrict res, I_MAT lc, I_MAT rc,
+                                  I_MAT i0, I_MAT i1, I_MAT k0, I_MAT k1,
+                                  I_MAT j0, I_MAT j1) {
+    for (I_MAT i = i0; i < i1; i++) {
+        RT_FLOAT* restrict res_row = res + i * rc;
+        for (I_MAT k = k0; k < k1; k++) {
+            // i-k-j order so the inner loop runs over contiguous rows and
+            // vectorizes
+            const RT_FLOAT l = left[i * lc + k];
+            const RT_FLOAT* restrict right_row = right + k * rc;
+            for (I_MAT j = j0; j < j1; j++) {
+                res_row[j] += l * right_row[j];
+            }
+        }
     }
+}
 
+void r_matmul_unchecked(const r_matrix left, const r_matrix right,
+                        r_matrix* res) {
     I_MAT lr = left.r;
     I_MAT lc = left.c;
-    I_MAT rr = right.r;
     I_MAT rc = right.c;
 
-    if (lc != rr) {
-        RETURN_ERR(INCOMPATIBLE_MATRIX);
+    memset(res->mat, 0, lr * rc * sizeof(RT_FLOAT));
+
+    if (lr * lc < R_MAT_BLOCK_MIN && lc * rc < R_MAT_BLOCK_MIN) {
+        r_matmul_block(left.mat, right.mat, res->mat, lc, rc, 0, lr, 0, lc, 0,
+                       rc);
+        return;
     }
 
-    RT_FLOAT l, r, n;
-    // Row index
-    for (I_MAT i = 0; i < lr; i++) {
-        // Column index
-        for (I_MAT j = 0; j < rc; j++) {
-            n = 0.0;
-            // Iterate
-            for (I_MAT k = 0; k < lc; k++) {
-                RET_IF_ERR(r_mat_get(left, i, k, &l));
-                RET_IF_ERR(r_mat_get(right, k, j, &r));
-                n += l * r;
+    for (I_MAT i = 0; i < lr; i += R_MAT_BLOCK) {
+        I_MAT i1 = i + R_MAT_BLOCK < lr ? i + R_MAT_BLOCK : lr;
+        for (I_MAT k = 0; k < lc; k += R_MAT_BLOCK) {
+            I_MAT k1 = k + R_MAT_BLOCK < lc ? k + R_MAT_BLOCK : lc;
+            for (I_MAT j = 0; j < rc; j += R_MAT_BLOCK) {
+                I_MAT j1 = j + R_MAT_BLOCK < rc ? j + R_MAT_BLOCK : rc;
+                r_matmul_block(left.mat, right.mat, res->mat, lc, rc, i, i1, k,
+                               k1, j, j1);
             }
-            r_mat_assign(res, i, j, n);
         }
     }
+}
+
+void r_matscalmul_unchecked(r_matrix* left, const RT_FLOAT right) {
+    RT_FLOAT* restrict m = left->mat;
+    I_MAT n = left->r * left->c;
+
+    for (I_MAT i = 0; i < n; i++) {
+        m[i] *= right;
+    }
+}
+
+void r_matsum_unchecked(const r_matrix left, const r_matrix right,
+                        r_matrix* res) {
+    // No restrict here since res may alias an input, which is still fine for
+    // an element wise loop
+    const RT_FLOAT* l = left.mat;
+    const RT_FLOAT* r = right.mat;
+    RT_FLOAT* o = res->mat;
+    I_MAT n = left.r * left.c;
+
+    for (I_MAT i = 0; i < n; i++) {
+        o[i] = l[i] + r[i];
+    }
+}
+
+RT_RES r_matmul(const r_matrix left, const r_matrix right, r_matrix* res) {
+    // Return matrix MUST NOT be one of the inputs
+    if (res->mat == left.mat || res->mat == right.mat) {
+        RETURN_ERR(INCOMPATIBLE_MATRIX);
+    }
+
+    if (left.c != right.r || res->r != left.r || res->c != right.c) {
+        RETURN_ERR(INCOMPATIBLE_MATRIX);
+    }
+
+    r_matmul_unchecked(left, right, res);
     RETURN_NOERROR;
 }
 
 RT_RES r_matscalmul(r_matrix* left, const RT_FLOAT right) {
-    RT_FLOAT n, v;
-
-    // Row
-    for (I_MAT i = 0; i < left->r; i++) {
-        // Column
-        for (I_MAT j = 0; j < left->c; j++) {
-            RET_IF_ERR(r_mat_get(*left, i, j, &v));
-            n = v * right;
-            r_mat_assign(left, i, j, n);
-        }
-    }
+    r_matscalmul_unchecked(left, right);
     RETURN_NOERROR;
 }
 
 RT_RES r_matsum(const r_matrix left, const r_matrix right, r_matrix* res) {
-    RT_FLOAT l, r;
     if (left.c != right.c || left.r != right.r || left.c != res->c ||
         left.r != res->r) {
         RETURN_ERR(INCOMPATIBLE_MATRIX);
     }
-    // Row
-    for (I_MAT i = 0; i < left.r; i++) {
-        // Column
-        for (I_MAT j = 0; j < left.c; j++) {
-            RET_IF_ERR(r_mat_get(left, i, j, &l));
-            RET_IF_ERR(r_mat_get(right, i, j, &r));
-            RET_IF_ERR(r_mat_assign(res, i, j, l + r));
-        }
-    }
+    r_matsum_unchecked(left, right, res);
     RETURN_NOERROR;
 }
 
 RT_RES r_mat_assign(r_matrix* mat, I_MAT r, I_MAT c, RT_FLOAT val) {
-    if (r >= mat->r || c >= mat->c) {
-        RETURN_ERR(OUT_OF_BOUNDS);
-    }
-
-    I_MAT i;
-
-    i = mat->c * r + c;
-
-    mat->mat[i] = val;
-
+    RT_CHECK(r < mat->r && c < mat->c, OUT_OF_BOUNDS);
+    r_mat_put(mat, r, c, val);
     RETURN_NOERROR;
 }
 
 RT_RES r_mat_get(const r_matrix mat, I_MAT r, I_MAT c, RT_FLOAT* res) {
-    if (r >= mat.r || c >= mat.c) {
-        RETURN_ERR(OUT_OF_BOUNDS);
-    }
-
-    I_MAT i;
-
-    i = mat.c * r + c;
-    *res = mat.mat[i];
+    RT_CHECK(r < mat.r && c < mat.c, OUT_OF_BOUNDS);
+    *res = r_mat_at(mat, r, c);
     RETURN_NOERROR;
 }
 
 void r_mat_print(const r_matrix mat) {
-    RT_FLOAT val;
     printf("[");
     for (int i = 0; i < mat.r; i++) {
         if (i != 0)
             printf(" ");
         for (int k = 0; k < mat.c; k++) {
-            r_mat_get(mat, i, k, &val);
-            printf("%f", val);
+            printf("%f", r_mat_at(mat, i, k));
             if (k != mat.c - 1)
                 printf(", ");
         }
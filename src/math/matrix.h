@@ -43,7 +43,7 @@ void r_mat_free(r_matrix* mat);
  * @param left An LxN matrix
  * @param right An NxR matrix
  * @param res The result of the matrix multiplication. MUST already be
- * allocated and cannot be one of the inputs
+ * allocated as an LxR matrix and cannot be one of the inputs
  * @return 0 if successful, error code if not.
  */
 RT_RES r_matmul(const r_matrix left, const r_matrix right, r_matrix* res);
@@ -64,12 +64,16 @@ RT_RES r_matscalmul(r_matrix* left, const RT_FLOAT right);
 RT_RES r_matsum(const r_matrix left, const r_matrix right, r_matrix* res);
 
 /** Assigns a value to the matrix
+ *
+ * The bounds are only checked if RT_CHECKS is defined (debug builds).
  *
  * @return 0 if successful, error code if not.
  */
 RT_RES r_mat_assign(r_matrix* mat, I_MAT r, I_MAT c, RT_FLOAT val);
 
 /** Returns a value from the given matrix
+ *
+ * The bounds are only checked if RT_CHECKS is defined (debug builds).
  *
  * @param res The return value of the function if read is successful
  * @return 0 if successful, error code if not.
@@ -79,4 +83,37 @@ RT_RES r_mat_get(const r_matrix mat, I_MAT r, I_MAT c, RT_FLOAT* res);
 /// Prints a matrix to stdout. For debug purposes.
 void r_mat_print(const r_matrix mat);
 
+// Unchecked API
+//
+// These do no checks at all, not even in debug builds. They are meant for hot
+// paths where the shapes are already known to be right.
+
+/// Unchecked r_mat_get()
+static inline RT_FLOAT r_mat_at(const r_matrix mat, I_MAT r, I_MAT c) {
+    return mat.mat[mat.c * r + c];
+}
+
+/// Unchecked r_mat_assign()
+static inline void r_mat_put(r_matrix* mat, I_MAT r, I_MAT c, RT_FLOAT val) {
+    mat->mat[mat->c * r + c] = val;
+}
+
+/// Matrices with fewer elements than this skip cache blocking in
+/// r_matmul_unchecked()
+#define R_MAT_BLOCK_MIN 4096
+/// Block edge length used by r_matmul_unchecked() for larger matrices
+#define R_MAT_BLOCK 64
+
+/// Unchecked r_matmul(), \b res must be an LxR matrix that isn't an input.
+/// Cache blocked for larger matrices.
+void r_matmul_unchecked(const r_matrix left, const r_matrix right,
+                        r_matrix* res);
+
+/// Unchecked r_matscalmul()
+void r_matscalmul_unchecked(r_matrix* left, const RT_FLOAT right);
+
+/// Unchecked r_matsum(), \b res may be one of the inputs
+void r_matsum_unchecked(const r_matrix left, const r_matrix right,
+                        r_matrix* res);
+
 #endif
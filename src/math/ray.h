@@ -14,8 +14,27 @@ typedef struct {
 } ray;
 
 /// Construct new ray
-ray ray_new(vector3 pos, vector3 path);
+static inline ray ray_new(vector3 pos, vector3 path) {
+    ray ret = {pos, vec_norm_fast(path)};
+    return ret;
+}
 
-vector3 ray_dist(ray r, RT_FLOAT dist);
+static inline vector3 ray_dist(ray r, RT_FLOAT dist) {
+    return vec_sum(r.pos, vec_mul(dist, r.path));
+}
+
+/** Cone around a ray, for how much of the scene a ray stands for (Akenine-
+ * Moller et al., "Texture Level of Detail Strategies for Real-Time Ray
+ * Tracing", 2019). A zero cone is a plain ray.
+ */
+typedef struct {
+    RT_FLOAT width;  ///< Width at the ray origin
+    RT_FLOAT spread; ///< Spread angle in radians
+} ray_cone;
+
+/// Width of the cone at the given distance from the origin
+static inline RT_FLOAT ray_cone_width(ray_cone c, RT_FLOAT dist) {
+    return c.width + c.spread * dist;
+}
 
 #endif
@@ -8,25 +8,25 @@ RT_RES r_matvec_mul(const r_matrix mat, const vector3 vec, vector3* res) {
         RT_FLOAT vecmat[4] = {vec.i, vec.j, vec.k, 1.0};
         r_matrix tmp_mat;
         RET_IF_ERR(r_mat_set(4, 1, &vecmat, sizeof(vecmat), &tmp_mat));
-        r_matrix res_mat = r_mat_alloc(4, 4);
+        r_matrix res_mat = r_mat_alloc(4, 1);
 
         RET_IF_ERR(r_matmul(mat, tmp_mat, &res_mat));
-        r_mat_get(res_mat, 0, 0, &res->i);
-        r_mat_get(res_mat, 1, 0, &res->j);
-        r_mat_get(res_mat, 2, 0, &res->k);
+        res->i = r_mat_at(res_mat, 0, 0);
+        res->j = r_mat_at(res_mat, 1, 0);
+        res->k = r_mat_at(res_mat, 2, 0);
 
         r_mat_free(&tmp_mat);
         r_mat_free(&res_mat);
     } else if (mat.c == 3 && mat.r == 3) {
         RT_FLOAT vecmat[3] = {vec.i, vec.j, vec.k};
         r_matrix tmp_mat;
-        r_matrix res_mat = r_mat_alloc(4, 4);
+        r_matrix res_mat = r_mat_alloc(3, 1);
 
         RET_IF_ERR(r_mat_set(3, 1, &vecmat, sizeof(vecmat), &tmp_mat));
         RET_IF_ERR(r_matmul(mat, tmp_mat, &res_mat));
-        r_mat_get(res_mat, 0, 0, &res->i);
-        r_mat_get(res_mat, 1, 0, &res->j);
-        r_mat_get(res_mat, 2, 0, &res->k);
+        res->i = r_mat_at(res_mat, 0, 0);
+        res->j = r_mat_at(res_mat, 1, 0);
+        res->k = r_mat_at(res_mat, 2, 0);
 
         r_mat_free(&tmp_mat);
         r_mat_free(&res_mat);
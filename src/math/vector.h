@@ -1,46 +1,237 @@
 #ifndef RAY_TRACE_VECTOR_H
 #define RAY_TRACE_VECTOR_H
 
+#include <float.h>
+#include <math.h>
+
 #include <include/util.h>
 
-/// A 3D vector.
+// The kernels use SSE or NEON when the compiler targets them and RT_FLOAT is
+// float, else plain C. Build with -DRT_NO_SIMD=1 to compare.
+#if !defined(RT_NO_SIMD) && !RT_FLOAT_IS_DOUBLE && defined(__SSE__)
+#define RT_VEC_SSE 1
+#include <xmmintrin.h>
+#elif !defined(RT_NO_SIMD) && !RT_FLOAT_IS_DOUBLE && defined(__ARM_NEON)
+#define RT_VEC_NEON 1
+#include <arm_neon.h>
+#endif
+
+/** A 3D vector.
+ *
+ * Padded to four components and aligned to 16 bytes so that one vector is
+ * one SIMD register. The padding is zero after every operation but nothing
+ * relies on it, initializers with three values are fine.
+ */
 typedef struct {
-    RT_FLOAT i; ///< X axis
-    RT_FLOAT j; ///< Y axis
-    RT_FLOAT k; ///< Z axis
+    _Alignas(16) RT_FLOAT i; ///< X axis
+    RT_FLOAT j;              ///< Y axis
+    RT_FLOAT k;              ///< Z axis
+    RT_FLOAT w;              ///< Padding
 } vector3;
 
-vector3 vec3(RT_FLOAT i, RT_FLOAT j, RT_FLOAT k);
+#if RT_VEC_SSE
+static inline __m128 vec_load(vector3 v) {
+    return _mm_load_ps(&v.i);
+}
+
+static inline vector3 vec_store(__m128 m) {
+    vector3 ret;
+    _mm_store_ps(&ret.i, m);
+    return ret;
+}
+
+/// Sum of the first three lanes
+static inline float vec_hsum3(__m128 m) {
+    __m128 j = _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1));
+    __m128 k = _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2));
+    return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(m, j), k));
+}
+#elif RT_VEC_NEON
+static inline float32x4_t vec_load(vector3 v) {
+    return vld1q_f32(&v.i);
+}
+
+static inline vector3 vec_store(float32x4_t m) {
+    vector3 ret;
+    vst1q_f32(&ret.i, m);
+    return ret;
+}
+
+/// Sum of the first three lanes
+static inline float vec_hsum3(float32x4_t m) {
+    return vgetq_lane_f32(m, 0) + vgetq_lane_f32(m, 1) + vgetq_lane_f32(m, 2);
+}
+#endif
+
+static inline vector3 vec3(RT_FLOAT i, RT_FLOAT j, RT_FLOAT k) {
+    vector3 ret = {i, j, k, 0.0};
+    return ret;
+}
 
+/// Random vector with each component in [min, min + max), drawn from the
+/// thread sampler if one is set up (sampler_thread()), else from the
+/// generator of the calling thread (rng_thread())
 vector3 vec_rand(RT_FLOAT min, RT_FLOAT max);
 
-vector3 vec_zero();
+static inline vector3 vec_zero() {
+    return vec3(0.0, 0.0, 0.0);
+}
 
 /// Cross product between two vectors
-vector3 vec_cross(const vector3 left, const vector3 right);
+static inline vector3 vec_cross(const vector3 left, const vector3 right) {
+#if RT_VEC_SSE
+    // (l.jki * r.kij) - (l.kij * r.jki), the padding lane stays 0
+    __m128 l = vec_load(left), r = vec_load(right);
+    __m128 l_jki = _mm_shuffle_ps(l, l, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 r_jki = _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 m = _mm_sub_ps(_mm_mul_ps(l, r_jki), _mm_mul_ps(l_jki, r));
+    return vec_store(_mm_shuffle_ps(m, m, _MM_SHUFFLE(3, 0, 2, 1)));
+#else
+    return vec3(left.j * right.k - left.k * right.j,
+                left.k * right.i - left.i * right.k,
+                left.i * right.j - left.j * right.i);
+#endif
+}
 
 /// Dot product between two vectors
-RT_FLOAT vec_dot(const vector3 left, const vector3 right);
+static inline RT_FLOAT vec_dot(const vector3 left, const vector3 right) {
+#if RT_VEC_SSE
+    return vec_hsum3(_mm_mul_ps(vec_load(left), vec_load(right)));
+#elif RT_VEC_NEON
+    return vec_hsum3(vmulq_f32(vec_load(left), vec_load(right)));
+#else
+    return left.i * right.i + left.j * right.j + left.k * right.k;
+#endif
+}
+
+/// Square root in the precision of RT_FLOAT
+static inline RT_FLOAT rt_sqrt(RT_FLOAT x) {
+#if RT_FLOAT_IS_DOUBLE
+    return sqrt(x);
+#else
+    return sqrtf(x);
+#endif
+}
+
+/// Cosine in the precision of RT_FLOAT
+static inline RT_FLOAT rt_cos(RT_FLOAT x) {
+#if RT_FLOAT_IS_DOUBLE
+    return cos(x);
+#else
+    return cosf(x);
+#endif
+}
+
+/// Sine in the precision of RT_FLOAT
+static inline RT_FLOAT rt_sin(RT_FLOAT x) {
+#if RT_FLOAT_IS_DOUBLE
+    return sin(x);
+#else
+    return sinf(x);
+#endif
+}
+
+/// Magnitude of \b x with the sign of \b y, in the precision of RT_FLOAT
+static inline RT_FLOAT rt_copysign(RT_FLOAT x, RT_FLOAT y) {
+#if RT_FLOAT_IS_DOUBLE
+    return copysign(x, y);
+#else
+    return copysignf(x, y);
+#endif
+}
+
+/** Square root for the hot path (sphere tests), \b x must not be negative.
+ *
+ * In PRECISION=fast builds (RT_FAST_NORM) this is \b x times the reciprocal
+ * square root estimate refined by one Newton step, like vec_norm_fast().
+ */
+static inline RT_FLOAT rt_sqrt_fast(RT_FLOAT x) {
+#if RT_FAST_NORM && RT_VEC_SSE
+    // Clamped so that 0 gives 0 instead of 0 * inf
+    __m128 v = _mm_max_ss(_mm_set_ss(x), _mm_set_ss(FLT_MIN));
+    __m128 y = _mm_rsqrt_ss(v);
+    __m128 h = _mm_mul_ss(_mm_mul_ss(_mm_set_ss(0.5), v), _mm_mul_ss(y, y));
+    y = _mm_mul_ss(y, _mm_sub_ss(_mm_set_ss(1.5), h));
+    return x * _mm_cvtss_f32(y);
+#elif RT_FAST_NORM && RT_VEC_NEON
+    float32x2_t v = vdup_n_f32(x > FLT_MIN ? x : FLT_MIN);
+    float32x2_t y = vrsqrte_f32(v);
+    y = vmul_f32(y, vrsqrts_f32(vmul_f32(v, y), y));
+    return x * vget_lane_f32(y, 0);
+#else
+    return rt_sqrt(x);
+#endif
+}
 
 /// Magnitude of a vector
-RT_FLOAT vec_mag(const vector3 vec);
-/// Normalized version of the vector
-vector3 vec_norm(const vector3 vec);
+static inline RT_FLOAT vec_mag(const vector3 vec) {
+    return rt_sqrt(vec_dot(vec, vec));
+}
+
+static inline vector3 vec_sum(vector3 left, vector3 right) {
+#if RT_VEC_SSE
+    return vec_store(_mm_add_ps(vec_load(left), vec_load(right)));
+#elif RT_VEC_NEON
+    return vec_store(vaddq_f32(vec_load(left), vec_load(right)));
+#else
+    return vec3(left.i + right.i, left.j + right.j, left.k + right.k);
+#endif
+}
 
-vector3 vec_sum(vector3 left, vector3 right);
-vector3 vec_sub(vector3 left, vector3 right);
-vector3 vec_mul(RT_FLOAT val, vector3 vec);
+static inline vector3 vec_sub(vector3 left, vector3 right) {
+#if RT_VEC_SSE
+    return vec_store(_mm_sub_ps(vec_load(left), vec_load(right)));
+#elif RT_VEC_NEON
+    return vec_store(vsubq_f32(vec_load(left), vec_load(right)));
+#else
+    return vec3(left.i - right.i, left.j - right.j, left.k - right.k);
+#endif
+}
 
-/// Given a vector and a normal, calculate the reflection vector
-vector3 vec_refl(vector3 in, vector3 norm);
+static inline vector3 vec_mul(RT_FLOAT val, vector3 vec) {
+#if RT_VEC_SSE
+    return vec_store(_mm_mul_ps(_mm_set1_ps(val), vec_load(vec)));
+#elif RT_VEC_NEON
+    return vec_store(vmulq_n_f32(vec_load(vec), val));
+#else
+    return vec3(vec.i * val, vec.j * val, vec.k * val);
+#endif
+}
 
-/** Get the diffused reflection from a vector and a normal
+/// Normalized version of the vector
+static inline vector3 vec_norm(const vector3 vec) {
+    return vec_mul(1.0 / vec_mag(vec), vec);
+}
+
+/** Normalized version of the vector for the hot path (ray directions,
+ * sphere normals).
  *
- * @param path Path the ray originally followed for the collision
- * @param norm Normal vector from the point ray hit
- * @param diff Diffusivity value, 0 means no diffusion, 1.0 means max diffusion
- * @return A random direction vector based on input parameters
+ * In PRECISION=fast builds (RT_FAST_NORM) this is the reciprocal square root
+ * estimate refined by one Newton step, within a couple of ulp of vec_norm().
+ * The estimate differs between CPU vendors, so by default it is vec_norm()
+ * and images stay the same on every machine.
  */
-vector3 vec_refl_diff(const vector3 path, const vector3 norm, RT_FLOAT diff);
+static inline vector3 vec_norm_fast(const vector3 vec) {
+#if RT_FAST_NORM && RT_VEC_SSE
+    __m128 x = _mm_set_ss(vec_dot(vec, vec));
+    __m128 y = _mm_rsqrt_ss(x);
+    // y * (1.5 - 0.5 * x * y * y)
+    __m128 h = _mm_mul_ss(_mm_mul_ss(_mm_set_ss(0.5), x), _mm_mul_ss(y, y));
+    y = _mm_mul_ss(y, _mm_sub_ss(_mm_set_ss(1.5), h));
+    return vec_mul(_mm_cvtss_f32(y), vec);
+#elif RT_FAST_NORM && RT_VEC_NEON
+    float32x2_t x = vdup_n_f32(vec_dot(vec, vec));
+    float32x2_t y = vrsqrte_f32(x);
+    y = vmul_f32(y, vrsqrts_f32(vmul_f32(x, y), y));
+    return vec_mul(vget_lane_f32(y, 0), vec);
+#else
+    return vec_norm(vec);
+#endif
+}
+
+/// Given a vector and a normal, calculate the reflection vector
+static inline vector3 vec_refl(vector3 in, vector3 norm) {
+    return vec_sum(in, vec_mul(-2.0, vec_mul(vec_dot(in, norm), norm)));
+}
 
 #endif
@@ -0,0 +1,1080 @@
+#include "ooc.h"
+#include <include/alloc.h>
+#include <include/util.h>
+
+#include <fcntl.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define OOC_MAGIC "RTOOC\0\0"
+#define OOC_VERSION 1
+/// No body, as a sphere or body id
+#define OOC_NONE UINT32_MAX
+/// Spheres per leaf of the tree inside a resident cluster
+#define OOC_LEAF 8
+
+/// Residency of a cluster
+enum { OOC_OUT, OOC_QUEUED, OOC_IN };
+
+/// Result of a closest hit query
+enum { OOC_MISS, OOC_HIT, OOC_WAIT };
+
+/// File header
+typedef struct {
+    char magic[8];           ///< OOC_MAGIC
+    uint32_t version;        ///< OOC_VERSION
+    uint32_t cluster_size;   ///< Max spheres per cluster
+    uint64_t sphere_count;   ///< Sphere records
+    uint64_t cluster_count;  ///< Cluster records
+    uint64_t cluster_offset; ///< File offset of the cluster table
+    uint64_t data_offset;    ///< File offset of the sphere records
+} ooc_file_head;
+
+/// Cluster record of the file
+typedef struct {
+    float min[3];   ///< Lower corner of the bounds
+    float max[3];   ///< Upper corner of the bounds
+    uint32_t first; ///< First sphere
+    uint32_t count; ///< Sphere count
+} ooc_file_cluster;
+
+/// Sphere record of the file
+typedef struct {
+    float center[3];
+    float radius;
+    float col[3];
+    float reflectivity;
+    float diffusivity;
+} ooc_file_sphere;
+
+typedef struct {
+    vector3 min;
+    vector3 max;
+    uint32_t first;
+    uint32_t count;
+} ooc_cluster;
+
+/// Node of the tree over the clusters, a leaf if left is 0 (the root is
+/// never a child)
+typedef struct {
+    vector3 min;
+    vector3 max;
+    uint32_t left;
+    uint32_t right;
+    uint32_t cluster; ///< Cluster of a leaf
+} ooc_node;
+
+typedef struct {
+    vector3 min;
+    vector3 max;
+} ooc_box;
+
+/** Resident copy of a cluster, allocated as one block.
+ *
+ * The spheres are in Morton order, so a complete binary tree over runs of
+ * OOC_LEAF of them culls well enough and needs no pointers. Leaves past the
+ * end have empty (inverted) boxes.
+ */
+typedef struct {
+    uint32_t slots;      ///< Leaf count of the tree, a power of two
+    ooc_box* nodes;      ///< Tree in heap order, 2 * slots - 1 nodes
+    ooc_sphere* spheres; ///< Sphere data
+} ooc_block;
+
+/// Cluster whose bounds a ray enters at distance t
+typedef struct {
+    RT_FLOAT t;
+    uint32_t c;
+} ooc_cand;
+
+RTVEC_DEFINE(rtvec_ooc_cand, ooc_cand)
+
+/** State of one path, kept between passes.
+ *
+ * The clusters a ray has to test are ordered by (entry distance, index). A
+ * ray that waits for a cluster remembers that key, everything before it was
+ * tested already and its closest hit so far is kept here.
+ */
+typedef struct {
+    ray r;              ///< Current segment
+    color sum;          ///< Color gathered so far
+    RT_FLOAT weight;    ///< Product of the reflectivities so far
+    RT_FLOAT best_dist; ///< Closest hit of the segment so far
+    vector3 best_norm;  ///< Normal at it
+    color best_col;     ///< Sphere color at it
+    RT_FLOAT best_refl; ///< Sphere reflectivity at it
+    RT_FLOAT best_diff; ///< Sphere diffusivity at it
+    RT_FLOAT resume_t;  ///< Key of the cluster waited for
+    uint32_t resume_c;  ///< Key of the cluster waited for
+    uint32_t best_id;   ///< Sphere or body of the closest hit, OOC_NONE
+    uint32_t ignore;    ///< Body the segment starts on
+    uint32_t pixel;     ///< Color buffer index
+    uint16_t depth;     ///< Reflection count
+    bool fresh;         ///< Whether the in-core bodies still need a test
+} ooc_path;
+
+struct ooc_scene {
+    int fd;
+    const char* map;
+    size_t map_size;
+    const ooc_file_sphere* records; ///< Sphere records in the mapping
+    size_t sphere_count;
+    size_t cluster_count;
+    ooc_cluster* clusters;
+    ooc_node* nodes;
+    size_t node_count;
+    rtvec_body_ptr bodies; ///< In-core bodies, id sphere_count + index
+
+    atomic_int* state;                ///< Residency per cluster
+    ooc_block** data;                 ///< Resident spheres per cluster
+    atomic_uint_least32_t* last_used; ///< Pass a cluster was last tested in
+    uint32_t pass;                    ///< Current pass
+
+    pthread_mutex_t lock; ///< Guards everything below
+    pthread_cond_t wake;  ///< Wakes the loader
+    pthread_cond_t idle;  ///< Signaled when the loader can't go on
+    pthread_t loader;
+    size_t budget;
+    size_t resident; ///< Resident bytes, including the one loading
+    rtvec_u32 resident_list;
+    rtvec_u32 queue; ///< Requested clusters from queue_head on
+    size_t queue_head;
+    bool loading;
+    bool stop;
+    ooc_stats stats;
+
+    atomic_uint_fast64_t rays;
+    atomic_uint_fast64_t waits;
+};
+
+/// Shared state of one pass
+typedef struct {
+    ooc_scene* scene;
+    const display* disp;
+    ooc_path* paths;
+    uint32_t* work; ///< Paths to trace, deferred ones are moved to the front
+                    ///< of their chunk
+    size_t work_count;
+    size_t* kept; ///< Deferred paths per chunk
+    uint64_t seed;
+} ooc_job;
+
+static inline RT_FLOAT vec_axis(const vector3 v, int axis) {
+    return axis == 0 ? v.i : (axis == 1 ? v.j : v.k);
+}
+
+/// Spreads 10 bits out to every third bit
+static uint32_t ooc_morton_expand(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+typedef struct {
+    uint32_t code;
+    uint32_t index;
+} ooc_key;
+
+static int ooc_key_cmp(const void* a, const void* b) {
+    const ooc_key* ka = a;
+    const ooc_key* kb = b;
+    if (ka->code != kb->code)
+        return ka->code < kb->code ? -1 : 1;
+    return ka->index < kb->index ? -1 : (ka->index > kb->index);
+}
+
+RT_RES ooc_write(const char* path, const ooc_sphere* spheres, size_t count,
+                 unsigned int cluster_size) {
+    vector3 min = vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    vector3 max = vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+    if (cluster_size == 0) {
+        cluster_size = OOC_CLUSTER_SIZE;
+    }
+    if (count >= OOC_NONE / 2) {
+        RETURN_ERR(OUT_OF_BOUNDS);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        vector3 c = spheres[i].sph.center;
+        min = vec3(fmin(min.i, c.i), fmin(min.j, c.j), fmin(min.k, c.k));
+        max = vec3(fmax(max.i, c.i), fmax(max.j, c.j), fmax(max.k, c.k));
+    }
+
+    // Sort along a Morton curve so that neighbours end up in one cluster
+    ooc_key* keys = rt_malloc(MEM_OOC, sizeof(ooc_key) * (count ? count : 1));
+    RT_FLOAT scale[3];
+    for (int a = 0; a < 3; a++) {
+        RT_FLOAT ext = vec_axis(max, a) - vec_axis(min, a);
+        scale[a] = ext > 0.0 ? 1023.0 / ext : 0.0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        vector3 c = spheres[i].sph.center;
+        keys[i].code =
+            ooc_morton_expand((c.i - min.i) * scale[0]) |
+            ooc_morton_expand((c.j - min.j) * scale[1]) << 1 |
+            ooc_morton_expand((c.k - min.k) * scale[2]) << 2;
+        keys[i].index = i;
+    }
+    qsort(keys, count, sizeof(ooc_key), &ooc_key_cmp);
+
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        rt_free(keys);
+        RETURN_ERR(FILE_ERROR);
+    }
+
+    size_t clusters = (count + cluster_size - 1) / cluster_size;
+    ooc_file_head head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, OOC_MAGIC, sizeof(head.magic));
+    head.version = OOC_VERSION;
+    head.cluster_size = cluster_size;
+    head.sphere_count = count;
+    head.cluster_count = clusters;
+    head.cluster_offset = sizeof(head);
+    head.data_offset = sizeof(head) + clusters * sizeof(ooc_file_cluster);
+    bool ok = fwrite(&head, sizeof(head), 1, f) == 1;
+
+    for (size_t c = 0; c < clusters && ok; c++) {
+        ooc_file_cluster rec;
+        size_t first = c * cluster_size;
+        size_t end =
+            first + cluster_size < count ? first + cluster_size : count;
+        for (int a = 0; a < 3; a++) {
+            rec.min[a] = FLT_MAX;
+            rec.max[a] = -FLT_MAX;
+        }
+        for (size_t i = first; i < end; i++) {
+            const body_sphere* sph = &spheres[keys[i].index].sph;
+            for (int a = 0; a < 3; a++) {
+                RT_FLOAT p = vec_axis(sph->center, a);
+                // Padded so that rounding never puts a hit outside
+                RT_FLOAT eps = RT_EPS(fabs(p) + sph->R);
+                rec.min[a] = fmin(rec.min[a], p - sph->R - eps);
+                rec.max[a] = fmax(rec.max[a], p + sph->R + eps);
+            }
+        }
+        rec.first = first;
+        rec.count = end - first;
+        ok = fwrite(&rec, sizeof(rec), 1, f) == 1;
+    }
+
+    for (size_t i = 0; i < count && ok; i++) {
+        const ooc_sphere* s = &spheres[keys[i].index];
+        ooc_file_sphere rec = {
+            {s->sph.center.i, s->sph.center.j, s->sph.center.k},
+            s->sph.R,
+            {s->col.r, s->col.g, s->col.b},
+            s->reflectivity,
+            s->diffusivity};
+        ok = fwrite(&rec, sizeof(rec), 1, f) == 1;
+    }
+
+    rt_free(keys);
+    if (fclose(f) != 0 || !ok) {
+        RETURN_ERR(FILE_ERROR);
+    }
+    RETURN_NOERROR;
+}
+
+bool ooc_sphere_from_body(const body_rep* const body, ooc_sphere* out) {
+    if (body->_col_impl != &sphere_col ||
+        body->tex.refl != &texture_single_impl) {
+        return false;
+    }
+    out->sph = *(const body_sphere*)body->body;
+    out->col = ((const ray_texture_single_color*)body->tex.impl)->col;
+    out->reflectivity = body->tex.reflectivity;
+    out->diffusivity = body->tex.diffusivity;
+    return true;
+}
+
+/// Builds the subtree over clusters [lo, hi), returns its node
+static uint32_t ooc_build_node(ooc_scene* scene, uint32_t lo, uint32_t hi) {
+    uint32_t index = scene->node_count++;
+    ooc_node* node = &scene->nodes[index];
+
+    if (hi - lo == 1) {
+        node->min = scene->clusters[lo].min;
+        node->max = scene->clusters[lo].max;
+        node->left = 0;
+        node->right = 0;
+        node->cluster = lo;
+        return index;
+    }
+
+    // Clusters are in Morton order, so halves are close together in space
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint32_t left = ooc_build_node(scene, lo, mid);
+    uint32_t right = ooc_build_node(scene, mid, hi);
+    const ooc_node* l = &scene->nodes[left];
+    const ooc_node* r = &scene->nodes[right];
+    node->min = vec3(fmin(l->min.i, r->min.i), fmin(l->min.j, r->min.j),
+                     fmin(l->min.k, r->min.k));
+    node->max = vec3(fmax(l->max.i, r->max.i), fmax(l->max.j, r->max.j),
+                     fmax(l->max.k, r->max.k));
+    node->left = left;
+    node->right = right;
+    node->cluster = 0;
+    return index;
+}
+
+/// Whole pages inside [ptr, ptr + size) of the mapping are dropped
+static void ooc_drop_pages(const void* ptr, size_t size) {
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t)ptr + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t)ptr + size) & ~(page - 1);
+    if (end > begin) {
+        madvise((void*)begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+/// Starts reading the records of a cluster ahead of time
+static void ooc_prefetch(const ooc_scene* scene, uint32_t c) {
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    const ooc_file_sphere* src = scene->records + scene->clusters[c].first;
+    uintptr_t begin = (uintptr_t)src & ~(page - 1);
+    uintptr_t end = (uintptr_t)(src + scene->clusters[c].count);
+    madvise((void*)begin, end - begin, MADV_WILLNEED);
+}
+
+/// Leaf count of the tree of a cluster
+static uint32_t ooc_slots(uint32_t count) {
+    uint32_t leaves = (count + OOC_LEAF - 1) / OOC_LEAF;
+    uint32_t slots = 1;
+    while (slots < leaves) {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+/// \b n rounded up to a multiple of the power of two \b align
+static inline size_t ooc_align(size_t n, size_t align) {
+    return (n + align - 1) & ~(align - 1);
+}
+
+/// Offset of the nodes of an ooc_block from its start, vector3 needs 16
+/// byte alignment
+static inline size_t ooc_nodes_offset(void) {
+    return ooc_align(sizeof(ooc_block), _Alignof(ooc_box));
+}
+
+/// Offset of the spheres of an ooc_block with \b slots leaves
+static inline size_t ooc_spheres_offset(uint32_t slots) {
+    return ooc_align(ooc_nodes_offset() + (2 * slots - 1) * sizeof(ooc_box),
+                     _Alignof(ooc_sphere));
+}
+
+static size_t ooc_cluster_bytes(const ooc_scene* scene, uint32_t c) {
+    uint32_t count = scene->clusters[c].count;
+    return ooc_spheres_offset(ooc_slots(count)) + count * sizeof(ooc_sphere);
+}
+
+/// Whether the cluster may be loaded without going over the budget
+static bool ooc_fits(const ooc_scene* scene, uint32_t c) {
+    return scene->resident == 0 ||
+           scene->resident + ooc_cluster_bytes(scene, c) <= scene->budget;
+}
+
+static ooc_box ooc_box_union(ooc_box a, ooc_box b) {
+    ooc_box ret = {vec3(fmin(a.min.i, b.min.i), fmin(a.min.j, b.min.j),
+                        fmin(a.min.k, b.min.k)),
+                   vec3(fmax(a.max.i, b.max.i), fmax(a.max.j, b.max.j),
+                        fmax(a.max.k, b.max.k))};
+    return ret;
+}
+
+/// Copies a cluster out of the mapping, the page faults happen here
+static ooc_block* ooc_load(const ooc_scene* scene, uint32_t c) {
+    const ooc_cluster* cl = &scene->clusters[c];
+    const ooc_file_sphere* src = scene->records + cl->first;
+    uint32_t slots = ooc_slots(cl->count);
+    ooc_block* block = rt_aligned_alloc(MEM_OOC, ooc_cluster_bytes(scene, c));
+    block->slots = slots;
+    block->nodes = (ooc_box*)((char*)block + ooc_nodes_offset());
+    block->spheres = (ooc_sphere*)((char*)block + ooc_spheres_offset(slots));
+
+    ooc_sphere* dst = block->spheres;
+    for (uint32_t i = 0; i < cl->count; i++) {
+        dst[i].sph.center =
+            vec3(src[i].center[0], src[i].center[1], src[i].center[2]);
+        dst[i].sph.R = src[i].radius;
+        dst[i].col = color_new(src[i].col[0], src[i].col[1], src[i].col[2]);
+        dst[i].reflectivity = src[i].reflectivity;
+        dst[i].diffusivity = src[i].diffusivity;
+    }
+    // The copy is what counts, don't keep the file pages around too
+    ooc_drop_pages(src, cl->count * sizeof(ooc_file_sphere));
+
+    // Leaves, then the inner nodes bottom up
+    for (uint32_t l = 0; l < slots; l++) {
+        ooc_box box = {vec3(FLT_MAX, FLT_MAX, FLT_MAX),
+                       vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX)};
+        uint32_t end = (l + 1) * OOC_LEAF;
+        for (uint32_t i = l * OOC_LEAF; i < end && i < cl->count; i++) {
+            vector3 c = dst[i].sph.center;
+            RT_FLOAT r = dst[i].sph.R +
+                         RT_EPS(fmax(fmax(fabs(c.i), fabs(c.j)), fabs(c.k)) +
+                                dst[i].sph.R);
+            vector3 ext = vec3(r, r, r);
+            ooc_box sph = {vec_sub(dst[i].sph.center, ext),
+                           vec_sum(dst[i].sph.center, ext)};
+            box = ooc_box_union(box, sph);
+        }
+        block->nodes[slots - 1 + l] = box;
+    }
+    for (uint32_t i = slots - 1; i-- > 0;) {
+        block->nodes[i] =
+            ooc_box_union(block->nodes[2 * i + 1], block->nodes[2 * i + 2]);
+    }
+    return block;
+}
+
+/// Loader thread, pages in requested clusters while there is room
+static void* ooc_loader(void* arg) {
+    ooc_scene* scene = (ooc_scene*)arg;
+
+    pthread_mutex_lock(&scene->lock);
+    for (;;) {
+        while (!scene->stop &&
+               (scene->queue_head == scene->queue.count ||
+                !ooc_fits(scene, scene->queue.data[scene->queue_head]))) {
+            pthread_cond_broadcast(&scene->idle);
+            pthread_cond_wait(&scene->wake, &scene->lock);
+        }
+        if (scene->stop) {
+            break;
+        }
+
+        uint32_t c = scene->queue.data[scene->queue_head++];
+        if (scene->queue_head == scene->queue.count) {
+            rtvec_u32_clear(&scene->queue);
+            scene->queue_head = 0;
+        } else {
+            ooc_prefetch(scene, scene->queue.data[scene->queue_head]);
+        }
+        scene->resident += ooc_cluster_bytes(scene, c);
+        if (scene->resident > scene->stats.resident_peak) {
+            scene->stats.resident_peak = scene->resident;
+        }
+        scene->loading = true;
+        pthread_mutex_unlock(&scene->lock);
+
+        ooc_block* data = ooc_load(scene, c);
+
+        pthread_mutex_lock(&scene->lock);
+        scene->data[c] = data;
+        atomic_store_explicit(&scene->state[c], OOC_IN, memory_order_release);
+        // Reserved for every cluster at open, so this doesn't allocate
+        rtvec_u32_push(&scene->resident_list, c);
+        scene->stats.loads++;
+        scene->loading = false;
+    }
+    pthread_mutex_unlock(&scene->lock);
+    return NULL;
+}
+
+/// Whether \b count records of \b rec bytes at \b offset are inside the
+/// mapping and aligned, without overflowing
+static bool ooc_table_valid(uint64_t offset, uint64_t count, size_t rec,
+                            size_t size) {
+    return offset <= size && offset % sizeof(float) == 0 &&
+           count <= (size - offset) / rec;
+}
+
+/** Checks everything ooc_scene_open() and the loader take from the file:
+ * both tables lie inside the mapping, the tree over the clusters can be
+ * indexed with uint32_t and every cluster covers a non-empty range of the
+ * sphere records, at most cluster_size long.
+ */
+static bool ooc_file_valid(const ooc_file_head* head, const char* map,
+                           size_t size) {
+    if (memcmp(head->magic, OOC_MAGIC, sizeof(head->magic)) != 0 ||
+        head->version != OOC_VERSION || head->sphere_count >= OOC_NONE / 2 ||
+        head->cluster_count > head->sphere_count ||
+        (head->sphere_count > 0 && head->cluster_count == 0) ||
+        !ooc_table_valid(head->cluster_offset, head->cluster_count,
+                         sizeof(ooc_file_cluster), size) ||
+        !ooc_table_valid(head->data_offset, head->sphere_count,
+                         sizeof(ooc_file_sphere), size)) {
+        return false;
+    }
+    const ooc_file_cluster* recs =
+        (const ooc_file_cluster*)(map + head->cluster_offset);
+    for (uint64_t c = 0; c < head->cluster_count; c++) {
+        // first + count can't overflow in 64 bits
+        if (recs[c].count == 0 || recs[c].count > head->cluster_size ||
+            (uint64_t)recs[c].first + recs[c].count > head->sphere_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ooc_scene* ooc_scene_open(const char* path, size_t budget) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ooc_file_head)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    const char* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    const ooc_file_head* head = (const ooc_file_head*)map;
+    if (!ooc_file_valid(head, map, size)) {
+        munmap((void*)map, size);
+        close(fd);
+        return NULL;
+    }
+    // Clusters are read in no particular order
+    madvise((void*)map, size, MADV_RANDOM);
+
+    ooc_scene* scene = rt_calloc(MEM_OOC, 1, sizeof(ooc_scene));
+    if (scene == NULL) {
+        munmap((void*)map, size);
+        close(fd);
+        return NULL;
+    }
+    pthread_mutex_init(&scene->lock, NULL);
+    pthread_cond_init(&scene->wake, NULL);
+    pthread_cond_init(&scene->idle, NULL);
+    // ooc_scene_close() skips the loader until it runs
+    scene->stop = true;
+    scene->fd = fd;
+    scene->map = map;
+    scene->map_size = size;
+    scene->records = (const ooc_file_sphere*)(map + head->data_offset);
+    scene->sphere_count = head->sphere_count;
+    scene->cluster_count = head->cluster_count;
+    scene->budget = budget;
+    scene->bodies = rtvec_body_ptr_new(MEM_OOC);
+    scene->resident_list = rtvec_u32_new(MEM_OOC);
+    scene->queue = rtvec_u32_new(MEM_OOC);
+
+    size_t n = scene->cluster_count;
+    const ooc_file_cluster* recs =
+        (const ooc_file_cluster*)(map + head->cluster_offset);
+    scene->clusters = rt_malloc(MEM_OOC, sizeof(ooc_cluster) * (n ? n : 1));
+    scene->nodes = rt_malloc(MEM_OOC, sizeof(ooc_node) * (n ? 2 * n - 1 : 1));
+    scene->state = rt_calloc(MEM_OOC, n ? n : 1, sizeof(atomic_int));
+    scene->data = rt_calloc(MEM_OOC, n ? n : 1, sizeof(ooc_block*));
+    scene->last_used =
+        rt_calloc(MEM_OOC, n ? n : 1, sizeof(atomic_uint_least32_t));
+    // Every cluster is at most once in each, so they never grow later
+    if (scene->clusters == NULL || scene->nodes == NULL ||
+        scene->state == NULL || scene->data == NULL ||
+        scene->last_used == NULL ||
+        !rtvec_u32_reserve(&scene->resident_list, n ? n : 1) ||
+        !rtvec_u32_reserve(&scene->queue, n ? n : 1)) {
+        ooc_scene_close(scene);
+        return NULL;
+    }
+    for (size_t c = 0; c < n; c++) {
+        scene->clusters[c].min =
+            vec3(recs[c].min[0], recs[c].min[1], recs[c].min[2]);
+        scene->clusters[c].max =
+            vec3(recs[c].max[0], recs[c].max[1], recs[c].max[2]);
+        scene->clusters[c].first = recs[c].first;
+        scene->clusters[c].count = recs[c].count;
+    }
+    // n <= sphere_count < 2^31, so the 2n - 1 node indices fit in uint32_t
+    if (n > 0) {
+        ooc_build_node(scene, 0, n);
+    }
+
+    scene->stop = false;
+    if (pthread_create(&scene->loader, NULL, &ooc_loader, scene) != 0) {
+        scene->stop = true;
+        ooc_scene_close(scene);
+        return NULL;
+    }
+    return scene;
+}
+
+void ooc_scene_close(ooc_scene* scene) {
+    pthread_mutex_lock(&scene->lock);
+    bool started = !scene->stop;
+    scene->stop = true;
+    pthread_cond_signal(&scene->wake);
+    pthread_mutex_unlock(&scene->lock);
+    if (started) {
+        pthread_join(scene->loader, NULL);
+    }
+
+    for (size_t c = 0; scene->data != NULL && c < scene->cluster_count; c++) {
+        rt_aligned_free(scene->data[c]);
+    }
+    pthread_mutex_destroy(&scene->lock);
+    pthread_cond_destroy(&scene->wake);
+    pthread_cond_destroy(&scene->idle);
+    rt_free(scene->state);
+    rt_free(scene->data);
+    rt_free(scene->last_used);
+    rt_free(scene->nodes);
+    rt_free(scene->clusters);
+    rtvec_body_ptr_free(&scene->bodies);
+    rtvec_u32_free(&scene->resident_list);
+    rtvec_u32_free(&scene->queue);
+    munmap((void*)scene->map, scene->map_size);
+    close(scene->fd);
+    rt_free(scene);
+}
+
+bool ooc_scene_add_body(ooc_scene* scene, const body_rep* body) {
+    return rtvec_body_ptr_push(&scene->bodies, body) != NULL;
+}
+
+size_t ooc_scene_sphere_count(const ooc_scene* scene) {
+    return scene->sphere_count;
+}
+
+ooc_stats ooc_scene_stats(const ooc_scene* scene) {
+    return scene->stats;
+}
+
+/// Asks the loader for a cluster, only the first request queues it
+static void ooc_request(ooc_scene* scene, uint32_t c) {
+    int expected = OOC_OUT;
+    if (!atomic_compare_exchange_strong(&scene->state[c], &expected,
+                                        OOC_QUEUED)) {
+        return;
+    }
+    pthread_mutex_lock(&scene->lock);
+    // The queued clusters are distinct, so once the ones already loaded are
+    // dropped the queue has room without growing
+    if (scene->queue.count == scene->queue.cap) {
+        memmove(scene->queue.data, scene->queue.data + scene->queue_head,
+                sizeof(uint32_t) * (scene->queue.count - scene->queue_head));
+        scene->queue.count -= scene->queue_head;
+        scene->queue_head = 0;
+    }
+    rtvec_u32_push(&scene->queue, c);
+    pthread_cond_signal(&scene->wake);
+    pthread_mutex_unlock(&scene->lock);
+}
+
+typedef struct {
+    uint32_t stamp;
+    uint32_t c;
+} ooc_age;
+
+static int ooc_age_cmp(const void* a, const void* b) {
+    const ooc_age* aa = a;
+    const ooc_age* ab = b;
+    if (aa->stamp != ab->stamp)
+        return aa->stamp < ab->stamp ? -1 : 1;
+    return aa->c < ab->c ? -1 : (aa->c > ab->c);
+}
+
+/// Drops least recently used clusters until \b need more bytes fit. Only
+/// called between passes with the lock held.
+static void ooc_evict(ooc_scene* scene, size_t need) {
+    size_t n = scene->resident_list.count;
+    ooc_age* ages = rt_malloc(MEM_OOC, sizeof(ooc_age) * (n ? n : 1));
+    for (size_t i = 0; i < n; i++) {
+        uint32_t c = scene->resident_list.data[i];
+        ages[i].stamp = atomic_load_explicit(&scene->last_used[c],
+                                             memory_order_relaxed);
+        ages[i].c = c;
+    }
+    qsort(ages, n, sizeof(ooc_age), &ooc_age_cmp);
+
+    size_t i = 0;
+    for (; i < n && scene->resident + need > scene->budget; i++) {
+        uint32_t c = ages[i].c;
+        atomic_store_explicit(&scene->state[c], OOC_OUT, memory_order_relaxed);
+        rt_aligned_free(scene->data[c]);
+        scene->data[c] = NULL;
+        scene->resident -= ooc_cluster_bytes(scene, c);
+        scene->stats.evictions++;
+    }
+    // Fewer than before, so this doesn't allocate
+    rtvec_u32_clear(&scene->resident_list);
+    for (; i < n; i++) {
+        rtvec_u32_push(&scene->resident_list, ages[i].c);
+    }
+    rt_free(ages);
+}
+
+/// Makes room for the requested clusters and waits until the loader has
+/// brought in what fits. Only called between passes.
+static void ooc_settle(ooc_scene* scene) {
+    double start = util_seconds();
+    size_t need = 0;
+
+    pthread_mutex_lock(&scene->lock);
+    for (size_t q = scene->queue_head; q < scene->queue.count; q++) {
+        need += ooc_cluster_bytes(scene, scene->queue.data[q]);
+    }
+    if (scene->resident + need > scene->budget) {
+        ooc_evict(scene, need);
+    }
+    pthread_cond_signal(&scene->wake);
+    while (scene->loading ||
+           (scene->queue_head < scene->queue.count &&
+            ooc_fits(scene, scene->queue.data[scene->queue_head]))) {
+        pthread_cond_wait(&scene->idle, &scene->lock);
+    }
+    pthread_mutex_unlock(&scene->lock);
+    scene->stats.stall_seconds += util_seconds() - start;
+}
+
+/// Entry distance of the ray into a box, false on a miss
+static bool ooc_box_hit(vector3 min, vector3 max, ray r, RT_FLOAT* t) {
+    RT_FLOAT tmin = 0.0, tmax = FLT_MAX;
+    for (int a = 0; a < 3; a++) {
+        RT_FLOAT o = vec_axis(r.pos, a);
+        RT_FLOAT d = vec_axis(r.path, a);
+        RT_FLOAT lo = vec_axis(min, a);
+        RT_FLOAT hi = vec_axis(max, a);
+        if (d == 0.0) {
+            if (o < lo || o > hi)
+                return false;
+            continue;
+        }
+        RT_FLOAT ta = (lo - o) / d;
+        RT_FLOAT tb = (hi - o) / d;
+        if (ta > tb) {
+            RT_FLOAT tmp = ta;
+            ta = tb;
+            tb = tmp;
+        }
+        tmin = ta > tmin ? ta : tmin;
+        tmax = tb < tmax ? tb : tmax;
+        if (tmin > tmax)
+            return false;
+    }
+    *t = tmin;
+    return true;
+}
+
+static int ooc_cand_cmp(const void* a, const void* b) {
+    const ooc_cand* ca = a;
+    const ooc_cand* cb = b;
+    if (ca->t != cb->t)
+        return ca->t < cb->t ? -1 : 1;
+    return ca->c < cb->c ? -1 : (ca->c > cb->c);
+}
+
+/// Clusters the ray enters before its closest hit so far, in key order
+static void ooc_collect(const ooc_scene* scene, const ooc_path* p,
+                        rtvec_ooc_cand* cand) {
+    // The tree is balanced, so its depth is at most 33
+    uint32_t stack[64];
+    int top = 0;
+    RT_FLOAT t;
+
+    rtvec_ooc_cand_clear(cand);
+    if (scene->node_count == 0) {
+        return;
+    }
+    stack[top++] = 0;
+    while (top > 0) {
+        const ooc_node* node = &scene->nodes[stack[--top]];
+        if (!ooc_box_hit(node->min, node->max, p->r, &t) ||
+            (p->best_id != OOC_NONE && t > p->best_dist)) {
+            continue;
+        }
+        if (node->left == 0) {
+            ooc_cand k = {t, node->cluster};
+            if (rtvec_ooc_cand_push(cand, k) == NULL) {
+                // A pool thread has no way to report it, and dropping the
+                // cluster would silently lose its spheres
+                fprintf(stderr, "ooc: out of memory for the cluster list\n");
+                abort();
+            }
+        } else {
+            stack[top++] = node->left;
+            stack[top++] = node->right;
+        }
+    }
+    // data is still NULL if nothing was pushed
+    if (cand->count > 1) {
+        qsort(cand->data, cand->count, sizeof(ooc_cand), &ooc_cand_cmp);
+    }
+}
+
+/// Tests the spheres of a resident cluster, walking its tree
+static void ooc_test_block(const ooc_block* block, const ooc_cluster* cl,
+                           ooc_path* p) {
+    uint32_t stack[64];
+    int top = 0;
+    RT_FLOAT t, z;
+    vector3 n;
+
+    stack[top++] = 0;
+    while (top > 0) {
+        uint32_t node = stack[--top];
+        const ooc_box* box = &block->nodes[node];
+        // Empty leaves have inverted boxes
+        if (box->min.i > box->max.i ||
+            !ooc_box_hit(box->min, box->max, p->r, &t) ||
+            (p->best_id != OOC_NONE && t > p->best_dist)) {
+            continue;
+        }
+        if (node < block->slots - 1) {
+            stack[top++] = 2 * node + 2;
+            stack[top++] = 2 * node + 1;
+            continue;
+        }
+
+        uint32_t first = (node - (block->slots - 1)) * OOC_LEAF;
+        uint32_t end = first + OOC_LEAF < cl->count ? first + OOC_LEAF
+                                                    : cl->count;
+        for (uint32_t j = first; j < end; j++) {
+            const ooc_sphere* sph = &block->spheres[j];
+            uint32_t id = cl->first + j;
+            if (id != p->ignore && sphere_hit(&sph->sph, p->r, &z, &n) &&
+                (p->best_id == OOC_NONE || z < p->best_dist)) {
+                p->best_id = id;
+                p->best_dist = z;
+                p->best_norm = n;
+                p->best_col = sph->col;
+                p->best_refl = sph->reflectivity;
+                p->best_diff = sph->diffusivity;
+            }
+        }
+    }
+}
+
+/// Closest hit of the current segment of a path, or OOC_WAIT if a cluster
+/// it needs isn't resident. The search goes on where it stopped next time.
+static int ooc_closest(ooc_scene* scene, ooc_path* p, rtvec_ooc_cand* cand) {
+    RT_FLOAT z;
+    vector3 n;
+
+    if (p->fresh) {
+        for (size_t i = 0; i < scene->bodies.count; i++) {
+            const body_rep* ref = scene->bodies.data[i];
+            uint32_t id = scene->sphere_count + i;
+            if (id != p->ignore && ref->_col_impl(ref, p->r, &z, &n) &&
+                (p->best_id == OOC_NONE || z < p->best_dist)) {
+                p->best_id = id;
+                p->best_dist = z;
+                p->best_norm = n;
+            }
+        }
+        p->fresh = false;
+        p->resume_t = -FLT_MAX;
+        p->resume_c = 0;
+    }
+
+    ooc_collect(scene, p, cand);
+    for (size_t k = 0; k < cand->count; k++) {
+        ooc_cand key = cand->data[k];
+        if (p->best_id != OOC_NONE && key.t > p->best_dist) {
+            break;
+        }
+        // Tested in an earlier pass
+        if (key.t < p->resume_t ||
+            (key.t == p->resume_t && key.c < p->resume_c)) {
+            continue;
+        }
+        if (atomic_load_explicit(&scene->state[key.c],
+                                 memory_order_acquire) != OOC_IN) {
+            ooc_request(scene, key.c);
+            p->resume_t = key.t;
+            p->resume_c = key.c;
+            atomic_fetch_add_explicit(&scene->waits, 1, memory_order_relaxed);
+            return OOC_WAIT;
+        }
+        atomic_store_explicit(&scene->last_used[key.c], scene->pass,
+                              memory_order_relaxed);
+
+        ooc_test_block(scene->data[key.c], &scene->clusters[key.c], p);
+    }
+    return p->best_id == OOC_NONE ? OOC_MISS : OOC_HIT;
+}
+
+/// Starts a new segment of the path
+static void ooc_path_segment(ooc_path* p) {
+    p->fresh = true;
+    p->best_id = OOC_NONE;
+    p->best_dist = FLT_MAX;
+}
+
+static void ooc_path_init(ooc_path* p, ray r, uint32_t pixel) {
+    p->r = r;
+    p->sum = color_black();
+    p->weight = 1.0;
+    p->ignore = OOC_NONE;
+    p->pixel = pixel;
+    p->depth = 0;
+    ooc_path_segment(p);
+}
+
+/** Follows a path until it is done or waits for a cluster.
+ *
+ * Same shading as display_trace_ray_accel(), unrolled: every hit adds its
+ * color weighted by 1 - reflectivity and by the reflectivities before it.
+ *
+ * @return false if the path was deferred
+ */
+static bool ooc_trace_path(const ooc_job* job, ooc_path* p,
+                           rtvec_ooc_cand* cand, uint64_t* rays) {
+    ooc_scene* scene = job->scene;
+    color c;
+    RT_FLOAT refl, diff;
+
+    for (;;) {
+        int res = ooc_closest(scene, p, cand);
+        if (res == OOC_WAIT) {
+            return false;
+        }
+        (*rays)++;
+        if (res == OOC_MISS) {
+            // Background color
+            p->sum = color_sum(
+                p->sum, color_mul(p->weight, color_new(0.71, 0.784, 0.798)));
+            break;
+        }
+
+        if (p->best_id < scene->sphere_count) {
+            c = p->best_col;
+            refl = p->best_refl;
+            diff = p->best_diff;
+        } else {
+            const body_rep* ref =
+                scene->bodies.data[p->best_id - scene->sphere_count];
+            tex_hit th = {ray_dist(p->r, p->best_dist), 0.0};
+            c = ref->tex.refl(ref->tex.impl, p->r, p->best_norm, &th);
+            refl = ref->tex.reflectivity;
+            diff = ref->tex.diffusivity;
+        }
+        p->sum = color_sum(p->sum, color_mul(p->weight * (1.0 - refl), c));
+        if (p->depth == job->disp->max_refl) {
+            break;
+        }
+
+        // The jitter only depends on the pixel and the bounce
+        rng_seed(rng_thread(), job->seed, rng_hash(p->pixel) + p->depth);
+        brdf_sample bs = brdf_sample_dir(p->r.path, p->best_norm, diff);
+        if (bs.weight <= 0.0) {
+            break;
+        }
+        p->r = ray_new(ray_dist(p->r, p->best_dist), bs.dir);
+        p->weight *= refl * bs.weight;
+        p->ignore = p->best_id;
+        p->depth++;
+        ooc_path_segment(p);
+    }
+    job->disp->color_buffer[p->pixel] = p->sum;
+    return true;
+}
+
+/// Traces one chunk of the work list, run by the pool
+static void ooc_trace_chunk(void* arg, size_t index, unsigned int worker) {
+    ooc_job* job = (ooc_job*)arg;
+    size_t begin = index * OOC_CHUNK;
+    size_t end = begin + OOC_CHUNK < job->work_count ? begin + OOC_CHUNK
+                                                     : job->work_count;
+    rtvec_ooc_cand cand = rtvec_ooc_cand_new(MEM_OOC);
+    size_t kept = 0;
+    uint64_t rays = 0;
+
+    for (size_t i = begin; i < end; i++) {
+        uint32_t p = job->work[i];
+        if (!ooc_trace_path(job, &job->paths[p], &cand, &rays)) {
+            job->work[begin + kept++] = p;
+        }
+    }
+    job->kept[index] = kept;
+    rtvec_ooc_cand_free(&cand);
+    atomic_fetch_add_explicit(&job->scene->rays, rays, memory_order_relaxed);
+}
+
+void ooc_render(ooc_scene* scene, const display* const disp, rt_pool* pool,
+                uint64_t seed) {
+    double start = util_seconds();
+    RT_FLOAT disp_x, disp_y;
+    size_t pixels = (size_t)disp->d_w * disp->d_h;
+    size_t batch = pixels < OOC_BATCH ? pixels : OOC_BATCH;
+
+    pthread_mutex_lock(&scene->lock);
+    size_t peak = scene->resident;
+    memset(&scene->stats, 0, sizeof(scene->stats));
+    scene->stats.resident_peak = peak;
+    pthread_mutex_unlock(&scene->lock);
+    atomic_store(&scene->rays, 0);
+    atomic_store(&scene->waits, 0);
+
+    display_view_extent(disp, &disp_x, &disp_y);
+    size_t max_chunks = (batch + OOC_CHUNK - 1) / OOC_CHUNK + 1;
+    ooc_path* paths =
+        rt_malloc(MEM_OOC, sizeof(ooc_path) * (batch ? batch : 1));
+    size_t* kept = rt_malloc(MEM_OOC, sizeof(size_t) * max_chunks);
+    rtvec_u32 work = rtvec_u32_new(MEM_OOC);
+    ooc_job job = {scene, disp, paths, NULL, 0, kept, seed};
+    // Nothing is traced if out of memory. Past this the work list only
+    // shrinks, so resizing it never allocates.
+    if (paths == NULL || kept == NULL ||
+        !rtvec_u32_reserve(&work, batch ? batch : 1)) {
+        pixels = 0;
+    }
+
+    // Batches of pixels keep the path states small for big frames
+    for (size_t b0 = 0; b0 < pixels; b0 += batch) {
+        size_t n = pixels - b0 < batch ? pixels - b0 : batch;
+        rtvec_u32_resize(&work, n);
+        for (size_t i = 0; i < n; i++) {
+            size_t px = b0 + i;
+            ooc_path_init(&paths[i],
+                          display_camera_ray(disp, disp_x, disp_y,
+                                             px % disp->d_w, px / disp->d_w),
+                          px);
+            work.data[i] = i;
+        }
+
+        while (work.count > 0) {
+            scene->pass++;
+            scene->stats.passes++;
+            job.work = work.data;
+            job.work_count = work.count;
+            size_t chunks = (work.count + OOC_CHUNK - 1) / OOC_CHUNK;
+            pool_run(pool, chunks, &ooc_trace_chunk, &job);
+
+            // Deferred paths of every chunk are at its front
+            size_t count = 0;
+            for (size_t ch = 0; ch < chunks; ch++) {
+                memmove(&work.data[count], &work.data[ch * OOC_CHUNK],
+                        sizeof(uint32_t) * kept[ch]);
+                count += kept[ch];
+            }
+            rtvec_u32_resize(&work, count);
+            if (count > 0) {
+                ooc_settle(scene);
+            }
+        }
+    }
+
+    rtvec_u32_free(&work);
+    rt_free(kept);
+    rt_free(paths);
+
+    pthread_mutex_lock(&scene->lock);
+    scene->stats.resident_bytes = scene->resident;
+    pthread_mutex_unlock(&scene->lock);
+    scene->stats.rays = atomic_load(&scene->rays);
+    scene->stats.waits = atomic_load(&scene->waits);
+    scene->stats.trace_seconds = util_seconds() - start;
+}
@@ -0,0 +1,107 @@
+#ifndef RAY_TRACE_OOC_H
+#define RAY_TRACE_OOC_H
+
+#include <include/body.h>
+#include <include/errors.h>
+#include <include/output.h>
+#include <include/sched.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Default sphere count per cluster
+#define OOC_CLUSTER_SIZE 256
+/// Pixels traced per batch, bounds the memory of the path states
+#define OOC_BATCH 65536
+/// Paths per pool item
+#define OOC_CHUNK 256
+
+/// Sphere as stored in memory by the out-of-core renderer
+typedef struct {
+    body_sphere sph;       ///< Geometry
+    color col;             ///< Single color texture
+    RT_FLOAT reflectivity; ///< See ray_texture
+    RT_FLOAT diffusivity;  ///< See ray_texture
+} ooc_sphere;
+
+/** Writes a scene file for ooc_scene_open().
+ *
+ * Spheres are sorted along a Morton curve of their centers and cut into
+ * clusters of \b cluster_size, so every cluster covers a small region of
+ * space and can be paged in on its own. The file uses the native byte order.
+ *
+ * @param cluster_size Spheres per cluster, e.g. OOC_CLUSTER_SIZE
+ */
+RT_RES ooc_write(const char* path, const ooc_sphere* spheres, size_t count,
+                 unsigned int cluster_size);
+
+/** Converts a sphere body with a single color texture.
+ *
+ * @return false if the body is something else
+ */
+bool ooc_sphere_from_body(const body_rep* const body, ooc_sphere* out);
+
+/// Counters of an out-of-core scene, reset by every ooc_render()
+typedef struct {
+    uint64_t rays;         ///< Ray segments finished
+    uint64_t waits;        ///< Times a ray was deferred for a cluster
+    uint64_t passes;       ///< Passes over the deferred rays
+    uint64_t loads;        ///< Clusters paged in
+    uint64_t evictions;    ///< Clusters dropped
+    size_t resident_bytes; ///< Cluster bytes in memory after the render
+    size_t resident_peak;  ///< Highest resident byte count
+    double stall_seconds;  ///< Time spent waiting for the loader
+    double trace_seconds;  ///< Wall time of the render
+} ooc_stats;
+
+/** Scene whose spheres stay on disk.
+ *
+ * The file is memory mapped, but tracing never touches the mapping. A loader
+ * thread copies the clusters rays ask for into memory, up to a residency
+ * budget, and least recently used clusters are dropped when more room is
+ * needed. A ray that reaches a cluster that isn't resident yet is put aside
+ * and retried in a later pass, so the tracing threads keep working on other
+ * rays instead of waiting on page faults.
+ *
+ * Only the cluster bounds (a small tree over them) are always in memory.
+ * Unbounded bodies like floors can be added with ooc_scene_add_body() and are
+ * tested by every ray.
+ *
+ * A scene must not be rendered by two threads at once.
+ */
+typedef struct ooc_scene ooc_scene;
+
+/** Opens a file written by ooc_write().
+ *
+ * @param budget Max bytes of resident cluster data. At least one cluster is
+ * always allowed in, whatever the budget.
+ * @return NULL if the file can't be read, isn't a scene file or is
+ * truncated or damaged (a table or cluster outside the file)
+ */
+ooc_scene* ooc_scene_open(const char* path, size_t budget);
+
+/// Stops the loader and frees everything, added bodies are not freed
+void ooc_scene_close(ooc_scene* scene);
+
+/// Adds an in-core body, it must outlive the scene. False if out of memory.
+bool ooc_scene_add_body(ooc_scene* scene, const body_rep* body);
+
+/// Sphere count of the file
+size_t ooc_scene_sphere_count(const ooc_scene* scene);
+
+/** Traces the frame of \b disp into its color buffer, using the camera, size
+ * and reflection limit of the display.
+ *
+ * Shading is the same as display_trace_ray(), so disp->env is ignored. The
+ * random jitter of a reflection only depends on \b seed, the pixel and the
+ * bounce, so the image doesn't depend on the order clusters arrive in.
+ * Nothing is traced if the path states can't be allocated.
+ */
+void ooc_render(ooc_scene* scene, const display* const disp, rt_pool* pool,
+                uint64_t seed);
+
+/// Stats of the last render
+ooc_stats ooc_scene_stats(const ooc_scene* scene);
+
+#endif
@@ -0,0 +1,634 @@
+#include "encode.h"
+#include <include/prof.h>
+#include <include/util.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Strips compressed by one call of encoder_rows()
+typedef struct {
+    const display* disp;
+    unsigned int first;    ///< First row of the first strip
+    encode_strip* strips;  ///< One per strip
+} encode_job;
+
+/// Rows [*begin, *end) of strip \b index of \b job
+static void encode_rows_of(const encode_job* job, size_t index,
+                           unsigned int* begin, unsigned int* end) {
+    *begin = job->first + (unsigned int)index * ENCODE_STRIP_ROWS;
+    *end = *begin + ENCODE_STRIP_ROWS;
+    if (*end > job->disp->d_h) {
+        *end = job->disp->d_h;
+    }
+}
+
+/// Converts a pixel like stream_p6()
+static inline void encode_pixel(const color* c, unsigned char* p) {
+    p[0] = (unsigned char)(c->r * 255.999);
+    p[1] = (unsigned char)(c->g * 255.999);
+    p[2] = (unsigned char)(c->b * 255.999);
+}
+
+static void encode_be32(unsigned char* p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+static bool encoder_begin(disp_encoder* enc) {
+    enc->f = fopen(enc->path, "wb");
+    enc->next_row = 0;
+    enc->adler = 1;
+    enc->failed = enc->f == NULL;
+    return enc->f != NULL;
+}
+
+/// Writes \b n bytes unless an earlier write failed
+static void encoder_write(disp_encoder* enc, const void* p, size_t n) {
+    if (!enc->failed && fwrite(p, 1, n, enc->f) != n) {
+        enc->failed = true;
+    }
+}
+
+#define ADLER_BASE 65521
+/// Bytes that can be summed before the sums must be reduced
+#define ADLER_NMAX 5552
+
+static uint32_t adler32(uint32_t adler, const unsigned char* p, size_t n) {
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    while (n > 0) {
+        size_t k = n < ADLER_NMAX ? n : ADLER_NMAX;
+        n -= k;
+        while (k-- > 0) {
+            a += *p++;
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+    }
+    return b << 16 | a;
+}
+
+/// Adler-32 of two blocks joined, from their own checksums (as in zlib)
+static uint32_t adler32_combine(uint32_t a1, uint32_t a2, size_t len2) {
+    uint32_t rem = len2 % ADLER_BASE;
+    uint32_t sum1 = a1 & 0xffff;
+    uint32_t sum2 = (uint32_t)(((uint64_t)rem * sum1) % ADLER_BASE);
+    sum1 += (a2 & 0xffff) + ADLER_BASE - 1;
+    sum2 += (a1 >> 16) + (a2 >> 16) + ADLER_BASE - rem;
+    if (sum1 >= ADLER_BASE) {
+        sum1 -= ADLER_BASE;
+    }
+    if (sum1 >= ADLER_BASE) {
+        sum1 -= ADLER_BASE;
+    }
+    if (sum2 >= 2 * ADLER_BASE) {
+        sum2 -= 2 * ADLER_BASE;
+    }
+    if (sum2 >= ADLER_BASE) {
+        sum2 -= ADLER_BASE;
+    }
+    return sum2 << 16 | sum1;
+}
+
+/** Compresses the strips that are complete once rows up to \b row_end are
+ * final, in parallel on the pool of \b enc, and writes them in order. The
+ * last strip of the frame may be shorter.
+ */
+static void encoder_rows(disp_encoder* enc, const display* const disp,
+                         unsigned int row_end, pool_fn fn) {
+    unsigned int last =
+        row_end == disp->d_h ? row_end
+                             : row_end / ENCODE_STRIP_ROWS * ENCODE_STRIP_ROWS;
+    if (last <= enc->next_row || enc->failed) {
+        return;
+    }
+    size_t count =
+        (last - enc->next_row + ENCODE_STRIP_ROWS - 1) / ENCODE_STRIP_ROWS;
+    encode_job job = {disp, enc->next_row,
+                      rt_calloc(MEM_OUTPUT, count, sizeof(encode_strip))};
+    if (job.strips == NULL) {
+        enc->failed = true;
+        return;
+    }
+
+    if (enc->pool != NULL && count > 1) {
+        pool_run(enc->pool, count, fn, &job);
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            fn(&job, i, 0);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        encode_strip* s = &job.strips[i];
+        if (s->data == NULL) {
+            enc->failed = true;
+        }
+        encoder_write(enc, s->data, s->size);
+        enc->adler = adler32_combine(enc->adler, s->adler, s->raw_size);
+        rt_free(s->data);
+    }
+    rt_free(job.strips);
+    enc->next_row = last;
+}
+
+static void encoder_end(disp_encoder* enc) {
+    if (fclose(enc->f) != 0) {
+        enc->failed = true;
+    }
+    enc->f = NULL;
+}
+
+/* QOI */
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+
+/// Pixel packed as 0xRRGGBB, alpha is always 255
+static inline uint32_t qoi_pixel(const display* disp, size_t i) {
+    unsigned char p[3];
+    encode_pixel(&disp->color_buffer[i], p);
+    return (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+}
+
+static inline unsigned int qoi_hash(uint32_t px) {
+    return ((px >> 16) * 3 + ((px >> 8) & 0xff) * 5 + (px & 0xff) * 7 +
+            255 * 11) %
+           64;
+}
+
+/** Encodes one strip as QOI ops that continue the stream of the strips
+ * before it. The decoder's previous pixel is the last pixel of the strip
+ * before, and its index holds at least what that strip puts there, so the
+ * index is seeded from it. Slots that aren't known are never referenced.
+ */
+static void qoi_strip(void* arg, size_t index, unsigned int worker) {
+    (void)worker;
+    PROF_BEGIN(span);
+    const encode_job* job = (const encode_job*)arg;
+    const display* disp = job->disp;
+    encode_strip* out = &job->strips[index];
+    unsigned int row_begin, row_end;
+    encode_rows_of(job, index, &row_begin, &row_end);
+    size_t begin = (size_t)row_begin * disp->d_w;
+    size_t end = (size_t)row_end * disp->d_w;
+    uint32_t seen[64], prev = 0, px;
+    bool known[64] = {false};
+    unsigned int run = 0;
+
+    if (begin > 0) {
+        size_t from = begin > ENCODE_STRIP_ROWS * (size_t)disp->d_w
+                          ? begin - ENCODE_STRIP_ROWS * (size_t)disp->d_w
+                          : 0;
+        for (size_t i = from; i < begin; i++) {
+            px = qoi_pixel(disp, i);
+            seen[qoi_hash(px)] = px;
+            known[qoi_hash(px)] = true;
+        }
+        prev = qoi_pixel(disp, begin - 1);
+    }
+    // Every op is at most 4 bytes per pixel
+    unsigned char* p = out->data = rt_malloc(MEM_OUTPUT, (end - begin) * 4);
+    if (p == NULL) {
+        return;
+    }
+
+    for (size_t i = begin; i < end; i++) {
+        px = qoi_pixel(disp, i);
+        if (px == prev) {
+            if (++run == 62) {
+                *p++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            *p++ = QOI_OP_RUN | (run - 1);
+            run = 0;
+        }
+        unsigned int h = qoi_hash(px);
+        if (known[h] && seen[h] == px) {
+            *p++ = QOI_OP_INDEX | h;
+        } else {
+            seen[h] = px;
+            known[h] = true;
+            signed char vr = (signed char)((px >> 16) - (prev >> 16));
+            signed char vg =
+                (signed char)(((px >> 8) & 0xff) - ((prev >> 8) & 0xff));
+            signed char vb = (signed char)((px & 0xff) - (prev & 0xff));
+            signed char vg_r = vr - vg, vg_b = vb - vg;
+            if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                *p++ = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+            } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 &&
+                       vg_b > -9 && vg_b < 8) {
+                *p++ = QOI_OP_LUMA | (vg + 32);
+                *p++ = (vg_r + 8) << 4 | (vg_b + 8);
+            } else {
+                *p++ = QOI_OP_RGB;
+                *p++ = px >> 16;
+                *p++ = (px >> 8) & 0xff;
+                *p++ = px & 0xff;
+            }
+        }
+        prev = px;
+    }
+    if (run > 0) {
+        *p++ = QOI_OP_RUN | (run - 1);
+    }
+    out->size = p - out->data;
+    out->adler = 1;
+    PROF_END(span, "encode", (int)index);
+}
+
+static bool qoi_begin(void* impl, const display* const disp) {
+    disp_encoder* enc = (disp_encoder*)impl;
+    if (!encoder_begin(enc)) {
+        return false;
+    }
+    // Magic, size, 3 channels, sRGB
+    unsigned char header[14] = {'q', 'o', 'i', 'f'};
+    encode_be32(header + 4, disp->d_w);
+    encode_be32(header + 8, disp->d_h);
+    header[12] = 3;
+    header[13] = 0;
+    encoder_write(enc, header, sizeof(header));
+    return true;
+}
+
+static void qoi_rows(void* impl, const display* const disp,
+                     unsigned int row_begin, unsigned int row_end) {
+    (void)row_begin;
+    encoder_rows((disp_encoder*)impl, disp, row_end, &qoi_strip);
+}
+
+static void qoi_end(void* impl, const display* const disp) {
+    (void)disp;
+    disp_encoder* enc = (disp_encoder*)impl;
+    static const unsigned char padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    encoder_write(enc, padding, sizeof(padding));
+    encoder_end(enc);
+}
+
+disp_stream stream_qoi(disp_encoder* impl) {
+    disp_stream ret = {impl, &qoi_begin, &qoi_rows, &qoi_end};
+    return ret;
+}
+
+/* PNG */
+
+static uint32_t crc_table[256];
+/// Fixed Huffman codes of the literal/length symbols, bit reversed
+static uint16_t lit_code[288];
+static unsigned char lit_bits[288];
+/// Length code (minus 257) of every match length
+static unsigned char len_sym[259];
+/// Distance code of distances - 1 below 256, then of (distance - 1) >> 7
+static unsigned char dist_sym[512];
+static pthread_once_t png_once = PTHREAD_ONCE_INIT;
+
+static const uint16_t len_base[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned char len_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                            1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                            4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,    49,    65,
+    97,  129, 193, 257, 385, 513,  769,  1025, 1537, 2049, 3073,  4097,  6145,
+    8193, 12289, 16385, 24577};
+static const unsigned char dist_extra[30] = {0, 0, 0,  0,  1,  1,  2,  2,
+                                             3, 3, 4,  4,  5,  5,  6,  6,
+                                             7, 7, 8,  8,  9,  9,  10, 10,
+                                             11, 11, 12, 12, 13, 13};
+
+static unsigned int png_reverse(unsigned int code, unsigned int bits) {
+    unsigned int ret = 0;
+    for (unsigned int i = 0; i < bits; i++) {
+        ret = ret << 1 | ((code >> i) & 1);
+    }
+    return ret;
+}
+
+static void png_init(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[n] = c;
+    }
+    for (unsigned int v = 0; v < 288; v++) {
+        unsigned int code, bits;
+        if (v < 144) {
+            code = 0x30 + v, bits = 8;
+        } else if (v < 256) {
+            code = 0x190 + v - 144, bits = 9;
+        } else if (v < 280) {
+            code = v - 256, bits = 7;
+        } else {
+            code = 0xc0 + v - 280, bits = 8;
+        }
+        lit_code[v] = png_reverse(code, bits);
+        lit_bits[v] = bits;
+    }
+    for (unsigned int s = 0; s < 29; s++) {
+        unsigned int to = s < 28 ? len_base[s + 1] - 1u : 258u;
+        for (unsigned int l = len_base[s]; l <= to; l++) {
+            len_sym[l] = s;
+        }
+    }
+    for (unsigned int s = 0; s < 30; s++) {
+        unsigned int from = dist_base[s] - 1;
+        unsigned int to = from + (1u << dist_extra[s]);
+        for (unsigned int d = from; d < to; d++) {
+            dist_sym[d < 256 ? d : 256 + (d >> 7)] = s;
+        }
+    }
+}
+
+static uint32_t png_crc(uint32_t crc, const unsigned char* p, size_t n) {
+    crc = ~crc;
+    while (n-- > 0) {
+        crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/// LSB first bit writer of a deflate stream
+typedef struct {
+    unsigned char* p;
+    uint64_t bits;
+    unsigned int count;
+} png_bits;
+
+static inline void png_put(png_bits* w, uint32_t v, unsigned int n) {
+    w->bits |= (uint64_t)v << w->count;
+    w->count += n;
+    while (w->count >= 8) {
+        *w->p++ = w->bits & 0xff;
+        w->bits >>= 8;
+        w->count -= 8;
+    }
+}
+
+/// Pads to the next byte boundary
+static void png_align(png_bits* w) {
+    if (w->count > 0) {
+        png_put(w, 0, 8 - w->count);
+    }
+}
+
+#define PNG_HASH_BITS 15
+#define PNG_WINDOW 32768
+#define PNG_MAX_MATCH 258
+
+static inline uint32_t png_hash(const unsigned char* p) {
+    uint32_t v = p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+    return (v * 2654435761u) >> (32 - PNG_HASH_BITS);
+}
+
+/** Deflates \b in as one block with the fixed Huffman codes, matching
+ * greedily against the last position of every hash. A block that isn't the
+ * last of the stream is followed by an empty stored block, so the output
+ * ends on a byte boundary and the next strip can be appended.
+ */
+static unsigned char* png_deflate(const unsigned char* in, size_t n,
+                                  bool last, int32_t* head,
+                                  unsigned char* out) {
+    png_bits w = {out, 0, 0};
+    size_t i = 0;
+
+    memset(head, 0xff, sizeof(int32_t) << PNG_HASH_BITS);
+    png_put(&w, last, 1);
+    png_put(&w, 1, 2);
+    while (i + 3 <= n) {
+        uint32_t h = png_hash(in + i);
+        int32_t cand = head[h];
+        head[h] = (int32_t)i;
+        size_t len = 0;
+        if (cand >= 0 && i - cand <= PNG_WINDOW &&
+            memcmp(in + cand, in + i, 3) == 0) {
+            size_t max = n - i < PNG_MAX_MATCH ? n - i : PNG_MAX_MATCH;
+            len = 3;
+            while (len < max && in[cand + len] == in[i + len]) {
+                len++;
+            }
+        }
+        if (len == 0) {
+            png_put(&w, lit_code[in[i]], lit_bits[in[i]]);
+            i++;
+            continue;
+        }
+        unsigned int ls = len_sym[len];
+        png_put(&w, lit_code[257 + ls], lit_bits[257 + ls]);
+        png_put(&w, len - len_base[ls], len_extra[ls]);
+        unsigned int d = (unsigned int)(i - cand) - 1;
+        unsigned int ds = dist_sym[d < 256 ? d : 256 + (d >> 7)];
+        png_put(&w, png_reverse(ds, 5), 5);
+        png_put(&w, d + 1 - dist_base[ds], dist_extra[ds]);
+        // Only the end of a match goes into the table, the positions inside
+        // it rarely start a longer one
+        size_t next = i + len;
+        if (next >= 2 && next + 1 <= n) {
+            head[png_hash(in + next - 2)] = (int32_t)(next - 2);
+        }
+        i = next;
+    }
+    for (; i < n; i++) {
+        png_put(&w, lit_code[in[i]], lit_bits[in[i]]);
+    }
+    png_put(&w, lit_code[256], lit_bits[256]);
+    if (!last) {
+        png_put(&w, 0, 3);
+        png_align(&w);
+        *w.p++ = 0x00;
+        *w.p++ = 0x00;
+        *w.p++ = 0xff;
+        *w.p++ = 0xff;
+    }
+    png_align(&w);
+    return w.p;
+}
+
+static inline unsigned char png_paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+/// Converts row \b y of the framebuffer to RGB bytes
+static void png_row(const display* disp, unsigned int y, unsigned char* p) {
+    const color* c = &disp->color_buffer[(size_t)y * disp->d_w];
+    for (unsigned int x = 0; x < disp->d_w; x++, p += 3) {
+        encode_pixel(&c[x], p);
+    }
+}
+
+/** Filters \b cur against \b prev into \b out (filter byte first), with the
+ * filter that has the smallest sum of absolute differences.
+ */
+static void png_filter(const unsigned char* cur, const unsigned char* prev,
+                       size_t n, unsigned char* out) {
+    unsigned int sum[5] = {0};
+    for (size_t i = 0; i < n; i++) {
+        int a = i >= 3 ? cur[i - 3] : 0, b = prev[i];
+        int c = i >= 3 ? prev[i - 3] : 0;
+        sum[0] += abs((signed char)cur[i]);
+        sum[1] += abs((signed char)(cur[i] - a));
+        sum[2] += abs((signed char)(cur[i] - b));
+        sum[4] += abs((signed char)(cur[i] - png_paeth(a, b, c)));
+    }
+    unsigned int best = 0;
+    for (unsigned int f = 1; f < 5; f++) {
+        if (f != 3 && sum[f] < sum[best]) {
+            best = f;
+        }
+    }
+    *out++ = best;
+    for (size_t i = 0; i < n; i++) {
+        int a = i >= 3 ? cur[i - 3] : 0, b = prev[i];
+        int c = i >= 3 ? prev[i - 3] : 0;
+        switch (best) {
+        case 0:
+            out[i] = cur[i];
+            break;
+        case 1:
+            out[i] = cur[i] - a;
+            break;
+        case 2:
+            out[i] = cur[i] - b;
+            break;
+        default:
+            out[i] = cur[i] - png_paeth(a, b, c);
+            break;
+        }
+    }
+}
+
+/** Filters and deflates one strip into a whole IDAT chunk. The row above the
+ * strip is converted again from the framebuffer, so strips don't depend on
+ * each other.
+ */
+static void png_strip(void* arg, size_t index, unsigned int worker) {
+    (void)worker;
+    PROF_BEGIN(span);
+    const encode_job* job = (const encode_job*)arg;
+    const display* disp = job->disp;
+    encode_strip* out = &job->strips[index];
+    unsigned int row_begin, row_end;
+    encode_rows_of(job, index, &row_begin, &row_end);
+    size_t row = (size_t)disp->d_w * 3;
+    size_t n = (row_end - row_begin) * (row + 1);
+    // Filtered strip, the rows above and current and the hash table
+    unsigned char* raw = rt_malloc(MEM_OUTPUT, n + 2 * row);
+    unsigned char* prev = raw + n;
+    unsigned char* cur = prev + row;
+    int32_t* head = rt_malloc(MEM_OUTPUT, sizeof(int32_t) << PNG_HASH_BITS);
+    // Chunk length and type, at most 9 bits per byte, the block ends and the
+    // CRC
+    out->data = rt_malloc(MEM_OUTPUT, 8 + n + n / 8 + 16);
+    if (raw == NULL || head == NULL || out->data == NULL) {
+        rt_free(raw);
+        rt_free(head);
+        rt_free(out->data);
+        out->data = NULL;
+        return;
+    }
+
+    if (row_begin > 0) {
+        png_row(disp, row_begin - 1, prev);
+    } else {
+        memset(prev, 0, row);
+    }
+    for (unsigned int y = row_begin; y < row_end; y++) {
+        png_row(disp, y, cur);
+        png_filter(cur, prev, row, raw + (y - row_begin) * (row + 1));
+        unsigned char* t = prev;
+        prev = cur;
+        cur = t;
+    }
+    out->adler = adler32(1, raw, n);
+    out->raw_size = n;
+
+    memcpy(out->data + 4, "IDAT", 4);
+    unsigned char* end = png_deflate(raw, n, row_end == disp->d_h, head,
+                                     out->data + 8);
+    uint32_t len = (uint32_t)(end - out->data - 8);
+    encode_be32(out->data, len);
+    encode_be32(end, png_crc(0, out->data + 4, len + 4));
+    out->size = end + 4 - out->data;
+    rt_free(raw);
+    rt_free(head);
+    PROF_END(span, "encode", (int)index);
+}
+
+static void png_chunk(disp_encoder* enc, const char* type,
+                      const unsigned char* data, uint32_t len) {
+    unsigned char b[4];
+    encode_be32(b, len);
+    encoder_write(enc, b, 4);
+    encoder_write(enc, type, 4);
+    if (len > 0) {
+        encoder_write(enc, data, len);
+    }
+    uint32_t crc = png_crc(png_crc(0, (const unsigned char*)type, 4), data,
+                           len);
+    encode_be32(b, crc);
+    encoder_write(enc, b, 4);
+}
+
+static bool png_begin(void* impl, const display* const disp) {
+    disp_encoder* enc = (disp_encoder*)impl;
+    pthread_once(&png_once, &png_init);
+    if (!encoder_begin(enc)) {
+        return false;
+    }
+    static const unsigned char signature[8] = {0x89, 'P',  'N',  'G',
+                                               '\r', '\n', 0x1a, '\n'};
+    encoder_write(enc, signature, sizeof(signature));
+    // Size, 8 bit RGB, deflate, adaptive filters, not interlaced
+    unsigned char ihdr[13] = {0};
+    encode_be32(ihdr, disp->d_w);
+    encode_be32(ihdr + 4, disp->d_h);
+    ihdr[8] = 8;
+    ihdr[9] = 2;
+    png_chunk(enc, "IHDR", ihdr, sizeof(ihdr));
+    // zlib header: deflate with a 32K window, no dictionary
+    static const unsigned char zlib[2] = {0x78, 0x01};
+    png_chunk(enc, "IDAT", zlib, sizeof(zlib));
+    return true;
+}
+
+static void png_rows(void* impl, const display* const disp,
+                     unsigned int row_begin, unsigned int row_end) {
+    (void)row_begin;
+    encoder_rows((disp_encoder*)impl, disp, row_end, &png_strip);
+}
+
+static void png_end(void* impl, const display* const disp) {
+    (void)disp;
+    disp_encoder* enc = (disp_encoder*)impl;
+    unsigned char adler[4];
+    encode_be32(adler, enc->adler);
+    png_chunk(enc, "IDAT", adler, sizeof(adler));
+    png_chunk(enc, "IEND", NULL, 0);
+    encoder_end(enc);
+}
+
+disp_stream stream_png(disp_encoder* impl) {
+    disp_stream ret = {impl, &png_begin, &png_rows, &png_end};
+    return ret;
+}
+
+void qoi_out(const display* const disp) {
+    display_write_stream(disp, stream_qoi((disp_encoder*)disp->output_impl));
+}
+
+void png_out(const display* const disp) {
+    display_write_stream(disp, stream_png((disp_encoder*)disp->output_impl));
+}
@@ -0,0 +1,65 @@
+#ifndef RAY_TRACE_ENCODE_H
+#define RAY_TRACE_ENCODE_H
+
+#include "pipeline.h"
+#include <include/sched.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/// Rows of a strip, the unit that is compressed on its own
+#define ENCODE_STRIP_ROWS 16
+
+/// Compressed data of one strip
+typedef struct {
+    unsigned char* data; ///< Bytes to write
+    size_t size;         ///< Bytes used
+    uint32_t adler;      ///< Adler-32 of the uncompressed bytes (PNG)
+    size_t raw_size;     ///< Uncompressed bytes (PNG)
+} encode_strip;
+
+/** File output implementation for the QOI and PNG streams.
+ *
+ * Rows are compressed in strips of ENCODE_STRIP_ROWS, every strip on its own
+ * so that the strips handed over at once are compressed in parallel on
+ * \b pool, and written in order. The pixels are converted from the
+ * framebuffer as they are compressed, like stream_p6() converts them.
+ *
+ * QOI strips start from the pixel before them and from an index built from
+ * the strip before, so they join into one valid stream. PNG strips are
+ * deflate blocks with fixed Huffman codes, each ending on a byte boundary
+ * and written as its own IDAT chunk, and the checksum of the zlib stream is
+ * combined from the strips.
+ *
+ * The stream interface has no way to report errors, so a failed open,
+ * allocation, write or close sets \b failed and the rest of the frame is
+ * skipped. Check it after the frame was written.
+ */
+typedef struct {
+    const char* path; ///< Output path
+    /// Pool that compresses the strips, NULL compresses them on the writing
+    /// thread
+    rt_pool* pool;
+    // Set while the stream is open
+    FILE* f;
+    unsigned int next_row; ///< First row not compressed yet
+    uint32_t adler;        ///< Adler-32 of the strips written so far (PNG)
+    bool failed;           ///< Whether the file is incomplete
+} disp_encoder;
+
+/// Returns a QOI stream writing to \b impl->path
+disp_stream stream_qoi(disp_encoder* impl);
+
+/// Returns a PNG (8 bit RGB) stream writing to \b impl->path
+disp_stream stream_png(disp_encoder* impl);
+
+/// Output implementation for display_init(), \b output_impl is a
+/// disp_encoder
+void qoi_out(const display* const disp);
+/// Output implementation for display_init(), \b output_impl is a
+/// disp_encoder
+void png_out(const display* const disp);
+
+#endif
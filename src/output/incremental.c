@@ -0,0 +1,158 @@
+#include "incremental.h"
+#include <include/body.h>
+#include <include/math.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void incr_init(incr_render* inc, const display* const disp, size_t body_count,
+               unsigned int tile_size) {
+    inc->disp = disp;
+    inc->body_count = body_count;
+    inc->tile_size = tile_size;
+    inc->tiles_x = (disp->d_w + tile_size - 1) / tile_size;
+    inc->tiles_y = (disp->d_h + tile_size - 1) / tile_size;
+    inc->mask_words = (body_count + 63) / 64;
+
+    size_t tiles = inc->tiles_x * inc->tiles_y;
+    inc->touched =
+        rt_calloc(MEM_OUTPUT, tiles * inc->mask_words, sizeof(uint64_t));
+    inc->dirty = rt_malloc(MEM_OUTPUT, tiles * sizeof(bool));
+    incr_mark_all(inc);
+}
+
+void incr_free(incr_render* inc) {
+    rt_free(inc->touched);
+    rt_free(inc->dirty);
+}
+
+void incr_mark_all(incr_render* inc) {
+    memset(inc->dirty, true, inc->tiles_x * inc->tiles_y * sizeof(bool));
+}
+
+/// Marks the tiles covering the pixel rectangle [x0, x1] x [y0, y1]
+static void incr_mark_pixels(incr_render* inc, long x0, long y0, long x1,
+                             long y1) {
+    if (x0 < 0)
+        x0 = 0;
+    if (y0 < 0)
+        y0 = 0;
+    if (x1 >= (long)inc->disp->d_w)
+        x1 = inc->disp->d_w - 1;
+    if (y1 >= (long)inc->disp->d_h)
+        y1 = inc->disp->d_h - 1;
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    for (long ty = y0 / inc->tile_size; ty <= y1 / inc->tile_size; ty++) {
+        for (long tx = x0 / inc->tile_size; tx <= x1 / inc->tile_size; tx++) {
+            inc->dirty[ty * inc->tiles_x + tx] = true;
+        }
+    }
+}
+
+/// Marks the tiles covered by the given bounding sphere on screen
+static void incr_mark_sphere(incr_render* inc, vector3 center,
+                             RT_FLOAT radius) {
+    const display* disp = inc->disp;
+    RT_FLOAT disp_x, disp_y;
+
+    vector3 c = display_to_camera(disp, vec_sub(center, disp->pos));
+    RT_FLOAT z_near = c.k - radius;
+    RT_FLOAT z_far = c.k + radius;
+    // Crosses the screen plane, projection is unbounded
+    if (z_near <= RTFCOMPVAL) {
+        incr_mark_all(inc);
+        return;
+    }
+
+    // Project the bounding box of the sphere onto the z = 1 screen. For a
+    // fixed x, x / z is monotonic in z so the extremes are at the corners.
+    RT_FLOAT x_min = fmin((c.i - radius) / z_near, (c.i - radius) / z_far);
+    RT_FLOAT x_max = fmax((c.i + radius) / z_near, (c.i + radius) / z_far);
+    RT_FLOAT y_min = fmin((c.j - radius) / z_near, (c.j - radius) / z_far);
+    RT_FLOAT y_max = fmax((c.j + radius) / z_near, (c.j + radius) / z_far);
+
+    display_view_extent(disp, &disp_x, &disp_y);
+    // Inverse of the pixel to screen mapping in display_run_region()
+    RT_FLOAT px0 = (x_min / disp_x + 1.0) * disp->d_w / 2.0 - 0.5;
+    RT_FLOAT px1 = (x_max / disp_x + 1.0) * disp->d_w / 2.0 - 0.5;
+    RT_FLOAT py0 = (1.0 - y_max / disp_y) * disp->d_h / 2.0 - 0.5;
+    RT_FLOAT py1 = (1.0 - y_min / disp_y) * disp->d_h / 2.0 - 0.5;
+
+    // Clamp before converting, the projection can be huge near the camera
+    px0 = fmax(px0, -1.0);
+    py0 = fmax(py0, -1.0);
+    px1 = fmin(px1, disp->d_w);
+    py1 = fmin(py1, disp->d_h);
+    incr_mark_pixels(inc, (long)floor(px0) - 1, (long)floor(py0) - 1,
+                     (long)ceil(px1) + 1, (long)ceil(py1) + 1);
+}
+
+void incr_mark_body(incr_render* inc, const body_rep** const bodies,
+                    size_t body_count, size_t body_index) {
+    size_t tiles = inc->tiles_x * inc->tiles_y;
+    size_t word = body_index / 64;
+    uint64_t bit = (uint64_t)1 << (body_index % 64);
+    vector3 center;
+    RT_FLOAT radius;
+
+    // Tiles that saw the body before the edit
+    for (size_t t = 0; t < tiles; t++) {
+        if (inc->touched[t * inc->mask_words + word] & bit) {
+            inc->dirty[t] = true;
+        }
+    }
+
+    // Tiles that see the body after the edit
+    if (!body_bounds(bodies[body_index], &center, &radius)) {
+        incr_mark_all(inc);
+        return;
+    }
+    incr_mark_sphere(inc, center, radius);
+
+    // Tiles that see the body mirrored in a floor
+    for (size_t i = 0; i < body_count; i++) {
+        if (i == body_index || bodies[i]->_col_impl != &floor_col) {
+            continue;
+        }
+        body_floor* flr = (body_floor*)bodies[i]->body;
+        vector3 mirrored = center;
+        mirrored.j = 2.0 * flr->height - center.j;
+        incr_mark_sphere(inc, mirrored, radius);
+    }
+}
+
+size_t incr_run(incr_render* inc, const body_rep** const bodies,
+                size_t body_count) {
+    const display* disp = inc->disp;
+    size_t traced = 0;
+    uint64_t* mask;
+
+    for (unsigned int ty = 0; ty < inc->tiles_y; ty++) {
+        for (unsigned int tx = 0; tx < inc->tiles_x; tx++) {
+            size_t t = ty * inc->tiles_x + tx;
+            if (!inc->dirty[t]) {
+                continue;
+            }
+            unsigned int x0 = tx * inc->tile_size;
+            unsigned int y0 = ty * inc->tile_size;
+            unsigned int x1 = x0 + inc->tile_size;
+            unsigned int y1 = y0 + inc->tile_size;
+            if (x1 > disp->d_w)
+                x1 = disp->d_w;
+            if (y1 > disp->d_h)
+                y1 = disp->d_h;
+
+            // Records are rebuilt from scratch for the new state of the tile
+            mask = inc->touched + t * inc->mask_words;
+            memset(mask, 0, inc->mask_words * sizeof(uint64_t));
+            display_run_region_touched(disp, bodies, body_count, x0, y0, x1,
+                                       y1, mask);
+            inc->dirty[t] = false;
+            traced++;
+        }
+    }
+    return traced;
+}
@@ -0,0 +1,72 @@
+#ifndef RAY_TRACE_INCREMENTAL_H
+#define RAY_TRACE_INCREMENTAL_H
+
+#include "output.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Default tile edge length in pixels for incremental rendering
+#define INCR_TILE_SIZE 32
+
+/** Keeps the result of a previous render around so that after a scene edit
+ * only the tiles that could have changed are traced again.
+ *
+ * For each tile we remember which bodies any of its rays hit (including
+ * reflections). When a body changes, every tile that hit it before and every
+ * tile covered by the body's new screen-space bounds (directly or mirrored in
+ * a floor) is marked dirty.
+ *
+ * Reflections in curved bodies aren't predicted, so a moved body that starts
+ * showing up in the reflection of a sphere won't be noticed there. Call
+ * incr_mark_all() if that matters.
+ *
+ * The display color buffer is the previous frame, so it must not be touched
+ * between renders.
+ */
+typedef struct {
+    const display* disp;     ///< Display that is rendered to
+    size_t body_count;       ///< Body count the records are made for
+    unsigned int tile_size;  ///< Tile edge length in pixels
+    unsigned int tiles_x;    ///< Tile count in width
+    unsigned int tiles_y;    ///< Tile count in height
+    size_t mask_words;       ///< uint64_t words per tile mask
+    uint64_t* touched;       ///< Per tile body masks
+    bool* dirty;             ///< Per tile dirty flags
+} incr_render;
+
+/** Initializes the incremental state. Every tile starts out dirty, so the
+ * first incr_run() renders the whole frame.
+ *
+ * @param disp Display to render into
+ * @param body_count Amount of bodies of the scene. If bodies are added or
+ * removed, the state has to be freed and initialized again.
+ * @param tile_size Tile edge length in pixels, e.g. INCR_TILE_SIZE
+ */
+void incr_init(incr_render* inc, const display* const disp, size_t body_count,
+               unsigned int tile_size);
+
+/// Frees the incremental state (not the display)
+void incr_free(incr_render* inc);
+
+/// Marks every tile dirty
+void incr_mark_all(incr_render* inc);
+
+/** Marks the tiles affected by an edit of bodies[body_index].
+ *
+ * Call this after the body was changed, with the body in its new state.
+ * Tiles that hit the old body are found through the records, tiles that see
+ * the new body are found through its bounds.
+ */
+void incr_mark_body(incr_render* inc, const body_rep** const bodies,
+                    size_t body_count, size_t body_index);
+
+/** Traces all dirty tiles and updates their records.
+ *
+ * @return Amount of tiles that were traced
+ */
+size_t incr_run(incr_render* inc, const body_rep** const bodies,
+                size_t body_count);
+
+#endif
@@ -1,108 +1,705 @@
 #include <include/output.h>
 #include <include/body.h>
 #include <include/math.h>
+#include <include/prof.h>
 #include <include/texture.h>
 #include <include/util.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+/// Rays traced by this thread, see display_thread_rays()
+static _Thread_local uint64_t display_rays;
+
+/// Camera rays traced by this thread, see display_thread_primary()
+static _Thread_local uint64_t display_primary;
+
+/// Reflections cut by the footprint test, see display_thread_culled()
+static _Thread_local uint64_t display_culled;
+
+uint64_t display_thread_rays(void) {
+    return display_rays;
+}
+
+uint64_t display_thread_primary(void) {
+    return display_primary;
+}
+
+uint64_t display_thread_culled(void) {
+    return display_culled;
+}
+
 display display_init(int w, int h, RT_FLOAT fov, vector3 pos,
                      void* buffer_out_impl,
                      void (*out)(const struct display* const),
                      void (*free_impl)(void*)) {
-    color* buf = malloc(sizeof(color) * w * h);
-    display ret = {w, h, fov, pos, buf, buffer_out_impl, out, free_impl};
+    color* buf = rt_malloc(MEM_OUTPUT, sizeof(color) * w * h);
+    display ret = {w, h, fov, pos, buf, buffer_out_impl, out, free_impl,
+                   MAX_REFL, NULL, SAMPLER_NONE, 1, 0, false,
+                   vec3(1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0),
+                   vec3(0.0, 0.0, 1.0), 0.0, NULL, true};
     return ret;
 }
 
 void display_free(display* disp) {
-    free(disp->color_buffer);
+    rt_free(disp->color_buffer);
     disp->free_impl(disp->output_impl);
 }
 
-void display_run_rays(const display* const disp, const body_rep** const bodies,
-                      size_t body_count) {
-    color c;
-    ray r;
+void display_look(display* disp, vector3 dir, vector3 up) {
+    vector3 forward = vec_norm(dir);
+    vector3 right = vec_cross(up, forward);
+    if (vec_mag(right) <= RTFCOMPVAL) {
+        // Looking straight along up, any roll will do
+        right = vec_cross(fabs(forward.i) < 0.9 ? vec3(1.0, 0.0, 0.0)
+                                                : vec3(0.0, 1.0, 0.0),
+                          forward);
+    }
+    disp->right = vec_norm(right);
+    disp->up = vec_cross(forward, disp->right);
+    disp->forward = forward;
+}
+
+void display_view_extent(const display* const disp, RT_FLOAT* disp_x,
+                         RT_FLOAT* disp_y) {
     RT_FLOAT ratio = (RT_FLOAT)disp->d_w /
                      (RT_FLOAT)disp->d_h; // Width to height ratio for display
-    RT_FLOAT z = 1.0; // Our pretend distance to the "display"
     RT_FLOAT fov_rad = disp->fov * M_PI / 180.0;
 
     // Fake physical Y distance between between top and bottom ends of the
     // display and the center
-    RT_FLOAT disp_y = tan(fov_rad / 2.0) * z;
+    *disp_y = tan(fov_rad / 2.0);
     // Fake physical X distance between between right and right ends of the
     // display and the center
-    RT_FLOAT disp_x = disp_y * ratio;
+    *disp_x = *disp_y * ratio;
+}
 
-    // Heigth iteration
-    for (int i = 0; i < disp->d_h; i++) {
-        // Width iteration
-        for (int j = 0; j < disp->d_w; j++) {
-            size_t index = i * disp->d_w + j;
-            // Construct fake coordinate to determine the path of the ray
-            vector3 path = vec_norm(vec3(
-                (2.0 * (j + 0.5) / (RT_FLOAT)disp->d_w - 1.0) * disp_x,
-                (1.0 - 2.0 * (i + 0.5) / (RT_FLOAT)disp->d_h) * disp_y, z));
-            r = ray_new(disp->pos, path);
-            c = display_iterate_single_ray(bodies, body_count, r, NULL,
-                                           MAX_REFL);
-            disp->color_buffer[index] = c;
+ray display_camera_ray(const display* const disp, RT_FLOAT disp_x,
+                       RT_FLOAT disp_y, unsigned int x, unsigned int y) {
+    return display_camera_ray_at(disp, disp_x, disp_y, x + 0.5, y + 0.5);
+}
+
+ray display_camera_ray_at(const display* const disp, RT_FLOAT disp_x,
+                          RT_FLOAT disp_y, RT_FLOAT x, RT_FLOAT y) {
+    RT_FLOAT z = 1.0; // Our pretend distance to the "display"
+    // Construct fake coordinate to determine the path of the ray
+    RT_FLOAT sx = (2.0 * x / (RT_FLOAT)disp->d_w - 1.0) * disp_x;
+    RT_FLOAT sy = (1.0 - 2.0 * y / (RT_FLOAT)disp->d_h) * disp_y;
+    vector3 path = vec_norm(vec_sum(
+        vec_sum(vec_mul(sx, disp->right), vec_mul(sy, disp->up)),
+        vec_mul(z, disp->forward)));
+    return ray_new(disp->pos, path);
+}
+
+ray_cone display_camera_cone(const display* const disp, RT_FLOAT disp_y) {
+    ray_cone ret = {0.0, 0.0};
+    if (disp->cones) {
+        // Angle one pixel covers at the center of the screen
+        ret.spread = atan(2.0 * disp_y / disp->d_h);
+    }
+    return ret;
+}
+
+/// Unclamped sum, a path is clamped once at its end (display_clamp())
+static inline color display_add(color a, color b) {
+    color ret = {a.r + b.r, a.g + b.g, a.b + b.b};
+    return ret;
+}
+
+/// Unclamped product, see display_add()
+static inline color display_scale(RT_FLOAT k, color c) {
+    color ret = {k * c.r, k * c.g, k * c.b};
+    return ret;
+}
+
+/// The color of a whole path, clamped to [COLOR_MIN, COLOR_MAX]
+static inline color display_clamp(color c) {
+    return color_new(c.r, c.g, c.b);
+}
+
+/// First hit of a camera ray
+typedef struct {
+    size_t body;   ///< Body hit, SIZE_MAX for none
+    vector3 norm;  ///< Normal at the hit
+    RT_FLOAT dist; ///< Distance along the ray, INFINITY for none
+} display_hit;
+
+/** display_trace_ray_cone() that also returns what the ray itself hits in
+ * \b first, unless it is NULL.
+ *
+ * Like display_trace_ray_cone() the path is clamped, except with an
+ * environment map: then samples are averaged in HDR and only the pixel is
+ * clamped (display_sample_mean()), since any clamp before that biases the
+ * weighing of the map samples against the reflected rays.
+ */
+static color display_trace_first(const display* const disp,
+                                 const body_rep** const bodies,
+                                 size_t body_count, ray r, ray_cone cone,
+                                 uint64_t* touched, display_hit* first);
+
+/** Moves the distance of \b hit, found by sample ray \b cam of pixel (x, y),
+ * to the pixel center ray where it crosses the tangent plane of the hit, so
+ * that the depth of a jittered sample matches that of the center.
+ */
+static void display_center_dist(const display* const disp, RT_FLOAT disp_x,
+                                RT_FLOAT disp_y, unsigned int x,
+                                unsigned int y, ray cam, display_hit* hit) {
+    ray center = display_camera_ray(disp, disp_x, disp_y, x, y);
+    RT_FLOAT facing = vec_dot(center.path, hit->norm);
+    if (fabs(facing) <= RTFCOMPVAL) {
+        return;
+    }
+    RT_FLOAT t =
+        vec_dot(vec_sub(ray_dist(cam, hit->dist), center.pos), hit->norm) /
+        facing;
+    if (t > RTFCOMPVAL) {
+        hit->dist = t;
+    }
+}
+
+/// Adds samples [first, first + count) of pixel (x, y) to \b sum, the
+/// thread sampler must be set up. \b hit gets the first hit of sample
+/// \b first if not NULL, its distance moved to the pixel center ray.
+static void display_sample_sum(const display* const disp,
+                               const body_rep** const bodies,
+                               size_t body_count, RT_FLOAT disp_x,
+                               RT_FLOAT disp_y, ray_cone cone, unsigned int x,
+                               unsigned int y, unsigned int first,
+                               unsigned int count, double* sum,
+                               uint64_t* touched, display_hit* hit) {
+    rt_sampler* s = sampler_thread();
+    float u, v;
+
+    // Summed unclamped, color_sum() would saturate
+    for (unsigned int n = first; n < first + count; n++) {
+        sampler_start(s, x, y, n);
+        sampler_2d(s, &u, &v);
+        ray cam = display_camera_ray_at(disp, disp_x, disp_y, x + u, y + v);
+        color c = display_trace_first(disp, bodies, body_count, cam, cone,
+                                      touched, n == first ? hit : NULL);
+        sum[0] += c.r;
+        sum[1] += c.g;
+        sum[2] += c.b;
+        if (n == first && hit != NULL && hit->body != SIZE_MAX) {
+            display_center_dist(disp, disp_x, disp_y, x, y, cam, hit);
+        }
+    }
+    display_primary += count;
+}
+
+/** Color of pixel (x, y) as display_run_region() traces it without
+ * adaptive rendering, the thread sampler must be set up.
+ *
+ * @param hit Set to the first hit (of the first sample), may be NULL
+ */
+static color display_pixel(const display* const disp,
+                           const body_rep** const bodies, size_t body_count,
+                           RT_FLOAT disp_x, RT_FLOAT disp_y, ray_cone cone,
+                           unsigned int x, unsigned int y, uint64_t* touched,
+                           display_hit* hit) {
+    if (disp->sampler == SAMPLER_NONE) {
+        ray r = display_camera_ray(disp, disp_x, disp_y, x, y);
+        display_primary++;
+        color c = display_trace_first(disp, bodies, body_count, r, cone,
+                                      touched, hit);
+        return display_clamp(c);
+    }
+    unsigned int spp = sampler_thread()->spp;
+    double sum[3] = {0.0, 0.0, 0.0};
+    display_sample_sum(disp, bodies, body_count, disp_x, disp_y, cone, x, y, 0,
+                       spp, sum, touched, hit);
+    return display_sample_mean(sum, spp);
+}
+
+color display_sample_mean(const double* sum, unsigned int count) {
+    return color_new(sum[0] / count, sum[1] / count, sum[2] / count);
+}
+
+void display_accum_region(const display* const disp,
+                          const body_rep** const bodies, size_t body_count,
+                          unsigned int x0, unsigned int y0, unsigned int x1,
+                          unsigned int y1, unsigned int first,
+                          unsigned int count, double* sum) {
+    RT_FLOAT disp_x, disp_y;
+
+    display_view_extent(disp, &disp_x, &disp_y);
+    sampler_init(sampler_thread(), disp->sampler, disp->spp, disp->seed);
+    ray_cone cone = display_camera_cone(disp, disp_y);
+
+    for (unsigned int i = y0; i < y1; i++) {
+        for (unsigned int j = x0; j < x1; j++) {
+            double* px = sum + 3 * ((size_t)(i - y0) * (x1 - x0) + (j - x0));
+            if (disp->sampler != SAMPLER_NONE) {
+                display_sample_sum(disp, bodies, body_count, disp_x, disp_y,
+                                   cone, j, i, first, count, px, NULL, NULL);
+            } else {
+                color c = display_pixel(disp, bodies, body_count, disp_x,
+                                        disp_y, cone, j, i, NULL, NULL);
+                px[0] += c.r;
+                px[1] += c.g;
+                px[2] += c.b;
+            }
         }
     }
+    sampler_thread()->kind = SAMPLER_NONE;
+}
+
+void display_run_region(const display* const disp,
+                        const body_rep** const bodies, size_t body_count,
+                        unsigned int x0, unsigned int y0, unsigned int x1,
+                        unsigned int y1) {
+    display_run_region_touched(disp, bodies, body_count, x0, y0, x1, y1, NULL);
+}
+
+/// First hit of a traced pixel of adaptive rendering
+typedef struct {
+    display_hit hit; ///< First hit of the pixel
+    bool traced;     ///< Whether the pixel was traced yet
+} display_probe;
+
+/// State of display_run_adaptive() for one region
+typedef struct {
+    const display* disp;
+    const body_rep** bodies;
+    size_t body_count;
+    RT_FLOAT disp_x, disp_y;
+    ray_cone cone;
+    uint64_t* touched;
+    RT_FLOAT* depth;        ///< First hit distances, may be NULL
+    unsigned int x0, y0, w; ///< Region origin and width
+    display_probe* probes;  ///< One per pixel of the region, row major
+} display_adaptive;
+
+/// Traces pixel (x, y) unless it already was
+static display_probe* display_adaptive_trace(display_adaptive* ad,
+                                             unsigned int x, unsigned int y) {
+    display_probe* p = &ad->probes[(size_t)(y - ad->y0) * ad->w + x - ad->x0];
+    if (!p->traced) {
+        const display* disp = ad->disp;
+        disp->color_buffer[(size_t)y * disp->d_w + x] = display_pixel(
+            disp, ad->bodies, ad->body_count, ad->disp_x, ad->disp_y,
+            ad->cone, x, y, ad->touched, &p->hit);
+        p->traced = true;
+        if (ad->depth != NULL) {
+            ad->depth[(size_t)y * disp->d_w + x] = p->hit.dist;
+        }
+    }
+    return p;
+}
+
+/// Whether two traced pixels show the same surface
+static bool display_adaptive_same(const display* const disp,
+                                  const display_probe* a, color ca,
+                                  const display_probe* b, color cb) {
+    if (a->hit.body != b->hit.body) {
+        return false;
+    }
+    if (a->hit.body != SIZE_MAX &&
+        vec_dot(a->hit.norm, b->hit.norm) < DISPLAY_ADAPTIVE_NORMAL) {
+        return false;
+    }
+    return fabs(ca.r - cb.r) <= disp->adaptive &&
+           fabs(ca.g - cb.g) <= disp->adaptive &&
+           fabs(ca.b - cb.b) <= disp->adaptive;
+}
+
+/** Fills the block with corners (x0, y0) and (x1, y1), both inclusive: the
+ * corners are traced, then the block is interpolated or split.
+ */
+static void display_adaptive_block(display_adaptive* ad, unsigned int x0,
+                                   unsigned int y0, unsigned int x1,
+                                   unsigned int y1) {
+    const display* disp = ad->disp;
+    color* buf = disp->color_buffer;
+    size_t w = disp->d_w;
+    const display_probe* p[4] = {
+        display_adaptive_trace(ad, x0, y0), display_adaptive_trace(ad, x1, y0),
+        display_adaptive_trace(ad, x0, y1), display_adaptive_trace(ad, x1, y1)};
+    color c[4] = {buf[y0 * w + x0], buf[y0 * w + x1], buf[y1 * w + x0],
+                  buf[y1 * w + x1]};
+    if (x1 - x0 <= 1 && y1 - y0 <= 1) {
+        return;
+    }
+
+    bool same = true;
+    for (int k = 1; k < 4 && same; k++) {
+        same = display_adaptive_same(disp, p[0], c[0], p[k], c[k]);
+    }
+    if (same) {
+        RT_FLOAT dx = x1 > x0 ? x1 - x0 : 1;
+        RT_FLOAT dy = y1 > y0 ? y1 - y0 : 1;
+        for (unsigned int i = y0; i <= y1; i++) {
+            RT_FLOAT v = (i - y0) / dy;
+            for (unsigned int j = x0; j <= x1; j++) {
+                if (ad->probes[(size_t)(i - ad->y0) * ad->w + j - ad->x0]
+                        .traced) {
+                    continue;
+                }
+                RT_FLOAT u = (j - x0) / dx;
+                RT_FLOAT k0 = (1.0 - u) * (1.0 - v), k1 = u * (1.0 - v);
+                RT_FLOAT k2 = (1.0 - u) * v, k3 = u * v;
+                buf[i * w + j] = color_new(
+                    k0 * c[0].r + k1 * c[1].r + k2 * c[2].r + k3 * c[3].r,
+                    k0 * c[0].g + k1 * c[1].g + k2 * c[2].g + k3 * c[3].g,
+                    k0 * c[0].b + k1 * c[1].b + k2 * c[2].b + k3 * c[3].b);
+                // The corners all hit the same body or all miss
+                if (ad->depth != NULL) {
+                    ad->depth[i * w + j] =
+                        p[0]->hit.body == SIZE_MAX
+                            ? INFINITY
+                            : k0 * p[0]->hit.dist + k1 * p[1]->hit.dist +
+                                  k2 * p[2]->hit.dist + k3 * p[3]->hit.dist;
+                }
+            }
+        }
+        return;
+    }
+
+    // Neighbouring halves share their middle row or column
+    unsigned int mx = x1 - x0 > 1 ? (x0 + x1) / 2 : x1;
+    unsigned int my = y1 - y0 > 1 ? (y0 + y1) / 2 : y1;
+    display_adaptive_block(ad, x0, y0, mx, my);
+    if (mx != x1) {
+        display_adaptive_block(ad, mx, y0, x1, my);
+    }
+    if (my != y1) {
+        display_adaptive_block(ad, x0, my, mx, y1);
+        if (mx != x1) {
+            display_adaptive_block(ad, mx, my, x1, y1);
+        }
+    }
+}
+
+/// Adaptive display_run_region_all(), false if out of memory
+static bool display_run_adaptive(display_adaptive* ad, unsigned int x1,
+                                 unsigned int y1) {
+    unsigned int h = y1 - ad->y0;
+    ad->probes = rt_calloc(MEM_OUTPUT, (size_t)ad->w * h,
+                           sizeof(display_probe));
+    if (ad->probes == NULL) {
+        return false;
+    }
+    for (unsigned int y = ad->y0;; y += DISPLAY_ADAPTIVE_BLOCK) {
+        unsigned int by = y + DISPLAY_ADAPTIVE_BLOCK < y1 - 1
+                              ? y + DISPLAY_ADAPTIVE_BLOCK
+                              : y1 - 1;
+        for (unsigned int x = ad->x0;; x += DISPLAY_ADAPTIVE_BLOCK) {
+            unsigned int bx = x + DISPLAY_ADAPTIVE_BLOCK < x1 - 1
+                                  ? x + DISPLAY_ADAPTIVE_BLOCK
+                                  : x1 - 1;
+            display_adaptive_block(ad, x, y, bx, by);
+            if (bx == x1 - 1) {
+                break;
+            }
+        }
+        if (by == y1 - 1) {
+            break;
+        }
+    }
+    rt_free(ad->probes);
+    return true;
+}
+
+/// display_run_region() with the optional outputs of
+/// display_run_region_touched() and display_run_region_depth()
+static void display_run_region_all(const display* const disp,
+                                   const body_rep** const bodies,
+                                   size_t body_count, unsigned int x0,
+                                   unsigned int y0, unsigned int x1,
+                                   unsigned int y1, uint64_t* touched,
+                                   RT_FLOAT* depth) {
+    RT_FLOAT disp_x, disp_y;
+
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    display_view_extent(disp, &disp_x, &disp_y);
+    sampler_init(sampler_thread(), disp->sampler, disp->spp, disp->seed);
+    ray_cone cone = display_camera_cone(disp, disp_y);
+
+    display_adaptive ad = {disp, bodies, body_count, disp_x, disp_y, cone,
+                           touched, depth, x0, y0, x1 - x0, NULL};
+    if (disp->adaptive <= 0.0 || !display_run_adaptive(&ad, x1, y1)) {
+        display_hit hit;
+        for (unsigned int i = y0; i < y1; i++) {
+            for (unsigned int j = x0; j < x1; j++) {
+                disp->color_buffer[i * disp->d_w + j] = display_pixel(
+                    disp, bodies, body_count, disp_x, disp_y, cone, j, i,
+                    touched, depth != NULL ? &hit : NULL);
+                if (depth != NULL) {
+                    depth[i * disp->d_w + j] = hit.dist;
+                }
+            }
+        }
+    }
+    // Other traces of this thread go back to the thread generator
+    sampler_thread()->kind = SAMPLER_NONE;
+}
+
+void display_run_region_touched(const display* const disp,
+                                const body_rep** const bodies,
+                                size_t body_count, unsigned int x0,
+                                unsigned int y0, unsigned int x1,
+                                unsigned int y1, uint64_t* touched) {
+    display_run_region_all(disp, bodies, body_count, x0, y0, x1, y1, touched,
+                           NULL);
+}
+
+void display_run_region_depth(const display* const disp,
+                              const body_rep** const bodies,
+                              size_t body_count, unsigned int x0,
+                              unsigned int y0, unsigned int x1,
+                              unsigned int y1, RT_FLOAT* depth) {
+    display_run_region_all(disp, bodies, body_count, x0, y0, x1, y1, NULL,
+                           depth);
+}
+
+void display_run_rays(const display* const disp, const body_rep** const bodies,
+                      size_t body_count) {
+    display_run_region(disp, bodies, body_count, 0, 0, disp->d_w, disp->d_h);
 }
 
 void display_write(const display* const disp) {
+    PROF_BEGIN(span);
     disp->out(disp);
+    PROF_END(span, "display_write", -1);
 }
 
 color display_iterate_single_ray(const body_rep** const bodies,
                                  size_t body_count, ray r, body_rep* ignore,
                                  int refl_c) {
-    body_rep const* ref;
-    color ret, c_tmp;
-    RT_FLOAT z, z_min;
-    ray refl;
-    vector3 norm;
-    bool first_col;
+    return display_trace_ray(bodies, body_count, r, ignore, refl_c, NULL);
+}
 
-    first_col = true;
-    z = 0.0;
-    z_min = 0.0;
+color display_trace_ray(const body_rep** const bodies, size_t body_count,
+                        ray r, const body_rep* ignore, int refl_c,
+                        uint64_t* touched) {
+    return display_trace_ray_accel(NULL, bodies, body_count, r, ignore, refl_c,
+                                   touched);
+}
+
+bool display_closest_hit(const body_rep** const bodies, size_t body_count,
+                         ray r, const body_rep* ignore, size_t* hit,
+                         RT_FLOAT* dist, vector3* norm) {
+    body_rep const* ref;
+    RT_FLOAT z;
+    vector3 n;
+    bool found = false;
 
-    // Background color as well
-    ret = color_new(0.71, 0.784, 0.798);
     // Iterate through each body
     for (size_t i = 0; i < body_count; i++) {
         ref = bodies[i];
         if (ref == ignore) {
             continue;
         }
-        // If we collide
-        if (body_ray_col(ref, r, &z, &refl, &norm)) {
-            if (refl_c != 0) {
-                c_tmp =
-                    color_sum(color_mul(1.0 - ref->tex.reflectivity,
-                                        ref->tex.refl(ref->tex.impl, r, norm)),
-                              color_mul(ref->tex.reflectivity,
-                                        display_iterate_single_ray(
-                                            bodies, body_count, refl,
-                                            (body_rep*)ref, refl_c - 1)));
-            } else {
-                c_tmp = color_mul(1.0 - ref->tex.reflectivity,
-                                  ref->tex.refl(ref->tex.impl, r, norm));
-            }
-            // We only draw the closest object
-            if (first_col || z < z_min) {
-                first_col = false;
-                z_min = z;
-                ret = c_tmp;
+        // We only care about the closest object
+        if (ref->_col_impl(ref, r, &z, &n) && (!found || z < *dist)) {
+            found = true;
+            *hit = i;
+            *dist = z;
+            *norm = n;
+        }
+    }
+    return found;
+}
+
+color display_trace_ray_accel(const rt_accel* accel,
+                              const body_rep** const bodies, size_t body_count,
+                              ray r, const body_rep* ignore, int refl_c,
+                              uint64_t* touched) {
+    ray_cone cone = {0.0, 0.0};
+    return display_trace_ray_cone(accel, bodies, body_count, r, cone, ignore,
+                                  refl_c, touched);
+}
+
+/** Radiance of \b env towards a ray that hit nothing.
+ *
+ * @param bounce_pdf Density the ray was reflected with, weighs the radiance
+ * against display_env_direct() by the power heuristic. 0 for camera rays,
+ * mirrors and without direct sampling.
+ */
+static color display_env_miss(const env_map* env, vector3 dir,
+                              RT_FLOAT bounce_pdf) {
+    color l = env_map_radiance(env, dir);
+    RT_FLOAT w = 1.0;
+    if (bounce_pdf > 0.0) {
+        RT_FLOAT p = env_map_pdf(env, dir);
+        w = bounce_pdf * bounce_pdf / (bounce_pdf * bounce_pdf + p * p);
+    }
+    return display_scale(w, l);
+}
+
+/** Light from \b env reaching a rough hit directly: one direction picked from
+ * the map, a shadow ray towards it and the lobe of the surface there, weighed
+ * against picking the same direction with the lobe by the power heuristic.
+ *
+ * @param in Ray that hit \b ref at \b point with normal \b norm
+ * @param touched Gets the bit of a body blocking the shadow ray, so moving it
+ * re-traces the shadow (see display_trace_ray_cone())
+ */
+static color display_env_direct(const rt_accel* accel,
+                                const body_rep** const bodies,
+                                size_t body_count, const env_map* env, ray in,
+                                vector3 point, vector3 norm,
+                                const body_rep* ref, uint64_t* touched) {
+    vector3 xi = vec_rand(0.0, 1.0);
+    env_sample es = env_map_sample(env, xi.i, xi.j);
+    if (es.pdf <= 0.0) {
+        return color_black();
+    }
+    RT_FLOAT bounce_pdf;
+    RT_FLOAT f = brdf_eval(in.path, norm, ref->tex.diffusivity, es.dir,
+                           &bounce_pdf);
+    if (f <= 0.0) {
+        return color_black();
+    }
+
+    size_t hit;
+    RT_FLOAT z;
+    vector3 n;
+    ray shadow = ray_new(point, es.dir);
+    display_rays++;
+    bool blocked =
+        accel != NULL
+            ? accel->closest(accel->impl, bodies, body_count, shadow, ref,
+                             &hit, &z, &n)
+            : display_closest_hit(bodies, body_count, shadow, ref, &hit, &z,
+                                  &n);
+    if (blocked) {
+        if (touched != NULL) {
+            touched[hit / 64] |= (uint64_t)1 << (hit % 64);
+        }
+        return color_black();
+    }
+    RT_FLOAT w = es.pdf * es.pdf / (es.pdf * es.pdf + bounce_pdf * bounce_pdf);
+    RT_FLOAT k = f * w / es.pdf;
+    return display_scale(k, es.radiance);
+}
+
+/** display_trace_ray_cone() that returns the first hit in \b first unless
+ * it is NULL, see display_trace_first().
+ *
+ * Nothing is clamped on the way, so HDR radiance from \b env keeps its weight
+ * through every bounce. The callers clamp with display_clamp().
+ *
+ * @param env Background, NULL for display_background()
+ * @param direct Sample \b env at rough hits, see display_env_direct()
+ * @param bounce_pdf See display_env_miss()
+ */
+static inline color display_trace_hit(const rt_accel* accel,
+                                      const env_map* env, bool direct,
+                                      const body_rep** const bodies,
+                                      size_t body_count, ray r, ray_cone cone,
+                                      const body_rep* ignore, int refl_c,
+                                      RT_FLOAT bounce_pdf, uint64_t* touched,
+                                      display_hit* first) {
+    body_rep const* ref;
+    color c;
+    RT_FLOAT z;
+    ray refl;
+    vector3 norm;
+    size_t hit;
+    bool found;
+
+    display_rays++;
+
+    if (accel != NULL) {
+        found = accel->closest(accel->impl, bodies, body_count, r, ignore, &hit,
+                               &z, &norm);
+    } else {
+        found = display_closest_hit(bodies, body_count, r, ignore, &hit, &z,
+                                    &norm);
+    }
+    if (first != NULL) {
+        first->body = found ? hit : SIZE_MAX;
+        first->dist = found ? z : INFINITY;
+        if (found) {
+            first->norm = norm;
+        }
+    }
+    if (!found) {
+        return env != NULL ? display_env_miss(env, r.path, bounce_pdf)
+                           : display_background();
+    }
+
+    ref = bodies[hit];
+    if (touched != NULL) {
+        touched[hit / 64] |= (uint64_t)1 << (hit % 64);
+    }
+    tex_hit th = {ray_dist(r, z), ray_cone_width(cone, z)};
+    c = ref->tex.refl(ref->tex.impl, r, norm, &th);
+    if (refl_c == 0) {
+        return display_scale(1.0 - ref->tex.reflectivity, c);
+    }
+
+    // Spheres spread the cone by twice the normal change over the footprint,
+    // rough surfaces by their lobe
+    RT_FLOAT curvature = 0.0;
+    if (cone.spread > 0.0) {
+        vector3 center;
+        RT_FLOAT radius;
+        if (body_bounds(ref, &center, &radius)) {
+            // The whole body is inside the footprint, so whatever it reflects
+            // is smaller than the pixel. Its surroundings on average are about
+            // the background.
+            if (th.width > 2.0 * radius) {
+                display_culled++;
+                return display_add(
+                    display_scale(1.0 - ref->tex.reflectivity, c),
+                    display_scale(ref->tex.reflectivity,
+                                  env != NULL ? env->mean
+                                              : display_background()));
             }
+            curvature = 2.0 * th.width / radius;
         }
     }
-    return ret;
+
+    // Mirrors can't be lit from a picked direction, their reflection is all
+    bool rough = env != NULL && direct &&
+                 ref->tex.diffusivity >= BRDF_MIRROR;
+    color lit = rough ? display_env_direct(accel, bodies, body_count, env, r,
+                                           th.point, norm, ref, touched)
+                      : color_black();
+
+    // color = current_color * (1 - current_reflectivity) +
+    // (current_reflectivity * sample weight * recursive())
+    brdf_sample bs = brdf_sample_dir(r.path, norm, ref->tex.diffusivity);
+    if (bs.weight <= 0.0) {
+        return display_add(display_scale(1.0 - ref->tex.reflectivity, c),
+                           display_scale(ref->tex.reflectivity, lit));
+    }
+    refl = ray_new(th.point, bs.dir);
+    ray_cone next = {th.width,
+                     cone.spread > 0.0
+                         ? cone.spread + curvature + ref->tex.diffusivity
+                         : 0.0};
+    color ret = display_add(
+        display_scale(1.0 - ref->tex.reflectivity, c),
+        display_scale(ref->tex.reflectivity * bs.weight,
+                      display_trace_hit(accel, env, direct, bodies, body_count,
+                                        refl, next, ref, refl_c - 1,
+                                        rough ? bs.pdf : 0.0, touched,
+                                        NULL)));
+    return display_add(ret, display_scale(ref->tex.reflectivity, lit));
+}
+
+color display_trace_ray_cone(const rt_accel* accel,
+                             const body_rep** const bodies, size_t body_count,
+                             ray r, ray_cone cone, const body_rep* ignore,
+                             int refl_c, uint64_t* touched) {
+    return display_clamp(display_trace_hit(accel, NULL, false, bodies,
+                                           body_count, r, cone, ignore, refl_c,
+                                           0.0, touched, NULL));
+}
+
+static color display_trace_first(const display* const disp,
+                                 const body_rep** const bodies,
+                                 size_t body_count, ray r, ray_cone cone,
+                                 uint64_t* touched, display_hit* first) {
+    color c = display_trace_hit(disp->accel, disp->env, disp->env_direct,
+                                bodies, body_count, r, cone, NULL,
+                                disp->max_refl, 0.0, touched, first);
+    return disp->env != NULL ? c : display_clamp(c);
 }
 
 void ppm_color(color val, char* list) {
@@ -117,6 +714,7 @@ void ppm_out(const display* const disp) {
     char color_char[12];
     color c;
     disp_ppm* impl = (disp_ppm*)disp->output_impl;
+    PROF_BEGIN(span);
     FILE* f = fopen(impl->disp_out, "w");
     fprintf(f, "P3\n");
     fprintf(f, "%u %u\n", disp->d_w, disp->d_h);
@@ -135,6 +733,7 @@ void ppm_out(const display* const disp) {
         fprintf(f, "\n");
     }
     fclose(f);
+    PROF_END(span, "ppm_out", -1);
 }
 
 void ppm_free(void* impl) {
@@ -3,16 +3,36 @@
 
 #include <include/body.h>
 #include <include/math.h>
+#include <include/sample.h>
 #include <include/texture.h>
 #include <include/util.h>
 
 #include <stddef.h>
+#include <stdint.h>
+
+/// Edge length in pixels of the coarse grid of adaptive rendering
+#define DISPLAY_ADAPTIVE_BLOCK 8
+/// Cosine between the normals of two samples that still count as one surface
+#define DISPLAY_ADAPTIVE_NORMAL 0.98
+
+/** Acceleration structure for closest hit queries.
+ *
+ * \b closest must behave exactly like display_closest_hit() on the same body
+ * list, just faster.
+ */
+typedef struct rt_accel {
+    const void* impl; ///< Acceleration structure data
+    /// Closest hit query, see display_closest_hit()
+    bool (*closest)(const void* impl, const body_rep** const bodies,
+                    size_t body_count, ray r, const body_rep* ignore,
+                    size_t* hit, RT_FLOAT* dist, vector3* norm);
+} rt_accel;
 
 /** The display type that holds information about the camera and also about the
  * implementation to make use of the output
  *
- * Currently there is no direction support, we face (1, 0, 0)
- *
+ * The camera looks along \b forward with \b right and \b up spanning the
+ * screen, (0, 0, 1) with +x right and +y up by default, see display_look().
  */
 typedef struct display {
     unsigned int d_w;    ///< Output width in pixels
@@ -24,6 +44,27 @@ typedef struct display {
     void* output_impl; ///< Pointer to output handler type implementation
     void (*out)(const struct display* const); ///< Implementaiton function
     void (*free_impl)(void* ptr); ///< Free function for implementation
+    int max_refl; ///< Reflection limit per path, MAX_REFL by default
+    /// Acceleration structure used for tracing, NULL tests every body
+    const rt_accel* accel;
+    sampler_kind sampler; ///< Pixel and reflection samples, SAMPLER_NONE
+    unsigned int spp;     ///< Samples per pixel, unused with SAMPLER_NONE
+    uint64_t seed;        ///< Seed of the sampler
+    /// Trace ray cones: textures pick a mip level from the footprint and
+    /// reflections of bodies smaller than the footprint are cut short
+    bool cones;
+    vector3 right;   ///< Camera basis, orthonormal
+    vector3 up;      ///< Camera basis, orthonormal
+    vector3 forward; ///< Viewing direction
+    /// Color tolerance of adaptive rendering, 0 traces every pixel. See
+    /// display_run_region().
+    RT_FLOAT adaptive;
+    /// Background of the rays that hit nothing, NULL for
+    /// display_background()
+    const env_map* env;
+    /// Also sample \b env at every rough hit and weigh that against the
+    /// reflected ray (multiple importance sampling)
+    bool env_direct;
 } display;
 
 display display_init(int w, int h, RT_FLOAT fov, vector3 pos,
@@ -34,10 +75,34 @@ display display_init(int w, int h, RT_FLOAT fov, vector3 pos,
 /// Frees the display
 void display_free(display* disp);
 
+/// Color of rays that hit nothing
+static inline color display_background(void) {
+    return color_new(0.71, 0.784, 0.798);
+}
+
+/** Points the camera along \b dir, rolled so that \b up points up on the
+ * screen as far as it can. If the two are parallel any perpendicular up is
+ * picked.
+ */
+void display_look(display* disp, vector3 dir, vector3 up);
+
+/** Camera space coordinates of a point relative to the camera position:
+ * right, up and along the view.
+ */
+static inline vector3 display_to_camera(const display* const disp,
+                                        vector3 v) {
+    return vec3(vec_dot(v, disp->right), vec_dot(v, disp->up),
+                vec_dot(v, disp->forward));
+}
+
 /** Runs the ray tracing routine using the given bodies and display
  * and fills the color buffer with the result. This function does NOT write the
  * buffer.
  *
+ * Unless the sampler is SAMPLER_NONE every pixel averages \b spp samples. The
+ * sampler places the camera ray inside the pixel and drives the reflection
+ * jitter of its path (see sampler_thread()).
+ *
  * @see write_display() for outputting the result of the ray trace
  *
  * @param disp Display data
@@ -47,6 +112,86 @@ void display_free(display* disp);
 void display_run_rays(const display* const disp, const body_rep** const bodies,
                       size_t body_count);
 
+/** Size of the pretend screen that rays are shot through, which sits at
+ * distance 1 in front of the display position.
+ *
+ * @param disp_x Set to half the width of the screen
+ * @param disp_y Set to half the height of the screen
+ */
+void display_view_extent(const display* const disp, RT_FLOAT* disp_x,
+                         RT_FLOAT* disp_y);
+
+/** Camera ray through the center of pixel (x, y).
+ *
+ * @param disp_x, disp_y Extent from display_view_extent()
+ */
+ray display_camera_ray(const display* const disp, RT_FLOAT disp_x,
+                       RT_FLOAT disp_y, unsigned int x, unsigned int y);
+
+/// Cone of the camera rays, a zero cone unless display.cones is set
+ray_cone display_camera_cone(const display* const disp, RT_FLOAT disp_y);
+
+/// Camera ray through a point of the image, pixel (x, y) covers
+/// [x, x + 1) x [y, y + 1)
+ray display_camera_ray_at(const display* const disp, RT_FLOAT disp_x,
+                          RT_FLOAT disp_y, RT_FLOAT x, RT_FLOAT y);
+
+/** Same as display_run_rays() but only traces the pixels inside the
+ * rectangle [x0, x1) x [y0, y1). Useful for splitting a frame into rows or
+ * tiles.
+ *
+ * With disp->adaptive > 0 only the corners of DISPLAY_ADAPTIVE_BLOCK sized
+ * blocks are traced first. A block whose corners hit the same body with
+ * normals within DISPLAY_ADAPTIVE_NORMAL and colors within \b adaptive per
+ * channel is filled by bilinear interpolation, any other block is split in
+ * four and refined down to single pixels. Edges and texture detail larger
+ * than a block are traced as usual while flat areas cost a few rays; details
+ * smaller than a block that no corner hits are lost. The hit and normal of a
+ * sampled pixel are those of its first sample.
+ */
+void display_run_region(const display* const disp,
+                        const body_rep** const bodies, size_t body_count,
+                        unsigned int x0, unsigned int y0, unsigned int x1,
+                        unsigned int y1);
+
+/** Adds samples [first, first + count) of every pixel of the region to
+ * \b sum, three doubles per pixel, row major over the region only.
+ *
+ * Without a sampler a pixel has the one sample at its center, so \b first
+ * must be 0 and \b count 1. Summing all disp->spp samples in any number of
+ * calls and dividing with display_sample_mean() gives exactly the colors
+ * display_run_region() writes.
+ */
+void display_accum_region(const display* const disp,
+                          const body_rep** const bodies, size_t body_count,
+                          unsigned int x0, unsigned int y0, unsigned int x1,
+                          unsigned int y1, unsigned int first,
+                          unsigned int count, double* sum);
+
+/// Color of a pixel from its sum of \b count samples
+color display_sample_mean(const double* sum, unsigned int count);
+
+/// display_run_region() that also records the bodies hit by any ray of the
+/// region in \b touched, see display_trace_ray().
+void display_run_region_touched(const display* const disp,
+                                const body_rep** const bodies,
+                                size_t body_count, unsigned int x0,
+                                unsigned int y0, unsigned int x1,
+                                unsigned int y1, uint64_t* touched);
+
+/** display_run_region() that also writes the distance along the pixel
+ * center ray to the first hit of each pixel of the region to \b depth,
+ * indexed like color_buffer, INFINITY where nothing is hit. With a sampler
+ * the hit of the first sample is moved to the center ray over its tangent
+ * plane, interpolated pixels of adaptive rendering get the interpolated
+ * distance.
+ */
+void display_run_region_depth(const display* const disp,
+                              const body_rep** const bodies,
+                              size_t body_count, unsigned int x0,
+                              unsigned int y0, unsigned int x1,
+                              unsigned int y1, RT_FLOAT* depth);
+
 /// Writes the display data using the data provided by the \b output_impl data
 void display_write(const display* const disp);
 
@@ -64,6 +209,58 @@ color display_iterate_single_ray(const body_rep** const bodies,
                                  size_t body_count, ray r, body_rep* ignore,
                                  int refl_c);
 
+/** Same as display_iterate_single_ray() but also records which bodies the
+ * ray and its reflections hit.
+ *
+ * @param touched NULL, or a bitmask with at least body_count bits. Bit i is set
+ * when bodies[i] is the closest hit of any ray of the path.
+ */
+color display_trace_ray(const body_rep** const bodies, size_t body_count,
+                        ray r, const body_rep* ignore, int refl_c,
+                        uint64_t* touched);
+
+/// display_trace_ray() that finds hits with \b accel (NULL tests every body)
+color display_trace_ray_accel(const rt_accel* accel,
+                              const body_rep** const bodies, size_t body_count,
+                              ray r, const body_rep* ignore, int refl_c,
+                              uint64_t* touched);
+
+/** display_trace_ray_accel() for a ray cone.
+ *
+ * The cone width at a hit is passed to the texture, and reflections widen the
+ * cone by the curvature of spheres and the roughness of the surface. When a
+ * bounded body fits inside the footprint its reflection is replaced by the
+ * background color instead of being traced, see display_thread_culled().
+ * A zero cone traces exactly like display_trace_ray_accel().
+ */
+color display_trace_ray_cone(const rt_accel* accel,
+                             const body_rep** const bodies, size_t body_count,
+                             ray r, ray_cone cone, const body_rep* ignore,
+                             int refl_c, uint64_t* touched);
+
+/** Finds the closest body the ray hits by testing every body.
+ *
+ * @param ignore Body to skip, may be NULL
+ * @param hit Set to the index of the closest body hit
+ * @param dist Set to the distance to the hit
+ * @param norm Set to the surface normal at the hit
+ * @return Whether anything was hit. If not, the outputs are untouched.
+ */
+bool display_closest_hit(const body_rep** const bodies, size_t body_count,
+                         ray r, const body_rep* ignore, size_t* hit,
+                         RT_FLOAT* dist, vector3* norm);
+
+/// Total amount of rays (including reflections) traced by the calling thread
+/// so far. Only meant for differences, e.g. before and after a tile.
+uint64_t display_thread_rays(void);
+
+/// Camera rays traced by the calling thread so far, see display_thread_rays()
+uint64_t display_thread_primary(void);
+
+/// Reflections the calling thread didn't trace because of their footprint,
+/// see display_trace_ray_cone()
+uint64_t display_thread_culled(void);
+
 typedef struct {
     char* disp_out;
     size_t disp_out_size;
@@ -0,0 +1,217 @@
+#include "pipeline.h"
+#include <include/prof.h>
+#include <include/texture.h>
+#include <include/util.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool p6_begin(void* impl, const display* const disp) {
+    disp_file* file = (disp_file*)impl;
+    file->f = fopen(file->path, "wb");
+    if (file->f == NULL) {
+        return false;
+    }
+    fprintf(file->f, "P6\n%u %u\n255\n", disp->d_w, disp->d_h);
+    file->row_buf = rt_malloc(MEM_OUTPUT, disp->d_w * 3);
+    return true;
+}
+
+static void p6_rows(void* impl, const display* const disp,
+                    unsigned int row_begin, unsigned int row_end) {
+    disp_file* file = (disp_file*)impl;
+    unsigned char* p;
+    color c;
+
+    for (unsigned int i = row_begin; i < row_end; i++) {
+        p = file->row_buf;
+        for (unsigned int j = 0; j < disp->d_w; j++) {
+            c = disp->color_buffer[i * disp->d_w + j];
+            // Same conversion as ppm_color()
+            *p++ = (unsigned char)(c.r * 255.999);
+            *p++ = (unsigned char)(c.g * 255.999);
+            *p++ = (unsigned char)(c.b * 255.999);
+        }
+        fwrite(file->row_buf, 3, disp->d_w, file->f);
+    }
+}
+
+static void file_end(void* impl, const display* const disp) {
+    disp_file* file = (disp_file*)impl;
+    fclose(file->f);
+    rt_free(file->row_buf);
+    file->f = NULL;
+    file->row_buf = NULL;
+}
+
+disp_stream stream_p6(disp_file* impl) {
+    disp_stream ret = {impl, &p6_begin, &p6_rows, &file_end};
+    return ret;
+}
+
+static bool pfm_begin(void* impl, const display* const disp) {
+    disp_file* file = (disp_file*)impl;
+    file->f = fopen(file->path, "wb");
+    if (file->f == NULL) {
+        return false;
+    }
+    // Negative scale means little endian data
+    fprintf(file->f, "PF\n%u %u\n-1.0\n", disp->d_w, disp->d_h);
+    file->data_offset = ftell(file->f);
+    file->row_buf = rt_malloc(MEM_OUTPUT, disp->d_w * 3 * sizeof(uint32_t));
+    return true;
+}
+
+static unsigned char* pfm_put(unsigned char* p, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    *p++ = bits & 0xff;
+    *p++ = (bits >> 8) & 0xff;
+    *p++ = (bits >> 16) & 0xff;
+    *p++ = (bits >> 24) & 0xff;
+    return p;
+}
+
+static void pfm_rows(void* impl, const display* const disp,
+                     unsigned int row_begin, unsigned int row_end) {
+    disp_file* file = (disp_file*)impl;
+    size_t row_bytes = disp->d_w * 3 * sizeof(uint32_t);
+    unsigned char* p;
+    color c;
+
+    for (unsigned int i = row_begin; i < row_end; i++) {
+        p = file->row_buf;
+        for (unsigned int j = 0; j < disp->d_w; j++) {
+            c = disp->color_buffer[i * disp->d_w + j];
+            p = pfm_put(p, c.r);
+            p = pfm_put(p, c.g);
+            p = pfm_put(p, c.b);
+        }
+        // PFM stores the rows bottom to top, so seek to where this row goes
+        fseek(file->f, file->data_offset + (disp->d_h - 1 - i) * row_bytes,
+              SEEK_SET);
+        fwrite(file->row_buf, 1, row_bytes, file->f);
+    }
+}
+
+disp_stream stream_pfm(disp_file* impl) {
+    disp_stream ret = {impl, &pfm_begin, &pfm_rows, &file_end};
+    return ret;
+}
+
+void display_write_stream(const display* const disp, disp_stream stream) {
+    PROF_BEGIN(span);
+    if (!stream.begin(stream.impl, disp)) {
+        return;
+    }
+    stream.rows(stream.impl, disp, 0, disp->d_h);
+    stream.end(stream.impl, disp);
+    PROF_END(span, "write", -1);
+}
+
+void p6_out(const display* const disp) {
+    display_write_stream(disp, stream_p6((disp_file*)disp->output_impl));
+}
+
+void pfm_out(const display* const disp) {
+    display_write_stream(disp, stream_pfm((disp_file*)disp->output_impl));
+}
+
+static void* out_pipeline_worker(void* arg) {
+    out_pipeline* pipe = (out_pipeline*)arg;
+    const display* disp = pipe->disp;
+    unsigned int from, to;
+
+    prof_thread_name("output");
+    pipe->ok = pipe->stream.begin(pipe->stream.impl, disp);
+
+    pthread_mutex_lock(&pipe->lock);
+    while (pipe->rows_written < disp->d_h) {
+        while (pipe->rows_ready == pipe->rows_written) {
+            pthread_cond_wait(&pipe->cond, &pipe->lock);
+        }
+        from = pipe->rows_written;
+        to = pipe->rows_ready;
+        pthread_mutex_unlock(&pipe->lock);
+
+        // The rows are final, so they can be read without the lock
+        if (pipe->ok) {
+            PROF_BEGIN(span);
+            pipe->stream.rows(pipe->stream.impl, disp, from, to);
+            PROF_END(span, "write rows", to - from);
+        }
+
+        pthread_mutex_lock(&pipe->lock);
+        pipe->rows_written = to;
+    }
+    pthread_mutex_unlock(&pipe->lock);
+
+    if (pipe->ok) {
+        pipe->stream.end(pipe->stream.impl, disp);
+    }
+    return NULL;
+}
+
+bool out_pipeline_start(out_pipeline* pipe, const display* const disp,
+                        disp_stream stream) {
+    pipe->disp = disp;
+    pipe->stream = stream;
+    pipe->row_done = rt_calloc(MEM_OUTPUT, disp->d_h, sizeof(bool));
+    pipe->rows_ready = 0;
+    pipe->rows_written = 0;
+    pipe->ok = true;
+    pthread_mutex_init(&pipe->lock, NULL);
+    pthread_cond_init(&pipe->cond, NULL);
+
+    if (pthread_create(&pipe->thread, NULL, &out_pipeline_worker, pipe) != 0) {
+        pthread_mutex_destroy(&pipe->lock);
+        pthread_cond_destroy(&pipe->cond);
+        rt_free(pipe->row_done);
+        return false;
+    }
+    return true;
+}
+
+void out_pipeline_row_done(out_pipeline* pipe, unsigned int row) {
+    pthread_mutex_lock(&pipe->lock);
+    pipe->row_done[row] = true;
+    // Only wake the encoder if the done prefix grew
+    if (row == pipe->rows_ready) {
+        while (pipe->rows_ready < pipe->disp->d_h &&
+               pipe->row_done[pipe->rows_ready]) {
+            pipe->rows_ready++;
+        }
+        pthread_cond_signal(&pipe->cond);
+    }
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+void out_pipeline_finish(out_pipeline* pipe) {
+    // Shows how long tracing waits on the writer after the last row
+    PROF_BEGIN(span);
+    pthread_join(pipe->thread, NULL);
+    PROF_END(span, "output wait", -1);
+    pthread_mutex_destroy(&pipe->lock);
+    pthread_cond_destroy(&pipe->cond);
+    rt_free(pipe->row_done);
+}
+
+void display_run_rays_pipelined(const display* const disp,
+                                const body_rep** const bodies,
+                                size_t body_count, disp_stream stream) {
+    out_pipeline pipe;
+
+    if (!out_pipeline_start(&pipe, disp, stream)) {
+        // No thread, do it the old way
+        display_run_rays(disp, bodies, body_count);
+        display_write_stream(disp, stream);
+        return;
+    }
+
+    for (unsigned int i = 0; i < disp->d_h; i++) {
+        display_run_region(disp, bodies, body_count, 0, i, disp->d_w, i + 1);
+        out_pipeline_row_done(&pipe, i);
+    }
+    out_pipeline_finish(&pipe);
+}
@@ -0,0 +1,91 @@
+#ifndef RAY_TRACE_PIPELINE_H
+#define RAY_TRACE_PIPELINE_H
+
+#include "output.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/** Row based writer that can be fed a frame piece by piece.
+ *
+ * All three functions are called from the same thread (the encoder thread
+ * when used through out_pipeline), so the implementation needs no locking.
+ * Rows are always handed out in ascending order.
+ */
+typedef struct disp_stream {
+    void* impl; ///< Writer implementation data
+    /// Called once before any rows. Returns false if the writer can't start
+    /// (e.g. the file couldn't be opened), in which case nothing else is
+    /// called.
+    bool (*begin)(void* impl, const display* const disp);
+    /// Write the rows [row_begin, row_end) from disp->color_buffer
+    void (*rows)(void* impl, const display* const disp, unsigned int row_begin,
+                 unsigned int row_end);
+    /// Called once after all rows were written
+    void (*end)(void* impl, const display* const disp);
+} disp_stream;
+
+/// File output implementation for the P6 and PFM streams.
+typedef struct {
+    const char* path;        ///< Output path
+    FILE* f;                 ///< Set while the stream is open
+    unsigned char* row_buf;  ///< Conversion buffer for a single row
+    long data_offset;        ///< Byte offset of the pixel data (after header)
+} disp_file;
+
+/// Returns a binary PPM (P6) stream writing to \b impl->path
+disp_stream stream_p6(disp_file* impl);
+
+/// Returns a little endian PFM (32 bit float RGB) stream writing to
+/// \b impl->path
+disp_stream stream_pfm(disp_file* impl);
+
+/// Writes the whole frame synchronously with the given stream.
+void display_write_stream(const display* const disp, disp_stream stream);
+
+/// Output implementation for display_init(), \b output_impl is a disp_file
+void p6_out(const display* const disp);
+/// Output implementation for display_init(), \b output_impl is a disp_file
+void pfm_out(const display* const disp);
+
+/** Background encoder that writes rows as soon as they have been traced.
+ *
+ * Tracing code calls out_pipeline_row_done() for each finished row, in any
+ * order and from any thread. The encoder thread writes the longest run of
+ * finished rows at the start of the frame that it hasn't written yet, so the
+ * output is always written top to bottom while tracing goes on.
+ */
+typedef struct {
+    const display* disp;  ///< Display whose buffer is written
+    disp_stream stream;   ///< Writer used by the encoder thread
+    pthread_t thread;     ///< Encoder thread
+    pthread_mutex_t lock; ///< Protects the fields below
+    pthread_cond_t cond;  ///< Signaled when a row is done
+    bool* row_done;       ///< Per row completion flags
+    unsigned int rows_ready;   ///< Rows [0, rows_ready) are done
+    unsigned int rows_written; ///< Rows [0, rows_written) are written
+    bool ok;                   ///< False if stream->begin() failed
+} out_pipeline;
+
+/// Starts the encoder thread. Returns false if the thread couldn't be
+/// created.
+bool out_pipeline_start(out_pipeline* pipe, const display* const disp,
+                        disp_stream stream);
+
+/// Marks the given row of the color buffer as final.
+void out_pipeline_row_done(out_pipeline* pipe, unsigned int row);
+
+/// Waits until every row is written and stops the encoder thread. Every row
+/// must have been marked done before this is called.
+void out_pipeline_finish(out_pipeline* pipe);
+
+/** Traces the frame like display_run_rays() while writing finished rows with
+ * \b stream on a background thread. Total time is close to the larger of
+ * tracing and writing instead of their sum.
+ */
+void display_run_rays_pipelined(const display* const disp,
+                                const body_rep** const bodies,
+                                size_t body_count, disp_stream stream);
+
+#endif
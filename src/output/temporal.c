@@ -0,0 +1,198 @@
+#include "temporal.h"
+#include <include/alloc.h>
+#include <include/math.h>
+#include <include/prof.h>
+
+#include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+
+/// Bilinear weight below which the history of a pixel isn't trusted
+#define TEMPORAL_MIN_WEIGHT 0.01
+
+/// State shared by the rows of one frame
+typedef struct {
+    temporal_render* tr;
+    const display* frame; ///< The display with the seed of this frame
+    const body_rep** bodies;
+    size_t body_count;
+    RT_FLOAT disp_x;
+    RT_FLOAT disp_y;
+    int cur;               ///< Buffer index written by this frame
+    atomic_size_t reused;  ///< Pixels that took history
+} temporal_job;
+
+bool temporal_init(temporal_render* tr, display* disp) {
+    size_t pixels = (size_t)disp->d_w * disp->d_h;
+    tr->disp = disp;
+    tr->max_history = TEMPORAL_MAX_HISTORY;
+    tr->depth_tol = TEMPORAL_DEPTH_TOL;
+    tr->frame = 0;
+    tr->prev_pos = disp->pos;
+    tr->prev_right = disp->right;
+    tr->prev_up = disp->up;
+    tr->prev_forward = disp->forward;
+    tr->valid = false;
+    tr->reused = 0;
+    for (int b = 0; b < 2; b++) {
+        tr->history[b] = rt_malloc(MEM_OUTPUT, sizeof(color) * pixels);
+        tr->depth[b] = rt_malloc(MEM_OUTPUT, sizeof(RT_FLOAT) * pixels);
+        tr->count[b] = rt_malloc(MEM_OUTPUT, sizeof(uint16_t) * pixels);
+    }
+    for (int b = 0; b < 2; b++) {
+        if (tr->history[b] == NULL || tr->depth[b] == NULL ||
+            tr->count[b] == NULL) {
+            temporal_free(tr);
+            return false;
+        }
+    }
+    return true;
+}
+
+void temporal_free(temporal_render* tr) {
+    for (int b = 0; b < 2; b++) {
+        rt_free(tr->history[b]);
+        rt_free(tr->depth[b]);
+        rt_free(tr->count[b]);
+        tr->history[b] = NULL;
+        tr->depth[b] = NULL;
+        tr->count[b] = NULL;
+    }
+}
+
+void temporal_reset(temporal_render* tr) {
+    tr->valid = false;
+}
+
+/** Looks up the history of the point the ray hits at \b depth.
+ *
+ * The point is projected into the previous camera and the four nearest
+ * history pixels are blended bilinearly, skipping those whose depth doesn't
+ * match (the point was hidden or it is a different surface).
+ *
+ * @return false if no usable history was found
+ */
+static bool temporal_fetch(const temporal_job* job, ray r, RT_FLOAT depth,
+                           color* col, unsigned int* count) {
+    const temporal_render* tr = job->tr;
+    const display* disp = job->frame;
+    int prev = 1 - job->cur;
+
+    // Points at infinity (the background) only move with the rotation
+    vector3 c = isinf(depth) ? r.path
+                             : vec_sub(ray_dist(r, depth), tr->prev_pos);
+    c = vec3(vec_dot(c, tr->prev_right), vec_dot(c, tr->prev_up),
+             vec_dot(c, tr->prev_forward));
+    if (c.k <= RTFCOMPVAL) {
+        return false;
+    }
+    RT_FLOAT expect = vec_mag(c);
+
+    // Inverse of display_camera_ray_at(), pixel centers are at + 0.5
+    RT_FLOAT px = (c.i / c.k / job->disp_x + 1.0) * disp->d_w / 2.0 - 0.5;
+    RT_FLOAT py = (1.0 - c.j / c.k / job->disp_y) * disp->d_h / 2.0 - 0.5;
+    RT_FLOAT x0 = floor(px), y0 = floor(py);
+    RT_FLOAT fx = px - x0, fy = py - y0;
+
+    double r_sum = 0.0, g_sum = 0.0, b_sum = 0.0, w_sum = 0.0, n_sum = 0.0;
+    for (int t = 0; t < 4; t++) {
+        long x = (long)x0 + (t & 1), y = (long)y0 + (t >> 1);
+        if (x < 0 || y < 0 || x >= (long)disp->d_w || y >= (long)disp->d_h) {
+            continue;
+        }
+        size_t index = (size_t)y * disp->d_w + x;
+        RT_FLOAT pd = tr->depth[prev][index];
+        if (isinf(depth) != isinf(pd) ||
+            (!isinf(depth) && fabs(pd - expect) > tr->depth_tol * expect)) {
+            continue;
+        }
+        double w = ((t & 1) ? fx : 1.0 - fx) * ((t >> 1) ? fy : 1.0 - fy);
+        color h = tr->history[prev][index];
+        r_sum += w * h.r;
+        g_sum += w * h.g;
+        b_sum += w * h.b;
+        n_sum += w * tr->count[prev][index];
+        w_sum += w;
+    }
+    if (w_sum < TEMPORAL_MIN_WEIGHT) {
+        return false;
+    }
+    *col = color_new(r_sum / w_sum, g_sum / w_sum, b_sum / w_sum);
+    *count = (unsigned int)(n_sum / w_sum);
+    return true;
+}
+
+/// Traces and blends one row, run by the pool
+static void temporal_row(void* arg, size_t y, unsigned int worker) {
+    temporal_job* job = (temporal_job*)arg;
+    temporal_render* tr = job->tr;
+    const display* disp = job->frame;
+    size_t reused = 0;
+
+    // The row's random sequence only depends on the frame seed and the row
+    rng_seed(rng_thread(), disp->seed, rng_hash(y));
+    PROF_BEGIN(span);
+    display_run_region_depth(disp, job->bodies, job->body_count, 0, y,
+                             disp->d_w, y + 1, tr->depth[job->cur]);
+    PROF_END(span, "row", y);
+    PROF_BEGIN(blend);
+
+    for (unsigned int x = 0; x < disp->d_w; x++) {
+        size_t index = y * disp->d_w + x;
+        ray r = display_camera_ray(disp, job->disp_x, job->disp_y, x, y);
+        RT_FLOAT depth = tr->depth[job->cur][index];
+        color cur = disp->color_buffer[index];
+        color hist;
+        unsigned int n = 0;
+
+        if (tr->valid && temporal_fetch(job, r, depth, &hist, &n)) {
+            reused++;
+            n = n + 1 < tr->max_history ? n + 1 : tr->max_history;
+            RT_FLOAT a = 1.0 / n;
+            cur = color_new(hist.r + a * (cur.r - hist.r),
+                            hist.g + a * (cur.g - hist.g),
+                            hist.b + a * (cur.b - hist.b));
+        } else {
+            n = 1;
+        }
+        disp->color_buffer[index] = cur;
+        tr->history[job->cur][index] = cur;
+        tr->count[job->cur][index] = n;
+    }
+    PROF_END(blend, "reproject", y);
+    atomic_fetch_add_explicit(&job->reused, reused, memory_order_relaxed);
+}
+
+size_t temporal_run(temporal_render* tr, const body_rep** const bodies,
+                    size_t body_count, rt_pool* pool) {
+    PROF_BEGIN(span);
+    display frame = *tr->disp;
+    frame.seed = rng_hash(tr->disp->seed + tr->frame);
+
+    temporal_job job;
+    job.tr = tr;
+    job.frame = &frame;
+    job.bodies = bodies;
+    job.body_count = body_count;
+    job.cur = tr->frame & 1;
+    atomic_init(&job.reused, 0);
+    display_view_extent(&frame, &job.disp_x, &job.disp_y);
+
+    if (pool != NULL) {
+        pool_run(pool, frame.d_h, &temporal_row, &job);
+    } else {
+        for (unsigned int y = 0; y < frame.d_h; y++) {
+            temporal_row(&job, y, 0);
+        }
+    }
+
+    tr->prev_pos = frame.pos;
+    tr->prev_right = frame.right;
+    tr->prev_up = frame.up;
+    tr->prev_forward = frame.forward;
+    tr->valid = true;
+    tr->frame++;
+    tr->reused = atomic_load(&job.reused);
+    PROF_END(span, "temporal", -1);
+    return tr->reused;
+}
@@ -0,0 +1,74 @@
+#ifndef RAY_TRACE_TEMPORAL_H
+#define RAY_TRACE_TEMPORAL_H
+
+#include "output.h"
+#include <include/sched.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Default cap of the frames a pixel's history averages over
+#define TEMPORAL_MAX_HISTORY 16
+/// Default relative depth difference at which history is thrown away
+#define TEMPORAL_DEPTH_TOL 0.02
+
+/** Accumulates samples over the frames of a moving camera.
+ *
+ * Every frame is traced with the sampler settings of the display (usually
+ * few samples), and the primary hit distance of every pixel is kept (see
+ * display_run_region_depth()). The next frame finds where each of its
+ * pixels was seen from the previous camera and, if the depths there agree,
+ * blends the old color in, so a pixel that stays visible keeps converging
+ * while the camera moves. Pixels that were off screen or hidden before start
+ * over.
+ *
+ * The camera may move and turn between frames (display.pos and the basis set
+ * by display_look()), the history is reprojected with the position and basis
+ * it was rendered from.
+ * Reflections are reused as if they were painted on the surface, which smears
+ * them a little while moving; max_history bounds how long that lasts.
+ *
+ * The display color buffer receives the blended frame.
+ */
+typedef struct {
+    display* disp;            ///< Display that is rendered to
+    unsigned int max_history; ///< Frames blended at most, TEMPORAL_MAX_HISTORY
+    RT_FLOAT depth_tol;       ///< Relative depth tolerance, TEMPORAL_DEPTH_TOL
+    uint64_t frame;           ///< Frames rendered so far
+    vector3 prev_pos;         ///< Camera position of the history
+    vector3 prev_right;       ///< Camera basis of the history
+    vector3 prev_up;          ///< Camera basis of the history
+    vector3 prev_forward;     ///< Camera basis of the history
+    bool valid;               ///< Whether there is a history
+    color* history[2];        ///< Blended color, previous and current
+    RT_FLOAT* depth[2];       ///< Primary hit distance, INFINITY on a miss
+    uint16_t* count[2];       ///< Frames in the history of each pixel
+    size_t reused;            ///< Pixels that reused history in the last frame
+} temporal_render;
+
+/** Initializes the state, the first temporal_run() has no history
+ *
+ * @return false if out of memory, nothing is left allocated
+ */
+bool temporal_init(temporal_render* tr, display* disp);
+
+/// Frees the state (not the display)
+void temporal_free(temporal_render* tr);
+
+/// Drops the history, e.g. after a cut or a scene edit
+void temporal_reset(temporal_render* tr);
+
+/** Traces a frame from the current display position and blends it with the
+ * reprojected history.
+ *
+ * Every frame uses a different sampler seed (derived from display.seed and
+ * the frame number) so that the blended samples are independent.
+ *
+ * @param pool Pool to trace rows with, NULL traces on the caller
+ * @return Pixels that reused history
+ */
+size_t temporal_run(temporal_render* tr, const body_rep** const bodies,
+                    size_t body_count, rt_pool* pool);
+
+#endif
@@ -0,0 +1,201 @@
+#include "prof.h"
+#include <include/alloc.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/// One recorded span
+typedef struct {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+    int64_t arg;
+    uint32_t tid; ///< Thread that recorded it, rings outlive their threads
+} prof_event;
+
+/// Spans of one thread. Only the owner writes, prof_write() reads.
+typedef struct prof_ring {
+    prof_event* events;
+    size_t cap;
+    atomic_uint_fast64_t head; ///< Spans recorded, the newest at head - 1
+    uint64_t session;          ///< Recording the spans belong to
+    atomic_bool owned;         ///< Whether a live thread uses the ring
+    struct prof_ring* next;    ///< Link in prof_rings, never removed
+} prof_ring;
+
+atomic_bool prof_on = false;
+
+static _Atomic(prof_ring*) prof_rings = NULL;
+static atomic_uint_fast64_t prof_session = 0;
+static atomic_size_t prof_cap = PROF_EVENTS;
+static atomic_uint prof_tids = 0;
+static uint64_t prof_base;
+static char prof_names[PROF_THREADS][32];
+
+static _Thread_local prof_ring* prof_self = NULL;
+static _Thread_local uint32_t prof_tid = 0;
+static pthread_key_t prof_key;
+static pthread_once_t prof_once = PTHREAD_ONCE_INIT;
+
+/// Hands the ring of an exiting thread to the next new one
+static void prof_release(void* ring) {
+    atomic_store(&((prof_ring*)ring)->owned, false);
+}
+
+static void prof_init_key(void) {
+    pthread_key_create(&prof_key, &prof_release);
+}
+
+uint64_t prof_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void prof_start(size_t events) {
+    atomic_store(&prof_cap, events == 0 ? PROF_EVENTS : events);
+    prof_base = prof_now();
+    atomic_fetch_add(&prof_session, 1);
+    atomic_store(&prof_on, true);
+}
+
+void prof_stop(void) {
+    atomic_store(&prof_on, false);
+}
+
+/// Thread id, assigned on the first call of the thread
+static uint32_t prof_thread_id(void) {
+    if (prof_tid == 0) {
+        prof_tid = atomic_fetch_add(&prof_tids, 1) + 1;
+    }
+    return prof_tid;
+}
+
+/// Ring of the calling thread for the current recording, NULL if out of
+/// memory
+static prof_ring* prof_ring_get(void) {
+    prof_ring* r = prof_self;
+    if (r == NULL) {
+        pthread_once(&prof_once, &prof_init_key);
+        for (r = atomic_load(&prof_rings); r != NULL; r = r->next) {
+            bool free_ring = false;
+            if (atomic_compare_exchange_strong(&r->owned, &free_ring, true)) {
+                break;
+            }
+        }
+        if (r == NULL) {
+            r = rt_calloc(MEM_PROF, 1, sizeof(prof_ring));
+            if (r == NULL) {
+                return NULL;
+            }
+            atomic_init(&r->owned, true);
+            r->next = atomic_load(&prof_rings);
+            while (!atomic_compare_exchange_weak(&prof_rings, &r->next, r)) {
+            }
+        }
+        prof_self = r;
+        pthread_setspecific(prof_key, r);
+    }
+
+    uint64_t session = atomic_load_explicit(&prof_session,
+                                            memory_order_relaxed);
+    if (r->session != session) {
+        size_t cap = atomic_load(&prof_cap);
+        if (r->cap != cap) {
+            rt_free(r->events);
+            r->events = rt_malloc(MEM_PROF, sizeof(prof_event) * cap);
+            r->cap = r->events != NULL ? cap : 0;
+        }
+        atomic_store_explicit(&r->head, 0, memory_order_relaxed);
+        r->session = session;
+    }
+    return r->cap > 0 ? r : NULL;
+}
+
+void prof_span(const char* name, uint64_t start, int64_t arg) {
+    uint64_t end = prof_now();
+    prof_ring* r = prof_ring_get();
+    if (r == NULL) {
+        return;
+    }
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    prof_event* e = &r->events[head % r->cap];
+    e->name = name;
+    e->start = start;
+    e->end = end;
+    e->arg = arg;
+    e->tid = prof_thread_id();
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+void prof_thread_name(const char* name) {
+    uint32_t tid = prof_thread_id();
+    if (tid < PROF_THREADS) {
+        snprintf(prof_names[tid], sizeof(prof_names[tid]), "%s", name);
+    }
+}
+
+/// Writes a JSON string, the names are plain but may come from callers
+static void prof_json_string(FILE* f, const char* s) {
+    fputc('"', f);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', f);
+        }
+        if ((unsigned char)*s >= 0x20) {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+RT_RES prof_write(const char* path) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        RETURN_ERR(FILE_ERROR);
+    }
+    uint64_t session = atomic_load(&prof_session);
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+               "\"args\":{\"name\":\"ray_trace\"}}");
+    unsigned int tids = atomic_load(&prof_tids);
+    for (unsigned int t = 1; t <= tids && t < PROF_THREADS; t++) {
+        if (prof_names[t][0] != '\0') {
+            fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                       "\"tid\":%u,\"args\":{\"name\":",
+                    t);
+            prof_json_string(f, prof_names[t]);
+            fprintf(f, "}}");
+        }
+    }
+    for (prof_ring* r = atomic_load(&prof_rings); r != NULL; r = r->next) {
+        if (r->session != session || r->cap == 0) {
+            continue;
+        }
+        uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        uint64_t from = head > r->cap ? head - r->cap : 0;
+        for (uint64_t i = from; i < head; i++) {
+            const prof_event* e = &r->events[i % r->cap];
+            // Spans started before prof_start() are clamped to it
+            uint64_t start = e->start > prof_base ? e->start - prof_base : 0;
+            uint64_t end = e->end > prof_base ? e->end - prof_base : 0;
+            fprintf(f, ",\n{\"name\":");
+            prof_json_string(f, e->name);
+            fprintf(f, ",\"cat\":\"rt\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                       "\"ts\":%.3f,\"dur\":%.3f",
+                    e->tid, start / 1000.0, (end - start) / 1000.0);
+            if (e->arg >= 0) {
+                fprintf(f, ",\"args\":{\"n\":%lld}", (long long)e->arg);
+            }
+            fputc('}', f);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0) {
+        RETURN_ERR(FILE_ERROR);
+    }
+    RETURN_NOERROR;
+}
@@ -0,0 +1,85 @@
+#ifndef RAY_TRACE_PROF_H
+#define RAY_TRACE_PROF_H
+
+#include <include/errors.h>
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Default spans kept per thread
+#define PROF_EVENTS 65536
+/// Threads that can be named, later ones show up by number
+#define PROF_THREADS 256
+
+/** Timeline of what every thread did, written as Chrome trace events for
+ * Perfetto or chrome://tracing.
+ *
+ * A span is a name, a start and an end on the thread that recorded it, e.g.
+ * one tile. Every thread writes its spans into its own ring buffer, claimed
+ * on its first span, so recording takes no lock and shares no cache line
+ * with other threads; a full ring overwrites its oldest spans. Rings of
+ * threads that exited are reused by new ones.
+ *
+ * While recording is off a span costs one relaxed load, building with
+ * RT_NO_PROF (make PROF=0) compiles them out.
+ */
+
+/// Set between prof_start() and prof_stop(), use prof_active()
+extern atomic_bool prof_on;
+
+/** Starts recording and drops the spans of earlier recordings.
+ *
+ * @param events Spans kept per thread, 0 for PROF_EVENTS
+ */
+void prof_start(size_t events);
+
+/// Stops recording, the spans are kept for prof_write()
+void prof_stop(void);
+
+/// Whether spans are recorded
+static inline bool prof_active(void) {
+#ifdef RT_NO_PROF
+    return false;
+#else
+    return atomic_load_explicit(&prof_on, memory_order_relaxed);
+#endif
+}
+
+/// Monotonic time in nanoseconds
+uint64_t prof_now(void);
+
+/** Records a span of the calling thread from \b start (prof_now()) to now.
+ *
+ * @param name Static string, only the pointer is kept
+ * @param arg Shown as "n" in the event, e.g. the tile index, -1 for none
+ */
+void prof_span(const char* name, uint64_t start, int64_t arg);
+
+/// Names the calling thread in the timeline (up to 31 characters)
+void prof_thread_name(const char* name);
+
+/** Writes the spans of the last recording as Chrome trace event JSON. No
+ * thread may record spans meanwhile, so stop first.
+ *
+ * @return FILE_ERROR if the file can't be written
+ */
+RT_RES prof_write(const char* path);
+
+#ifdef RT_NO_PROF
+#define PROF_BEGIN(var) uint64_t var = 0
+#define PROF_END(var, name, arg) (void)(var)
+#else
+/// Starts a span in the local \b var if recording
+#define PROF_BEGIN(var) uint64_t var = prof_active() ? prof_now() : 0
+/// Ends the span started by PROF_BEGIN(var)
+#define PROF_END(var, name, arg)                                               \
+    do {                                                                       \
+        if (var != 0) {                                                        \
+            prof_span(name, var, arg);                                         \
+        }                                                                      \
+    } while (0)
+#endif
+
+#endif
@@ -0,0 +1,233 @@
+#include "budget.h"
+#include <include/alloc.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Source column pair and weight of one output column
+typedef struct {
+    unsigned int x0, x1;
+    float tx;
+} budget_tap;
+
+/// Bilinear blend of four pixels
+static inline COLOR_TYPE budget_lerp(COLOR_TYPE a, COLOR_TYPE b, COLOR_TYPE c,
+                                     COLOR_TYPE d, float tx, float ty) {
+    float top = a + (b - a) * tx;
+    float bottom = c + (d - c) * tx;
+    return (COLOR_TYPE)(top + (bottom - top) * ty);
+}
+
+/// Bilinear resampling with pixel centers aligned. It runs on the critical
+/// path of every scaled frame, so it stays plain arithmetic and the columns
+/// are worked out once.
+static void budget_resample(const color* src, unsigned int sw,
+                            unsigned int sh, color* dst, unsigned int dw,
+                            unsigned int dh) {
+    double sx = (double)sw / dw, sy = (double)sh / dh;
+    budget_tap* taps = rt_malloc(MEM_RENDER, sizeof(budget_tap) * dw);
+    if (taps == NULL) {
+        return;
+    }
+    for (unsigned int x = 0; x < dw; x++) {
+        double fx = (x + 0.5) * sx - 0.5;
+        fx = fx < 0.0 ? 0.0 : fx;
+        taps[x].x0 = (unsigned int)fx;
+        taps[x].x1 = taps[x].x0 + 1 < sw ? taps[x].x0 + 1 : sw - 1;
+        taps[x].tx = (float)(fx - taps[x].x0);
+    }
+    for (unsigned int y = 0; y < dh; y++) {
+        double fy = (y + 0.5) * sy - 0.5;
+        fy = fy < 0.0 ? 0.0 : fy;
+        unsigned int y0 = (unsigned int)fy;
+        unsigned int y1 = y0 + 1 < sh ? y0 + 1 : sh - 1;
+        float ty = (float)(fy - y0);
+        const color* r0 = src + (size_t)y0 * sw;
+        const color* r1 = src + (size_t)y1 * sw;
+        color* out = dst + (size_t)y * dw;
+        for (unsigned int x = 0; x < dw; x++) {
+            budget_tap t = taps[x];
+            out[x].r = budget_lerp(r0[t.x0].r, r0[t.x1].r, r1[t.x0].r,
+                                   r1[t.x1].r, t.tx, ty);
+            out[x].g = budget_lerp(r0[t.x0].g, r0[t.x1].g, r1[t.x0].g,
+                                   r1[t.x1].g, t.tx, ty);
+            out[x].b = budget_lerp(r0[t.x0].b, r0[t.x1].b, r1[t.x0].b,
+                                   r1[t.x1].b, t.tx, ty);
+        }
+    }
+    rt_free(taps);
+}
+
+/** Estimated seconds of a pass.
+ *
+ * A path can't trace more rays than the reflection limit allows, but paths
+ * that end early don't get cheaper with a lower one, so this only assumes a
+ * saving once the limit is below the measured rays per path.
+ */
+static double budget_cost(double per_path, double path, size_t pixels,
+                          unsigned int spp, int max_refl) {
+    double rays = max_refl + 1.0 < path ? max_refl + 1.0 : path;
+    return per_path / path * rays * (double)pixels * spp;
+}
+
+bool rt_context_render_budget(rt_context* ctx, double seconds,
+                              budget_report* report) {
+    double start = util_seconds();
+    double deadline = start + seconds;
+    rt_config want = ctx->cfg;
+    unsigned int spp = want.sampler != SAMPLER_NONE && want.spp > 1
+                           ? want.spp : 1;
+    budget_report rep = {0};
+
+    // Estimate pass, kept as the image if nothing better is ready in time
+    rt_config cfg = want;
+    cfg.width = (unsigned int)(want.width * BUDGET_PROBE_SCALE + 0.5);
+    cfg.height = (unsigned int)(want.height * BUDGET_PROBE_SCALE + 0.5);
+    cfg.width = cfg.width == 0 ? 1 : cfg.width;
+    cfg.height = cfg.height == 0 ? 1 : cfg.height;
+    cfg.spp = 1;
+    if (!rt_context_configure(ctx, &cfg)) {
+        return false;
+    }
+    unsigned int pw = cfg.width, ph = cfg.height;
+    size_t probe_pixels = (size_t)pw * ph;
+    memset(ctx->disp.color_buffer, 0, sizeof(color) * probe_pixels);
+    bool whole = rt_context_render_until(ctx, deadline);
+    rt_stats st = ctx->stats;
+    color* probe = rt_malloc(MEM_RENDER, sizeof(color) * probe_pixels);
+    if (probe == NULL) {
+        rt_context_configure(ctx, &want);
+        return false;
+    }
+    memcpy(probe, ctx->disp.color_buffer, sizeof(color) * probe_pixels);
+    rep.width = pw;
+    rep.height = ph;
+    rep.spp = 1;
+    rep.max_refl = want.max_refl;
+    rep.probe_seconds = util_seconds() - start;
+    size_t pixels = (size_t)want.width * want.height;
+
+    // Already late, so the probe is the image: no plan and no second copy
+    // at full size
+    if (!whole) {
+        rep.drops = BUDGET_DROP_LATE | BUDGET_DROP_RES |
+                    (spp > 1 ? BUDGET_DROP_SPP : 0);
+        bool ok = rt_context_configure(ctx, &want);
+        if (ok) {
+            PROF_BEGIN(late);
+            budget_resample(probe, pw, ph, ctx->disp.color_buffer,
+                            want.width, want.height);
+            PROF_END(late, "upscale", -1);
+        }
+        rt_free(probe);
+        rep.seconds = util_seconds() - start;
+        if (report != NULL) {
+            *report = rep;
+        }
+        return ok;
+    }
+
+    // Best image so far at full size. Scaling it up also measures what the
+    // final upscale will cost.
+    color* best = rt_malloc(MEM_RENDER, sizeof(color) * pixels);
+    if (best == NULL) {
+        rt_free(probe);
+        rt_context_configure(ctx, &want);
+        return false;
+    }
+    double up_start = util_seconds();
+    PROF_BEGIN(span);
+    budget_resample(probe, pw, ph, best, want.width, want.height);
+    PROF_END(span, "upscale", -1);
+    double up_seconds = util_seconds() - up_start;
+
+    // The structure is built by now, the final pass only pays for tracing
+    double per_path = (st.trace_seconds - st.accel_seconds) / probe_pixels;
+    double path = st.primary_rays > 0 ? (double)st.rays / st.primary_rays
+                                      : 1.0;
+    path = path < 1.0 ? 1.0 : path;
+    double left = (deadline - util_seconds() - up_seconds) * BUDGET_MARGIN;
+    int refl = want.max_refl;
+    double cost = budget_cost(per_path, path, pixels, spp, refl);
+
+    if (cost > left && spp > 1) {
+        // The count below could leave up to half of the time unused, then
+        // one more sample with a lower resolution fills it
+        double fit = spp * left / cost;
+        unsigned int below = (unsigned int)fit;
+        spp = below >= 1 && below / fit >= BUDGET_SPP_FILL ? below : below + 1;
+        cost = budget_cost(per_path, path, pixels, spp, refl);
+        rep.drops |= BUDGET_DROP_SPP;
+    }
+    // Only once a single sample per pixel doesn't fit
+    for (int r = refl / 2; spp == 1 && cost > left && r >= 1; r /= 2) {
+        double c = budget_cost(per_path, path, pixels, spp, r);
+        if (c < cost) {
+            refl = r;
+            cost = c;
+            rep.drops |= BUDGET_DROP_REFL;
+        }
+    }
+    double scale = cost > left && left > 0.0 ? sqrt(left / cost) : 1.0;
+    cfg = want;
+    cfg.width = scale < 1.0 ? (unsigned int)(want.width * scale) : want.width;
+    cfg.height =
+        scale < 1.0 ? (unsigned int)(want.height * scale) : want.height;
+    cfg.spp = spp;
+    cfg.max_refl = refl;
+    bool final = left > 0.0 && cfg.width > pw && cfg.height > ph;
+    if (!final || scale < 1.0) {
+        rep.drops |= BUDGET_DROP_RES;
+    }
+
+    if (final && rt_context_configure(ctx, &cfg)) {
+        rep.predicted = budget_cost(per_path, path,
+                                    (size_t)cfg.width * cfg.height, spp, refl);
+        // Tiles that miss the deadline keep the probe
+        budget_resample(probe, pw, ph, ctx->disp.color_buffer, cfg.width,
+                        cfg.height);
+        if (!rt_context_render_until(ctx, deadline)) {
+            rep.drops |= BUDGET_DROP_LATE;
+        }
+        rep.width = cfg.width;
+        rep.height = cfg.height;
+        rep.spp = spp;
+        rep.max_refl = refl;
+        PROF_BEGIN(up);
+        budget_resample(ctx->disp.color_buffer, cfg.width, cfg.height, best,
+                        want.width, want.height);
+        PROF_END(up, "upscale", -1);
+    }
+
+    bool ok = rt_context_configure(ctx, &want);
+    if (ok) {
+        memcpy(ctx->disp.color_buffer, best, sizeof(color) * pixels);
+    }
+    rt_free(best);
+    rt_free(probe);
+    rep.seconds = util_seconds() - start;
+    if (report != NULL) {
+        *report = rep;
+    }
+    return ok;
+}
+
+int budget_drop_names(unsigned int drops, char* buf, size_t size) {
+    static const char* const names[] = {"spp", "refl", "res", "late"};
+    int len = 0;
+    if (drops == 0) {
+        return snprintf(buf, size, "none");
+    }
+    if (size > 0) {
+        buf[0] = '\0';
+    }
+    for (unsigned int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (drops & (1u << i)) {
+            size_t at = (size_t)len < size ? (size_t)len : size;
+            len += snprintf(buf + at, size - at, "%s%s", len > 0 ? "," : "",
+                            names[i]);
+        }
+    }
+    return len;
+}
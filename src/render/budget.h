@@ -0,0 +1,70 @@
+#ifndef RAY_TRACE_BUDGET_H
+#define RAY_TRACE_BUDGET_H
+
+#include "context.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// Edge length of the estimate pass relative to the frame
+#define BUDGET_PROBE_SCALE 0.25
+/// Share of the time left that the final pass is planned to take
+#define BUDGET_MARGIN 0.8
+/// Least share of the planned time a lower sample count has to fill, else
+/// the resolution is lowered instead
+#define BUDGET_SPP_FILL 0.9
+
+/// Quality a budgeted render gave up, as flags
+typedef enum {
+    BUDGET_DROP_SPP = 1 << 0,  ///< Fewer samples per pixel
+    BUDGET_DROP_REFL = 1 << 1, ///< Lower reflection limit
+    BUDGET_DROP_RES = 1 << 2,  ///< Traced at a lower resolution and scaled
+    BUDGET_DROP_LATE = 1 << 3, ///< Tiles missed the deadline, show the probe
+} budget_drop;
+
+/// What rt_context_render_budget() did
+typedef struct {
+    unsigned int width;      ///< Resolution of the last pass traced
+    unsigned int height;
+    unsigned int spp;        ///< Samples per pixel of the last pass
+    int max_refl;            ///< Reflection limit of the last pass
+    unsigned int drops;      ///< budget_drop flags, 0 if nothing was dropped
+    double probe_seconds;    ///< Wall time of the estimate pass
+    double predicted;        ///< Estimated seconds of the final pass
+    double seconds;          ///< Wall time of the whole render
+} budget_report;
+
+/** Renders the frame of the current settings of \b ctx within \b seconds
+ * of wall time.
+ *
+ * A pass at BUDGET_PROBE_SCALE of the size and one sample per pixel measures
+ * the cost of a sample and the rays per path. From these the final pass is
+ * planned to fit BUDGET_MARGIN of the time left, giving up quality in this
+ * order: samples per pixel are cut to the largest count that fits if that
+ * fills BUDGET_SPP_FILL of the time, else to one more (at least 1), the
+ * reflection limit is halved down to 1 while one sample per pixel still
+ * doesn't fit, then the resolution is lowered as far as needed, down to the
+ * probe's. The final pass skips tiles that haven't started by the
+ * deadline, which keep the upscaled probe, so the framebuffer always holds a
+ * whole image at the size of the settings when this returns.
+ *
+ * A budget shorter than the probe isn't met: the probe still traces the
+ * tiles started before the deadline and is then scaled to full size, a few
+ * milliseconds at 640x360 on one core. Nothing else is done then.
+ *
+ * The settings of \b ctx are the same afterwards.
+ *
+ * @param report Filled if not NULL
+ * @return false if the framebuffer couldn't be resized
+ */
+bool rt_context_render_budget(rt_context* ctx, double seconds,
+                              budget_report* report);
+
+/** Writes the names of the dropped levels separated by commas, "none" if
+ * \b drops is 0.
+ *
+ * @return Length like snprintf()
+ */
+int budget_drop_names(unsigned int drops, char* buf, size_t size);
+
+#endif
@@ -0,0 +1,327 @@
+#include "context.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/// State shared by the tiles of one render
+typedef struct {
+    rt_context* ctx;
+    unsigned int tiles_x;         ///< Tile count in width
+    unsigned int tiles_y;         ///< Tile count in height
+    atomic_uint_fast64_t primary; ///< Camera rays of all tiles
+    atomic_uint_fast64_t rays;    ///< Rays traced by all tiles
+    atomic_uint_fast64_t culled;  ///< Reflections cut by all tiles
+    out_pipeline* pipe;           ///< Row writer, may be NULL
+    atomic_uint* band_done;       ///< Finished tiles per tile row (with pipe)
+    double deadline;              ///< util_seconds() to skip tiles after
+    atomic_uint_fast64_t skipped; ///< Tiles skipped for the deadline
+} rt_render_job;
+
+rt_config rt_config_default(void) {
+    rt_config ret = {1920, 1080, 60.0, vec_zero(), MAX_REFL, 0, RT_TILE_SIZE,
+                     0, ACCEL_AUTO, NULL, false, SAMPLER_NONE, 1, false,
+                     vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), 0.0, NULL, true};
+    return ret;
+}
+
+rt_context* rt_context_new(const rt_config* const cfg) {
+    rt_context* ctx = rt_calloc(MEM_RENDER, 1, sizeof(rt_context));
+    if (ctx == NULL) {
+        return NULL;
+    }
+    ctx->cfg = *cfg;
+    ctx->bodies = rtvec_body_new(MEM_RENDER);
+    ctx->body_ptrs = rtvec_body_ptr_new(MEM_RENDER);
+    ctx->built = ACCEL_NONE;
+    ctx->accel_dirty = true;
+    if (ctx->cfg.tile_size == 0) {
+        ctx->cfg.tile_size = RT_TILE_SIZE;
+    }
+
+    ctx->disp = display_init(cfg->width, cfg->height, cfg->fov, cfg->pos, NULL,
+                             NULL, &no_free_func);
+    ctx->disp.max_refl = cfg->max_refl;
+    ctx->disp.sampler = cfg->sampler;
+    ctx->disp.spp = cfg->spp == 0 ? 1 : cfg->spp;
+    ctx->disp.seed = cfg->seed;
+    ctx->disp.cones = cfg->cones;
+    ctx->disp.adaptive = cfg->adaptive;
+    ctx->disp.env = cfg->env;
+    ctx->disp.env_direct = cfg->env_direct;
+    display_look(&ctx->disp, cfg->dir, cfg->up);
+    if (ctx->disp.color_buffer == NULL) {
+        rt_free(ctx);
+        return NULL;
+    }
+
+    if (cfg->pool != NULL) {
+        ctx->pool = cfg->pool;
+        ctx->own_pool = false;
+    } else {
+        ctx->pool = pool_new(cfg->threads);
+        ctx->own_pool = true;
+        if (ctx->pool == NULL) {
+            display_free(&ctx->disp);
+            rt_free(ctx);
+            return NULL;
+        }
+    }
+    return ctx;
+}
+
+/// Drops the acceleration structure, if any
+static void rt_context_drop_accel(rt_context* ctx) {
+    if (ctx->built == ACCEL_GRID) {
+        grid_free(&ctx->grid);
+    }
+    ctx->built = ACCEL_NONE;
+    ctx->accel_dirty = true;
+}
+
+void rt_context_free(rt_context* ctx) {
+    rt_context_drop_accel(ctx);
+    for (size_t i = 0; i < ctx->bodies.count; i++) {
+        body_free(&ctx->bodies.data[i]);
+    }
+    rtvec_body_free(&ctx->bodies);
+    rtvec_body_ptr_free(&ctx->body_ptrs);
+    display_free(&ctx->disp);
+    if (ctx->own_pool) {
+        pool_free(ctx->pool);
+    }
+    rt_free(ctx);
+}
+
+size_t rt_context_add_body(rt_context* ctx, body_rep body) {
+    if (rtvec_body_push(&ctx->bodies, body) == NULL) {
+        body_free(&body);
+        return RT_NO_BODY;
+    }
+    ctx->accel_dirty = true;
+    return ctx->bodies.count - 1;
+}
+
+body_rep* rt_context_body(rt_context* ctx, size_t index) {
+    ctx->accel_dirty = true;
+    return &ctx->bodies.data[index];
+}
+
+void rt_context_set_accel(rt_context* ctx, const rt_accel* accel,
+                          size_t body_count) {
+    ctx->custom.impl = accel != NULL ? accel->impl : NULL;
+    ctx->custom.closest = accel != NULL ? accel->closest : NULL;
+    ctx->custom_count = body_count;
+    ctx->accel_dirty = true;
+}
+
+bool rt_context_configure(rt_context* ctx, const rt_config* const cfg) {
+    if (cfg->width != ctx->disp.d_w || cfg->height != ctx->disp.d_h) {
+        color* buf = rt_realloc(MEM_OUTPUT, ctx->disp.color_buffer,
+                                sizeof(color) * cfg->width * cfg->height);
+        if (buf == NULL) {
+            return false;
+        }
+        ctx->disp.color_buffer = buf;
+        ctx->disp.d_w = cfg->width;
+        ctx->disp.d_h = cfg->height;
+    }
+    if (cfg->accel != ctx->cfg.accel) {
+        ctx->accel_dirty = true;
+    }
+
+    rt_pool* pool = ctx->cfg.pool;
+    unsigned int threads = ctx->cfg.threads;
+    ctx->cfg = *cfg;
+    ctx->cfg.pool = pool;
+    ctx->cfg.threads = threads;
+    if (ctx->cfg.tile_size == 0) {
+        ctx->cfg.tile_size = RT_TILE_SIZE;
+    }
+    ctx->disp.fov = cfg->fov;
+    ctx->disp.pos = cfg->pos;
+    ctx->disp.max_refl = cfg->max_refl;
+    ctx->disp.sampler = cfg->sampler;
+    ctx->disp.spp = cfg->spp == 0 ? 1 : cfg->spp;
+    ctx->disp.seed = cfg->seed;
+    ctx->disp.cones = cfg->cones;
+    ctx->disp.adaptive = cfg->adaptive;
+    ctx->disp.env = cfg->env;
+    ctx->disp.env_direct = cfg->env_direct;
+    display_look(&ctx->disp, cfg->dir, cfg->up);
+    return true;
+}
+
+/// Renders one tile, run by the pool
+static void rt_render_tile(void* arg, size_t index, unsigned int worker) {
+    rt_render_job* job = (rt_render_job*)arg;
+    rt_context* ctx = job->ctx;
+    const display* disp = &ctx->disp;
+    unsigned int ts = ctx->cfg.tile_size;
+    unsigned int tx = index % job->tiles_x;
+    unsigned int ty = index / job->tiles_x;
+    unsigned int x0 = tx * ts;
+    unsigned int y0 = ty * ts;
+    unsigned int x1 = x0 + ts < disp->d_w ? x0 + ts : disp->d_w;
+    unsigned int y1 = y0 + ts < disp->d_h ? y0 + ts : disp->d_h;
+
+    if (job->deadline > 0.0 && util_seconds() > job->deadline) {
+        atomic_fetch_add(&job->skipped, 1);
+        return;
+    }
+    PROF_BEGIN(span);
+
+    // The sequence only depends on the seed and the tile
+    rng_seed(rng_thread(), ctx->cfg.seed, rng_hash(index));
+
+    uint64_t primary = display_thread_primary();
+    uint64_t rays = display_thread_rays();
+    uint64_t culled = display_thread_culled();
+    display_run_region(disp, ctx->body_ptrs.data, ctx->body_ptrs.count, x0, y0,
+                       x1, y1);
+    atomic_fetch_add(&job->primary, display_thread_primary() - primary);
+    atomic_fetch_add(&job->rays, display_thread_rays() - rays);
+    atomic_fetch_add(&job->culled, display_thread_culled() - culled);
+    PROF_END(span, "tile", index);
+
+    if (job->pipe != NULL &&
+        atomic_fetch_add(&job->band_done[ty], 1) + 1 == job->tiles_x) {
+        for (unsigned int i = y0; i < y1; i++) {
+            out_pipeline_row_done(job->pipe, i);
+        }
+    }
+}
+
+bool rt_context_prepare(rt_context* ctx) {
+    // Bodies may have moved since the last render
+    double accel_start = util_seconds();
+    ctx->disp.accel = NULL;
+    if (ctx->accel_dirty) {
+        PROF_BEGIN(span);
+        rt_context_drop_accel(ctx);
+        if (!rtvec_body_ptr_resize(&ctx->body_ptrs, ctx->bodies.count)) {
+            // The old pointers may be stale, and the next call tries again
+            rtvec_body_ptr_clear(&ctx->body_ptrs);
+            return false;
+        }
+        for (size_t i = 0; i < ctx->bodies.count; i++) {
+            ctx->body_ptrs.data[i] = &ctx->bodies.data[i];
+        }
+
+        accel_kind kind = ctx->cfg.accel;
+        if (ctx->custom.closest != NULL &&
+            ctx->custom_count == ctx->body_ptrs.count) {
+            kind = ACCEL_CUSTOM;
+        } else if (kind == ACCEL_AUTO || kind == ACCEL_CUSTOM) {
+            kind = accel_choose(ctx->body_ptrs.data, ctx->body_ptrs.count);
+        }
+        if (kind == ACCEL_GRID &&
+            !grid_build(&ctx->grid, ctx->body_ptrs.data, ctx->body_ptrs.count,
+                        GRID_DENSITY)) {
+            // Out of memory, test every body instead
+            kind = ACCEL_NONE;
+        }
+        ctx->built = kind;
+        ctx->accel_dirty = false;
+        PROF_END(span, "accel build", ctx->body_ptrs.count);
+    }
+    if (ctx->built == ACCEL_GRID) {
+        ctx->accel = grid_accel(&ctx->grid);
+        ctx->disp.accel = &ctx->accel;
+    } else if (ctx->built == ACCEL_CUSTOM) {
+        ctx->disp.accel = &ctx->custom;
+    }
+    ctx->stats.accel = ctx->built;
+    ctx->stats.accel_seconds = util_seconds() - accel_start;
+    return true;
+}
+
+/// Shared part of the render functions
+static void rt_context_run(rt_context* ctx, out_pipeline* pipe,
+                           double deadline) {
+    rt_render_job job;
+    unsigned int ts = ctx->cfg.tile_size;
+    double start = util_seconds();
+    PROF_BEGIN(span);
+
+    bool ready = rt_context_prepare(ctx);
+
+    job.ctx = ctx;
+    job.tiles_x = (ctx->disp.d_w + ts - 1) / ts;
+    job.tiles_y = (ctx->disp.d_h + ts - 1) / ts;
+    atomic_init(&job.primary, 0);
+    atomic_init(&job.rays, 0);
+    atomic_init(&job.culled, 0);
+    job.pipe = pipe;
+    job.band_done = NULL;
+    job.deadline = deadline;
+    atomic_init(&job.skipped, 0);
+    if (pipe != NULL) {
+        job.band_done = rt_calloc(MEM_RENDER, job.tiles_y, sizeof(atomic_uint));
+    }
+
+    // Out of memory traces nothing, the framebuffer is kept (and written)
+    size_t tiles = ready ? (size_t)job.tiles_x * job.tiles_y : 0;
+    pool_run(ctx->pool, tiles, &rt_render_tile, &job);
+    for (unsigned int i = 0; !ready && pipe != NULL && i < ctx->disp.d_h;
+         i++) {
+        out_pipeline_row_done(pipe, i);
+    }
+
+    ctx->stats.primary_rays = atomic_load(&job.primary);
+    ctx->stats.rays = atomic_load(&job.rays);
+    ctx->stats.culled = atomic_load(&job.culled);
+    ctx->stats.tiles = tiles - atomic_load(&job.skipped);
+    ctx->stats.trace_seconds = util_seconds() - start;
+    ctx->stats.write_seconds = 0.0;
+    rt_free(job.band_done);
+    ctx->disp.accel = NULL;
+    PROF_END(span, "render", -1);
+
+    rt_mem_stat mem = rt_mem_total();
+    ctx->stats.mem_current = mem.current;
+    ctx->stats.mem_peak = mem.peak;
+    if (ctx->cfg.mem_report) {
+        rt_mem_report(stdout);
+    }
+}
+
+void rt_context_render(rt_context* ctx) {
+    rt_context_run(ctx, NULL, 0.0);
+}
+
+bool rt_context_render_until(rt_context* ctx, double deadline) {
+    rt_context_run(ctx, NULL, deadline);
+    unsigned int ts = ctx->cfg.tile_size;
+    return ctx->stats.tiles == (uint64_t)((ctx->disp.d_w + ts - 1) / ts) *
+                                   ((ctx->disp.d_h + ts - 1) / ts);
+}
+
+void rt_context_render_stream(rt_context* ctx, disp_stream stream) {
+    out_pipeline pipe;
+
+    if (!out_pipeline_start(&pipe, &ctx->disp, stream)) {
+        rt_context_render(ctx);
+        rt_context_write(ctx, stream);
+        return;
+    }
+    rt_context_run(ctx, &pipe, 0.0);
+
+    double start = util_seconds();
+    out_pipeline_finish(&pipe);
+    // Only the part of writing that didn't overlap with tracing
+    ctx->stats.write_seconds = util_seconds() - start;
+}
+
+void rt_context_write(rt_context* ctx, disp_stream stream) {
+    double start = util_seconds();
+    display_write_stream(&ctx->disp, stream);
+    ctx->stats.write_seconds = util_seconds() - start;
+}
+
+const display* rt_context_display(const rt_context* ctx) {
+    return &ctx->disp;
+}
+
+rt_stats rt_context_stats(const rt_context* ctx) {
+    return ctx->stats;
+}
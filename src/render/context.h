@@ -0,0 +1,184 @@
+#ifndef RAY_TRACE_CONTEXT_H
+#define RAY_TRACE_CONTEXT_H
+
+#include <include/accel.h>
+#include <include/body.h>
+#include <include/output.h>
+#include <include/prof.h>
+#include <include/sample.h>
+#include <include/sched.h>
+#include <include/util.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Default tile edge length in pixels of a render context
+#define RT_TILE_SIZE 32
+/// rt_context_add_body() result when the body couldn't be added
+#define RT_NO_BODY ((size_t)-1)
+
+/// Render settings, get the defaults from rt_config_default()
+typedef struct {
+    unsigned int width;     ///< Output width in pixels
+    unsigned int height;    ///< Output height in pixels
+    RT_FLOAT fov;           ///< Vertical FOV in degrees
+    vector3 pos;            ///< Camera position
+    int max_refl;           ///< Reflection limit per path
+    unsigned int threads;   ///< Threads including the caller, 0 = one per CPU
+    unsigned int tile_size; ///< Tile edge length in pixels
+    uint64_t seed;          ///< Seed for the random jitter of reflections
+    accel_kind accel;       ///< Acceleration structure, ACCEL_AUTO by default
+    /// Pool to share with other contexts. NULL makes the context create its
+    /// own pool with \b threads threads.
+    rt_pool* pool;
+    bool mem_report; ///< Print rt_mem_report() to stdout after each render
+    /// Pixel and reflection samples, SAMPLER_NONE traces pixel centers
+    sampler_kind sampler;
+    unsigned int spp; ///< Samples per pixel of the sampler
+    bool cones;       ///< Trace ray cones, see display.cones
+    vector3 dir;      ///< Viewing direction, see display_look()
+    vector3 up;       ///< Up direction of the screen
+    /// Color tolerance of adaptive rendering, 0 traces every pixel, see
+    /// display_run_region()
+    RT_FLOAT adaptive;
+    /// Background of rays that hit nothing, NULL for display_background().
+    /// Owned by the caller and kept alive while the context renders.
+    const env_map* env;
+    bool env_direct; ///< Sample \b env at rough hits, see display.env_direct
+} rt_config;
+
+/// Counters of a render context, reset at the start of every render
+typedef struct {
+    uint64_t primary_rays; ///< Camera rays (fewer with cfg.adaptive)
+    uint64_t rays;         ///< All rays including reflections
+    uint64_t culled;       ///< Reflections cut by the ray cone footprint
+    uint64_t tiles;        ///< Tiles traced (not skipped for a deadline)
+    accel_kind accel;      ///< Acceleration structure used
+    double accel_seconds;  ///< Wall time of building it, ~0 if reused
+    double trace_seconds;  ///< Wall time of the last render
+    double write_seconds;  ///< Wall time spent in rt_context_write()
+    /// Accounted bytes of the whole process after the render, and the peak so
+    /// far (see rt_mem_total())
+    size_t mem_current;
+    size_t mem_peak;
+} rt_stats;
+
+/** Everything a render needs, so that any number of contexts can render at
+ * the same time in one process.
+ *
+ * The context owns its scene, framebuffer, thread pool (unless a shared one
+ * is given) and stats. The random sequence of each tile only depends on the
+ * seed and the tile, so the same config always gives the same image no
+ * matter how many threads are used.
+ *
+ * A single context must not be used by two threads at once.
+ */
+typedef struct rt_context {
+    rt_config cfg;             ///< Settings the context was created with
+    display disp;              ///< Framebuffer and camera
+    rtvec_body bodies;         ///< Owned bodies
+    rtvec_body_ptr body_ptrs;  ///< Pointer list handed to the tracer
+    accel_grid grid;           ///< Grid, if the current structure is one
+    accel_kind built;          ///< Structure built for the current bodies
+    bool accel_dirty;          ///< Bodies changed since it was built
+    rt_accel accel;            ///< Handle of the grid for disp.accel
+    rt_accel custom;           ///< Caller's structure, NULL closest if none
+    size_t custom_count;       ///< Body count \b custom was made for
+    rt_pool* pool;             ///< Pool used for rendering
+    bool own_pool;             ///< Whether the pool is freed with the context
+    rt_stats stats;            ///< Stats of the last render
+} rt_context;
+
+/// Default settings: 1920x1080, 60 degrees, camera at the origin, all CPUs
+rt_config rt_config_default(void);
+
+/** Creates a new context.
+ *
+ * @return NULL if the framebuffer or the pool couldn't be created
+ */
+rt_context* rt_context_new(const rt_config* const cfg);
+
+/// Frees the context together with its bodies and its own pool
+void rt_context_free(rt_context* ctx);
+
+/** Adds a body to the scene. The context takes ownership and frees it with
+ * body_free().
+ *
+ * @return Index of the body, or RT_NO_BODY if out of memory (the body is
+ * freed then)
+ */
+size_t rt_context_add_body(rt_context* ctx, body_rep body);
+
+/** Body at the given index. The pointer is invalidated by adding bodies.
+ *
+ * The body may be edited through it until the next render, which rebuilds
+ * the acceleration structure.
+ */
+body_rep* rt_context_body(rt_context* ctx, size_t index);
+
+/** Traces with the caller's acceleration structure instead of building one,
+ * e.g. a scene compiled by tools/rt_scenegen (see scene_compiled_open()).
+ *
+ * It must answer for the bodies of the context in the order they were added.
+ * It is only used while the context has exactly \b body_count bodies, other
+ * renders fall back to cfg.accel. \b accel is copied, its impl must outlive
+ * the context. NULL goes back to cfg.accel.
+ */
+void rt_context_set_accel(rt_context* ctx, const rt_accel* accel,
+                          size_t body_count);
+
+/** Applies the per frame settings of \b cfg: size, FOV, camera position and
+ * direction, reflection limit, tile size, seed, acceleration structure,
+ * sampler, adaptive tolerance and memory report. The scene and its
+ * acceleration structure are kept (unless \b cfg asks for another kind),
+ * \b threads and \b pool are ignored.
+ *
+ * @return false if the framebuffer couldn't be resized, the context is
+ * unchanged then
+ */
+bool rt_context_configure(rt_context* ctx, const rt_config* const cfg);
+
+/** Updates the body list and the acceleration structure and points
+ * disp.accel at it, the first step of every render. For code that traces
+ * the scene of the context itself, e.g. progressive_run(). disp.accel is
+ * valid until bodies change or the next render finishes. If the grid can't
+ * be built every body is tested instead.
+ *
+ * @return false if the body list couldn't be allocated, it is empty then
+ * and the renders trace nothing
+ */
+bool rt_context_prepare(rt_context* ctx);
+
+/** Traces the whole frame into the framebuffer using the thread pool.
+ *
+ * The acceleration structure is built on the first render and rebuilt only
+ * after bodies were added or handed out by rt_context_body(), so repeated
+ * renders of the same scene (e.g. from another camera position) skip it.
+ * If rt_context_prepare() fails nothing is traced and stats.tiles is 0.
+ */
+void rt_context_render(rt_context* ctx);
+
+/** Like rt_context_render(), but tiles that haven't started by \b deadline
+ * (a util_seconds() value) are skipped and keep what the framebuffer held.
+ * Tiles already started finish, so the render may end a tile later.
+ *
+ * @return true if every tile was traced
+ */
+bool rt_context_render_until(rt_context* ctx, double deadline);
+
+/** Like rt_context_render(), but rows are written with \b stream on a
+ * background thread as soon as every tile covering them is finished.
+ */
+void rt_context_render_stream(rt_context* ctx, disp_stream stream);
+
+/// Writes the framebuffer synchronously with \b stream
+void rt_context_write(rt_context* ctx, disp_stream stream);
+
+/// Framebuffer and camera of the context
+const display* rt_context_display(const rt_context* ctx);
+
+/// Stats of the last render
+rt_stats rt_context_stats(const rt_context* ctx);
+
+#endif
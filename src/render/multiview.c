@@ -0,0 +1,168 @@
+#include "multiview.h"
+#include <include/alloc.h>
+
+#include <stdatomic.h>
+
+/// State shared by the tiles of one multiview_render()
+typedef struct {
+    rt_multiview* mv;
+    atomic_uint_fast64_t primary; ///< Camera rays of all tiles
+    atomic_uint_fast64_t rays;    ///< Rays traced by all tiles
+    atomic_uint_fast64_t culled;  ///< Reflections cut by all tiles
+    out_pipeline* pipes;          ///< Writer of every view
+    bool* piped;                  ///< Whether the view has a writer
+    atomic_uint** band_done;      ///< Finished tiles per tile row of each view
+} multiview_job;
+
+bool multiview_init(rt_multiview* mv, rt_context* ctx, const rt_view* views,
+                    size_t count) {
+    mv->ctx = ctx;
+    mv->count = 0;
+    mv->disps = rt_calloc(MEM_RENDER, count, sizeof(display));
+    mv->streams = rt_calloc(MEM_RENDER, count, sizeof(disp_stream));
+    mv->first_tile = rt_calloc(MEM_RENDER, count + 1, sizeof(size_t));
+    if (mv->disps == NULL || mv->streams == NULL || mv->first_tile == NULL) {
+        multiview_free(mv);
+        return false;
+    }
+    for (size_t v = 0; v < count; v++) {
+        const rt_view* view = &views[v];
+        display* disp = &mv->disps[v];
+        *disp = display_init(view->width, view->height, view->fov, view->pos,
+                             NULL, NULL, &no_free_func);
+        if (disp->color_buffer == NULL) {
+            multiview_free(mv);
+            return false;
+        }
+        display_look(disp, view->dir, view->up);
+        mv->streams[v] = view->stream;
+        mv->count++;
+    }
+    return true;
+}
+
+void multiview_free(rt_multiview* mv) {
+    for (size_t v = 0; v < mv->count; v++) {
+        display_free(&mv->disps[v]);
+    }
+    rt_free(mv->disps);
+    rt_free(mv->streams);
+    rt_free(mv->first_tile);
+    mv->count = 0;
+}
+
+/// Traces one tile of some view, run by the pool
+static void multiview_tile(void* arg, size_t index, unsigned int worker) {
+    multiview_job* job = (multiview_job*)arg;
+    rt_multiview* mv = job->mv;
+    rt_context* ctx = mv->ctx;
+    size_t v = 0;
+    while (index >= mv->first_tile[v + 1]) {
+        v++;
+    }
+    const display* disp = &mv->disps[v];
+    size_t tile = index - mv->first_tile[v];
+    unsigned int ts = ctx->cfg.tile_size;
+    unsigned int tiles_x = (disp->d_w + ts - 1) / ts;
+    unsigned int ty = tile / tiles_x;
+    unsigned int x0 = tile % tiles_x * ts;
+    unsigned int y0 = ty * ts;
+    unsigned int x1 = x0 + ts < disp->d_w ? x0 + ts : disp->d_w;
+    unsigned int y1 = y0 + ts < disp->d_h ? y0 + ts : disp->d_h;
+    PROF_BEGIN(span);
+
+    // The same sequence as rt_context_render() of this view alone
+    rng_seed(rng_thread(), ctx->cfg.seed, rng_hash(tile));
+    uint64_t primary = display_thread_primary();
+    uint64_t rays = display_thread_rays();
+    uint64_t culled = display_thread_culled();
+    display_run_region(disp, ctx->body_ptrs.data, ctx->body_ptrs.count, x0, y0,
+                       x1, y1);
+    atomic_fetch_add(&job->primary, display_thread_primary() - primary);
+    atomic_fetch_add(&job->rays, display_thread_rays() - rays);
+    atomic_fetch_add(&job->culled, display_thread_culled() - culled);
+
+    if (job->piped[v] &&
+        atomic_fetch_add(&job->band_done[v][ty], 1) + 1 == tiles_x) {
+        for (unsigned int i = y0; i < y1; i++) {
+            out_pipeline_row_done(&job->pipes[v], i);
+        }
+    }
+    PROF_END(span, "tile", tile);
+}
+
+void multiview_render(rt_multiview* mv) {
+    rt_context* ctx = mv->ctx;
+    unsigned int ts = ctx->cfg.tile_size;
+    double start = util_seconds();
+    PROF_BEGIN(span);
+
+    if (!rt_context_prepare(ctx)) {
+        ctx->stats.primary_rays = ctx->stats.rays = ctx->stats.culled = 0;
+        ctx->stats.tiles = 0;
+        return;
+    }
+
+    multiview_job job;
+    job.mv = mv;
+    atomic_init(&job.primary, 0);
+    atomic_init(&job.rays, 0);
+    atomic_init(&job.culled, 0);
+    job.pipes = rt_calloc(MEM_RENDER, mv->count, sizeof(out_pipeline));
+    job.piped = rt_calloc(MEM_RENDER, mv->count, sizeof(bool));
+    job.band_done = rt_calloc(MEM_RENDER, mv->count, sizeof(atomic_uint*));
+
+    for (size_t v = 0; v < mv->count; v++) {
+        display* disp = &mv->disps[v];
+        // Everything but the camera comes from the context
+        disp->max_refl = ctx->disp.max_refl;
+        disp->accel = ctx->disp.accel;
+        disp->sampler = ctx->disp.sampler;
+        disp->spp = ctx->disp.spp;
+        disp->seed = ctx->disp.seed;
+        disp->cones = ctx->disp.cones;
+        disp->adaptive = ctx->disp.adaptive;
+        disp->env = ctx->disp.env;
+        disp->env_direct = ctx->disp.env_direct;
+
+        unsigned int tiles_x = (disp->d_w + ts - 1) / ts;
+        unsigned int tiles_y = (disp->d_h + ts - 1) / ts;
+        mv->first_tile[v + 1] = mv->first_tile[v] + (size_t)tiles_x * tiles_y;
+
+        if (mv->streams[v].begin != NULL &&
+            out_pipeline_start(&job.pipes[v], disp, mv->streams[v])) {
+            job.piped[v] = true;
+            job.band_done[v] =
+                rt_calloc(MEM_RENDER, tiles_y, sizeof(atomic_uint));
+        }
+    }
+
+    pool_run(ctx->pool, mv->first_tile[mv->count], &multiview_tile, &job);
+
+    for (size_t v = 0; v < mv->count; v++) {
+        if (job.piped[v]) {
+            out_pipeline_finish(&job.pipes[v]);
+        } else if (mv->streams[v].begin != NULL) {
+            // No thread for the writer, do it the old way
+            display_write_stream(&mv->disps[v], mv->streams[v]);
+        }
+        rt_free(job.band_done[v]);
+        mv->disps[v].accel = NULL;
+    }
+    rt_free(job.pipes);
+    rt_free(job.piped);
+    rt_free(job.band_done);
+    ctx->disp.accel = NULL;
+
+    ctx->stats.primary_rays = atomic_load(&job.primary);
+    ctx->stats.rays = atomic_load(&job.rays);
+    ctx->stats.culled = atomic_load(&job.culled);
+    ctx->stats.tiles = mv->first_tile[mv->count];
+    ctx->stats.trace_seconds = util_seconds() - start;
+    ctx->stats.write_seconds = 0.0;
+    PROF_END(span, "multiview", mv->count);
+}
+
+const display* multiview_display(const rt_multiview* mv, size_t index) {
+    return &mv->disps[index];
+}
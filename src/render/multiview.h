@@ -0,0 +1,62 @@
+#ifndef RAY_TRACE_MULTIVIEW_H
+#define RAY_TRACE_MULTIVIEW_H
+
+#include "context.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// One camera of a multi-view render
+typedef struct {
+    unsigned int width;  ///< Output width in pixels
+    unsigned int height; ///< Output height in pixels
+    RT_FLOAT fov;        ///< Vertical FOV in degrees
+    vector3 pos;         ///< Camera position
+    vector3 dir;         ///< Viewing direction, see display_look()
+    vector3 up;          ///< Up direction of the screen
+    /// Writer of the view, called as its rows finish. A NULL \b begin
+    /// writes nothing, the image stays in the framebuffer.
+    disp_stream stream;
+} rt_view;
+
+/** Several cameras on the scene of one context, e.g. stereo pairs, cube map
+ * faces or product shots from a set of angles.
+ *
+ * multiview_render() builds the acceleration structure once and hands the
+ * tiles of every view to the pool of the context as one batch, so threads
+ * that finish a view go on with the next one instead of waiting for the
+ * slowest tile of each. Views are traced in order, and each one is written
+ * by its own output thread while the later ones are traced.
+ *
+ * Every view gets exactly the image rt_context_render() gives with its
+ * camera and the other settings of the context.
+ */
+typedef struct {
+    rt_context* ctx;      ///< Scene, settings and pool
+    size_t count;         ///< View count
+    display* disps;       ///< Framebuffer and camera of every view
+    disp_stream* streams; ///< Writer of every view
+    /// First tile of every view in the batch, the tile total at [count]
+    size_t* first_tile;
+} rt_multiview;
+
+/** Sets up the views, their framebuffers are allocated here.
+ *
+ * @return false if out of memory
+ */
+bool multiview_init(rt_multiview* mv, rt_context* ctx, const rt_view* views,
+                    size_t count);
+
+/// Frees the framebuffers (not the context or the writers)
+void multiview_free(rt_multiview* mv);
+
+/** Traces every view with the current settings of the context and writes
+ * each one with its stream. The stats of the context cover all views.
+ * Nothing is traced or written if rt_context_prepare() fails.
+ */
+void multiview_render(rt_multiview* mv);
+
+/// Framebuffer and camera of view \b index
+const display* multiview_display(const rt_multiview* mv, size_t index);
+
+#endif
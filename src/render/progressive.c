@@ -0,0 +1,342 @@
+#include "progressive.h"
+#include <include/alloc.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PROGRESSIVE_MAGIC "RTCKPT1"
+
+/// Start of a checkpoint file, followed by the passes of every tile
+/// (uint32_t) and the sums (3 doubles per pixel), all in host byte order
+typedef struct {
+    char magic[8];
+    uint32_t width;
+    uint32_t height;
+    uint32_t spp;
+    uint32_t pass_spp;
+    uint32_t tile_size;
+    uint32_t sampler;
+    int32_t max_refl;
+    uint32_t tiles;
+    uint64_t seed;
+    uint64_t bodies;
+} progressive_header;
+
+/// State of one progressive_run()
+typedef struct {
+    progressive_render* pr;
+    unsigned int pass;          ///< Pass the tiles are traced for
+    atomic_uint_fast64_t rays; ///< Rays traced by all tiles
+} progressive_job;
+
+/// Background checkpoint writer
+typedef struct {
+    progressive_render* pr;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool quit;
+    double* sum;         ///< Snapshot of the sums
+    uint32_t* tile_pass; ///< Snapshot of the tile passes
+} progressive_writer;
+
+static size_t progressive_pixels(const progressive_render* pr) {
+    return (size_t)pr->ctx->disp.d_w * pr->ctx->disp.d_h;
+}
+
+static size_t progressive_tiles(const progressive_render* pr) {
+    return (size_t)pr->tiles_x * pr->tiles_y;
+}
+
+static progressive_header progressive_make_header(
+    const progressive_render* pr) {
+    const rt_context* ctx = pr->ctx;
+    progressive_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, PROGRESSIVE_MAGIC, sizeof(PROGRESSIVE_MAGIC));
+    h.width = ctx->disp.d_w;
+    h.height = ctx->disp.d_h;
+    h.spp = ctx->disp.spp;
+    h.pass_spp = pr->pass_spp;
+    h.tile_size = ctx->cfg.tile_size;
+    h.sampler = ctx->disp.sampler;
+    h.max_refl = ctx->disp.max_refl;
+    h.tiles = progressive_tiles(pr);
+    h.seed = ctx->cfg.seed;
+    h.bodies = ctx->bodies.count;
+    return h;
+}
+
+bool progressive_init(progressive_render* pr, rt_context* ctx,
+                      unsigned int pass_spp) {
+    unsigned int ts = ctx->cfg.tile_size;
+    unsigned int spp = ctx->disp.sampler != SAMPLER_NONE ? ctx->disp.spp : 1;
+
+    pr->ctx = ctx;
+    pr->pass_spp = pass_spp == 0 ? PROGRESSIVE_PASS_SPP : pass_spp;
+    if (pr->pass_spp > spp) {
+        pr->pass_spp = spp;
+    }
+    pr->passes = (spp + pr->pass_spp - 1) / pr->pass_spp;
+    pr->tiles_x = (ctx->disp.d_w + ts - 1) / ts;
+    pr->tiles_y = (ctx->disp.d_h + ts - 1) / ts;
+    pr->checkpoint = NULL;
+    pr->interval = PROGRESSIVE_INTERVAL;
+    pr->saved = 0;
+    atomic_init(&pr->stop, false);
+    pr->sum = rt_calloc(MEM_OUTPUT, progressive_pixels(pr) * 3, sizeof(double));
+    pr->tile_pass =
+        rt_calloc(MEM_RENDER, progressive_tiles(pr), sizeof(uint32_t));
+    if (pr->sum == NULL || pr->tile_pass == NULL) {
+        rt_free(pr->sum);
+        rt_free(pr->tile_pass);
+        return false;
+    }
+    pthread_mutex_init(&pr->lock, NULL);
+    return true;
+}
+
+void progressive_free(progressive_render* pr) {
+    pthread_mutex_destroy(&pr->lock);
+    rt_free(pr->sum);
+    rt_free(pr->tile_pass);
+}
+
+void progressive_checkpoint(progressive_render* pr, const char* path,
+                            double interval) {
+    pr->checkpoint = path;
+    pr->interval = interval;
+}
+
+/// Writes a checkpoint of the given buffers to a temporary file and renames
+/// it over \b path, so a crash while writing keeps the last one
+static RT_RES progressive_write(const progressive_render* pr,
+                                const char* path, const double* sum,
+                                const uint32_t* tile_pass) {
+    char tmp[4096];
+    if ((size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp)) {
+        RETURN_ERR(FILE_ERROR);
+    }
+    FILE* f = fopen(tmp, "wb");
+    if (f == NULL) {
+        RETURN_ERR(FILE_ERROR);
+    }
+    PROF_BEGIN(span);
+    progressive_header h = progressive_make_header(pr);
+    size_t tiles = progressive_tiles(pr), values = progressive_pixels(pr) * 3;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(tile_pass, sizeof(uint32_t), tiles, f) == tiles &&
+              fwrite(sum, sizeof(double), values, f) == values &&
+              fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = fclose(f) == 0 && ok;
+    PROF_END(span, "checkpoint", -1);
+    if (!ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        RETURN_ERR(FILE_ERROR);
+    }
+    RETURN_NOERROR;
+}
+
+RT_RES progressive_save(progressive_render* pr, const char* path) {
+    return progressive_write(pr, path, pr->sum, pr->tile_pass);
+}
+
+RT_RES progressive_resume(progressive_render* pr, const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        RETURN_ERR(FILE_ERROR);
+    }
+    progressive_header want = progressive_make_header(pr), got;
+    size_t tiles = progressive_tiles(pr), values = progressive_pixels(pr) * 3;
+    uint32_t* tile_pass = rt_malloc(MEM_RENDER, sizeof(uint32_t) * tiles);
+    double* sum = rt_malloc(MEM_OUTPUT, sizeof(double) * values);
+
+    bool ok = fread(&got, sizeof(got), 1, f) == 1 &&
+              memcmp(&got, &want, sizeof(got)) == 0 &&
+              fread(tile_pass, sizeof(uint32_t), tiles, f) == tiles &&
+              fread(sum, sizeof(double), values, f) == values &&
+              fgetc(f) == EOF;
+    fclose(f);
+    for (size_t t = 0; ok && t < tiles; t++) {
+        ok = tile_pass[t] <= pr->passes;
+    }
+    if (!ok) {
+        rt_free(tile_pass);
+        rt_free(sum);
+        RETURN_ERR(PARSE_ERROR);
+    }
+    rt_free(pr->tile_pass);
+    rt_free(pr->sum);
+    pr->tile_pass = tile_pass;
+    pr->sum = sum;
+    RETURN_NOERROR;
+}
+
+bool progressive_done(const progressive_render* pr) {
+    for (size_t t = 0; t < progressive_tiles(pr); t++) {
+        if (pr->tile_pass[t] < pr->passes) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void progressive_stop(progressive_render* pr) {
+    atomic_store(&pr->stop, true);
+}
+
+/// Traces one pass of one tile, run by the pool
+static void progressive_tile(void* arg, size_t index, unsigned int worker) {
+    progressive_job* job = (progressive_job*)arg;
+    progressive_render* pr = job->pr;
+    rt_context* ctx = pr->ctx;
+    const display* disp = &ctx->disp;
+    if (pr->tile_pass[index] > job->pass || atomic_load(&pr->stop)) {
+        return;
+    }
+
+    PROF_BEGIN(span);
+    unsigned int ts = ctx->cfg.tile_size;
+    unsigned int x0 = index % pr->tiles_x * ts;
+    unsigned int y0 = index / pr->tiles_x * ts;
+    unsigned int x1 = x0 + ts < disp->d_w ? x0 + ts : disp->d_w;
+    unsigned int y1 = y0 + ts < disp->d_h ? y0 + ts : disp->d_h;
+    unsigned int first = job->pass * pr->pass_spp;
+    unsigned int spp = disp->sampler != SAMPLER_NONE ? disp->spp : 1;
+    unsigned int count = spp - first < pr->pass_spp ? spp - first
+                                                    : pr->pass_spp;
+    size_t row = (size_t)(x1 - x0) * 3;
+
+    // Traced into a copy so that a snapshot never sees half a tile. Only
+    // this thread writes the tile, reading it unlocked is fine.
+    double* local = rt_malloc(MEM_RENDER, sizeof(double) * row * (y1 - y0));
+    double* shared = pr->sum + ((size_t)y0 * disp->d_w + x0) * 3;
+    for (unsigned int y = 0; y < y1 - y0; y++) {
+        memcpy(local + y * row, shared + (size_t)y * disp->d_w * 3,
+               sizeof(double) * row);
+    }
+    // The same sequence as rt_context_render() for renders without sampler
+    rng_seed(rng_thread(), ctx->cfg.seed, rng_hash(index));
+    uint64_t rays = display_thread_rays();
+    display_accum_region(disp, ctx->body_ptrs.data, ctx->body_ptrs.count, x0,
+                         y0, x1, y1, first, count, local);
+    atomic_fetch_add(&job->rays, display_thread_rays() - rays);
+
+    pthread_mutex_lock(&pr->lock);
+    for (unsigned int y = 0; y < y1 - y0; y++) {
+        memcpy(shared + (size_t)y * disp->d_w * 3, local + y * row,
+               sizeof(double) * row);
+    }
+    pr->tile_pass[index] = job->pass + 1;
+    pthread_mutex_unlock(&pr->lock);
+    rt_free(local);
+    PROF_END(span, "pass tile", index);
+}
+
+/// Takes a snapshot every interval and writes it, until told to quit
+static void* progressive_writer_main(void* arg) {
+    progressive_writer* w = (progressive_writer*)arg;
+    progressive_render* pr = w->pr;
+    size_t tiles = progressive_tiles(pr), values = progressive_pixels(pr) * 3;
+
+    prof_thread_name("checkpoint");
+    pthread_mutex_lock(&w->lock);
+    while (!w->quit) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        double secs = until.tv_nsec / 1e9 + pr->interval;
+        until.tv_sec += (time_t)secs;
+        until.tv_nsec = (long)((secs - (time_t)secs) * 1e9);
+        int res = 0;
+        while (!w->quit && res != ETIMEDOUT) {
+            res = pthread_cond_timedwait(&w->cond, &w->lock, &until);
+        }
+        if (w->quit) {
+            break;
+        }
+        pthread_mutex_unlock(&w->lock);
+
+        pthread_mutex_lock(&pr->lock);
+        memcpy(w->sum, pr->sum, sizeof(double) * values);
+        memcpy(w->tile_pass, pr->tile_pass, sizeof(uint32_t) * tiles);
+        pthread_mutex_unlock(&pr->lock);
+        RT_RES err = progressive_write(pr, pr->checkpoint, w->sum,
+                                       w->tile_pass);
+        PRINT_ERR(err);
+        if (err.type == ALL_GOOD) {
+            pr->saved++;
+        }
+
+        pthread_mutex_lock(&w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+bool progressive_run(progressive_render* pr) {
+    rt_context* ctx = pr->ctx;
+    double start = util_seconds();
+    progressive_writer w;
+    pthread_t writer;
+    bool writing = false;
+
+    if (!rt_context_prepare(ctx)) {
+        return false;
+    }
+    atomic_store(&pr->stop, false);
+    pr->saved = 0;
+    if (pr->checkpoint != NULL) {
+        w.pr = pr;
+        w.quit = false;
+        w.sum = rt_malloc(MEM_OUTPUT,
+                          sizeof(double) * progressive_pixels(pr) * 3);
+        w.tile_pass =
+            rt_malloc(MEM_RENDER, sizeof(uint32_t) * progressive_tiles(pr));
+        pthread_mutex_init(&w.lock, NULL);
+        pthread_cond_init(&w.cond, NULL);
+        writing = pthread_create(&writer, NULL, &progressive_writer_main,
+                                 &w) == 0;
+    }
+
+    progressive_job job;
+    job.pr = pr;
+    job.pass = 0;
+    atomic_init(&job.rays, 0);
+    for (; job.pass < pr->passes && !atomic_load(&pr->stop); job.pass++) {
+        pool_run(ctx->pool, progressive_tiles(pr), &progressive_tile, &job);
+    }
+
+    if (pr->checkpoint != NULL) {
+        if (writing) {
+            pthread_mutex_lock(&w.lock);
+            w.quit = true;
+            pthread_cond_signal(&w.cond);
+            pthread_mutex_unlock(&w.lock);
+            pthread_join(writer, NULL);
+        }
+        pthread_mutex_destroy(&w.lock);
+        pthread_cond_destroy(&w.cond);
+        rt_free(w.sum);
+        rt_free(w.tile_pass);
+    }
+    ctx->disp.accel = NULL;
+    ctx->stats.rays = atomic_load(&job.rays);
+    ctx->stats.tiles = progressive_tiles(pr);
+    ctx->stats.trace_seconds = util_seconds() - start;
+
+    if (!progressive_done(pr)) {
+        if (pr->checkpoint != NULL) {
+            RT_RES err = progressive_save(pr, pr->checkpoint);
+            PRINT_ERR(err);
+            pr->saved += err.type == ALL_GOOD;
+        }
+        return false;
+    }
+    unsigned int spp = ctx->disp.sampler != SAMPLER_NONE ? ctx->disp.spp : 1;
+    for (size_t i = 0; i < progressive_pixels(pr); i++) {
+        ctx->disp.color_buffer[i] = display_sample_mean(pr->sum + 3 * i, spp);
+    }
+    return true;
+}
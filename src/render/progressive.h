@@ -0,0 +1,95 @@
+#ifndef RAY_TRACE_PROGRESSIVE_H
+#define RAY_TRACE_PROGRESSIVE_H
+
+#include "context.h"
+#include <include/errors.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Default samples per pixel of one pass
+#define PROGRESSIVE_PASS_SPP 16
+/// Default seconds between checkpoints
+#define PROGRESSIVE_INTERVAL 60.0
+
+/** A long render traced in passes, which can be checkpointed and resumed.
+ *
+ * Every pass adds PROGRESSIVE_PASS_SPP (\b pass_spp) samples to every tile
+ * of the context until disp.spp are reached. Per pixel sums are kept in
+ * double, and a tile adds its samples in the same order no matter how the
+ * passes were interrupted, so a resumed render gives exactly the image of
+ * an uninterrupted one, which is also the image of rt_context_render().
+ *
+ * While progressive_run() traces, a background thread writes a checkpoint
+ * every \b interval seconds: a snapshot of the sums and of the passes each
+ * tile finished is taken under a lock that tiles only hold to publish their
+ * result, and the file is written outside of it.
+ *
+ * Without a sampler there is one pass of one sample.
+ */
+typedef struct {
+    rt_context* ctx;         ///< Context with the scene and the settings
+    unsigned int pass_spp;   ///< Samples per pixel of one pass
+    unsigned int passes;     ///< Passes of the whole render
+    unsigned int tiles_x;    ///< Tile count in width
+    unsigned int tiles_y;    ///< Tile count in height
+    double* sum;             ///< Sum of the samples, RGB per pixel
+    uint32_t* tile_pass;     ///< Passes finished by every tile
+    const char* checkpoint;  ///< Checkpoint file, NULL for none
+    double interval;         ///< Seconds between checkpoints
+    unsigned int saved;      ///< Checkpoints written by the last run
+    atomic_bool stop;        ///< Set by progressive_stop()
+    pthread_mutex_t lock;    ///< Guards publishing tiles against snapshots
+} progressive_render;
+
+/** Sets up a render of the current settings of \b ctx with no samples yet.
+ *
+ * The settings and bodies of \b ctx must not change until
+ * progressive_free().
+ *
+ * @param pass_spp Samples per pass, 0 for PROGRESSIVE_PASS_SPP
+ * @return false if out of memory
+ */
+bool progressive_init(progressive_render* pr, rt_context* ctx,
+                      unsigned int pass_spp);
+
+/// Frees the state (not the context)
+void progressive_free(progressive_render* pr);
+
+/** Writes checkpoints to \b path every \b interval seconds during
+ * progressive_run(), NULL turns them off. The file is replaced atomically.
+ */
+void progressive_checkpoint(progressive_render* pr, const char* path,
+                            double interval);
+
+/// Writes a checkpoint now. Not while progressive_run() is running.
+RT_RES progressive_save(progressive_render* pr, const char* path);
+
+/** Continues from a checkpoint.
+ *
+ * @return FILE_ERROR if it can't be read, PARSE_ERROR if it is damaged or
+ * was written for another size, sampler, pass size or seed; the state is
+ * unchanged then
+ */
+RT_RES progressive_resume(progressive_render* pr, const char* path);
+
+/** Traces the passes left with the pool of the context, then writes the
+ * image to the framebuffer.
+ *
+ * @return false if progressive_stop() ended it early, the framebuffer is
+ * untouched then and a checkpoint was written (if enabled). Also false,
+ * with nothing traced, if rt_context_prepare() fails.
+ */
+bool progressive_run(progressive_render* pr);
+
+/// Asks a running progressive_run() to stop after the tiles in flight, e.g.
+/// from a signal handler
+void progressive_stop(progressive_render* pr);
+
+/// Whether every tile finished every pass
+bool progressive_done(const progressive_render* pr);
+
+#endif
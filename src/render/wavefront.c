@@ -0,0 +1,559 @@
+#include "wavefront.h"
+#include <include/alloc.h>
+
+#include <float.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Hit index of a ray that hit nothing, and ignore index of a camera ray
+#define WAVEFRONT_NONE UINT32_MAX
+
+/** Rays and path states of one wave, structure of arrays so a stage only
+ * loads the fields it uses. Path i of a wave is sample i % spp of its
+ * (i / spp)th pixel.
+ */
+typedef struct {
+    RT_FLOAT *ox, *oy, *oz;   ///< Ray origins
+    RT_FLOAT *dx, *dy, *dz;   ///< Normalized ray directions
+    RT_FLOAT *width, *spread; ///< Ray cones
+    uint32_t* hit;            ///< Closest body of the last stage, or NONE
+    RT_FLOAT* dist;           ///< Distance to it
+    RT_FLOAT *nx, *ny, *nz;   ///< Normal there
+    color* sum;               ///< Color gathered so far
+    RT_FLOAT* weight;         ///< Product of the reflectivities so far
+    uint32_t* ignore;         ///< Body the ray starts on, or NONE
+    uint16_t* depth;          ///< Reflection count
+    uint16_t* dim;            ///< Next sampler dimension
+} wavefront_paths;
+
+/// State shared by the stages of one wavefront_render()
+typedef struct {
+    rt_context* ctx;
+    const display* disp;
+    const body_rep** bodies;
+    size_t body_count;
+    RT_FLOAT disp_x, disp_y; ///< See display_view_extent()
+    ray_cone cone;           ///< Cone of the camera rays
+    unsigned int spp;        ///< Paths per pixel
+    wavefront_paths p;
+    size_t first_pixel; ///< First pixel of the wave
+    size_t count;       ///< Paths of the wave
+    uint32_t* queue;    ///< Live paths of the stage
+    size_t queue_count;
+    uint32_t* next;   ///< Paths continuing after the shade stage
+    size_t* kept;     ///< Paths kept by every chunk, at its front of \b next
+    uint32_t* key;    ///< Shading key of every body
+    uint32_t keys;    ///< Distinct keys
+    size_t* key_pos;  ///< Counting sort positions, keys + 1 entries
+    bool* sphere;     ///< Whether the body is a plain sphere
+    atomic_uint_fast64_t rays;
+    atomic_uint_fast64_t culled;
+} wavefront_job;
+
+/// Body fields a shading key is made of, for sorting
+typedef struct {
+    uintptr_t col, refl, impl;
+    uint32_t body;
+} wavefront_key;
+
+static int wavefront_key_cmp(const void* a, const void* b) {
+    const wavefront_key* l = (const wavefront_key*)a;
+    const wavefront_key* r = (const wavefront_key*)b;
+    if (l->col != r->col) {
+        return l->col < r->col ? -1 : 1;
+    }
+    if (l->refl != r->refl) {
+        return l->refl < r->refl ? -1 : 1;
+    }
+    if (l->impl != r->impl) {
+        return l->impl < r->impl ? -1 : 1;
+    }
+    return 0;
+}
+
+/// Numbers the distinct (body type, texture function, texture) triples
+static uint32_t wavefront_keys(wavefront_job* job) {
+    size_t n = job->body_count;
+    wavefront_key* k = rt_malloc(MEM_RENDER, sizeof(wavefront_key) * (n + 1));
+    for (size_t i = 0; i < n; i++) {
+        const body_rep* b = job->bodies[i];
+        wavefront_key e = {(uintptr_t)b->_col_impl, (uintptr_t)b->tex.refl,
+                           (uintptr_t)b->tex.impl, i};
+        k[i] = e;
+        job->sphere[i] = b->_col_impl == &sphere_col;
+    }
+    qsort(k, n, sizeof(wavefront_key), &wavefront_key_cmp);
+    uint32_t keys = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0 && wavefront_key_cmp(&k[i - 1], &k[i]) != 0) {
+            keys++;
+        }
+        job->key[k[i].body] = keys;
+    }
+    rt_free(k);
+    return n > 0 ? keys + 1 : 0;
+}
+
+static inline ray wavefront_ray(const wavefront_paths* p, uint32_t i) {
+    ray r = {vec3(p->ox[i], p->oy[i], p->oz[i]),
+             vec3(p->dx[i], p->dy[i], p->dz[i])};
+    return r;
+}
+
+static inline void wavefront_set_ray(wavefront_paths* p, uint32_t i, ray r) {
+    p->ox[i] = r.pos.i;
+    p->oy[i] = r.pos.j;
+    p->oz[i] = r.pos.k;
+    p->dx[i] = r.path.i;
+    p->dy[i] = r.path.j;
+    p->dz[i] = r.path.k;
+}
+
+/// Camera ray stage, one chunk of the wave
+static void wavefront_generate(void* arg, size_t index, unsigned int worker) {
+    wavefront_job* job = (wavefront_job*)arg;
+    const display* disp = job->disp;
+    wavefront_paths* p = &job->p;
+    rt_sampler* s = sampler_thread();
+    size_t end = (index + 1) * WAVEFRONT_CHUNK;
+    end = end < job->count ? end : job->count;
+    float u, v;
+    PROF_BEGIN(span);
+
+    sampler_init(s, disp->sampler, disp->spp, disp->seed);
+    for (size_t i = index * WAVEFRONT_CHUNK; i < end; i++) {
+        size_t px = job->first_pixel + i / job->spp;
+        unsigned int x = px % disp->d_w, y = px / disp->d_w;
+        ray r;
+        if (disp->sampler != SAMPLER_NONE) {
+            sampler_start(s, x, y, i % job->spp);
+            sampler_2d(s, &u, &v);
+            r = display_camera_ray_at(disp, job->disp_x, job->disp_y, x + u,
+                                      y + v);
+            p->dim[i] = s->dim;
+        } else {
+            r = display_camera_ray(disp, job->disp_x, job->disp_y, x, y);
+        }
+        wavefront_set_ray(p, i, r);
+        p->width[i] = job->cone.width;
+        p->spread[i] = job->cone.spread;
+        p->sum[i] = color_black();
+        p->weight[i] = 1.0;
+        p->ignore[i] = WAVEFRONT_NONE;
+        p->depth[i] = 0;
+        job->queue[i] = i;
+    }
+    s->kind = SAMPLER_NONE;
+    PROF_END(span, "generate", index);
+}
+
+/** Tests the gathered rays of a chunk body by body. Spheres run over all
+ * rays in one SIMD loop, other bodies through their _col_impl.
+ */
+static void wavefront_brute(const wavefront_job* job, size_t n,
+                            const uint32_t* idx, uint32_t* best_id,
+                            RT_FLOAT* best) {
+    const wavefront_paths* p = &job->p;
+    RT_FLOAT ox[WAVEFRONT_CHUNK], oy[WAVEFRONT_CHUNK], oz[WAVEFRONT_CHUNK];
+    RT_FLOAT dx[WAVEFRONT_CHUNK], dy[WAVEFRONT_CHUNK], dz[WAVEFRONT_CHUNK];
+    uint32_t ign[WAVEFRONT_CHUNK];
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t k = idx[i];
+        ox[i] = p->ox[k];
+        oy[i] = p->oy[k];
+        oz[i] = p->oz[k];
+        dx[i] = p->dx[k];
+        dy[i] = p->dy[k];
+        dz[i] = p->dz[k];
+        ign[i] = p->ignore[k];
+        best[i] = FLT_MAX;
+        best_id[i] = WAVEFRONT_NONE;
+    }
+
+    for (uint32_t b = 0; b < job->body_count; b++) {
+        const body_rep* ref = job->bodies[b];
+        if (!job->sphere[b]) {
+            RT_FLOAT z;
+            vector3 norm;
+            for (size_t i = 0; i < n; i++) {
+                ray r = {vec3(ox[i], oy[i], oz[i]), vec3(dx[i], dy[i], dz[i])};
+                if (ign[i] != b && ref->_col_impl(ref, r, &z, &norm) &&
+                    z < best[i]) {
+                    best[i] = z;
+                    best_id[i] = b;
+                }
+            }
+            continue;
+        }
+        const body_sphere* sph = (const body_sphere*)ref->body;
+        RT_FLOAT cx = sph->center.i, cy = sph->center.j, cz = sph->center.k;
+        RT_FLOAT r2 = sph->R * sph->R;
+        // sphere_hit() with the factors of two cancelled
+        size_t i = 0;
+#if RT_VEC_SSE
+        // Four rays at a time, closer hits are rare so they are stored one
+        // by one
+        __m128 vcx = _mm_set1_ps(cx), vcy = _mm_set1_ps(cy);
+        __m128 vcz = _mm_set1_ps(cz), vr2 = _mm_set1_ps(r2);
+        __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= n; i += 4) {
+            __m128 ocx = _mm_sub_ps(vcx, _mm_loadu_ps(ox + i));
+            __m128 ocy = _mm_sub_ps(vcy, _mm_loadu_ps(oy + i));
+            __m128 ocz = _mm_sub_ps(vcz, _mm_loadu_ps(oz + i));
+            __m128 h = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(dx + i), ocx),
+                           _mm_mul_ps(_mm_loadu_ps(dy + i), ocy)),
+                _mm_mul_ps(_mm_loadu_ps(dz + i), ocz));
+            __m128 oc2 = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)),
+                _mm_mul_ps(ocz, ocz));
+            __m128 disc =
+                _mm_sub_ps(_mm_mul_ps(h, h), _mm_sub_ps(oc2, vr2));
+            __m128 sq = _mm_sqrt_ps(_mm_max_ps(disc, zero));
+            __m128 t1 = _mm_sub_ps(h, sq);
+            __m128 near = _mm_cmpge_ps(t1, zero);
+            __m128 t = _mm_or_ps(_mm_and_ps(near, t1),
+                                 _mm_andnot_ps(near, _mm_add_ps(h, sq)));
+            __m128 ok = _mm_and_ps(
+                _mm_and_ps(_mm_cmpge_ps(disc, zero), _mm_cmpge_ps(t, zero)),
+                _mm_cmplt_ps(t, _mm_loadu_ps(best + i)));
+            int mask = _mm_movemask_ps(ok);
+            if (mask != 0) {
+                _Alignas(16) float tv[4];
+                _mm_store_ps(tv, t);
+                for (int l = 0; l < 4; l++) {
+                    if ((mask >> l & 1) && ign[i + l] != b) {
+                        best[i + l] = tv[l];
+                        best_id[i + l] = b;
+                    }
+                }
+            }
+        }
+#endif
+        for (; i < n; i++) {
+            RT_FLOAT ocx = cx - ox[i], ocy = cy - oy[i], ocz = cz - oz[i];
+            RT_FLOAT h = dx[i] * ocx + dy[i] * ocy + dz[i] * ocz;
+            RT_FLOAT disc = h * h - (ocx * ocx + ocy * ocy + ocz * ocz - r2);
+            RT_FLOAT sq = rt_sqrt(disc > 0.0f ? disc : 0.0f);
+            RT_FLOAT t = h - sq >= 0.0f ? h - sq : h + sq;
+            bool closer =
+                disc >= 0.0f && t >= 0.0f && t < best[i] && ign[i] != b;
+            best[i] = closer ? t : best[i];
+            best_id[i] = closer ? b : best_id[i];
+        }
+    }
+}
+
+/// Intersection stage, one chunk of the queue
+static void wavefront_intersect(void* arg, size_t index, unsigned int worker) {
+    wavefront_job* job = (wavefront_job*)arg;
+    wavefront_paths* p = &job->p;
+    const rt_accel* accel = job->disp->accel;
+    size_t begin = index * WAVEFRONT_CHUNK;
+    size_t n = job->queue_count - begin < WAVEFRONT_CHUNK
+                   ? job->queue_count - begin
+                   : WAVEFRONT_CHUNK;
+    const uint32_t* idx = job->queue + begin;
+    uint32_t best_id[WAVEFRONT_CHUNK];
+    RT_FLOAT best[WAVEFRONT_CHUNK];
+    PROF_BEGIN(span);
+
+    if (accel == NULL) {
+        wavefront_brute(job, n, idx, best_id, best);
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint32_t k = idx[i];
+        ray r = wavefront_ray(p, k);
+        const body_rep* ignore =
+            p->ignore[k] != WAVEFRONT_NONE ? job->bodies[p->ignore[k]] : NULL;
+        size_t hit;
+        RT_FLOAT z;
+        vector3 norm;
+        bool found;
+        if (accel != NULL) {
+            found = accel->closest(accel->impl, job->bodies, job->body_count,
+                                   r, ignore, &hit, &z, &norm);
+        } else {
+            // Distance and normal exactly as the scalar tracer has them
+            hit = best_id[i];
+            const body_rep* ref = job->bodies[hit < job->body_count ? hit : 0];
+            found = hit != WAVEFRONT_NONE && ref->_col_impl(ref, r, &z, &norm);
+        }
+        if (!found) {
+            p->hit[k] = WAVEFRONT_NONE;
+            p->sum[k] = color_sum(p->sum[k], color_mul(p->weight[k],
+                                                       display_background()));
+            continue;
+        }
+        p->hit[k] = hit;
+        p->dist[k] = z;
+        p->nx[k] = norm.i;
+        p->ny[k] = norm.j;
+        p->nz[k] = norm.k;
+    }
+    atomic_fetch_add_explicit(&job->rays, n, memory_order_relaxed);
+    PROF_END(span, "intersect", index);
+}
+
+/// Drops the misses of the queue and sorts the hits by shading key
+static void wavefront_sort(wavefront_job* job) {
+    const wavefront_paths* p = &job->p;
+    size_t* pos = job->key_pos;
+    PROF_BEGIN(span);
+
+    for (uint32_t k = 0; k <= job->keys; k++) {
+        pos[k] = 0;
+    }
+    for (size_t i = 0; i < job->queue_count; i++) {
+        uint32_t h = p->hit[job->queue[i]];
+        if (h != WAVEFRONT_NONE) {
+            pos[job->key[h] + 1]++;
+        }
+    }
+    for (uint32_t k = 0; k < job->keys; k++) {
+        pos[k + 1] += pos[k];
+    }
+    for (size_t i = 0; i < job->queue_count; i++) {
+        uint32_t h = p->hit[job->queue[i]];
+        if (h != WAVEFRONT_NONE) {
+            job->next[pos[job->key[h]]++] = job->queue[i];
+        }
+    }
+    job->queue_count = pos[job->keys > 0 ? job->keys - 1 : 0];
+
+    uint32_t* tmp = job->queue;
+    job->queue = job->next;
+    job->next = tmp;
+    PROF_END(span, "sort", job->queue_count);
+}
+
+/** Shading stage, one chunk of the sorted queue.
+ *
+ * The same as display_trace_ray_cone() unrolled: every hit adds its color
+ * weighted by 1 - reflectivity and by the reflectivities before it, and
+ * paths that reflect are kept at the front of the chunk in \b next.
+ */
+static void wavefront_shade(void* arg, size_t index, unsigned int worker) {
+    wavefront_job* job = (wavefront_job*)arg;
+    const display* disp = job->disp;
+    wavefront_paths* p = &job->p;
+    rt_sampler* s = sampler_thread();
+    size_t begin = index * WAVEFRONT_CHUNK;
+    size_t end = begin + WAVEFRONT_CHUNK < job->queue_count
+                     ? begin + WAVEFRONT_CHUNK
+                     : job->queue_count;
+    size_t kept = 0;
+    uint64_t culled = 0;
+    PROF_BEGIN(span);
+
+    sampler_init(s, disp->sampler, disp->spp, disp->seed);
+    for (size_t i = begin; i < end; i++) {
+        uint32_t k = job->queue[i];
+        const body_rep* ref = job->bodies[p->hit[k]];
+        ray r = wavefront_ray(p, k);
+        vector3 norm = vec3(p->nx[k], p->ny[k], p->nz[k]);
+        RT_FLOAT z = p->dist[k];
+        ray_cone cone = {p->width[k], p->spread[k]};
+        tex_hit th = {ray_dist(r, z), ray_cone_width(cone, z)};
+        RT_FLOAT refl = ref->tex.reflectivity;
+        color c = ref->tex.refl(ref->tex.impl, r, norm, &th);
+        p->sum[k] = color_sum(p->sum[k],
+                              color_mul(p->weight[k] * (1.0 - refl), c));
+        if (p->depth[k] == disp->max_refl) {
+            continue;
+        }
+
+        RT_FLOAT curvature = 0.0;
+        if (cone.spread > 0.0) {
+            vector3 center;
+            RT_FLOAT radius;
+            if (body_bounds(ref, &center, &radius)) {
+                if (th.width > 2.0 * radius) {
+                    culled++;
+                    p->sum[k] = color_sum(
+                        p->sum[k], color_mul(p->weight[k] * refl,
+                                             display_background()));
+                    continue;
+                }
+                curvature = 2.0 * th.width / radius;
+            }
+        }
+
+        size_t px = job->first_pixel + k / job->spp;
+        if (disp->sampler != SAMPLER_NONE) {
+            sampler_start(s, px % disp->d_w, px / disp->d_w, k % job->spp);
+            s->dim = p->dim[k];
+        } else {
+            // The jitter only depends on the pixel and the bounce
+            rng_seed(rng_thread(), disp->seed, rng_hash(px) + p->depth[k]);
+        }
+        brdf_sample bs = brdf_sample_dir(r.path, norm, ref->tex.diffusivity);
+        p->dim[k] = s->dim;
+        if (bs.weight <= 0.0) {
+            continue;
+        }
+        wavefront_set_ray(p, k, ray_new(th.point, bs.dir));
+        p->width[k] = th.width;
+        p->spread[k] =
+            cone.spread > 0.0 ? cone.spread + curvature + ref->tex.diffusivity
+                              : 0.0;
+        p->weight[k] *= refl * bs.weight;
+        p->ignore[k] = p->hit[k];
+        p->depth[k]++;
+        job->next[begin + kept++] = k;
+    }
+    s->kind = SAMPLER_NONE;
+    job->kept[index] = kept;
+    atomic_fetch_add_explicit(&job->culled, culled, memory_order_relaxed);
+    PROF_END(span, "shade", index);
+}
+
+/// Averages the paths of every pixel of the wave into the framebuffer
+static void wavefront_resolve(void* arg, size_t index, unsigned int worker) {
+    wavefront_job* job = (wavefront_job*)arg;
+    size_t pixels = job->count / job->spp;
+    size_t end = (index + 1) * WAVEFRONT_CHUNK;
+    end = end < pixels ? end : pixels;
+
+    for (size_t i = index * WAVEFRONT_CHUNK; i < end; i++) {
+        double sum[3] = {0.0, 0.0, 0.0};
+        for (unsigned int n = 0; n < job->spp; n++) {
+            color c = job->p.sum[i * job->spp + n];
+            sum[0] += c.r;
+            sum[1] += c.g;
+            sum[2] += c.b;
+        }
+        job->disp->color_buffer[job->first_pixel + i] =
+            display_sample_mean(sum, job->spp);
+    }
+}
+
+/// Allocates the buffers of \b batch paths, false if out of memory
+static bool wavefront_alloc(wavefront_job* job, size_t batch) {
+    wavefront_paths* p = &job->p;
+    RT_FLOAT** floats[] = {&p->ox,    &p->oy,   &p->oz,    &p->dx,
+                           &p->dy,    &p->dz,   &p->width, &p->spread,
+                           &p->dist,  &p->nx,   &p->ny,    &p->nz,
+                           &p->weight};
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(floats) / sizeof(floats[0]); i++) {
+        *floats[i] = rt_malloc(MEM_RENDER, sizeof(RT_FLOAT) * batch);
+        ok = ok && *floats[i] != NULL;
+    }
+    p->hit = rt_malloc(MEM_RENDER, sizeof(uint32_t) * batch);
+    p->ignore = rt_malloc(MEM_RENDER, sizeof(uint32_t) * batch);
+    p->sum = rt_malloc(MEM_RENDER, sizeof(color) * batch);
+    p->depth = rt_malloc(MEM_RENDER, sizeof(uint16_t) * batch);
+    p->dim = rt_malloc(MEM_RENDER, sizeof(uint16_t) * batch);
+    job->queue = rt_malloc(MEM_RENDER, sizeof(uint32_t) * batch);
+    job->next = rt_malloc(MEM_RENDER, sizeof(uint32_t) * batch);
+    size_t chunks = (batch + WAVEFRONT_CHUNK - 1) / WAVEFRONT_CHUNK;
+    job->kept = rt_malloc(MEM_RENDER, sizeof(size_t) * chunks);
+    size_t bodies = job->body_count > 0 ? job->body_count : 1;
+    job->key = rt_malloc(MEM_RENDER, sizeof(uint32_t) * bodies);
+    job->sphere = rt_malloc(MEM_RENDER, sizeof(bool) * bodies);
+    job->key_pos = rt_malloc(MEM_RENDER, sizeof(size_t) * (bodies + 1));
+    return ok && p->hit != NULL && p->ignore != NULL && p->sum != NULL &&
+           p->depth != NULL && p->dim != NULL && job->queue != NULL &&
+           job->next != NULL && job->kept != NULL && job->key != NULL &&
+           job->sphere != NULL && job->key_pos != NULL;
+}
+
+static void wavefront_free(wavefront_job* job) {
+    wavefront_paths* p = &job->p;
+    void* all[] = {p->ox,     p->oy,       p->oz,      p->dx,
+                   p->dy,     p->dz,       p->width,   p->spread,
+                   p->dist,   p->nx,       p->ny,      p->nz,
+                   p->weight, p->hit,      p->ignore,  p->sum,
+                   p->depth,  p->dim,      job->queue, job->next,
+                   job->kept, job->key,    job->sphere, job->key_pos};
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        rt_free(all[i]);
+    }
+}
+
+void wavefront_render(rt_context* ctx, wavefront_stats* stats) {
+    double start = util_seconds();
+    wavefront_stats ws = {0, 0, 0};
+    PROF_BEGIN(span);
+
+    bool ready = rt_context_prepare(ctx);
+
+    wavefront_job job = {0};
+    job.ctx = ctx;
+    job.disp = &ctx->disp;
+    job.bodies = ctx->body_ptrs.data;
+    job.body_count = ctx->body_ptrs.count;
+    display_view_extent(job.disp, &job.disp_x, &job.disp_y);
+    job.cone = display_camera_cone(job.disp, job.disp_y);
+    job.spp = job.disp->sampler != SAMPLER_NONE ? job.disp->spp : 1;
+    atomic_init(&job.rays, 0);
+    atomic_init(&job.culled, 0);
+
+    // Whole pixels per wave, so one thread averages all samples of one
+    size_t pixels = (size_t)job.disp->d_w * job.disp->d_h;
+    size_t wave_pixels = WAVEFRONT_BATCH / job.spp;
+    wave_pixels = wave_pixels > 0 ? wave_pixels : 1;
+    wave_pixels = wave_pixels < pixels ? wave_pixels : pixels;
+    if (ready && pixels > 0 && wavefront_alloc(&job, wave_pixels * job.spp)) {
+        job.keys = wavefront_keys(&job);
+        ws.materials = job.keys;
+
+        for (job.first_pixel = 0; job.first_pixel < pixels;
+             job.first_pixel += wave_pixels) {
+            size_t n = pixels - job.first_pixel < wave_pixels
+                           ? pixels - job.first_pixel
+                           : wave_pixels;
+            job.count = n * job.spp;
+            job.queue_count = job.count;
+            size_t chunks = (job.count + WAVEFRONT_CHUNK - 1) / WAVEFRONT_CHUNK;
+            pool_run(ctx->pool, chunks, &wavefront_generate, &job);
+            ws.waves++;
+
+            while (job.queue_count > 0) {
+                chunks = (job.queue_count + WAVEFRONT_CHUNK - 1) /
+                         WAVEFRONT_CHUNK;
+                pool_run(ctx->pool, chunks, &wavefront_intersect, &job);
+                wavefront_sort(&job);
+                ws.stages++;
+                if (job.queue_count == 0) {
+                    break;
+                }
+
+                chunks = (job.queue_count + WAVEFRONT_CHUNK - 1) /
+                         WAVEFRONT_CHUNK;
+                pool_run(ctx->pool, chunks, &wavefront_shade, &job);
+                // Continuing paths of every chunk are at its front
+                size_t count = 0;
+                for (size_t ch = 0; ch < chunks; ch++) {
+                    memmove(&job.queue[count], &job.next[ch * WAVEFRONT_CHUNK],
+                            sizeof(uint32_t) * job.kept[ch]);
+                    count += job.kept[ch];
+                }
+                job.queue_count = count;
+            }
+
+            chunks = (n + WAVEFRONT_CHUNK - 1) / WAVEFRONT_CHUNK;
+            pool_run(ctx->pool, chunks, &wavefront_resolve, &job);
+        }
+    }
+    wavefront_free(&job);
+    ctx->disp.accel = NULL;
+
+    ctx->stats.primary_rays = (uint64_t)pixels * job.spp;
+    ctx->stats.rays = atomic_load(&job.rays);
+    ctx->stats.culled = atomic_load(&job.culled);
+    ctx->stats.tiles = 0;
+    ctx->stats.trace_seconds = util_seconds() - start;
+    ctx->stats.write_seconds = 0.0;
+    rt_mem_stat mem = rt_mem_total();
+    ctx->stats.mem_current = mem.current;
+    ctx->stats.mem_peak = mem.peak;
+    if (stats != NULL) {
+        *stats = ws;
+    }
+    PROF_END(span, "wavefront", ws.waves);
+}
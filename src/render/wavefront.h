@@ -0,0 +1,47 @@
+#ifndef RAY_TRACE_WAVEFRONT_H
+#define RAY_TRACE_WAVEFRONT_H
+
+#include "context.h"
+
+#include <stdint.h>
+
+/// Paths in flight per wave, bounds the memory of the ray buffers
+#define WAVEFRONT_BATCH 16384
+/// Paths per pool item of a stage
+#define WAVEFRONT_CHUNK 256
+
+/// Counters of the last wavefront_render(), next to the context stats
+typedef struct {
+    uint64_t waves;     ///< Batches of paths
+    uint64_t stages;    ///< Intersect and shade rounds over all waves
+    uint64_t materials; ///< Distinct shading keys of the scene
+} wavefront_stats;
+
+/** Renders the frame of \b ctx one stage at a time instead of one path at a
+ * time.
+ *
+ * A wave of up to WAVEFRONT_BATCH camera rays is generated into structure of
+ * arrays buffers. Every round then intersects all live rays of the wave as
+ * one stage, drops the misses, sorts the hits by shading key (body type,
+ * texture function and texture) and shades them in that order, putting the
+ * reflected rays back into the queue of the next round. A stage runs one
+ * kind of code over many rays, so the branches, textures and bodies it
+ * touches stay in cache. Without an acceleration structure the rays of a
+ * chunk are tested body by body, with SSE four rays per sphere test.
+ *
+ * Shading is display_trace_ray_cone() unrolled like ooc_render(), both clamp
+ * the sum of a path once. With a sampler every path draws the same sample
+ * dimensions as in rt_context_render(), so the images match up to rounding.
+ * Without one the reflection jitter is seeded per pixel and
+ * bounce, so the image doesn't depend on the thread count either. Adaptive
+ * rendering doesn't apply, every pixel is traced, and misses always get
+ * display_background() whatever cfg.env says.
+ *
+ * Fills the stats of the context like rt_context_render(), with no tiles.
+ * Nothing is traced if rt_context_prepare() or the ray buffers fail.
+ *
+ * @param stats Set to the wavefront counters, may be NULL
+ */
+void wavefront_render(rt_context* ctx, wavefront_stats* stats);
+
+#endif
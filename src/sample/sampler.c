@@ -0,0 +1,221 @@
+#include "sampler.h"
+#include <include/util.h>
+
+#include <math.h>
+
+/// R2 sequence constants, 1 / g and 1 / g^2 of the plastic number g
+#define SAMPLER_R2_A 0.7548776662466927
+#define SAMPLER_R2_B 0.5698402909980532
+/// R1 sequence constant, the golden ratio minus 1
+#define SAMPLER_R1_A 0.6180339887498949
+
+/// Largest float below 1
+#define SAMPLER_ONE_MINUS 0x1.fffffep-1f
+
+static _Thread_local rt_sampler sampler_tls;
+
+rt_sampler* sampler_thread(void) {
+    return &sampler_tls;
+}
+
+const char* sampler_name(sampler_kind kind) {
+    switch (kind) {
+    case SAMPLER_NONE:
+        return "none";
+    case SAMPLER_RANDOM:
+        return "random";
+    case SAMPLER_STRATIFIED:
+        return "stratified";
+    case SAMPLER_SOBOL:
+        return "sobol";
+    case SAMPLER_BLUE:
+        return "blue";
+    }
+    return "?";
+}
+
+void sampler_init(rt_sampler* s, sampler_kind kind, unsigned int spp,
+                  uint64_t seed) {
+    rt_sampler ret = {kind, spp == 0 ? 1 : spp, seed, 0, 0, 0, 0, 0};
+    *s = ret;
+}
+
+void sampler_start(rt_sampler* s, unsigned int x, unsigned int y,
+                   unsigned int index) {
+    s->x = x;
+    s->y = y;
+    s->index = index;
+    s->dim = 0;
+    s->key = rng_hash(s->seed ^ rng_hash(((uint64_t)y << 32) | x));
+}
+
+/// Top 24 bits as a float in [0, 1)
+static inline float sampler_float(uint32_t x) {
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+/// Fractional part as a float in [0, 1)
+static inline float sampler_frac(double x) {
+    float f = (float)(x - floor(x));
+    return f < SAMPLER_ONE_MINUS ? f : SAMPLER_ONE_MINUS;
+}
+
+/// Hash of the current pixel, dimension and a salt
+static inline uint32_t sampler_key(const rt_sampler* s, unsigned int salt) {
+    return (uint32_t)rng_hash(s->key + ((uint64_t)s->dim << 8) + salt);
+}
+
+static inline uint32_t sampler_reverse(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+/// Owen scramble with the hash of Laine and Karras, as in Burley, "Practical
+/// Hash-based Owen Scrambling" (2020). Every bit is flipped depending only on
+/// the bits above it.
+static inline uint32_t sampler_owen(uint32_t x, uint32_t seed) {
+    x = sampler_reverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return sampler_reverse(x);
+}
+
+/// First (van der Corput) or second dimension of the Sobol sequence
+static inline uint32_t sampler_sobol(uint32_t index, int second) {
+    uint32_t x = 0, v = 0x80000000u;
+    for (; index != 0; index >>= 1) {
+        if (index & 1) {
+            x ^= v;
+        }
+        v = second ? v ^ (v >> 1) : v >> 1;
+    }
+    return x;
+}
+
+/// Hash of the seed and the current dimension, the same for every pixel
+static inline uint64_t sampler_dim_key(const rt_sampler* s) {
+    return rng_hash(s->seed + ((uint64_t)s->dim << 8) + 0xb1);
+}
+
+/// Owen scrambled Sobol value of the current dimension, \b i is the
+/// shuffled sample index
+static inline float sampler_sobol_dim(const rt_sampler* s, uint32_t i,
+                                      int second) {
+    return sampler_float(
+        sampler_owen(sampler_sobol(i, second), sampler_key(s, 1 + second)));
+}
+
+/// Random permutation of [0, n) indexed by \b key (Kensler, "Correlated
+/// Multi-Jittered Sampling", 2013)
+static uint32_t sampler_permute(uint32_t i, uint32_t n, uint32_t key) {
+    uint32_t w = n - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= key;
+        i *= 0xe170893du;
+        i ^= key >> 16;
+        i ^= (i & w) >> 4;
+        i ^= key >> 8;
+        i *= 0x0929eb3fu;
+        i ^= key >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | key >> 27;
+        i *= 0x6935fa69u;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303u;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3u;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3dfu;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+    return (i + key) % n;
+}
+
+/// Per pixel offset of the blue sampler. The R2 sequence over the pixels
+/// puts neighbours far apart, so the remaining error looks like blue noise.
+/// Dimensions are only rotated by a constant, a per pixel hash would turn it
+/// back into white noise.
+static inline double sampler_mask(const rt_sampler* s, double a, double b) {
+    return s->x * a + s->y * b;
+}
+
+float sampler_1d(rt_sampler* s) {
+    float ret;
+    uint32_t k = sampler_key(s, 0);
+    switch (s->kind) {
+    case SAMPLER_STRATIFIED: {
+        uint32_t cell = sampler_permute(s->index % s->spp, s->spp, k);
+        uint32_t jit = (uint32_t)rng_hash(k + ((uint64_t)s->index << 32));
+        ret = sampler_frac((cell + sampler_float(jit)) / s->spp);
+        break;
+    }
+    case SAMPLER_SOBOL:
+        ret = sampler_sobol_dim(s, sampler_owen(s->index, k), 0);
+        break;
+    case SAMPLER_BLUE:
+        ret = sampler_frac(0.5 + s->index * SAMPLER_R1_A +
+                           sampler_mask(s, SAMPLER_R2_A, SAMPLER_R2_B) +
+                           sampler_float((uint32_t)sampler_dim_key(s)));
+        break;
+    default:
+        ret = sampler_float(
+            (uint32_t)rng_hash(k + ((uint64_t)s->index << 32)));
+        break;
+    }
+    s->dim++;
+    return ret;
+}
+
+void sampler_2d(rt_sampler* s, float* u, float* v) {
+    uint32_t k = sampler_key(s, 0);
+    switch (s->kind) {
+    case SAMPLER_STRATIFIED: {
+        // As square as possible, some strata stay empty if spp isn't a square
+        uint32_t nx = (uint32_t)sqrt((double)s->spp);
+        uint32_t ny = (s->spp + nx - 1) / nx;
+        uint32_t cell = sampler_permute(s->index % s->spp, nx * ny, k);
+        uint64_t jit = rng_hash(k + ((uint64_t)s->index << 32));
+        *u = sampler_frac((cell % nx + sampler_float((uint32_t)jit)) / nx);
+        *v = sampler_frac((cell / nx + sampler_float(jit >> 32)) / ny);
+        break;
+    }
+    case SAMPLER_SOBOL: {
+        uint32_t i = sampler_owen(s->index, k);
+        *u = sampler_sobol_dim(s, i, 0);
+        *v = sampler_sobol_dim(s, i, 1);
+        break;
+    }
+    case SAMPLER_BLUE: {
+        // Second mask with the constants swapped, so u and v aren't shifted
+        // by the same amount
+        uint64_t rot = sampler_dim_key(s);
+        *u = sampler_frac(0.5 + s->index * SAMPLER_R2_A +
+                          sampler_mask(s, SAMPLER_R2_A, SAMPLER_R2_B) +
+                          sampler_float((uint32_t)rot));
+        *v = sampler_frac(0.5 + s->index * SAMPLER_R2_B +
+                          sampler_mask(s, SAMPLER_R2_B, SAMPLER_R2_A) +
+                          sampler_float(rot >> 32));
+        break;
+    }
+    default: {
+        uint64_t h = rng_hash(k + ((uint64_t)s->index << 32));
+        *u = sampler_float((uint32_t)h);
+        *v = sampler_float(h >> 32);
+        break;
+    }
+    }
+    s->dim++;
+}
@@ -0,0 +1,63 @@
+#ifndef RAY_TRACE_SAMPLER_H
+#define RAY_TRACE_SAMPLER_H
+
+#include <stdint.h>
+
+/// Sample sequences, see rt_sampler
+typedef enum {
+    SAMPLER_NONE,       ///< Pixel centers and the thread generator, 1 sample
+    SAMPLER_RANDOM,     ///< Independent hashed values
+    SAMPLER_STRATIFIED, ///< Jittered strata, shuffled per dimension
+    SAMPLER_SOBOL,      ///< Owen scrambled Sobol (0, 2) points
+    SAMPLER_BLUE,       ///< R2 points rotated by a blue noise like pixel mask
+} sampler_kind;
+
+/** Sample generator of one pixel sample.
+ *
+ * Every value only depends on the seed, the pixel, the sample index and the
+ * dimension, never on the thread or the order pixels are traced in.
+ * Dimensions are counted per sample: the camera jitter takes the first one and
+ * every diffuse bounce takes the next two, so the same bounce of different
+ * samples of a pixel draws from the same well distributed point set.
+ *
+ * A 2D draw gives a point of a 2D sequence and a 1D draw a value of a 1D
+ * sequence, each takes one dimension. Different dimensions are decorrelated
+ * with hashed scrambles.
+ */
+typedef struct {
+    sampler_kind kind;  ///< Sequence
+    unsigned int spp;   ///< Samples per pixel, sets the stratification
+    uint64_t seed;      ///< Seed of the scrambles
+    unsigned int x;     ///< Pixel column
+    unsigned int y;     ///< Pixel row
+    unsigned int index; ///< Sample of the pixel, [0, spp)
+    unsigned int dim;   ///< Next dimension
+    uint64_t key;       ///< Hash of the seed and the pixel
+} rt_sampler;
+
+/// Sets up a sampler, \b spp of 0 counts as 1
+void sampler_init(rt_sampler* s, sampler_kind kind, unsigned int spp,
+                  uint64_t seed);
+
+/// Starts sample \b index of pixel (x, y) at the first dimension
+void sampler_start(rt_sampler* s, unsigned int x, unsigned int y,
+                   unsigned int index);
+
+/// Value in [0, 1) of the next dimension
+float sampler_1d(rt_sampler* s);
+
+/// Point in [0, 1)^2 of the next dimension
+void sampler_2d(rt_sampler* s, float* u, float* v);
+
+/** Sampler of the path the calling thread is tracing.
+ *
+ * vec_rand() draws from it while its kind isn't SAMPLER_NONE, which is how
+ * reflection jitter follows the pixel sample. The tracer sets it up for each
+ * sample and resets the kind afterwards.
+ */
+rt_sampler* sampler_thread(void);
+
+/// Name of a sampler kind, e.g. "sobol"
+const char* sampler_name(sampler_kind kind);
+
+#endif
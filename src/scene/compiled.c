@@ -0,0 +1,238 @@
+#include "compiled.h"
+
+#include <dlfcn.h>
+
+/** Helpers of the generated code, the same arithmetic as sphere_hit() and
+ * floor_col() so that the images don't change.
+ *
+ * They take the ray and center by pointer: by value GCC splits the ray into
+ * scalars and writes them back before every vector load, which costs a
+ * store forwarding stall per sphere.
+ */
+static const char scene_prologue[] =
+    "#include <include/render.h>\n"
+    "\n"
+    "#include <math.h>\n"
+    "#include <stdint.h>\n"
+    "\n"
+    "static inline bool gen_sphere(const ray* r, const vector3* C,\n"
+    "                              RT_FLOAT R, RT_FLOAT* dist) {\n"
+    "    vector3 oc = vec_sub(*C, r->pos);\n"
+    "    RT_FLOAT a = 1;\n"
+    "    RT_FLOAT b = -2 * vec_dot(r->path, oc);\n"
+    "    RT_FLOAT c = vec_dot(oc, oc) - R * R;\n"
+    "    RT_FLOAT disc = b * b - 4 * a * c;\n"
+    "    if (!(disc >= 0)) {\n"
+    "        return false;\n"
+    "    }\n"
+    "    RT_FLOAT root = rt_sqrt_fast(disc);\n"
+    "    RT_FLOAT d1 = (-b - root) / (2 * a);\n"
+    "    RT_FLOAT d2 = (-b + root) / (2 * a);\n"
+    "    if (d1 < 0.0) {\n"
+    "        if (d2 < 0.0) {\n"
+    "            return false;\n"
+    "        }\n"
+    "        *dist = d2;\n"
+    "        return true;\n"
+    "    }\n"
+    "    *dist = d1;\n"
+    "    return true;\n"
+    "}\n"
+    "\n"
+    "static inline bool gen_floor(const ray* r, RT_FLOAT height,\n"
+    "                             RT_FLOAT* dist) {\n"
+    "    RT_FLOAT y_diff = r->pos.j - height;\n"
+    "    if (y_diff * r->path.j < 0.0) {\n"
+    "        *dist = -y_diff / r->path.j;\n"
+    "        return true;\n"
+    "    }\n"
+    "    return false;\n"
+    "}\n"
+    "\n";
+
+/// Exact C literal of a value
+static void scene_lit(FILE* out, RT_FLOAT v) {
+    fprintf(out, "(RT_FLOAT)%a", (double)v);
+}
+
+RT_RES scene_compile(const rt_context* ctx, uint64_t hash, FILE* out) {
+    const rtvec_body* bodies = &ctx->bodies;
+    size_t n = bodies->count, spheres = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (bodies->data[i]._col_impl == &sphere_col) {
+            spheres++;
+        } else if (bodies->data[i]._col_impl != &floor_col) {
+            RETURN_ERR(PARSE_ERROR);
+        }
+    }
+    bool unroll = spheres <= SCENE_UNROLL_MAX;
+
+    fprintf(out, "// Generated by rt_scenegen, %zu bodies. Don't edit.\n\n",
+            n);
+    fputs(scene_prologue, out);
+    fprintf(out, "const uint64_t " SCENE_SYM_HASH " = 0x%016llxULL;\n",
+            (unsigned long long)hash);
+    fprintf(out, "const size_t " SCENE_SYM_COUNT " = %zu;\n\n", n);
+
+    if (spheres > 0) {
+        // Centers, radii and body indices of the spheres
+        fprintf(out, "static const vector3 gen_center[%zu] = {\n", spheres);
+        for (size_t i = 0; i < n; i++) {
+            const body_rep* b = &bodies->data[i];
+            if (b->_col_impl == &sphere_col) {
+                const body_sphere* sph = (const body_sphere*)b->body;
+                fprintf(out, "    {");
+                scene_lit(out, sph->center.i);
+                fprintf(out, ", ");
+                scene_lit(out, sph->center.j);
+                fprintf(out, ", ");
+                scene_lit(out, sph->center.k);
+                fprintf(out, "},\n");
+            }
+        }
+        fprintf(out, "};\n\nstatic const RT_FLOAT gen_radius[%zu] = {\n",
+                spheres);
+        for (size_t i = 0; i < n; i++) {
+            const body_rep* b = &bodies->data[i];
+            if (b->_col_impl == &sphere_col) {
+                fprintf(out, "    ");
+                scene_lit(out, ((const body_sphere*)b->body)->R);
+                fprintf(out, ",\n");
+            }
+        }
+        fprintf(out, "};\n\n");
+    }
+    if (!unroll) {
+        fprintf(out, "static const size_t gen_index[%zu] = {\n", spheres);
+        for (size_t i = 0; i < n; i++) {
+            if (bodies->data[i]._col_impl == &sphere_col) {
+                fprintf(out, "    %zu,\n", i);
+            }
+        }
+        fprintf(out, "};\n\n");
+    }
+
+    // The bodies are one array in scene order (rt_context), so the ignored
+    // body is found by its offset. Ties go to the lower index like in
+    // display_closest_hit().
+    fprintf(out,
+            "bool " SCENE_SYM_CLOSEST "(const void* impl,\n"
+            "                      const body_rep** const bodies,\n"
+            "                      size_t body_count, ray r,\n"
+            "                      const body_rep* ignore, size_t* hit,\n"
+            "                      RT_FLOAT* dist, vector3* norm) {\n"
+            "    size_t skip = ignore != NULL ? (size_t)(ignore - bodies[0])\n"
+            "                                 : %zu;\n"
+            "    size_t best = %zu;\n"
+            "    RT_FLOAT best_z = 0.0;\n"
+            "    size_t best_s = 0;\n"
+            "    RT_FLOAT z;\n\n",
+            n, n);
+    if (!unroll) {
+        fprintf(out,
+                "    for (size_t s = 0; s < %zu; s++) {\n"
+                "        size_t i = gen_index[s];\n"
+                "        if (i != skip &&\n"
+                "            gen_sphere(&r, &gen_center[s], gen_radius[s], "
+                "&z) &&\n"
+                "            (best == %zu || z < best_z ||\n"
+                "             (z == best_z && i < best))) {\n"
+                "            best = i;\n"
+                "            best_z = z;\n"
+                "            best_s = s;\n"
+                "        }\n"
+                "    }\n",
+                spheres, n);
+    }
+    for (size_t i = 0, s = 0; i < n; i++) {
+        const body_rep* b = &bodies->data[i];
+        bool sphere = b->_col_impl == &sphere_col;
+        if (sphere && !unroll) {
+            continue;
+        }
+        fprintf(out, "    if (skip != %zu && ", i);
+        if (sphere) {
+            fprintf(out, "gen_sphere(&r, &gen_center[%zu], gen_radius[%zu]",
+                    s, s);
+        } else {
+            const body_floor* flr = (const body_floor*)b->body;
+            fprintf(out, "gen_floor(&r, ");
+            scene_lit(out, flr->height);
+        }
+        fprintf(out,
+                ", &z) &&\n"
+                "        (best == %zu || z < best_z ||\n"
+                "         (z == best_z && %zu < best))) {\n"
+                "        best = %zu;\n"
+                "        best_z = z;\n",
+                n, i, i);
+        if (sphere) {
+            fprintf(out, "        best_s = %zu;\n", s++);
+        }
+        fprintf(out, "    }\n");
+    }
+
+    // Normals only for the closest body
+    fprintf(out,
+            "\n    if (best == %zu) {\n"
+            "        return false;\n"
+            "    }\n"
+            "    *hit = best;\n"
+            "    *dist = best_z;\n"
+            "    switch (best) {\n",
+            n);
+    for (size_t i = 0; i < n; i++) {
+        const body_rep* b = &bodies->data[i];
+        if (b->_col_impl == &floor_col) {
+            const body_floor* flr = (const body_floor*)b->body;
+            fprintf(out, "    case %zu:\n", i);
+            fprintf(out, "        *norm = vec3(0.0, r.pos.j - ");
+            scene_lit(out, flr->height);
+            fprintf(out, " >= 0.0 ? 1.0 : -1.0, 0.0);\n"
+                         "        return true;\n");
+        }
+    }
+    fprintf(out, "    }\n");
+    if (spheres > 0) {
+        fprintf(out, "    *norm = vec_norm_fast(\n"
+                     "        vec_sub(ray_dist(r, best_z), "
+                     "gen_center[best_s]));\n");
+    }
+    fprintf(out, "    return true;\n"
+                 "}\n");
+
+    if (ferror(out)) {
+        RETURN_ERR(FILE_ERROR);
+    }
+    RETURN_NOERROR;
+}
+
+RT_RES scene_compiled_open(scene_compiled* sc, const char* path,
+                           uint64_t hash) {
+    void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        RETURN_ERR(FILE_ERROR);
+    }
+    const uint64_t* sym_hash = dlsym(handle, SCENE_SYM_HASH);
+    const size_t* sym_count = dlsym(handle, SCENE_SYM_COUNT);
+    void* sym_closest = dlsym(handle, SCENE_SYM_CLOSEST);
+    if (sym_hash == NULL || sym_count == NULL || sym_closest == NULL ||
+        *sym_hash != hash) {
+        dlclose(handle);
+        RETURN_ERR(FILE_ERROR);
+    }
+
+    sc->handle = handle;
+    sc->body_count = *sym_count;
+    sc->accel.impl = NULL;
+    // POSIX allows converting dlsym() results to function pointers
+    *(void**)&sc->accel.closest = sym_closest;
+    RETURN_NOERROR;
+}
+
+void scene_compiled_close(scene_compiled* sc) {
+    dlclose(sc->handle);
+    sc->handle = NULL;
+    sc->accel.closest = NULL;
+}
@@ -0,0 +1,57 @@
+#ifndef RAY_TRACE_COMPILED_H
+#define RAY_TRACE_COMPILED_H
+
+#include <include/errors.h>
+#include <include/render.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/// Symbols of a compiled scene, see scene_compile()
+#define SCENE_SYM_HASH "rt_scene_hash"
+#define SCENE_SYM_COUNT "rt_scene_body_count"
+#define SCENE_SYM_CLOSEST "rt_scene_closest"
+
+/// Spheres up to which every test is its own code, more are looped over a
+/// constant table so the code doesn't outgrow the instruction cache
+#define SCENE_UNROLL_MAX 32
+
+/// A compiled scene loaded with scene_compiled_open()
+typedef struct {
+    void* handle;      ///< dlopen() handle
+    size_t body_count; ///< Bodies the scene was compiled from
+    rt_accel accel;    ///< Closest hit query, for rt_context_set_accel()
+} scene_compiled;
+
+/** Writes a C translation unit that traces the bodies of \b ctx.
+ *
+ * Every sphere center, radius and floor height is a constant and the test
+ * of every body is unrolled into one function, so the compiler can fold
+ * them into the code instead of loading them and calling through _col_impl
+ * per body. The result behaves exactly like display_closest_hit() on the
+ * bodies of \b ctx, as long as they aren't moved or reordered.
+ *
+ * Compile it with -Isrc into a shared object and load it with
+ * scene_compiled_open(). The code is linear in the body count, so this is
+ * meant for small scenes rendered many times, not for particle fields.
+ *
+ * @param hash Hash of the scene text (scene_hash()), checked when loading
+ * @return PARSE_ERROR if a body isn't a sphere or a floor, FILE_ERROR if
+ * writing failed
+ */
+RT_RES scene_compile(const rt_context* ctx, uint64_t hash, FILE* out);
+
+/** Loads a compiled scene.
+ *
+ * @param hash Hash of the scene text the bodies were parsed from
+ * @return FILE_ERROR if it can't be loaded or was compiled from another
+ * scene, \b sc is untouched then
+ */
+RT_RES scene_compiled_open(scene_compiled* sc, const char* path,
+                           uint64_t hash);
+
+/// Unloads a compiled scene, no context may still use it
+void scene_compiled_close(scene_compiled* sc);
+
+#endif
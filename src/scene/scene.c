@@ -0,0 +1,113 @@
+#include "scene.h"
+#include <include/alloc.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/// Whether a color channel or reflection value is in range
+static bool scene_unit(double v) {
+    return v >= 0.0 && v <= 1.0;
+}
+
+/// Parses one line without its comment, false on a malformed body or if it
+/// can't be added
+static bool scene_line(rt_context* ctx, const char* buf) {
+    char kind[16];
+    int used = 0;
+    double x = 0.0, y, z = 0.0, radius = 0.0, r, g, b, refl, diff;
+
+    if (sscanf(buf, " %15s %n", kind, &used) != 1) {
+        return true; // Blank
+    }
+    buf += used;
+    used = 0;
+    if (strcmp(kind, "sphere") == 0) {
+        if (sscanf(buf, "%lf %lf %lf %lf %lf %lf %lf %lf %lf %n", &x, &y, &z,
+                   &radius, &r, &g, &b, &refl, &diff, &used) != 9 ||
+            radius <= 0.0) {
+            return false;
+        }
+    } else if (strcmp(kind, "floor") == 0) {
+        if (sscanf(buf, "%lf %lf %lf %lf %lf %lf %n", &y, &r, &g, &b, &refl,
+                   &diff, &used) != 6) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    // Nothing may follow the numbers
+    if (buf[used] != '\0' || !scene_unit(r) || !scene_unit(g) ||
+        !scene_unit(b) || !scene_unit(diff) || refl <= 0.0 || refl >= 1.0) {
+        return false;
+    }
+
+    ray_texture tex = texture_new_single_color(color_new(r, g, b), refl, diff);
+    body_rep body = kind[0] == 's'
+                        ? body_sphere_new(vec3(x, y, z), radius, tex)
+                        : body_floor_new(y, tex);
+    return rt_context_add_body(ctx, body) != RT_NO_BODY;
+}
+
+RT_RES scene_parse(rt_context* ctx, const char* text, size_t len,
+                   size_t* line) {
+    char buf[SCENE_MAX_LINE];
+    size_t pos = 0, n = 0;
+    PROF_BEGIN(span);
+
+    while (pos < len) {
+        const char* start = text + pos;
+        const char* nl = memchr(start, '\n', len - pos);
+        size_t size = nl != NULL ? (size_t)(nl - start) : len - pos;
+        pos += size + 1;
+        n++;
+        if (line != NULL) {
+            *line = n;
+        }
+        if (size >= SCENE_MAX_LINE) {
+            RETURN_ERR(PARSE_ERROR);
+        }
+        memcpy(buf, start, size);
+        buf[size] = '\0';
+        char* comment = strchr(buf, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        if (!scene_line(ctx, buf)) {
+            RETURN_ERR(PARSE_ERROR);
+        }
+    }
+    PROF_END(span, "scene parse", n);
+    RETURN_NOERROR;
+}
+
+char* scene_read(const char* path, size_t* len) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    size_t cap = 4096, size = 0, got;
+    char* data = rt_malloc(MEM_RENDER, cap);
+    while ((got = fread(data + size, 1, cap - size, f)) > 0) {
+        size += got;
+        if (size == cap) {
+            cap *= 2;
+            data = rt_realloc(MEM_RENDER, data, cap);
+        }
+    }
+    if (ferror(f)) {
+        rt_free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *len = size;
+    return data;
+}
+
+uint64_t scene_hash(const char* text, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)text[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
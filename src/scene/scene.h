@@ -0,0 +1,40 @@
+#ifndef RAY_TRACE_SCENE_H
+#define RAY_TRACE_SCENE_H
+
+#include <include/errors.h>
+#include <include/render.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Longest line of a scene file
+#define SCENE_MAX_LINE 512
+
+/** Parses a text scene and adds its bodies to the context.
+ *
+ * One body per line, blank lines and everything after a '#' are ignored:
+ *
+ *     sphere <x> <y> <z> <radius> <r> <g> <b> <reflectivity> <diffusivity>
+ *     floor <y> <r> <g> <b> <reflectivity> <diffusivity>
+ *
+ * Colors are in [0, 1], the reflectivity in (0, 1) (see ray_texture).
+ * Bodies of the lines before an error are still added.
+ *
+ * @param text Scene text, doesn't need to be NUL terminated
+ * @param line Set to the line of the error, may be NULL
+ * @return PARSE_ERROR for a malformed line or one whose body couldn't be
+ * added for lack of memory
+ */
+RT_RES scene_parse(rt_context* ctx, const char* text, size_t len,
+                   size_t* line);
+
+/** Reads a whole file into memory, freed with rt_free().
+ *
+ * @return NULL if it can't be read
+ */
+char* scene_read(const char* path, size_t* len);
+
+/// 64 bit FNV-1a hash of a scene text, for caching scenes by content
+uint64_t scene_hash(const char* text, size_t len);
+
+#endif
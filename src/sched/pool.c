@@ -0,0 +1,197 @@
+#include "pool.h"
+
+#include <include/alloc.h>
+#include <include/prof.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/// One pool_run() call. Lives on the stack of the caller.
+typedef struct pool_batch {
+    pool_fn fn;
+    void* arg;
+    size_t count;
+    atomic_size_t next;           ///< Next index to hand out
+    unsigned int users;           ///< Workers inside the batch (under lock)
+    struct pool_batch* next_batch; ///< Queue link (under lock)
+    bool queued;                   ///< Still in the queue (under lock)
+} pool_batch;
+
+struct rt_pool {
+    pthread_t* threads;      ///< Worker threads
+    unsigned int n_threads;  ///< Worker count
+    pthread_mutex_t lock;    ///< Protects everything below
+    pthread_cond_t work;     ///< Signaled when a batch is queued or on stop
+    pthread_cond_t idle;     ///< Signaled when a worker leaves a batch
+    pool_batch* head;        ///< Batch queue
+    bool stop;               ///< Set by pool_free()
+};
+
+/// Context of one worker thread
+typedef struct {
+    rt_pool* pool;
+    unsigned int id;
+} pool_worker;
+
+/// Removes the batch from the queue. Must hold the lock.
+static void pool_unqueue(rt_pool* pool, pool_batch* b) {
+    if (!b->queued) {
+        return;
+    }
+    pool_batch** p = &pool->head;
+    while (*p != b) {
+        p = &(*p)->next_batch;
+    }
+    *p = b->next_batch;
+    b->queued = false;
+}
+
+/// Runs items of the batch until they run out
+static void pool_batch_work(pool_batch* b, unsigned int worker) {
+    size_t i;
+    while ((i = atomic_fetch_add(&b->next, 1)) < b->count) {
+        b->fn(b->arg, i, worker);
+    }
+}
+
+static void* pool_worker_main(void* arg) {
+    pool_worker* w = (pool_worker*)arg;
+    rt_pool* pool = w->pool;
+    pool_batch* b;
+    char name[32];
+
+    snprintf(name, sizeof(name), "worker %u", w->id);
+    prof_thread_name(name);
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->head == NULL) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        b = pool->head;
+        b->users++;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool_batch_work(b, w->id);
+
+        pthread_mutex_lock(&pool->lock);
+        // Nothing left to hand out, don't let anyone else pick it up
+        pool_unqueue(pool, b);
+        b->users--;
+        if (b->users == 0) {
+            pthread_cond_broadcast(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    rt_free(w);
+    return NULL;
+}
+
+unsigned int pool_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned int)n : 1;
+}
+
+rt_pool* pool_new(unsigned int threads) {
+    rt_pool* pool = rt_malloc(MEM_SCHED, sizeof(rt_pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    if (threads == 0) {
+        threads = pool_cpu_count();
+    }
+
+    pool->n_threads = 0;
+    pool->threads = rt_malloc(MEM_SCHED, sizeof(pthread_t) * threads);
+    pool->head = NULL;
+    pool->stop = false;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    // The caller of pool_run() is the last thread
+    for (unsigned int i = 0; i + 1 < threads; i++) {
+        pool_worker* w = rt_malloc(MEM_SCHED, sizeof(pool_worker));
+        w->pool = pool;
+        w->id = i;
+        if (pthread_create(&pool->threads[i], NULL, &pool_worker_main, w) !=
+            0) {
+            // Run with the workers we got
+            rt_free(w);
+            break;
+        }
+        pool->n_threads++;
+    }
+    return pool;
+}
+
+void pool_free(rt_pool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned int i = 0; i < pool->n_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->idle);
+    rt_free(pool->threads);
+    rt_free(pool);
+}
+
+unsigned int pool_slots(const rt_pool* pool) {
+    return pool->n_threads + 1;
+}
+
+void pool_run(rt_pool* pool, size_t count, pool_fn fn, void* arg) {
+    pool_batch b;
+    pool_batch** tail;
+
+    if (count == 0) {
+        return;
+    }
+    // Nobody to share with
+    if (pool->n_threads == 0 || count == 1) {
+        for (size_t i = 0; i < count; i++) {
+            fn(arg, i, pool->n_threads);
+        }
+        return;
+    }
+
+    b.fn = fn;
+    b.arg = arg;
+    b.count = count;
+    atomic_init(&b.next, 0);
+    b.users = 0;
+    b.next_batch = NULL;
+    b.queued = true;
+
+    pthread_mutex_lock(&pool->lock);
+    tail = &pool->head;
+    while (*tail != NULL) {
+        tail = &(*tail)->next_batch;
+    }
+    *tail = &b;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    pool_batch_work(&b, pool->n_threads);
+
+    // All items are handed out, wait for the workers still running them
+    PROF_BEGIN(span);
+    pthread_mutex_lock(&pool->lock);
+    pool_unqueue(pool, &b);
+    while (b.users != 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    PROF_END(span, "pool wait", -1);
+}
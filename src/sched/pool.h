@@ -0,0 +1,44 @@
+#ifndef RAY_TRACE_POOL_H
+#define RAY_TRACE_POOL_H
+
+#include <stddef.h>
+
+/// Work function of a pool batch.
+///
+/// @param arg Batch argument given to pool_run()
+/// @param index Item index, in [0, count)
+/// @param worker Id of the thread running the item, in [0, pool_slots())
+typedef void (*pool_fn)(void* arg, size_t index, unsigned int worker);
+
+/** Fixed size thread pool.
+ *
+ * Work is handed out as batches of indexed items. The thread calling
+ * pool_run() helps with its own batch, so a pool with N threads has N - 1
+ * workers. Several threads may call pool_run() on the same pool at once, the
+ * batches are then worked on in the order they were started.
+ */
+typedef struct rt_pool rt_pool;
+
+/** Creates a new pool.
+ *
+ * @param threads Total thread count including the calling thread, 0 means one
+ * per online CPU.
+ * @return NULL if the pool couldn't be created
+ */
+rt_pool* pool_new(unsigned int threads);
+
+/// Stops and frees the pool. No batches may be running.
+void pool_free(rt_pool* pool);
+
+/** Amount of distinct worker ids handed to pool_fn, for sizing per worker
+ * scratch data. The caller of pool_run() uses the last one.
+ */
+unsigned int pool_slots(const rt_pool* pool);
+
+/// Runs fn for every index in [0, count) and returns once all are done.
+void pool_run(rt_pool* pool, size_t count, pool_fn fn, void* arg);
+
+/// Online CPU count
+unsigned int pool_cpu_count(void);
+
+#endif
@@ -0,0 +1,220 @@
+#include "envmap.h"
+#include <include/alloc.h>
+#include <include/util.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Luminance of linear RGB (Rec. 709)
+static inline double env_luminance(color c) {
+    return 0.2126 * c.r + 0.7152 * c.g + 0.0722 * c.b;
+}
+
+/// Polar angle at the center of row \b y
+static inline double env_row_theta(const env_map* env, unsigned int y) {
+    return M_PI * (y + 0.5) / env->h;
+}
+
+bool env_map_init(env_map* env, const color* texels, unsigned int w,
+                  unsigned int h) {
+    size_t n = (size_t)w * h;
+    env->w = w;
+    env->h = h;
+    env->texels = rt_malloc(MEM_TEXTURE, sizeof(color) * n);
+    env->row_cdf = rt_malloc(MEM_TEXTURE, sizeof(float) * (h + 1));
+    env->col_cdf = rt_malloc(MEM_TEXTURE, sizeof(float) * (w + 1) * h);
+    double* rows = rt_malloc(MEM_TEXTURE, sizeof(double) * h);
+    if (env->texels == NULL || env->row_cdf == NULL || env->col_cdf == NULL ||
+        rows == NULL) {
+        env_map_free(env);
+        rt_free(rows);
+        return false;
+    }
+    memcpy(env->texels, texels, sizeof(color) * n);
+
+    // Weights are summed in double, the CDFs only have to be monotonic
+    double total = 0.0, mean[3] = {0.0, 0.0, 0.0}, area = 0.0;
+    for (unsigned int y = 0; y < h; y++) {
+        double s = sin(env_row_theta(env, y)), row = 0.0;
+        float* cdf = &env->col_cdf[(size_t)y * (w + 1)];
+        for (unsigned int x = 0; x < w; x++) {
+            color c = texels[(size_t)y * w + x];
+            double l = env_luminance(c);
+            cdf[x] = (float)row;
+            row += l > 0.0 ? l * s : 0.0;
+            mean[0] += c.r * s;
+            mean[1] += c.g * s;
+            mean[2] += c.b * s;
+        }
+        // Rows without weight are never picked, uniform keeps them valid
+        for (unsigned int x = 0; x <= w; x++) {
+            cdf[x] = row > 0.0 ? (x < w ? cdf[x] / row : 1.0f)
+                               : (float)x / w;
+        }
+        rows[y] = row;
+        total += row;
+        area += s * w;
+    }
+    double acc = 0.0;
+    for (unsigned int y = 0; y < h; y++) {
+        env->row_cdf[y] = total > 0.0 ? (float)(acc / total) : (float)y / h;
+        acc += rows[y];
+    }
+    env->row_cdf[h] = 1.0f;
+    rt_free(rows);
+
+    env->weight = total;
+    color m = {mean[0] / area, mean[1] / area, mean[2] / area};
+    env->mean = m;
+    return true;
+}
+
+/// Reads one 4 byte float of a PFM file
+static bool env_read_float(FILE* f, bool little, float* v) {
+    unsigned char b[4];
+    if (fread(b, 1, 4, f) != 4) {
+        return false;
+    }
+    uint32_t bits = little ? (uint32_t)b[0] | (uint32_t)b[1] << 8 |
+                                 (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24
+                           : (uint32_t)b[3] | (uint32_t)b[2] << 8 |
+                                 (uint32_t)b[1] << 16 | (uint32_t)b[0] << 24;
+    memcpy(v, &bits, sizeof(*v));
+    return true;
+}
+
+RT_RES env_map_load(env_map* env, const char* path) {
+    unsigned int w, h;
+    double scale;
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        RETURN_ERR(FILE_ERROR);
+    }
+    // One whitespace character separates the header from the data
+    if (fscanf(f, "PF %u %u %lf", &w, &h, &scale) != 3 || w == 0 || h == 0 ||
+        scale == 0.0 || fgetc(f) == EOF) {
+        fclose(f);
+        RETURN_ERR(PARSE_ERROR);
+    }
+    color* texels = rt_malloc(MEM_TEXTURE, sizeof(color) * w * h);
+    if (texels == NULL) {
+        fclose(f);
+        RETURN_ERR(OUT_OF_MEMORY);
+    }
+    bool ok = true;
+    // Rows are stored bottom to top, a negative scale means little endian
+    for (unsigned int y = h; y-- > 0 && ok;) {
+        for (unsigned int x = 0; x < w && ok; x++) {
+            float c[3];
+            for (int k = 0; k < 3 && ok; k++) {
+                ok = env_read_float(f, scale < 0.0, &c[k]);
+                c[k] = isfinite(c[k]) && c[k] > 0.0f ? c[k] : 0.0f;
+            }
+            color t = {c[0], c[1], c[2]};
+            texels[(size_t)y * w + x] = t;
+        }
+    }
+    fclose(f);
+    if (!ok) {
+        rt_free(texels);
+        RETURN_ERR(PARSE_ERROR);
+    }
+    // Loaded into a copy, a failed init leaves \b env untouched
+    env_map loaded;
+    ok = env_map_init(&loaded, texels, w, h);
+    rt_free(texels);
+    if (!ok) {
+        RETURN_ERR(OUT_OF_MEMORY);
+    }
+    *env = loaded;
+    RETURN_NOERROR;
+}
+
+void env_map_free(env_map* env) {
+    rt_free(env->texels);
+    rt_free(env->row_cdf);
+    rt_free(env->col_cdf);
+    env->texels = NULL;
+    env->row_cdf = NULL;
+    env->col_cdf = NULL;
+}
+
+/// Texel of direction \b dir, with the sine of its polar angle in \b sin_t
+static size_t env_texel(const env_map* env, vector3 dir, RT_FLOAT* sin_t) {
+    RT_FLOAT phi = atan2(dir.i, dir.k);
+    if (phi < 0.0) {
+        phi += 2.0 * M_PI;
+    }
+    RT_FLOAT cos_t = dir.j > 1.0 ? 1.0 : (dir.j < -1.0 ? -1.0 : dir.j);
+    RT_FLOAT theta = acos(cos_t);
+    unsigned int x = (unsigned int)(phi / (2.0 * M_PI) * env->w);
+    unsigned int y = (unsigned int)(theta / M_PI * env->h);
+    x = x < env->w ? x : env->w - 1;
+    y = y < env->h ? y : env->h - 1;
+    *sin_t = sin(theta);
+    return (size_t)y * env->w + x;
+}
+
+color env_map_radiance(const env_map* env, vector3 dir) {
+    RT_FLOAT sin_t;
+    return env->texels[env_texel(env, dir, &sin_t)];
+}
+
+/// Density per solid angle of texel \b i picked at polar angle sine \b sin_t
+static RT_FLOAT env_texel_pdf(const env_map* env, size_t i, RT_FLOAT sin_t) {
+    unsigned int y = i / env->w;
+    if (env->weight <= 0.0 || sin_t <= 0.0) {
+        return 0.0;
+    }
+    double l = env_luminance(env->texels[i]);
+    double p = (l > 0.0 ? l * sin(env_row_theta(env, y)) : 0.0) / env->weight;
+    // Uniform inside the texel over the unit square of (phi, theta)
+    return p * env->w * env->h / (2.0 * M_PI * M_PI * sin_t);
+}
+
+RT_FLOAT env_map_pdf(const env_map* env, vector3 dir) {
+    RT_FLOAT sin_t;
+    size_t i = env_texel(env, dir, &sin_t);
+    return env_texel_pdf(env, i, sin_t);
+}
+
+/// Last index i of \b cdf[0, n) with cdf[i] <= u
+static unsigned int env_search(const float* cdf, unsigned int n, float u) {
+    unsigned int lo = 0, hi = n;
+    while (hi - lo > 1) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (cdf[mid] <= u) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+env_sample env_map_sample(const env_map* env, RT_FLOAT u, RT_FLOAT v) {
+    env_sample ret = {vec3(0.0, 1.0, 0.0), {0.0, 0.0, 0.0}, 0.0};
+    if (env->weight <= 0.0) {
+        return ret;
+    }
+    unsigned int y = env_search(env->row_cdf, env->h, u);
+    const float* cdf = &env->col_cdf[(size_t)y * (env->w + 1)];
+    unsigned int x = env_search(cdf, env->w, v);
+    // Where in the texel, from what is left of the two numbers
+    const float* row = &env->row_cdf[y];
+    RT_FLOAT dy = (u - row[0]) / (row[1] - row[0]);
+    RT_FLOAT dx = (v - cdf[x]) / (cdf[x + 1] - cdf[x]);
+    dy = dy < 0.0 ? 0.0 : (dy > 1.0 ? 1.0 : dy);
+    dx = dx < 0.0 ? 0.0 : (dx > 1.0 ? 1.0 : dx);
+
+    RT_FLOAT theta = M_PI * (y + dy) / env->h;
+    RT_FLOAT phi = 2.0 * M_PI * (x + dx) / env->w;
+    RT_FLOAT sin_t = sin(theta);
+    ret.dir = vec3(sin_t * sin(phi), cos(theta), sin_t * cos(phi));
+    size_t i = (size_t)y * env->w + x;
+    ret.radiance = env->texels[i];
+    ret.pdf = env_texel_pdf(env, i, sin_t);
+    return ret;
+}
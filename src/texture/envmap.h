@@ -0,0 +1,64 @@
+#ifndef RAY_TRACE_ENVMAP_H
+#define RAY_TRACE_ENVMAP_H
+
+#include "texture.h"
+#include <include/errors.h>
+
+/** Radiance arriving from every direction, the background of rays that hit
+ * nothing.
+ *
+ * An equirectangular float image: the columns go around the y axis starting
+ * at +z towards +x, the top row is +y and the bottom row -y. Texels are
+ * looked up nearest and aren't clamped, so HDR maps keep their range until
+ * shading scales them.
+ *
+ * For importance sampling every texel gets a weight of its luminance times
+ * the solid angle it covers. A marginal CDF over the rows and a conditional
+ * CDF per row turn two uniform numbers into a direction with a density
+ * proportional to that weight, see env_map_sample().
+ */
+typedef struct {
+    unsigned int w;   ///< Width in texels
+    unsigned int h;   ///< Height in texels
+    color* texels;    ///< Radiance, row major from the top
+    float* row_cdf;   ///< CDF over the rows, h + 1 entries
+    float* col_cdf;   ///< CDF over the texels of every row, w + 1 each
+    double weight;    ///< Sum of the texel weights, 0 for a black map
+    color mean;       ///< Mean radiance over the sphere, not clamped
+} env_map;
+
+/// Direction picked by env_map_sample()
+typedef struct {
+    vector3 dir;    ///< Normalized direction
+    color radiance; ///< Radiance from \b dir, not clamped
+    RT_FLOAT pdf;   ///< Density per solid angle, 0 if nothing was picked
+} env_sample;
+
+/** Builds a map from \b w x \b h texels (copied) and its sampling tables
+ *
+ * @return false if out of memory, nothing is left allocated
+ */
+bool env_map_init(env_map* env, const color* texels, unsigned int w,
+                  unsigned int h);
+
+/** Loads a map from a PFM file (PF, 3 channels, either byte order).
+ *
+ * @return FILE_ERROR if the file can't be read, PARSE_ERROR if it isn't an
+ * RGB PFM, OUT_OF_MEMORY if the map doesn't fit. \b env is untouched then.
+ */
+RT_RES env_map_load(env_map* env, const char* path);
+
+/// Frees the texels and tables of the map
+void env_map_free(env_map* env);
+
+/// Radiance arriving from direction \b dir (normalized), not clamped
+color env_map_radiance(const env_map* env, vector3 dir);
+
+/// Density with which env_map_sample() picks the normalized \b dir
+RT_FLOAT env_map_pdf(const env_map* env, vector3 dir);
+
+/// Picks a direction with a density proportional to the texel weights from
+/// two uniform numbers in [0, 1)
+env_sample env_map_sample(const env_map* env, RT_FLOAT u, RT_FLOAT v);
+
+#endif
@@ -1,6 +1,8 @@
 #include <include/texture.h>
+#include <include/alloc.h>
 #include <include/util.h>
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 
 color color_new(COLOR_TYPE r, COLOR_TYPE g, COLOR_TYPE b) {
@@ -52,7 +54,7 @@ color color_black() {
 }
 
 color texture_single_impl(const void* const impl, const ray r,
-                          const vector3 norm) {
+                          const vector3 norm, const tex_hit* const hit) {
     ray_texture_single_color* impl_data = (ray_texture_single_color*)impl;
     return impl_data->col;
 }
@@ -60,10 +62,129 @@ color texture_single_impl(const void* const impl, const ray r,
 ray_texture texture_new_single_color(color col, RT_FLOAT transparency, RT_FLOAT diffusivity) {
     assert(transparency < 1.0 && transparency > 0.0);
     ray_texture_single_color* tex_impl =
-        (ray_texture_single_color*)malloc(sizeof(ray_texture_single_color));
+        (ray_texture_single_color*)rt_malloc(
+            MEM_TEXTURE, sizeof(ray_texture_single_color));
     tex_impl->col = col;
     ray_texture ret = {(void*)tex_impl, true, transparency, diffusivity,
-                       &texture_single_impl, &free_generic_impl};
+                       &texture_single_impl, &free_rt_impl};
+    return ret;
+}
+
+/// Texel of a level, wrapping around
+static inline color texture_texel(const ray_texture_image* img,
+                                  unsigned int level, long x, long y) {
+    long w = img->w[level], h = img->h[level];
+    x %= w;
+    y %= h;
+    x += x < 0 ? w : 0;
+    y += y < 0 ? h : 0;
+    return img->texels[level][y * w + x];
+}
+
+color texture_image_impl(const void* const impl, const ray r,
+                         const vector3 norm, const tex_hit* const hit) {
+    const ray_texture_image* img = (const ray_texture_image*)impl;
+
+    // Footprint on the surface in level 0 texels
+    RT_FLOAT cos_t = fabs(vec_dot(r.path, norm));
+    RT_FLOAT width = hit->width / (cos_t > TEX_MIN_COS ? cos_t : TEX_MIN_COS);
+    RT_FLOAT texels = width * img->w[0] / img->size;
+    unsigned int level = 0;
+    if (texels > 1.0) {
+        RT_FLOAT l = log2(texels);
+        level = l >= img->levels - 1 ? img->levels - 1 : (unsigned int)l;
+    }
+
+    // Bilinear inside the level, texel centers are at + 0.5
+    RT_FLOAT u = hit->point.i / img->size * img->w[level] - 0.5;
+    RT_FLOAT v = hit->point.k / img->size * img->h[level] - 0.5;
+    RT_FLOAT x0 = floor(u), y0 = floor(v);
+    RT_FLOAT fx = u - x0, fy = v - y0;
+    color c00 = texture_texel(img, level, x0, y0);
+    color c10 = texture_texel(img, level, x0 + 1, y0);
+    color c01 = texture_texel(img, level, x0, y0 + 1);
+    color c11 = texture_texel(img, level, x0 + 1, y0 + 1);
+    color ret = {
+        (c00.r * (1 - fx) + c10.r * fx) * (1 - fy) +
+            (c01.r * (1 - fx) + c11.r * fx) * fy,
+        (c00.g * (1 - fx) + c10.g * fx) * (1 - fy) +
+            (c01.g * (1 - fx) + c11.g * fx) * fy,
+        (c00.b * (1 - fx) + c10.b * fx) * (1 - fy) +
+            (c01.b * (1 - fx) + c11.b * fx) * fy,
+    };
+    return ret;
+}
+
+/// Frees an image texture with its levels
+static void texture_image_free(void* impl) {
+    ray_texture_image* img = (ray_texture_image*)impl;
+    for (unsigned int l = 0; l < img->levels; l++) {
+        rt_free(img->texels[l]);
+    }
+    rt_free(img);
+}
+
+ray_texture texture_new_image(const color* texels, unsigned int w,
+                              unsigned int h, RT_FLOAT size,
+                              RT_FLOAT reflectivity, RT_FLOAT diffusivity) {
+    assert(reflectivity < 1.0 && reflectivity > 0.0);
+    assert(w > 0 && h > 0);
+    ray_texture_image* img =
+        rt_malloc(MEM_TEXTURE, sizeof(ray_texture_image));
+    img->size = size;
+    img->levels = 1;
+    img->w[0] = w;
+    img->h[0] = h;
+    img->texels[0] = rt_malloc(MEM_TEXTURE, sizeof(color) * w * h);
+    for (size_t i = 0; i < (size_t)w * h; i++) {
+        img->texels[0][i] = texels[i];
+    }
+
+    // Box filter 2x2 blocks until a level is a single texel wide or high,
+    // odd edges reuse the last row or column
+    while (img->levels < TEX_MAX_LEVELS &&
+           (img->w[img->levels - 1] > 1 || img->h[img->levels - 1] > 1)) {
+        unsigned int l = img->levels;
+        unsigned int pw = img->w[l - 1], ph = img->h[l - 1];
+        unsigned int lw = pw > 1 ? pw / 2 : 1, lh = ph > 1 ? ph / 2 : 1;
+        const color* src = img->texels[l - 1];
+        color* dst = rt_malloc(MEM_TEXTURE, sizeof(color) * lw * lh);
+        for (unsigned int y = 0; y < lh; y++) {
+            for (unsigned int x = 0; x < lw; x++) {
+                unsigned int x1 = 2 * x + 1 < pw ? 2 * x + 1 : pw - 1;
+                unsigned int y1 = 2 * y + 1 < ph ? 2 * y + 1 : ph - 1;
+                color a = src[2 * y * pw + 2 * x], b = src[2 * y * pw + x1];
+                color c = src[y1 * pw + 2 * x], d = src[y1 * pw + x1];
+                color m = {(a.r + b.r + c.r + d.r) * 0.25f,
+                           (a.g + b.g + c.g + d.g) * 0.25f,
+                           (a.b + b.b + c.b + d.b) * 0.25f};
+                dst[y * lw + x] = m;
+            }
+        }
+        img->w[l] = lw;
+        img->h[l] = lh;
+        img->texels[l] = dst;
+        img->levels++;
+    }
+
+    ray_texture ret = {(void*)img, true, reflectivity, diffusivity,
+                       &texture_image_impl, &texture_image_free};
+    return ret;
+}
+
+ray_texture texture_new_checker(color a, color b, unsigned int squares,
+                                RT_FLOAT size, RT_FLOAT reflectivity,
+                                RT_FLOAT diffusivity) {
+    unsigned int w = squares * 8;
+    color* texels = rt_malloc(MEM_TEXTURE, sizeof(color) * w * w);
+    for (unsigned int y = 0; y < w; y++) {
+        for (unsigned int x = 0; x < w; x++) {
+            texels[y * w + x] = ((x / 8 + y / 8) & 1) ? b : a;
+        }
+    }
+    ray_texture ret =
+        texture_new_image(texels, w, w, size, reflectivity, diffusivity);
+    rt_free(texels);
     return ret;
 }
 
@@ -36,6 +36,12 @@ color color_white();
 /// Black color (all \b COLOR_MIN)
 color color_black();
 
+/// Where a ray hit a surface, for texture lookups
+typedef struct {
+    vector3 point;  ///< Hit point
+    RT_FLOAT width; ///< Ray cone width at the hit, 0 for a plain ray
+} tex_hit;
+
 /** Struct that describes how to acquire color and stores the colors in a
  * vector if needed.
  *
@@ -58,10 +64,12 @@ typedef struct ray_texture {
      * @param impl Texture implementation
      * @param r Ray
      * @param norm Surface normal at the point of interaction
+     * @param hit Hit point and ray footprint there
      *
      * @return Color value
      */
-    color (*refl)(const void* const impl, const ray r, const vector3 norm);
+    color (*refl)(const void* const impl, const ray r, const vector3 norm,
+                  const tex_hit* const hit);
     void (*impl_free)(
         void* impl); ///< Free the impl object (called from rttex_free())
 } ray_texture;
@@ -73,12 +81,49 @@ typedef struct {
 } ray_texture_single_color;
 
 color texture_single_impl(const void* const impl, const ray r,
-                          const vector3 norm);
+                          const vector3 norm, const tex_hit* const hit);
 
 /// Initialize a new empty texture struct with the given color
 ray_texture texture_new_single_color(color col, RT_FLOAT reflectivity,
                                      RT_FLOAT diffusivity);
 
+/// Most mip levels of an image texture
+#define TEX_MAX_LEVELS 16
+/// Smallest cosine a footprint is stretched by at grazing angles
+#define TEX_MIN_COS 0.05
+
+/** Mipmapped image, projected along y (onto the xz plane) and repeated.
+ *
+ * The level is picked from the ray cone width at the hit, stretched by the
+ * angle to the surface, so a far away or grazing hit reads a small
+ * prefiltered level instead of a few random texels of the full image.
+ *
+ * @see texture_image_impl implementation function
+ */
+typedef struct {
+    unsigned int levels;               ///< Mip levels, 0 is the full image
+    unsigned int w[TEX_MAX_LEVELS];    ///< Width of each level
+    unsigned int h[TEX_MAX_LEVELS];    ///< Height of each level
+    color* texels[TEX_MAX_LEVELS];     ///< Row major texels of each level
+    RT_FLOAT size;                     ///< World size of one repeat
+} ray_texture_image;
+
+color texture_image_impl(const void* const impl, const ray r,
+                         const vector3 norm, const tex_hit* const hit);
+
+/** Image texture from row major texels, which are copied.
+ *
+ * @param size World size of one repeat of the image along x and z
+ */
+ray_texture texture_new_image(const color* texels, unsigned int w,
+                              unsigned int h, RT_FLOAT size,
+                              RT_FLOAT reflectivity, RT_FLOAT diffusivity);
+
+/// Image texture of \b squares x \b squares checkers, 8 texels each
+ray_texture texture_new_checker(color a, color b, unsigned int squares,
+                                RT_FLOAT size, RT_FLOAT reflectivity,
+                                RT_FLOAT diffusivity);
+
 /// Free the texture struct given.
 void texture_free(ray_texture* tex);
 
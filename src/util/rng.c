@@ -0,0 +1,43 @@
+#include "rng.h"
+
+/// Default seed of every thread generator
+#define RNG_DEF_SEED 0x853c49e6748fea9bULL
+
+static _Thread_local rt_rng rng_tls;
+static _Thread_local int rng_tls_init = 0;
+
+uint32_t rng_next_u32(rt_rng* rng) {
+    uint64_t old = rng->state;
+    rng->state = old * 6364136223846793005ULL + rng->inc;
+    uint32_t xorshifted = ((old >> 18u) ^ old) >> 27u;
+    uint32_t rot = old >> 59u;
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+void rng_seed(rt_rng* rng, uint64_t seed, uint64_t stream) {
+    rng->state = 0u;
+    rng->inc = (stream << 1u) | 1u;
+    rng_next_u32(rng);
+    rng->state += seed;
+    rng_next_u32(rng);
+}
+
+float rng_next_float(rt_rng* rng) {
+    // Top 24 bits, exactly representable so the result is never 1.0
+    return (rng_next_u32(rng) >> 8) * (1.0f / 16777216.0f);
+}
+
+rt_rng* rng_thread(void) {
+    if (!rng_tls_init) {
+        rng_seed(&rng_tls, RNG_DEF_SEED, 0);
+        rng_tls_init = 1;
+    }
+    return &rng_tls;
+}
+
+uint64_t rng_hash(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
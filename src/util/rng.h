@@ -0,0 +1,37 @@
+#ifndef RAY_TRACE_RNG_H
+#define RAY_TRACE_RNG_H
+
+#include <stdint.h>
+
+/** Small PCG32 random number generator.
+ *
+ * Unlike rand() the whole state is in this struct, so separate renders (or
+ * threads) never share a sequence.
+ */
+typedef struct {
+    uint64_t state; ///< Internal state
+    uint64_t inc;   ///< Stream selector, always odd
+} rt_rng;
+
+/// Seeds the generator. Different \b stream values give independent sequences
+/// for the same seed.
+void rng_seed(rt_rng* rng, uint64_t seed, uint64_t stream);
+
+/// Next 32 random bits
+uint32_t rng_next_u32(rt_rng* rng);
+
+/// Uniform float in [0, 1)
+float rng_next_float(rt_rng* rng);
+
+/** Generator of the calling thread.
+ *
+ * Everything that needs randomness while tracing (e.g. vec_rand()) uses this
+ * one. Every thread starts with the same fixed seed, renderers reseed it with
+ * rng_seed() when they want a particular sequence.
+ */
+rt_rng* rng_thread(void);
+
+/// Mixes a value into a well distributed 64 bit hash (splitmix64 finalizer)
+uint64_t rng_hash(uint64_t x);
+
+#endif
@@ -3,12 +3,32 @@
 
 #include <stddef.h>
 
-/// Float type
+/// Float type, double in PRECISION=double builds (RT_DOUBLE)
+#if RT_DOUBLE
+typedef double RT_FLOAT;
+/// Whether RT_FLOAT is double, for code that has to know in the preprocessor
+#define RT_FLOAT_IS_DOUBLE 1
+#else
 typedef float RT_FLOAT;
+/// Whether RT_FLOAT is double, for code that has to know in the preprocessor
+#define RT_FLOAT_IS_DOUBLE 0
+#endif
 
 /// Matrix index type
 typedef size_t I_MAT;
 
+/// Absolute epsilon for coordinates around unit size
 #define RTFCOMPVAL 0.0001
+/// Relative resolution of RT_FLOAT the epsilons keep clear of, a few dozen
+/// ulp
+#if RT_DOUBLE
+#define RT_EPS_REL 1e-12
+#else
+#define RT_EPS_REL 4e-6
+#endif
+/// Epsilon for coordinates of magnitude \b scale: RTFCOMPVAL, or more far
+/// from the origin where rounding is coarser than that
+#define RT_EPS(scale)                                                        \
+    ((scale) * RT_EPS_REL > RTFCOMPVAL ? (scale) * RT_EPS_REL : RTFCOMPVAL)
 
 #endif
@@ -1,5 +1,7 @@
 #include "util.h"
+#include <include/alloc.h>
 #include <stdlib.h>
+#include <time.h>
 
 void no_free_func(void* impl) {
     return;
@@ -8,3 +10,13 @@ void no_free_func(void* impl) {
 void free_generic_impl(void* ptr) {
     free(ptr);
 }
+
+void free_rt_impl(void* ptr) {
+    rt_free(ptr);
+}
+
+double util_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
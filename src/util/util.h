@@ -2,5 +2,11 @@
 #define RAY_TRACE_UTIL_H
 
 void no_free_func(void* impl);
+/// Frees an impl allocated with malloc(), for impls the caller made
 void free_generic_impl(void* impl);
+/// Frees an impl allocated with rt_malloc(), for impls the library made
+void free_rt_impl(void* impl);
+
+/// Monotonic wall clock time in seconds, only meant for differences
+double util_seconds(void);
 #endif // !RAY_TRACE_UTIL_H
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Speed against image error of every PRECISION build profile (see Makefile).
+#
+# Builds perf/perftest once per profile, each in its own copy of the tree so
+# the working tree keeps its objects, then renders the perftest scenes with
+# all of them. The double images are the reference and the double
+# throughput the baseline, so "change" is the speedup over double and "PSNR"
+# the error against it.
+#
+# Usage: tools/precision_report.sh [work dir]
+
+set -e
+
+work=${1:-/tmp/rt_precision}
+modes="double float fast"
+root=$(cd "$(dirname "$0")/.." && pwd)
+
+rm -rf "$work"
+mkdir -p "$work/ref/golden"
+for mode in $modes; do
+    mkdir -p "$work/$mode"
+    cp -R "$root/src" "$root/perf" "$root/Makefile" "$work/$mode/"
+    make -s -C "$work/$mode" clean
+    make -s -C "$work/$mode" PRECISION="$mode" perf/perftest >/dev/null
+done
+
+"$work/double/perf/perftest" -d "$work/ref" -g -b >/dev/null
+for mode in $modes; do
+    echo "== PRECISION=$mode"
+    # Never fails on speed or error, this is a report
+    "$work/$mode/perf/perftest" -d "$work/ref" -t 100 -p 0 |
+        grep -v '^perftest:'
+done
@@ -0,0 +1,142 @@
+// Sends one request to rt_daemon and prints the reply.
+//
+// Usage: rt_client [-s socket] [-o image] [-n repeat] <request words...>
+// e.g. rt_client -o preview.ppm render scene=res/demo.scene w=160 h=90
+// An inline image is written to -o, or dropped without it. With -n the
+// request is sent that many times over the same connection and the round
+// trip times are printed.
+
+#include <include/util.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define CLIENT_SOCKET "/tmp/ray_trace.sock"
+
+/// Reads one reply line into buf, false on EOF
+static bool client_line(int fd, char* buf, size_t size) {
+    size_t n = 0;
+    while (n + 1 < size) {
+        ssize_t got = read(fd, buf + n, 1);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        if (buf[n] == '\n') {
+            break;
+        }
+        n++;
+    }
+    buf[n] = '\0';
+    return true;
+}
+
+/// Reads \b size bytes of image data and writes them to \b f (may be NULL)
+static bool client_data(int fd, size_t size, FILE* f) {
+    char buf[65536];
+    while (size > 0) {
+        ssize_t got = read(fd, buf, size < sizeof(buf) ? size : sizeof(buf));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        if (f != NULL) {
+            fwrite(buf, 1, got, f);
+        }
+        size -= got;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* path = CLIENT_SOCKET;
+    const char* image = NULL;
+    int repeat = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "+s:o:n:")) != -1) {
+        switch (opt) {
+        case 's':
+            path = optarg;
+            break;
+        case 'o':
+            image = optarg;
+            break;
+        case 'n':
+            repeat = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+        default:
+            return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr,
+                "usage: %s [-s socket] [-o image] [-n repeat] request...\n",
+                argv[0]);
+        return 2;
+    }
+
+    char req[4096];
+    size_t len = 0;
+    for (int i = optind; i < argc; i++) {
+        len += snprintf(req + len, sizeof(req) - len, "%s%s",
+                        i > optind ? " " : "", argv[i]);
+        if (len >= sizeof(req) - 1) {
+            fprintf(stderr, "request too long\n");
+            return 2;
+        }
+    }
+    req[len++] = '\n';
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("rt_client");
+        return 1;
+    }
+
+    int status = 0;
+    for (int r = 0; r < repeat && status == 0; r++) {
+        char reply[1024];
+        double start = util_seconds();
+        if (write(fd, req, len) != (ssize_t)len ||
+            !client_line(fd, reply, sizeof(reply))) {
+            fprintf(stderr, "connection lost\n");
+            return 1;
+        }
+        size_t size;
+        char* inline_at = strstr(reply, " inline ");
+        if (strncmp(reply, "ok", 2) == 0 && inline_at != NULL &&
+            sscanf(inline_at, " inline %zu", &size) == 1) {
+            FILE* f = image != NULL && r == repeat - 1 ? fopen(image, "wb")
+                                                       : NULL;
+            bool ok = client_data(fd, size, f);
+            if (f != NULL) {
+                fclose(f);
+            }
+            if (!ok) {
+                fprintf(stderr, "connection lost\n");
+                return 1;
+            }
+        }
+        printf("%s (round trip %.3f ms)\n", reply,
+               (util_seconds() - start) * 1000.0);
+        status = strncmp(reply, "ok", 2) == 0 ? 0 : 1;
+    }
+    close(fd);
+    return status;
+}
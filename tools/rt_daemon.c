@@ -0,0 +1,650 @@
+// Render daemon: keeps a thread pool and recently used scenes (with their
+// acceleration structures) warm, and renders jobs sent over a Unix domain
+// socket.
+//
+// Usage: rt_daemon [-s socket] [-t threads] [-c cached scenes] [-T trace]
+//
+// Requests are single lines, one connection may send any number of them:
+//   render scene=<file> [w=] [h=] [fov=] [pos=x,y,z] [max_refl=] [spp=]
+//          [sampler=none|random|stratified|sobol|blue] [seed=] [cones=0|1]
+//          [adaptive=<tolerance>] [budget=<ms>] [out=<file>]
+//   stats
+//   quit
+// Replies are a line "ok ..." or "err <message>". A render with out= writes
+// a P6 file (PNG or QOI if the name ends in .png or .qoi) and replies
+// "ok <ms> <hit|miss> <file>", without it replies
+// "ok <ms> <hit|miss> inline <bytes>" followed by the P6 image itself. With
+// budget= the frame is rendered by rt_context_render_budget() and the reply
+// ends with "dropped=<levels>" (e.g. "dropped=spp,res" or "dropped=none").
+//
+// With -T the daemon records a timeline of every request, tile and write
+// and saves it as Chrome trace JSON on exit (see src/prof/prof.h).
+//
+// Scenes are cached by the FNV-1a hash of their content (see scene_parse()),
+// so an edited file is loaded again while renaming one costs nothing.
+//
+// Every connection is served on its own thread and renders share the pool,
+// so a preview doesn't wait for a long render of another scene. Two renders
+// of the same cached scene take turns, it has one framebuffer. Scenes are
+// parsed without holding the cache lock. A connection that sends nothing or
+// doesn't read its reply for DAEMON_IDLE seconds is closed.
+
+#include <include/prof.h>
+#include <include/render.h>
+#include <include/scene.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define DAEMON_SOCKET "/tmp/ray_trace.sock"
+#define DAEMON_CACHE 8
+/// Longest request line
+#define DAEMON_LINE 4096
+/// Seconds a connection may stay silent or leave its reply unread
+#define DAEMON_IDLE 30
+
+/// Cached scene
+typedef struct {
+    uint64_t hash;    ///< Content hash of the scene file
+    rt_context* ctx;  ///< Context holding the scene, NULL if the slot is free
+    uint64_t used;    ///< Request counter at the last use, for LRU
+    unsigned int users;     ///< Requests holding the slot, never evicted then
+    pthread_mutex_t render; ///< Held while a request uses \b ctx
+} daemon_entry;
+
+/// Scene being parsed by a request, other requests for it wait
+typedef struct daemon_load {
+    uint64_t hash;            ///< Content hash of the scene
+    struct daemon_load* next; ///< Next load in progress
+} daemon_load;
+
+typedef struct {
+    rt_pool* pool;          ///< Shared by every cached context
+    daemon_entry* cache;    ///< Cached scenes
+    unsigned int cache_cap; ///< Slots in the cache
+    uint64_t requests;      ///< Requests served
+    uint64_t hits;          ///< Renders that found their scene cached
+    pthread_mutex_t lock;   ///< Guards the cache slots and the counters
+    pthread_cond_t idle;    ///< Signaled when a connection closes
+    daemon_load* loads;     ///< Scenes being parsed, without the lock
+    pthread_cond_t loaded;  ///< Broadcast when a load ends
+    unsigned int clients;   ///< Open connections
+    int sock;               ///< Listening socket
+} daemon_state;
+
+/// Connection handed to its thread
+typedef struct {
+    daemon_state* st;
+    int fd;
+} daemon_conn;
+
+static volatile sig_atomic_t daemon_stop = 0;
+
+static void daemon_signal(int sig) {
+    daemon_stop = 1;
+}
+
+/// Writes the whole buffer, false if the client went away
+static bool daemon_send(int fd, const void* data, size_t size) {
+    const char* p = data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        // A timeout (EAGAIN) means the client stopped reading
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool daemon_reply(int fd, const char* msg) {
+    return daemon_send(fd, msg, strlen(msg));
+}
+
+/// Whether \b path ends in \b ext
+static bool daemon_ext(const char* path, const char* ext) {
+    size_t n = strlen(path), e = strlen(ext);
+    return n >= e && strcmp(path + n - e, ext) == 0;
+}
+
+/// Framebuffer as a binary P6 image
+static unsigned char* daemon_p6(const display* disp, size_t* size) {
+    char header[64];
+    int hl = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", disp->d_w,
+                      disp->d_h);
+    size_t pixels = (size_t)disp->d_w * disp->d_h;
+    unsigned char* ret = malloc(hl + pixels * 3);
+    memcpy(ret, header, hl);
+    for (size_t i = 0; i < pixels; i++) {
+        color c = disp->color_buffer[i];
+        ret[hl + i * 3] = (unsigned char)(c.r * 255.999);
+        ret[hl + i * 3 + 1] = (unsigned char)(c.g * 255.999);
+        ret[hl + i * 3 + 2] = (unsigned char)(c.b * 255.999);
+    }
+    *size = hl + pixels * 3;
+    return ret;
+}
+
+/** Finds the cached slot of a scene text or loads it into the least
+ * recently used free slot, and claims it (see daemon_release()).
+ *
+ * The scene is parsed without the cache lock, so a big upload doesn't hold
+ * up requests for cached scenes. Requests for a scene that is being loaded
+ * wait for it instead of parsing it again. A slot is only evicted once the
+ * new scene parsed.
+ *
+ * @return NULL with \b err set if the scene doesn't parse. If every slot is
+ * in use the scene gets a context of its own, returned in \b own with a
+ * NULL slot.
+ */
+static daemon_entry* daemon_scene(daemon_state* st, const char* text,
+                                  size_t len, const rt_config* cfg, bool* hit,
+                                  rt_context** own, char* err,
+                                  size_t err_size) {
+    uint64_t hash = scene_hash(text, len);
+    daemon_load load = {hash, NULL};
+
+    *own = NULL;
+    *hit = false;
+    pthread_mutex_lock(&st->lock);
+    for (;;) {
+        daemon_entry* e = NULL;
+        for (unsigned int i = 0; i < st->cache_cap && e == NULL; i++) {
+            if (st->cache[i].ctx != NULL && st->cache[i].hash == hash) {
+                e = &st->cache[i];
+            }
+        }
+        if (e != NULL) {
+            e->used = st->requests;
+            e->users++;
+            st->hits++;
+            pthread_mutex_unlock(&st->lock);
+            *hit = true;
+            return e;
+        }
+        daemon_load* l = st->loads;
+        while (l != NULL && l->hash != hash) {
+            l = l->next;
+        }
+        if (l == NULL) {
+            break;
+        }
+        pthread_cond_wait(&st->loaded, &st->lock);
+    }
+    load.next = st->loads;
+    st->loads = &load;
+    pthread_mutex_unlock(&st->lock);
+
+    size_t line = 0;
+    rt_context* ctx = rt_context_new(cfg);
+    if (ctx == NULL) {
+        snprintf(err, err_size, "can't create a context");
+    } else if (scene_parse(ctx, text, len, &line).type != ALL_GOOD) {
+        snprintf(err, err_size, "scene line %zu is malformed", line);
+        rt_context_free(ctx);
+        ctx = NULL;
+    }
+
+    daemon_entry* slot = NULL;
+    rt_context* evicted = NULL;
+    pthread_mutex_lock(&st->lock);
+    daemon_load** link = &st->loads;
+    while (*link != &load) {
+        link = &(*link)->next;
+    }
+    *link = load.next;
+    // Waiters look again, and parse themselves if this one failed
+    pthread_cond_broadcast(&st->loaded);
+    for (unsigned int i = 0; i < st->cache_cap && ctx != NULL; i++) {
+        daemon_entry* e = &st->cache[i];
+        if (e->users == 0 &&
+            (slot == NULL || e->ctx == NULL ||
+             (slot->ctx != NULL && e->used < slot->used))) {
+            slot = e;
+        }
+    }
+    if (slot != NULL) {
+        evicted = slot->ctx;
+        slot->hash = hash;
+        slot->ctx = ctx;
+        slot->used = st->requests;
+        slot->users++;
+    }
+    pthread_mutex_unlock(&st->lock);
+
+    if (evicted != NULL) {
+        rt_context_free(evicted);
+    }
+    if (slot == NULL) {
+        *own = ctx;
+    }
+    return slot;
+}
+
+/// Gives back a slot claimed by daemon_scene()
+static void daemon_release(daemon_state* st, daemon_entry* e) {
+    pthread_mutex_lock(&st->lock);
+    e->users--;
+    pthread_mutex_unlock(&st->lock);
+}
+
+/// Parses the key=value words of a render request into the config
+static bool daemon_options(char* args, rt_config* cfg, const char** scene,
+                           const char** out, double* budget, char* err,
+                           size_t err_size) {
+    char* save = NULL;
+    for (char* w = strtok_r(args, " \t", &save); w != NULL;
+         w = strtok_r(NULL, " \t", &save)) {
+        char* v = strchr(w, '=');
+        if (v == NULL) {
+            snprintf(err, err_size, "expected key=value, got %s", w);
+            return false;
+        }
+        *v++ = '\0';
+        if (strcmp(w, "scene") == 0) {
+            *scene = v;
+        } else if (strcmp(w, "out") == 0) {
+            *out = v;
+        } else if (strcmp(w, "w") == 0) {
+            cfg->width = strtoul(v, NULL, 10);
+        } else if (strcmp(w, "h") == 0) {
+            cfg->height = strtoul(v, NULL, 10);
+        } else if (strcmp(w, "fov") == 0) {
+            cfg->fov = strtod(v, NULL);
+        } else if (strcmp(w, "max_refl") == 0) {
+            cfg->max_refl = atoi(v);
+        } else if (strcmp(w, "spp") == 0) {
+            cfg->spp = strtoul(v, NULL, 10);
+        } else if (strcmp(w, "cones") == 0) {
+            cfg->cones = atoi(v) != 0;
+        } else if (strcmp(w, "adaptive") == 0) {
+            cfg->adaptive = strtod(v, NULL);
+        } else if (strcmp(w, "budget") == 0) {
+            *budget = strtod(v, NULL) / 1000.0;
+        } else if (strcmp(w, "seed") == 0) {
+            cfg->seed = strtoull(v, NULL, 10);
+        } else if (strcmp(w, "pos") == 0) {
+            double x, y, z;
+            if (sscanf(v, "%lf,%lf,%lf", &x, &y, &z) != 3) {
+                snprintf(err, err_size, "pos needs x,y,z");
+                return false;
+            }
+            cfg->pos = vec3(x, y, z);
+        } else if (strcmp(w, "sampler") == 0) {
+            bool found = false;
+            for (int k = SAMPLER_NONE; k <= SAMPLER_BLUE; k++) {
+                if (strcmp(v, sampler_name(k)) == 0) {
+                    cfg->sampler = k;
+                    found = true;
+                }
+            }
+            if (!found) {
+                snprintf(err, err_size, "unknown sampler %s", v);
+                return false;
+            }
+        } else {
+            snprintf(err, err_size, "unknown key %s", w);
+            return false;
+        }
+    }
+    if (*scene == NULL) {
+        snprintf(err, err_size, "render needs scene=");
+        return false;
+    }
+    if (cfg->width == 0 || cfg->height == 0 || cfg->width > 16384 ||
+        cfg->height > 16384) {
+        snprintf(err, err_size, "bad image size");
+        return false;
+    }
+    return true;
+}
+
+/// Renders with the scene in \b ctx and replies, false if the client went
+/// away. The caller holds \b ctx.
+static bool daemon_render_ctx(rt_context* ctx, int fd, const rt_config* cfg,
+                              const char* out, double budget, bool hit,
+                              double start) {
+    char msg[512];
+    if (!rt_context_configure(ctx, cfg)) {
+        return daemon_reply(fd, "err can't resize the framebuffer\n");
+    }
+    char dropped[64] = "";
+    if (budget > 0.0) {
+        // What's left of the budget after loading the scene
+        budget_report rep;
+        if (!rt_context_render_budget(
+                ctx, budget - (util_seconds() - start), &rep)) {
+            return daemon_reply(fd, "err can't resize the framebuffer\n");
+        }
+        strcpy(dropped, " dropped=");
+        budget_drop_names(rep.drops, dropped + strlen(dropped),
+                          sizeof(dropped) - strlen(dropped));
+    } else {
+        rt_context_render(ctx);
+    }
+
+    if (out != NULL) {
+        disp_file file = {out};
+        // Strips are compressed on the render pool, which is idle by now
+        disp_encoder enc = {out, ctx->pool};
+        rt_context_write(ctx, daemon_ext(out, ".png")   ? stream_png(&enc)
+                              : daemon_ext(out, ".qoi") ? stream_qoi(&enc)
+                                                        : stream_p6(&file));
+        if (enc.failed) {
+            snprintf(msg, sizeof(msg), "err can't write %s\n", out);
+            return daemon_reply(fd, msg);
+        }
+        snprintf(msg, sizeof(msg), "ok %.3f %s %s%s\n",
+                 (util_seconds() - start) * 1000.0, hit ? "hit" : "miss",
+                 out, dropped);
+        return daemon_reply(fd, msg);
+    }
+    size_t size;
+    unsigned char* img = daemon_p6(rt_context_display(ctx), &size);
+    snprintf(msg, sizeof(msg), "ok %.3f %s inline %zu%s\n",
+             (util_seconds() - start) * 1000.0, hit ? "hit" : "miss", size,
+             dropped);
+    bool ok = daemon_reply(fd, msg) && daemon_send(fd, img, size);
+    free(img);
+    return ok;
+}
+
+/// Serves a render request, false if the client went away
+static bool daemon_render(daemon_state* st, int fd, char* args) {
+    char msg[512], err[256];
+    const char* scene_path = NULL;
+    const char* out = NULL;
+    double budget = 0.0;
+    double start = util_seconds();
+
+    rt_config cfg = rt_config_default();
+    cfg.width = 320;
+    cfg.height = 180;
+    cfg.pool = st->pool;
+    if (!daemon_options(args, &cfg, &scene_path, &out, &budget, err,
+                        sizeof(err))) {
+        snprintf(msg, sizeof(msg), "err %s\n", err);
+        return daemon_reply(fd, msg);
+    }
+
+    size_t len;
+    char* text = scene_read(scene_path, &len);
+    if (text == NULL) {
+        snprintf(msg, sizeof(msg), "err can't read %s\n", scene_path);
+        return daemon_reply(fd, msg);
+    }
+    bool hit;
+    rt_context* own;
+    daemon_entry* e = daemon_scene(st, text, len, &cfg, &hit, &own, err,
+                                   sizeof(err));
+    rt_free(text);
+    if (e == NULL && own == NULL) {
+        snprintf(msg, sizeof(msg), "err %s\n", err);
+        return daemon_reply(fd, msg);
+    }
+    if (own != NULL) {
+        bool ok = daemon_render_ctx(own, fd, &cfg, out, budget, hit, start);
+        rt_context_free(own);
+        return ok;
+    }
+    pthread_mutex_lock(&e->render);
+    bool ok = daemon_render_ctx(e->ctx, fd, &cfg, out, budget, hit, start);
+    pthread_mutex_unlock(&e->render);
+    daemon_release(st, e);
+    return ok;
+}
+
+/// Serves the requests of one connection until it closes
+static void daemon_client(daemon_state* st, int fd) {
+    char buf[DAEMON_LINE];
+    size_t have = 0;
+    unsigned int idle = 0;
+
+    while (!daemon_stop) {
+        char* nl = memchr(buf, '\n', have);
+        if (nl == NULL) {
+            if (have == sizeof(buf)) {
+                daemon_reply(fd, "err request too long\n");
+                return;
+            }
+            // Reads wake up every second to see daemon_stop
+            ssize_t n = read(fd, buf + have, sizeof(buf) - have);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (++idle >= DAEMON_IDLE) {
+                    daemon_reply(fd, "err idle for too long\n");
+                    return;
+                }
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return;
+            }
+            idle = 0;
+            have += n;
+            continue;
+        }
+
+        *nl = '\0';
+        size_t used = nl - buf + 1;
+        if (nl > buf && nl[-1] == '\r') {
+            nl[-1] = '\0';
+        }
+        pthread_mutex_lock(&st->lock);
+        uint64_t request = ++st->requests;
+        pthread_mutex_unlock(&st->lock);
+        bool ok = true;
+        if (strncmp(buf, "render", 6) == 0 &&
+            (buf[6] == ' ' || buf[6] == '\0')) {
+            PROF_BEGIN(span);
+            ok = daemon_render(st, fd, buf + 6);
+            PROF_END(span, "request", request);
+        } else if (strcmp(buf, "stats") == 0) {
+            char msg[256];
+            unsigned int cached = 0;
+            pthread_mutex_lock(&st->lock);
+            for (unsigned int i = 0; i < st->cache_cap; i++) {
+                cached += st->cache[i].ctx != NULL;
+            }
+            rt_mem_stat mem = rt_mem_total();
+            snprintf(msg, sizeof(msg),
+                     "ok requests %llu hits %llu cached %u clients %u "
+                     "memory %zu\n",
+                     (unsigned long long)st->requests,
+                     (unsigned long long)st->hits, cached, st->clients,
+                     mem.current);
+            pthread_mutex_unlock(&st->lock);
+            ok = daemon_reply(fd, msg);
+        } else if (strcmp(buf, "quit") == 0) {
+            daemon_reply(fd, "ok\n");
+            daemon_stop = 1;
+            // Wakes the accept() of the main thread
+            shutdown(st->sock, SHUT_RDWR);
+        } else if (buf[0] != '\0') {
+            ok = daemon_reply(fd, "err unknown request\n");
+        }
+        if (!ok) {
+            return;
+        }
+        memmove(buf, buf + used, have - used);
+        have -= used;
+    }
+}
+
+/// Thread of one connection
+static void* daemon_conn_main(void* arg) {
+    daemon_conn* conn = arg;
+    daemon_state* st = conn->st;
+    prof_thread_name("client");
+    daemon_client(st, conn->fd);
+    close(conn->fd);
+    free(conn);
+
+    pthread_mutex_lock(&st->lock);
+    st->clients--;
+    pthread_cond_signal(&st->idle);
+    pthread_mutex_unlock(&st->lock);
+    return NULL;
+}
+
+/// Starts the thread of a new connection, closes it if that fails
+static void daemon_accept(daemon_state* st, int fd) {
+    // The reads wake up every second, a reply that isn't read in
+    // DAEMON_IDLE seconds gives up
+    struct timeval rcv = {1, 0}, snd = {DAEMON_IDLE, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &rcv, sizeof(rcv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &snd, sizeof(snd));
+
+    daemon_conn* conn = malloc(sizeof(daemon_conn));
+    conn->st = st;
+    conn->fd = fd;
+    pthread_mutex_lock(&st->lock);
+    st->clients++;
+    pthread_mutex_unlock(&st->lock);
+
+    // Signals go to the main thread, so they interrupt accept()
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    pthread_t t;
+    int res = pthread_create(&t, NULL, &daemon_conn_main, conn);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (res != 0) {
+        daemon_reply(fd, "err too many connections\n");
+        close(fd);
+        free(conn);
+        pthread_mutex_lock(&st->lock);
+        st->clients--;
+        pthread_mutex_unlock(&st->lock);
+        return;
+    }
+    pthread_detach(t);
+}
+
+int main(int argc, char** argv) {
+    const char* path = DAEMON_SOCKET;
+    unsigned int threads = 0;
+    unsigned int cache_cap = DAEMON_CACHE;
+    const char* trace = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:t:c:T:")) != -1) {
+        switch (opt) {
+        case 's':
+            path = optarg;
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'c':
+            cache_cap = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+        case 'T':
+            trace = optarg;
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-s socket] [-t threads] [-c cache] "
+                    "[-T trace]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long\n");
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (sock < 0 || bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(sock, 16) != 0) {
+        perror("rt_daemon");
+        return 1;
+    }
+
+    // No SA_RESTART, so that a signal gets accept() out of its wait
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = &daemon_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    daemon_state st = {pool_new(threads),
+                       calloc(cache_cap, sizeof(daemon_entry)),
+                       cache_cap,
+                       0,
+                       0,
+                       PTHREAD_MUTEX_INITIALIZER,
+                       PTHREAD_COND_INITIALIZER,
+                       NULL,
+                       PTHREAD_COND_INITIALIZER,
+                       0,
+                       sock};
+    for (unsigned int i = 0; i < cache_cap; i++) {
+        pthread_mutex_init(&st.cache[i].render, NULL);
+    }
+    printf("rt_daemon listening on %s, %u threads, %u cached scenes\n", path,
+           pool_slots(st.pool), cache_cap);
+    fflush(stdout);
+    if (trace != NULL) {
+        prof_thread_name("daemon");
+        prof_start(0);
+    }
+
+    while (!daemon_stop) {
+        int fd = accept(sock, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        daemon_accept(&st, fd);
+    }
+
+    close(sock);
+    unlink(path);
+    // Connections see daemon_stop within a second, or once their render is
+    // done
+    pthread_mutex_lock(&st.lock);
+    while (st.clients > 0) {
+        pthread_cond_wait(&st.idle, &st.lock);
+    }
+    pthread_mutex_unlock(&st.lock);
+    if (trace != NULL) {
+        prof_stop();
+        RT_RES res = prof_write(trace);
+        PRINT_ERR(res);
+    }
+    for (unsigned int i = 0; i < cache_cap; i++) {
+        if (st.cache[i].ctx != NULL) {
+            rt_context_free(st.cache[i].ctx);
+        }
+        pthread_mutex_destroy(&st.cache[i].render);
+    }
+    free(st.cache);
+    pool_free(st.pool);
+    return 0;
+}
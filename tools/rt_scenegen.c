@@ -0,0 +1,65 @@
+// Compiles a scene file into C code that traces exactly that scene, see
+// scene_compile().
+//
+// Usage: rt_scenegen [-o out.c] <scene>
+// e.g. make res/demo.scene.so, then scene_compiled_open() and
+// rt_context_set_accel() on a context holding the same scene.
+
+#include <include/render.h>
+#include <include/scene.h>
+
+#include <getopt.h>
+#include <stdio.h>
+
+int main(int argc, char** argv) {
+    const char* out_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:")) != -1) {
+        switch (opt) {
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            return 2;
+        }
+    }
+    if (optind + 1 != argc) {
+        fprintf(stderr, "usage: %s [-o out.c] scene\n", argv[0]);
+        return 2;
+    }
+
+    size_t len, line;
+    char* text = scene_read(argv[optind], &len);
+    if (text == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+    rt_config cfg = rt_config_default();
+    cfg.width = 1;
+    cfg.height = 1;
+    cfg.threads = 1;
+    rt_context* ctx = rt_context_new(&cfg);
+    RT_RES res = scene_parse(ctx, text, len, &line);
+    if (res.type != ALL_GOOD) {
+        fprintf(stderr, "%s:%zu: malformed body\n", argv[optind], line);
+        return 1;
+    }
+
+    FILE* out = out_path != NULL ? fopen(out_path, "w") : stdout;
+    if (out == NULL) {
+        perror(out_path);
+        return 1;
+    }
+    res = scene_compile(ctx, scene_hash(text, len), out);
+    if (out != stdout && fclose(out) != 0) {
+        res.type = FILE_ERROR;
+    }
+    if (res.type != ALL_GOOD) {
+        fprintf(stderr, "%s: can't compile the scene\n", argv[optind]);
+        return 1;
+    }
+    rt_context_free(ctx);
+    rt_free(text);
+    return 0;
+}